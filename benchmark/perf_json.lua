@@ -0,0 +1,203 @@
+-- JSON encode/decode throughput on realistic payloads.
+--
+-- usage:
+--   ./silly benchmark/perf_json.lua
+--   ./silly benchmark/perf_json.lua --baseline=/path/to/old/silly.so
+--
+-- With --baseline the same payloads are also run through the
+-- silly.encoding.json module of another build (e.g. a silly.so built from
+-- an older commit) and the speedup of the current build is printed.
+
+local silly = require "silly"
+local env = require "silly.env"
+local json = require "silly.encoding.json"
+
+local clock = os.clock
+local format = string.format
+
+local ROUNDS = tonumber(env.get("rounds")) or 5
+local BUDGET = 0.2 -- seconds per measurement
+
+math.randomseed(42)
+
+local words = {
+	"alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf",
+	"hotel", "india", "juliett", "kilo", "lima", "mike", "november",
+}
+
+local function sentence(n)
+	local buf = {}
+	for i = 1, n do
+		buf[i] = words[math.random(#words)]
+	end
+	return table.concat(buf, " ")
+end
+
+-- Typical REST list response: many small objects with repeated keys.
+local function api_list()
+	local items = {}
+	for i = 1, 200 do
+		items[i] = {
+			id = 100000 + i,
+			name = sentence(2),
+			email = "user" .. i .. "@example.com",
+			active = i % 3 ~= 0,
+			score = math.random() * 100,
+			balance = math.random(1, 1000000) / 100,
+			tags = {words[i % #words + 1], words[(i * 7) % #words + 1]},
+			address = {
+				city = sentence(1),
+				zip = format("%05d", i * 37 % 100000),
+				geo = {lat = math.random() * 180 - 90, lng = math.random() * 360 - 180},
+			},
+		}
+	end
+	return {code = 0, message = "ok", total = #items, data = items}
+end
+
+-- Text-heavy documents: long strings, a few escapes.
+local function articles()
+	local list = {}
+	for i = 1, 50 do
+		list[i] = {
+			title = sentence(8),
+			body = sentence(300) .. "\n\n\"" .. sentence(20) .. "\"\n" .. sentence(200),
+			author = {name = sentence(2), bio = sentence(40)},
+			published = 1700000000 + i * 3600,
+		}
+	end
+	return {articles = list}
+end
+
+-- Metrics/time series: float heavy.
+local function metrics()
+	local series = {}
+	for i = 1, 20 do
+		local points = {}
+		for j = 1, 200 do
+			points[j] = {1700000000 + j * 15, math.random() * 1000}
+		end
+		series[i] = {metric = "cpu_usage_" .. i, unit = "percent", points = points}
+	end
+	return {series = series}
+end
+
+local payloads = {
+	{"api_list", api_list()},
+	{"articles", articles()},
+	{"metrics", metrics()},
+}
+
+-- pretty-printed variant of api_list to exercise whitespace skipping
+local function pretty(s)
+	local out, depth = {}, 0
+	local instr, esc = false, false
+	for ch in s:gmatch(".") do
+		if instr then
+			out[#out + 1] = ch
+			if esc then
+				esc = false
+			elseif ch == "\\" then
+				esc = true
+			elseif ch == '"' then
+				instr = false
+			end
+		elseif ch == '"' then
+			instr = true
+			out[#out + 1] = ch
+		elseif ch == "{" or ch == "[" then
+			depth = depth + 1
+			out[#out + 1] = ch .. "\n" .. string.rep("    ", depth)
+		elseif ch == "}" or ch == "]" then
+			depth = depth - 1
+			out[#out + 1] = "\n" .. string.rep("    ", depth) .. ch
+		elseif ch == "," then
+			out[#out + 1] = ",\n" .. string.rep("    ", depth)
+		elseif ch == ":" then
+			out[#out + 1] = ": "
+		else
+			out[#out + 1] = ch
+		end
+	end
+	return table.concat(out)
+end
+
+local function measure(fn, arg)
+	local best = math.huge
+	for _ = 1, ROUNDS do
+		local n = 0
+		local start = clock()
+		local elapsed
+		repeat
+			fn(arg)
+			n = n + 1
+			elapsed = clock() - start
+		until elapsed >= BUDGET
+		local per = elapsed / n
+		if per < best then
+			best = per
+		end
+	end
+	return best
+end
+
+local function load_baseline(path)
+	if not path then
+		return nil
+	end
+	local open, err = package.loadlib(path, "luaopen_silly_encoding_json")
+	if not open then
+		print("load baseline fail:", err)
+		return nil
+	end
+	return open()
+end
+
+local baseline = load_baseline(env.get("baseline"))
+
+local function run(name, doc, text)
+	local enc_mb = #text / 1024 / 1024
+	local enc = measure(json.encode, doc)
+	local dec = measure(json.decode, text)
+	local line = format("%-16s %8.1f KiB  encode %8.1f MB/s  decode %8.1f MB/s",
+		name, #text / 1024, enc_mb / enc, enc_mb / dec)
+	if baseline then
+		local benc = measure(baseline.encode, doc)
+		local bdec = measure(baseline.decode, text)
+		line = line .. format("  | baseline encode %8.1f MB/s (%5.2fx)  decode %8.1f MB/s (%5.2fx)",
+			enc_mb / benc, benc / enc, enc_mb / bdec, bdec / dec)
+	end
+	print(line)
+end
+
+print(format("=== silly.encoding.json (best of %d rounds) ===", ROUNDS))
+for _, p in ipairs(payloads) do
+	local name, doc = p[1], p[2]
+	local text = json.encode(doc)
+	run(name, doc, text)
+end
+local text = pretty(json.encode(payloads[1][2]))
+run("api_list_pretty", json.decode(text), text)
+
+-- Gateway style access: read a few fields of a large document.
+local function partial(name, text, fn)
+	local mb = #text / 1024 / 1024
+	print(format("%-16s %-12s %8.1f MB/s", name, "", mb / measure(fn, text)))
+end
+
+print("=== read 4 fields of api_list ===")
+text = json.encode(payloads[1][2])
+partial("decode", text, function(s)
+	local t = json.decode(s)
+	return t.code, t.total, t.data[100].name, t.data[100].address.city
+end)
+partial("lazy", text, function(s)
+	local t = json.lazy(s)
+	return t.code, t.total, t.data[100].name, t.data[100].address.city
+end)
+partial("get", text, function(s)
+	return json.get(s, "/code"), json.get(s, "/total"),
+		json.get(s, "/data/99/name"), json.get(s, "/data/99/address/city")
+end)
+
+silly.exit(0)
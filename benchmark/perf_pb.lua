@@ -0,0 +1,184 @@
+-- Protobuf encode/decode throughput: interpreted pb.encode/pb.decode
+-- against the compiled per-message codecs built by pb.compile.
+--
+-- usage:
+--   ./silly benchmark/perf_pb.lua
+--   ./silly benchmark/perf_pb.lua --rounds=10
+
+local silly = require "silly"
+local env = require "silly.env"
+local pb = require "pb"
+local protoc = require "protoc"
+
+local clock = os.clock
+local format = string.format
+
+local ROUNDS = tonumber(env.get("rounds")) or 5
+local BUDGET = 0.2 -- seconds per measurement
+
+math.randomseed(42)
+
+local schema = [[
+syntax = "proto3";
+
+package bench;
+
+message Address {
+  string city = 1;
+  string zip = 2;
+  double lat = 3;
+  double lng = 4;
+}
+
+message User {
+  int64 id = 1;
+  string name = 2;
+  string email = 3;
+  bool active = 4;
+  double score = 5;
+  repeated string tags = 6;
+  Address address = 7;
+  map<string, string> labels = 8;
+}
+
+message ListUsersResponse {
+  int32 code = 1;
+  string message = 2;
+  int32 total = 3;
+  repeated User users = 4;
+}
+
+message KeyValue {
+  bytes key = 1;
+  int64 create_revision = 2;
+  int64 mod_revision = 3;
+  int64 version = 4;
+  bytes value = 5;
+  int64 lease = 6;
+}
+
+message RangeResponse {
+  int64 revision = 1;
+  repeated KeyValue kvs = 2;
+  bool more = 3;
+  int64 count = 4;
+}
+]]
+
+local words = {
+	"alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf",
+	"hotel", "india", "juliett", "kilo", "lima", "mike", "november",
+}
+
+local function word()
+	return words[math.random(#words)]
+end
+
+-- gRPC style list response: many small nested messages
+local function list_users()
+	local users = {}
+	for i = 1, 200 do
+		users[i] = {
+			id = 100000 + i,
+			name = word() .. " " .. word(),
+			email = "user" .. i .. "@example.com",
+			active = i % 3 ~= 0,
+			score = math.random() * 100,
+			tags = {word(), word()},
+			address = {
+				city = word(),
+				zip = format("%05d", i * 37 % 100000),
+				lat = math.random() * 180 - 90,
+				lng = math.random() * 360 - 180,
+			},
+			labels = {tier = word(), region = word()},
+		}
+	end
+	return {code = 0, message = "ok", total = #users, users = users}
+end
+
+-- etcd style range response: flat messages, integer heavy
+local function range()
+	local kvs = {}
+	for i = 1, 500 do
+		kvs[i] = {
+			key = "/service/node/" .. i,
+			create_revision = 1000 + i,
+			mod_revision = 2000 + i,
+			version = i % 7 + 1,
+			value = word() .. ":" .. (8000 + i),
+			lease = 7587862073015441000 + i,
+		}
+	end
+	return {revision = 99999, kvs = kvs, more = false, count = #kvs}
+end
+
+local payloads = {
+	{"bench.ListUsersResponse", list_users()},
+	{"bench.RangeResponse", range()},
+}
+
+local function measure(fn, a, b)
+	local best = math.huge
+	for _ = 1, ROUNDS do
+		collectgarbage("collect")
+		local n = 0
+		local start = clock()
+		local elapsed
+		repeat
+			fn(a, b)
+			n = n + 1
+			elapsed = clock() - start
+		until elapsed >= BUDGET
+		local per = elapsed / n
+		if per < best then
+			best = per
+		end
+	end
+	return best
+end
+
+local function run(label, encode, decode)
+	print(format("=== %s (best of %d rounds) ===", label, ROUNDS))
+	local result = {}
+	for _, p in ipairs(payloads) do
+		local name, msg = p[1], p[2]
+		local data = pb.encode(name, msg)
+		local mb = #data / 1024 / 1024
+		local enc = measure(encode, name, msg)
+		local dec = measure(decode, name, data)
+		print(format("%-24s %8.1f KiB  encode %8.1f MB/s  decode %8.1f MB/s",
+			name, #data / 1024, mb / enc, mb / dec))
+		result[name] = {enc, dec}
+	end
+	return result
+end
+
+local p = protoc.new()
+assert(pb.load(p:compile(schema))) -- plain load, nothing compiled yet
+local interp = run("interpreted", pb.encode, pb.decode)
+
+pb.compile()
+local compiled = run("compiled", pb.encode, pb.decode)
+
+print(format("=== speedup of compiled codecs ==="))
+for _, p in ipairs(payloads) do
+	local name = p[1]
+	local a, b = interp[name], compiled[name]
+	print(format("%-24s encode %5.2fx  decode %5.2fx", name, a[1] / b[1], a[2] / b[2]))
+end
+
+-- positional layout skips the string keyed field lookups
+local name = "bench.RangeResponse"
+local data = pb.encode(name, payloads[2][2])
+local mb = #data / 1024 / 1024
+print(format("=== %s, name vs index layout ===", name))
+for _, layout in ipairs({"name", "index"}) do
+	local codec = pb.compile(name, layout)
+	local obj = codec:decode(data)
+	print(format("%-24s %8.1f KiB  encode %8.1f MB/s  decode %8.1f MB/s", layout,
+		#data / 1024, mb / measure(codec.encode, codec, obj),
+		mb / measure(codec.decode, codec, data)))
+end
+
+silly.exit(0)
@@ -49,6 +49,7 @@ export default sidebar({
           children: [
             { text: "silly.adt.buffer", icon: "box", link: "buffer" },
             { text: "silly.adt.queue", icon: "layer-group", link: "queue" },
+            { text: "silly.adt.blob", icon: "cube", link: "blob" },
           ],
         },
         {
@@ -0,0 +1,167 @@
+#include <string.h>
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "silly.h"
+#include "luastr.h"
+#include "blob.h"
+
+#define BLOB (1)
+
+static inline void blobdata_ref(struct blobdata *d)
+{
+	atomic_fetch_add_explicit(&d->ref, 1, memory_order_relaxed);
+}
+
+//NOTE: may be called concurrently from the worker and hive threads
+static void blobdata_unref(struct blobdata *d)
+{
+	if (atomic_fetch_sub_explicit(&d->ref, 1, memory_order_acq_rel) == 1)
+		silly_free(d);
+}
+
+static void *view_free(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+	(void)ptr;
+	(void)osize;
+	(void)nsize;
+	blobdata_unref((struct blobdata *)ud);
+	return NULL;
+}
+
+static inline struct blobdata *check_blob(lua_State *L, int idx)
+{
+	struct blob *b = (struct blob *)luaL_checkudata(L, idx, BLOB_METANAME);
+	return b->d;
+}
+
+static void push_view(lua_State *L, struct blobdata *d)
+{
+	blobdata_ref(d);
+	lua_pushexternalstring(L, (const char *)d->data, d->size, view_free, d);
+}
+
+// run string.<name> with the blob at `idx` replaced by a zero-copy view
+static int call_string(lua_State *L, int idx, const char *name)
+{
+	int n = lua_gettop(L);
+	struct blobdata *d = check_blob(L, idx);
+	push_view(L, d);
+	lua_replace(L, idx);
+	if (luaL_getmetafield(L, idx, "__index") != LUA_TTABLE)
+		return luaL_error(L, "string library is not loaded");
+	lua_getfield(L, -1, name);
+	lua_remove(L, -2);
+	lua_insert(L, 1);
+	lua_call(L, n, LUA_MULTRET);
+	return lua_gettop(L);
+}
+
+static int lgc(lua_State *L)
+{
+	struct blob *b = (struct blob *)lua_touserdata(L, BLOB);
+	if (b->d != NULL) {
+		blobdata_unref(b->d);
+		b->d = NULL;
+	}
+	return 0;
+}
+
+static int llen(lua_State *L)
+{
+	struct blobdata *d = check_blob(L, BLOB);
+	lua_pushinteger(L, (lua_Integer)d->size);
+	return 1;
+}
+
+static int lview(lua_State *L)
+{
+	struct blobdata *d = check_blob(L, BLOB);
+	push_view(L, d);
+	return 1;
+}
+
+static int lsub(lua_State *L)
+{
+	return call_string(L, BLOB, "sub");
+}
+
+static int lbyte(lua_State *L)
+{
+	return call_string(L, BLOB, "byte");
+}
+
+// blob:unpack(fmt [, pos]) is string.unpack(fmt, view [, pos])
+static int lunpack(lua_State *L)
+{
+	luaL_checkstring(L, 2);
+	lua_pushvalue(L, 1);
+	lua_pushvalue(L, 2);
+	lua_replace(L, 1);
+	lua_replace(L, 2);
+	return call_string(L, 2, "unpack");
+}
+
+static void set_metatable(lua_State *L)
+{
+	luaL_Reg tbl[] = {
+		{ "len",    llen    },
+		{ "view",   lview   },
+		{ "sub",    lsub    },
+		{ "byte",   lbyte   },
+		{ "unpack", lunpack },
+		{ NULL,     NULL    },
+	};
+	if (luaL_newmetatable(L, BLOB_METANAME)) {
+		luaL_newlib(L, tbl);
+		lua_setfield(L, -2, "__index");
+		lua_pushcfunction(L, llen);
+		lua_setfield(L, -2, "__len");
+		lua_pushcfunction(L, lgc);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_setmetatable(L, -2);
+}
+
+void blob_push(lua_State *L, struct blobdata *d)
+{
+	struct blob *b = (struct blob *)lua_newuserdatauv(L, sizeof(*b), 0);
+	b->d = NULL;
+	set_metatable(L);
+	blobdata_ref(d);
+	b->d = d;
+}
+
+static int lnew(lua_State *L)
+{
+	struct luastr str;
+	struct blob *b;
+	struct blobdata *d;
+	luastr_check(L, 1, &str);
+	b = (struct blob *)lua_newuserdatauv(L, sizeof(*b), 0);
+	b->d = NULL;
+	set_metatable(L);
+	d = (struct blobdata *)silly_malloc(offsetof(struct blobdata, data) +
+					    str.len + 1);
+	atomic_init(&d->ref, 1);
+	d->size = (size_t)str.len;
+	memcpy(d->data, str.str, str.len);
+	d->data[str.len] = '\0';
+	b->d = d;
+	return 1;
+}
+
+SILLY_MOD_API int luaopen_silly_adt_blob(lua_State *L)
+{
+	luaL_Reg tbl[] = {
+		{ "new",    lnew    },
+		{ "len",    llen    },
+		{ "view",   lview   },
+		{ "sub",    lsub    },
+		{ "byte",   lbyte   },
+		{ "unpack", lunpack },
+		{ NULL,     NULL    },
+	};
+	luaL_newlib(L, tbl);
+	return 1;
+}
@@ -0,0 +1,37 @@
+#ifndef _BLOB_H
+#define _BLOB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <lua.h>
+#include <lauxlib.h>
+
+#define BLOB_METANAME "silly.adt.blob"
+
+/*
+ * Immutable byte block shared between lua_States (main worker and hive
+ * threads). Each state holds its own `struct blob` userdata pointing to
+ * the same `struct blobdata`; the data is freed when the last reference
+ * (userdata or zero-copy string view) goes away.
+ */
+struct blobdata {
+	atomic_uint ref;
+	size_t size;
+	uint8_t data[1]; /* size bytes + '\0' */
+};
+
+struct blob {
+	struct blobdata *d;
+};
+
+static inline struct blobdata *blob_test(lua_State *L, int idx)
+{
+	struct blob *b = (struct blob *)luaL_testudata(L, idx, BLOB_METANAME);
+	return b != NULL ? b->d : NULL;
+}
+
+/* push a new userdata of L referencing d, the reference count is increased */
+void blob_push(lua_State *L, struct blobdata *d);
+
+#endif
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <lua.h>
 #include <lauxlib.h>
 
@@ -12,9 +13,192 @@
 #include "luabuf.h"
 #include "luafmt.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define JSON_SIMD_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define JSON_SIMD_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define JSON_SIMD_NEON
+#endif
+
 #define MAX_DEPTH 128
 #define NULL_UPVALUE lua_upvalueindex(1)
 
+/* -------------------- scanner -------------------- */
+
+/* bytes that end a plain run inside a string: '"', '\\' and control chars */
+static const uint8_t string_special[256] = {
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	0,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,0,0,0,
+};
+
+/* return the first byte in [p, end) that is '"', '\\' or < 0x20 */
+static inline const uint8_t *scan_string(const uint8_t *p, const uint8_t *end)
+{
+#if defined(JSON_SIMD_AVX2)
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i bslash = _mm256_set1_epi8('\\');
+	const __m256i ctrl = _mm256_set1_epi8(0x1f);
+	while (end - p >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)p);
+		__m256i m = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+					_mm256_cmpeq_epi8(v, bslash)),
+			_mm256_cmpeq_epi8(_mm256_max_epu8(v, ctrl), ctrl));
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(m);
+		if (mask != 0)
+			return p + __builtin_ctz(mask);
+		p += 32;
+	}
+#elif defined(JSON_SIMD_SSE2)
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i bslash = _mm_set1_epi8('\\');
+	const __m128i ctrl = _mm_set1_epi8(0x1f);
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		__m128i m = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+				     _mm_cmpeq_epi8(v, bslash)),
+			_mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl));
+		int mask = _mm_movemask_epi8(m);
+		if (mask != 0)
+			return p + __builtin_ctz(mask);
+		p += 16;
+	}
+#elif defined(JSON_SIMD_NEON)
+	const uint8x16_t quote = vdupq_n_u8('"');
+	const uint8x16_t bslash = vdupq_n_u8('\\');
+	const uint8x16_t ctrl = vdupq_n_u8(0x1f);
+	while (end - p >= 16) {
+		uint8x16_t v = vld1q_u8(p);
+		uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, quote),
+						 vceqq_u8(v, bslash)),
+					vcleq_u8(v, ctrl));
+		/* narrow to 4 bits per byte */
+		uint64_t mask = vget_lane_u64(
+			vreinterpret_u64_u8(
+				vshrn_n_u16(vreinterpretq_u16_u8(m), 4)),
+			0);
+		if (mask != 0)
+			return p + (__builtin_ctzll(mask) >> 2);
+		p += 16;
+	}
+#endif
+	while (p < end && !string_special[*p])
+		p++;
+	return p;
+}
+
+static inline int is_space(uint8_t ch)
+{
+	return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+/* return the first non-whitespace byte in [p, end) */
+static inline const uint8_t *scan_space(const uint8_t *p, const uint8_t *end)
+{
+	/* minified input: nothing to skip */
+	if (p >= end || !is_space(*p))
+		return p;
+#if defined(JSON_SIMD_SSE2) || defined(JSON_SIMD_AVX2)
+	const __m128i sp = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i lf = _mm_set1_epi8('\n');
+	const __m128i cr = _mm_set1_epi8('\r');
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		__m128i m = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, sp),
+				     _mm_cmpeq_epi8(v, tab)),
+			_mm_or_si128(_mm_cmpeq_epi8(v, lf),
+				     _mm_cmpeq_epi8(v, cr)));
+		int mask = _mm_movemask_epi8(m) ^ 0xffff;
+		if (mask != 0)
+			return p + __builtin_ctz(mask);
+		p += 16;
+	}
+#elif defined(JSON_SIMD_NEON)
+	const uint8x16_t sp = vdupq_n_u8(' ');
+	const uint8x16_t tab = vdupq_n_u8('\t');
+	const uint8x16_t lf = vdupq_n_u8('\n');
+	const uint8x16_t cr = vdupq_n_u8('\r');
+	while (end - p >= 16) {
+		uint8x16_t v = vld1q_u8(p);
+		uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, sp),
+						 vceqq_u8(v, tab)),
+					vorrq_u8(vceqq_u8(v, lf),
+						 vceqq_u8(v, cr)));
+		uint64_t mask = ~vget_lane_u64(
+			vreinterpret_u64_u8(
+				vshrn_n_u16(vreinterpretq_u16_u8(m), 4)),
+			0);
+		if (mask != 0)
+			return p + (__builtin_ctzll(mask) >> 2);
+		p += 16;
+	}
+#endif
+	while (p < end && is_space(*p))
+		p++;
+	return p;
+}
+
+/* return the first of '"', '{', '}', '[', ']' in [p, end) */
+static inline const uint8_t *scan_structural(const uint8_t *p,
+					     const uint8_t *end)
+{
+#if defined(JSON_SIMD_SSE2) || defined(JSON_SIMD_AVX2)
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i lsquare = _mm_set1_epi8('[');
+	const __m128i rsquare = _mm_set1_epi8(']');
+	const __m128i lcurly = _mm_set1_epi8('{');
+	const __m128i rcurly = _mm_set1_epi8('}');
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		__m128i m = _mm_or_si128(
+			_mm_cmpeq_epi8(v, quote),
+			_mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(v, lsquare),
+					     _mm_cmpeq_epi8(v, rsquare)),
+				_mm_or_si128(_mm_cmpeq_epi8(v, lcurly),
+					     _mm_cmpeq_epi8(v, rcurly))));
+		int mask = _mm_movemask_epi8(m);
+		if (mask != 0)
+			return p + __builtin_ctz(mask);
+		p += 16;
+	}
+#elif defined(JSON_SIMD_NEON)
+	const uint8x16_t quote = vdupq_n_u8('"');
+	const uint8x16_t lsquare = vdupq_n_u8('[');
+	const uint8x16_t rsquare = vdupq_n_u8(']');
+	const uint8x16_t lcurly = vdupq_n_u8('{');
+	const uint8x16_t rcurly = vdupq_n_u8('}');
+	while (end - p >= 16) {
+		uint8x16_t v = vld1q_u8(p);
+		uint8x16_t m = vorrq_u8(
+			vceqq_u8(v, quote),
+			vorrq_u8(vorrq_u8(vceqq_u8(v, lsquare),
+					  vceqq_u8(v, rsquare)),
+				 vorrq_u8(vceqq_u8(v, lcurly),
+					  vceqq_u8(v, rcurly))));
+		uint64_t mask = vget_lane_u64(
+			vreinterpret_u64_u8(
+				vshrn_n_u16(vreinterpretq_u16_u8(m), 4)),
+			0);
+		if (mask != 0)
+			return p + (__builtin_ctzll(mask) >> 2);
+		p += 16;
+	}
+#endif
+	while (p < end && *p != '"' && *p != '[' && *p != ']' && *p != '{' &&
+	       *p != '}')
+		p++;
+	return p;
+}
+
 /* -------------------- encoder -------------------- */
 
 struct encode_state {
@@ -24,17 +208,18 @@ struct encode_state {
 
 static int encode_value(struct encode_state *es, int idx, int depth);
 
-static void encode_string(struct encode_state *es, int idx)
+/* escape [p, end) without the surrounding quotes */
+static void encode_string_body(struct encode_state *es, const uint8_t *p,
+			       const uint8_t *end)
 {
-	size_t len;
 	struct luabuf *lb = &es->lb;
-	const char *str = lua_tolstring(lb->L, idx, &len);
-	const uint8_t *p = (const uint8_t *)str;
-	const uint8_t *end = p + len;
-	luabuf_addchar(lb, '"');
-	while (p < end) {
-		uint8_t ch = *p;
-		switch (ch) {
+	for (;;) {
+		const uint8_t *run = scan_string(p, end);
+		if (run > p)
+			luabuf_addlstring(lb, (const char *)p, run - p);
+		if (run >= end)
+			break;
+		switch (*run) {
 		case '"':
 			luabuf_addlstring(lb, "\\\"", 2);
 			break;
@@ -56,18 +241,27 @@ static void encode_string(struct encode_state *es, int idx)
 		case '\t':
 			luabuf_addlstring(lb, "\\t", 2);
 			break;
-		default:
-			if (ch < 0x20) {
-				char esc[7];
-				snprintf(esc, sizeof(esc), "\\u%04x", ch);
-				luabuf_addlstring(lb, esc, 6);
-			} else {
-				luabuf_addchar(lb, ch);
-			}
+		default: {
+			static const char hex[] = "0123456789abcdef";
+			char esc[6] = { '\\', 'u', '0', '0', 0, 0 };
+			esc[4] = hex[*run >> 4];
+			esc[5] = hex[*run & 0xf];
+			luabuf_addlstring(lb, esc, 6);
 			break;
 		}
-		p++;
+		}
+		p = run + 1;
 	}
+}
+
+static void encode_string(struct encode_state *es, int idx)
+{
+	size_t len;
+	struct luabuf *lb = &es->lb;
+	const char *str = lua_tolstring(lb->L, idx, &len);
+	luabuf_addchar(lb, '"');
+	encode_string_body(es, (const uint8_t *)str,
+			   (const uint8_t *)str + len);
 	luabuf_addchar(lb, '"');
 }
 
@@ -107,13 +301,8 @@ static int encode_number(struct encode_state *es, int idx)
 		if (is_integer_double((double)n, &ivalue)) {
 			len = luafmt_int64(tmp, ivalue);
 		} else {
-			/* Slow path: real float - use snprintf (like Lua does) */
-			char *dp;
-			len = snprintf(tmp, sizeof(tmp), "%.14g", (double)n);
-			/* fix locale decimal separator (e.g. ',' in de_DE) */
-			dp = strchr(tmp, ',');
-			if (dp)
-				*dp = '.';
+			/* shortest string that reads back as the same double */
+			len = luafmt_double(tmp, (double)n);
 		}
 	}
 	luabuf_addlstring(lb, tmp, len);
@@ -163,9 +352,27 @@ static int encode_object(struct encode_state *es, int idx, int depth)
 	return 0;
 }
 
-static int encode_table(struct encode_state *es, int idx, int depth)
+/* array: has element at index 1, or empty table */
+static int table_is_array(lua_State *L, int idx)
 {
 	int is_array;
+	lua_rawgeti(L, idx, 1);
+	is_array = !lua_isnil(L, -1);
+	lua_pop(L, 1);
+	if (!is_array) {
+		/* check if table is empty (object with no keys = empty array) */
+		lua_pushnil(L);
+		if (lua_next(L, idx) == 0) {
+			is_array = 1; /* empty table → [] */
+		} else {
+			lua_pop(L, 2);
+		}
+	}
+	return is_array;
+}
+
+static int encode_table(struct encode_state *es, int idx, int depth)
+{
 	struct luabuf *lb = &es->lb;
 	lua_State *L = lb->L;
 	if (unlikely(depth > MAX_DEPTH)) {
@@ -180,20 +387,7 @@ static int encode_table(struct encode_state *es, int idx, int depth)
 		return 0;
 	}
 	luaL_checkstack(L, depth + LUA_MINSTACK, "too many nested tables");
-	/* detect array: has element at index 1, or empty table */
-	lua_rawgeti(L, idx, 1);
-	is_array = !lua_isnil(L, -1);
-	lua_pop(L, 1);
-	if (!is_array) {
-		/* check if table is empty (object with no keys = empty array) */
-		lua_pushnil(L);
-		if (lua_next(L, idx) == 0) {
-			is_array = 1; /* empty table → [] */
-		} else {
-			lua_pop(L, 2);
-		}
-	}
-	if (is_array)
+	if (table_is_array(L, idx))
 		return encode_array(es, idx, depth);
 	return encode_object(es, idx, depth);
 }
@@ -243,6 +437,225 @@ static int lencode(lua_State *L)
 	return 1;
 }
 
+/* -------------------- streaming encoder -------------------- */
+
+/*
+ * json.encoder(obj [, chunk]) walks the value with an explicit stack instead
+ * of C recursion, so the walk can stop whenever `chunk` bytes are buffered
+ * and resume on the next call. Open tables and the last key of each object
+ * live in the state table (uservalue 1): T[2d-1] is the table at depth d,
+ * T[2d] the key lua_next resumes from, T[0] a string value being written
+ * across chunks.
+ */
+#define ENCODER_CHUNK 4096
+#define ENCODER_STATE 1
+#define ENCODER_ROOT 2
+#define ENCODER_UPVALUE lua_upvalueindex(2)
+
+struct encoder_frame {
+	int array;
+	lua_Integer i;
+	lua_Integer n;
+};
+
+struct encoder {
+	int started;
+	int done;
+	int depth;
+	size_t chunk;
+	size_t stroff; /* bytes of T[0] already written, (size_t)-1 if none */
+	struct encoder_frame frames[MAX_DEPTH + 1];
+};
+
+static int encoder_value(struct encoder *e, struct encode_state *es, int st,
+			 int idx)
+{
+	lua_State *L = es->lb.L;
+	struct encoder_frame *f;
+	switch (lua_type(L, idx)) {
+	case LUA_TTABLE:
+		if (lua_rawequal(L, idx, NULL_UPVALUE)) {
+			luabuf_addlstring(&es->lb, "null", 4);
+			return 0;
+		}
+		if (unlikely(e->depth > MAX_DEPTH)) {
+			es->error = "nesting too deep";
+			return -1;
+		}
+		f = &e->frames[e->depth++];
+		f->array = table_is_array(L, idx);
+		f->i = 0;
+		f->n = f->array ? luaL_len(L, idx) : 0;
+		lua_pushvalue(L, idx);
+		lua_rawseti(L, st, 2 * e->depth - 1);
+		luabuf_addchar(&es->lb, f->array ? '[' : '{');
+		return 0;
+	case LUA_TSTRING: {
+		size_t room = 0;
+		if (es->lb.cb.len < e->chunk)
+			room = e->chunk - es->lb.cb.len;
+		if (lua_rawlen(L, idx) > room) {
+			/* does not fit: written piecewise by encoder_string */
+			lua_pushvalue(L, idx);
+			lua_rawseti(L, st, 0);
+			e->stroff = 0;
+			luabuf_addchar(&es->lb, '"');
+			return 0;
+		}
+		encode_string(es, idx);
+		return 0;
+	}
+	default:
+		return encode_value(es, idx, 0);
+	}
+}
+
+/* continue the pending string value, return 1 once it is closed */
+static int encoder_string(struct encoder *e, struct encode_state *es, int st)
+{
+	size_t len, n;
+	const char *str;
+	lua_State *L = es->lb.L;
+	lua_rawgeti(L, st, 0);
+	str = lua_tolstring(L, -1, &len);
+	n = len - e->stroff;
+	if (n > e->chunk - es->lb.cb.len)
+		n = e->chunk - es->lb.cb.len;
+	encode_string_body(es, (const uint8_t *)str + e->stroff,
+			   (const uint8_t *)str + e->stroff + n);
+	lua_pop(L, 1);
+	e->stroff += n;
+	if (e->stroff < len)
+		return 0;
+	luabuf_addchar(&es->lb, '"');
+	lua_pushnil(L);
+	lua_rawseti(L, st, 0);
+	e->stroff = (size_t)-1;
+	return 1;
+}
+
+static void encoder_pop(struct encoder *e, struct encode_state *es, int st)
+{
+	lua_State *L = es->lb.L;
+	struct encoder_frame *f = &e->frames[e->depth - 1];
+	luabuf_addchar(&es->lb, f->array ? ']' : '}');
+	lua_pushnil(L);
+	lua_rawseti(L, st, 2 * e->depth - 1);
+	lua_pushnil(L);
+	lua_rawseti(L, st, 2 * e->depth);
+	e->depth--;
+}
+
+/* write the next element of the innermost open table */
+static int encoder_step(struct encoder *e, struct encode_state *es, int st)
+{
+	int ret;
+	lua_State *L = es->lb.L;
+	struct encoder_frame *f = &e->frames[e->depth - 1];
+	int tbl = lua_gettop(L) + 1;
+	lua_rawgeti(L, st, 2 * e->depth - 1);
+	if (f->array) {
+		if (f->i >= f->n) {
+			lua_pop(L, 1);
+			encoder_pop(e, es, st);
+			return 0;
+		}
+		if (f->i++ > 0)
+			luabuf_addchar(&es->lb, ',');
+		lua_rawgeti(L, tbl, f->i);
+		ret = encoder_value(e, es, st, tbl + 1);
+		lua_pop(L, 2);
+		return ret;
+	}
+	lua_rawgeti(L, st, 2 * e->depth);
+	if (lua_next(L, tbl) == 0) {
+		lua_pop(L, 1);
+		encoder_pop(e, es, st);
+		return 0;
+	}
+	/* stack: table, key, value */
+	if (unlikely(lua_type(L, tbl + 1) != LUA_TSTRING)) {
+		lua_pop(L, 3);
+		es->error = "object key must be string";
+		return -1;
+	}
+	if (f->i++ > 0)
+		luabuf_addchar(&es->lb, ',');
+	encode_string(es, tbl + 1);
+	luabuf_addchar(&es->lb, ':');
+	lua_pushvalue(L, tbl + 1);
+	lua_rawseti(L, st, 2 * e->depth);
+	ret = encoder_value(e, es, st, tbl + 2);
+	lua_pop(L, 3);
+	return ret;
+}
+
+/// iterator returned by json.encoder, upvalue 2 is the encoder userdata
+static int lencoder_next(lua_State *L)
+{
+	int st;
+	struct encode_state es;
+	struct encoder *e = (struct encoder *)lua_touserdata(L, ENCODER_UPVALUE);
+	if (e->done)
+		return 0;
+	lua_settop(L, 0);
+	lua_getiuservalue(L, ENCODER_UPVALUE, ENCODER_STATE);
+	st = lua_gettop(L);
+	es.error = NULL;
+	luabuf_init(&es.lb, L);
+	if (!e->started) {
+		e->started = 1;
+		lua_getiuservalue(L, ENCODER_UPVALUE, ENCODER_ROOT);
+		lua_pushnil(L);
+		lua_setiuservalue(L, ENCODER_UPVALUE, ENCODER_ROOT);
+		if (encoder_value(e, &es, st, st + 1) < 0)
+			goto fail;
+		lua_settop(L, st);
+	}
+	while (es.lb.cb.len < e->chunk) {
+		if (e->stroff != (size_t)-1) {
+			encoder_string(e, &es, st);
+		} else if (e->depth > 0) {
+			if (encoder_step(e, &es, st) < 0)
+				goto fail;
+		} else {
+			e->done = 1;
+			break;
+		}
+	}
+	if (e->stroff == (size_t)-1 && e->depth == 0)
+		e->done = 1;
+	luabuf_pushresult(&es.lb);
+	return 1;
+fail:
+	luabuf_free(&es.lb);
+	e->done = 1;
+	return luaL_error(L, "%s", es.error);
+}
+
+/// json.encoder(obj [, chunk]) — upvalue 1 is json.null
+static int lencoder(lua_State *L)
+{
+	struct encoder *e;
+	lua_Integer chunk;
+	luaL_checkany(L, 1);
+	chunk = luaL_optinteger(L, 2, ENCODER_CHUNK);
+	luaL_argcheck(L, chunk > 0, 2, "chunk size must be positive");
+	lua_pushvalue(L, NULL_UPVALUE);
+	e = (struct encoder *)lua_newuserdatauv(L, sizeof(*e), 2);
+	e->started = 0;
+	e->done = 0;
+	e->depth = 0;
+	e->chunk = (size_t)chunk;
+	e->stroff = (size_t)-1;
+	lua_newtable(L);
+	lua_setiuservalue(L, -2, ENCODER_STATE);
+	lua_pushvalue(L, 1);
+	lua_setiuservalue(L, -2, ENCODER_ROOT);
+	lua_pushcclosure(L, lencoder_next, 2);
+	return 1;
+}
+
 /* -------------------- decoder -------------------- */
 
 struct decode_state {
@@ -254,13 +667,8 @@ struct decode_state {
 
 static inline void skip_space(struct decode_state *s)
 {
-	while (s->ptr < s->end) {
-		char ch = *s->ptr;
-		if (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r')
-			s->ptr++;
-		else
-			break;
-	}
+	s->ptr = (const char *)scan_space((const uint8_t *)s->ptr,
+					  (const uint8_t *)s->end);
 }
 
 static inline int hex_digit(char ch)
@@ -318,10 +726,30 @@ static int decode_string(struct decode_state *s)
 {
 	lua_State *L = s->L;
 	luaL_Buffer buf;
-	luaL_buffinit(L, &buf);
+	const char *run;
 	s->ptr++; /* skip opening '"' */
+	run = (const char *)scan_string((const uint8_t *)s->ptr,
+					(const uint8_t *)s->end);
+	/* fast path: no escapes, push straight from the input. Short strings
+	 * (most object keys) are interned by Lua, so repeated keys resolve to
+	 * the existing string without allocating. */
+	if (run < s->end && *run == '"') {
+		lua_pushlstring(L, s->ptr, run - s->ptr);
+		s->ptr = run + 1;
+		return 0;
+	}
+	luaL_buffinit(L, &buf);
 	while (s->ptr < s->end) {
-		char ch = *s->ptr;
+		char ch;
+		run = (const char *)scan_string((const uint8_t *)s->ptr,
+						(const uint8_t *)s->end);
+		if (run > s->ptr) {
+			luaL_addlstring(&buf, s->ptr, run - s->ptr);
+			s->ptr = run;
+			if (s->ptr >= s->end)
+				break;
+		}
+		ch = *s->ptr;
 		if (ch == '"') {
 			s->ptr++;
 			luaL_pushresult(&buf);
@@ -396,11 +824,8 @@ static int decode_string(struct decode_state *s)
 				return -1; /* invalid escape */
 			}
 			s->ptr++;
-		} else if ((uint8_t)ch < 0x20) {
-			return -1; /* unescaped control character */
 		} else {
-			luaL_addchar(&buf, ch);
-			s->ptr++;
+			return -1; /* unescaped control character */
 		}
 	}
 	return -1; /* unterminated string */
@@ -408,12 +833,24 @@ static int decode_string(struct decode_state *s)
 
 static int decode_number(struct decode_state *s)
 {
+	/* exactly representable powers of ten */
+	static const double pow10[] = {
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+		1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+		1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+	};
 	lua_State *L = s->L;
 	const char *start = s->ptr;
 	int is_float = 0;
+	int neg = 0;
+	int digits = 0; /* significant digits collected into mant */
+	int exp10 = 0;
+	uint64_t mant = 0;
 	char *numend;
-	if (s->ptr < s->end && *s->ptr == '-')
+	if (s->ptr < s->end && *s->ptr == '-') {
+		neg = 1;
 		s->ptr++;
+	}
 	if (s->ptr >= s->end || !isdigit((uint8_t)*s->ptr))
 		return -1;
 	if (*s->ptr == '0') {
@@ -421,33 +858,64 @@ static int decode_number(struct decode_state *s)
 		if (s->ptr < s->end && isdigit((uint8_t)*s->ptr))
 			return -1;
 	} else {
-		while (s->ptr < s->end && isdigit((uint8_t)*s->ptr))
+		while (s->ptr < s->end && isdigit((uint8_t)*s->ptr)) {
+			if (digits < 19)
+				mant = mant * 10 + (*s->ptr - '0');
+			digits++;
 			s->ptr++;
+		}
 	}
 	if (s->ptr < s->end && *s->ptr == '.') {
 		is_float = 1;
 		s->ptr++;
 		if (s->ptr >= s->end || !isdigit((uint8_t)*s->ptr))
 			return -1;
-		while (s->ptr < s->end && isdigit((uint8_t)*s->ptr))
+		while (s->ptr < s->end && isdigit((uint8_t)*s->ptr)) {
+			if (digits < 19) {
+				mant = mant * 10 + (*s->ptr - '0');
+				exp10--;
+			}
+			if (mant != 0)
+				digits++;
 			s->ptr++;
+		}
 	}
 	if (s->ptr < s->end && (*s->ptr == 'e' || *s->ptr == 'E')) {
+		int eneg = 0, e = 0;
 		is_float = 1;
 		s->ptr++;
 		if (s->ptr < s->end && (*s->ptr == '+' || *s->ptr == '-'))
-			s->ptr++;
+			eneg = *s->ptr++ == '-';
 		if (s->ptr >= s->end || !isdigit((uint8_t)*s->ptr))
 			return -1;
-		while (s->ptr < s->end && isdigit((uint8_t)*s->ptr))
+		while (s->ptr < s->end && isdigit((uint8_t)*s->ptr)) {
+			if (e < 100000)
+				e = e * 10 + (*s->ptr - '0');
 			s->ptr++;
+		}
+		exp10 += eneg ? -e : e;
 	}
 	if (is_float) {
-		double d = strtod(start, &numend);
+		double d;
+		/* Clinger's fast path: mant and 10^|exp10| are both exact
+		 * doubles, so a single multiply/divide is correctly rounded */
+		if (digits <= 15 && exp10 >= -22 && exp10 <= 22) {
+			d = (double)mant;
+			d = exp10 < 0 ? d / pow10[-exp10] : d * pow10[exp10];
+			if (neg)
+				d = -d;
+		} else {
+			d = strtod(start, &numend);
+		}
 		lua_pushnumber(L, d);
+	} else if (digits <= 18) {
+		lua_Integer n = (lua_Integer)mant;
+		lua_pushinteger(L, neg ? -n : n);
 	} else {
-		long long n = strtoll(start, &numend, 10);
-		if (n >= LUA_MININTEGER && n <= LUA_MAXINTEGER)
+		long long n;
+		errno = 0;
+		n = strtoll(start, &numend, 10);
+		if (errno != ERANGE && n >= LUA_MININTEGER && n <= LUA_MAXINTEGER)
 			lua_pushinteger(L, (lua_Integer)n);
 		else
 			lua_pushnumber(L, (lua_Number)strtod(start, &numend));
@@ -591,6 +1059,940 @@ static int ldecode(lua_State *L)
 	return 1;
 }
 
+/* -------------------- streaming decoder -------------------- */
+
+/*
+ * json.decoder() parses input fed in arbitrary chunks. Containers are built
+ * as soon as their elements arrive, so only the tree and the bytes of one
+ * unfinished token (carried over in `pending`) are kept between feeds.
+ * Open containers live in the state table (uservalue 1): T[2d-1] is the
+ * table at depth d, T[2d] the key waiting for its value, T[0] the result.
+ */
+#define DECODER_METANAME "silly.encoding.json.decoder"
+#define DECODER_STATE 1
+#define DECODER_NULL 2
+
+enum decoder_state {
+	DS_VALUE,        /* expect a value */
+	DS_ARRAY_FIRST,  /* after '[': value or ']' */
+	DS_OBJECT_FIRST, /* after '{': key or '}' */
+	DS_KEY,          /* after ',' in object */
+	DS_COLON,        /* after key */
+	DS_NEXT,         /* after element: ',' or close */
+	DS_DONE,
+	DS_ERROR,
+};
+
+enum decoder_token {
+	DT_NONE,
+	DT_STRING,
+	DT_BARE, /* number, true, false, null */
+};
+
+struct decoder {
+	int state;
+	int token;  /* token being carried over in pending */
+	int escape; /* pending string ends inside an escape */
+	int depth;
+	const char *error;
+	struct cbuf pending;
+	struct {
+		int array;
+		lua_Integer n;
+	} frames[MAX_DEPTH];
+};
+
+static inline int is_bare(uint8_t ch)
+{
+	return (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') ||
+	       (ch >= 'A' && ch <= 'Z') || ch == '-' || ch == '+' || ch == '.';
+}
+
+/* end of the token continuing at p, or NULL if it runs past end */
+static const char *token_end(struct decoder *d, const char *p, const char *end)
+{
+	const uint8_t *q = (const uint8_t *)p;
+	const uint8_t *e = (const uint8_t *)end;
+	if (d->token == DT_BARE) {
+		while (q < e && is_bare(*q))
+			q++;
+		return q < e ? (const char *)q : NULL;
+	}
+	if (d->escape) {
+		if (q >= e)
+			return NULL;
+		d->escape = 0;
+		q++;
+	}
+	for (;;) {
+		q = scan_string(q, e);
+		if (q >= e)
+			return NULL;
+		if (*q != '\\') /* closing quote, or a control char to reject */
+			return (const char *)q + 1;
+		if (q + 1 >= e) {
+			d->escape = 1;
+			return NULL;
+		}
+		q += 2;
+	}
+}
+
+static int decoder_fail(struct decoder *d, const char *err)
+{
+	d->state = DS_ERROR;
+	d->error = err;
+	return -1;
+}
+
+/* store the value on top of the stack into the innermost container */
+static void decoder_put(lua_State *L, struct decoder *d, int st)
+{
+	int depth = d->depth;
+	if (depth == 0) {
+		lua_rawseti(L, st, 0);
+		d->state = DS_DONE;
+		return;
+	}
+	lua_rawgeti(L, st, 2 * depth - 1);
+	lua_insert(L, -2);
+	if (d->frames[depth - 1].array) {
+		lua_rawseti(L, -2, ++d->frames[depth - 1].n);
+	} else {
+		lua_rawgeti(L, st, 2 * depth);
+		lua_insert(L, -2);
+		lua_rawset(L, -3);
+		lua_pushnil(L);
+		lua_rawseti(L, st, 2 * depth);
+	}
+	lua_pop(L, 1);
+	d->state = DS_NEXT;
+}
+
+/* decode the complete token [p, end) as a key or a value */
+static int decoder_token(lua_State *L, struct decoder *d, int st,
+			 const char *p, const char *end)
+{
+	struct decode_state s;
+	s.L = L;
+	s.ptr = p;
+	s.end = end;
+	s.null_idx = st + 1;
+	d->token = DT_NONE;
+	if (decode_value(&s) < 0 || s.ptr != end)
+		return decoder_fail(d, "Invalid json");
+	if (d->state == DS_OBJECT_FIRST || d->state == DS_KEY) {
+		lua_rawseti(L, st, 2 * d->depth);
+		d->state = DS_COLON;
+	} else {
+		decoder_put(L, d, st);
+	}
+	return 0;
+}
+
+static int decoder_open(lua_State *L, struct decoder *d, int st, int array)
+{
+	if (d->depth >= MAX_DEPTH)
+		return decoder_fail(d, "nesting too deep");
+	d->frames[d->depth].array = array;
+	d->frames[d->depth].n = 0;
+	d->depth++;
+	lua_newtable(L);
+	lua_rawseti(L, st, 2 * d->depth - 1);
+	d->state = array ? DS_ARRAY_FIRST : DS_OBJECT_FIRST;
+	return 0;
+}
+
+static int decoder_close(lua_State *L, struct decoder *d, int st, char ch)
+{
+	int depth = d->depth;
+	if (depth == 0 || (ch != ']' && ch != '}') ||
+	    (ch == ']') != d->frames[depth - 1].array)
+		return decoder_fail(d, "Invalid json");
+	lua_rawgeti(L, st, 2 * depth - 1);
+	lua_pushnil(L);
+	lua_rawseti(L, st, 2 * depth - 1);
+	d->depth--;
+	decoder_put(L, d, st);
+	return 0;
+}
+
+/* finish the token carried over from the previous feed, *used gets the
+ * number of bytes taken from [p, end) */
+static int decoder_resume(lua_State *L, struct decoder *d, int st,
+			  const char *p, const char *end, size_t *used)
+{
+	const char *q = token_end(d, p, end);
+	struct cbuf *cb = &d->pending;
+	if (q == NULL) {
+		cbuf_addlstr(cb, p, end - p);
+		*used = end - p;
+		return 0;
+	}
+	cbuf_addlstr(cb, p, q - p);
+	cbuf_addchar(cb, '\0'); /* strtod must stop at the end of the token */
+	cbuf_pop(cb, 1);
+	*used = q - p;
+	if (decoder_token(L, d, st, cb->data, cb->data + cb->len) < 0)
+		return -1;
+	cb->len = 0;
+	return 0;
+}
+
+static int decoder_feed(lua_State *L, struct decoder *d, int st,
+			const char *p, const char *end)
+{
+	if (d->token != DT_NONE) {
+		size_t used;
+		if (decoder_resume(L, d, st, p, end, &used) < 0)
+			return -1;
+		p += used;
+	}
+	while (d->token == DT_NONE) {
+		uint8_t ch;
+		p = (const char *)scan_space((const uint8_t *)p,
+					     (const uint8_t *)end);
+		if (p >= end)
+			return 0;
+		ch = (uint8_t)*p;
+		switch (d->state) {
+		case DS_DONE:
+			return decoder_fail(d, "Trailing data");
+		case DS_COLON:
+			if (ch != ':')
+				return decoder_fail(d, "Invalid json");
+			d->state = DS_VALUE;
+			p++;
+			continue;
+		case DS_NEXT:
+			if (ch == ',') {
+				int array = d->frames[d->depth - 1].array;
+				d->state = array ? DS_VALUE : DS_KEY;
+				p++;
+				continue;
+			}
+			if (decoder_close(L, d, st, ch) < 0)
+				return -1;
+			p++;
+			continue;
+		case DS_ARRAY_FIRST:
+		case DS_OBJECT_FIRST:
+			if (ch == ']' || ch == '}') {
+				if (decoder_close(L, d, st, ch) < 0)
+					return -1;
+				p++;
+				continue;
+			}
+			break;
+		default:
+			break;
+		}
+		if (d->state == DS_OBJECT_FIRST || d->state == DS_KEY) {
+			if (ch != '"')
+				return decoder_fail(d, "Invalid json");
+		} else if (ch == '{' || ch == '[') {
+			if (decoder_open(L, d, st, ch == '[') < 0)
+				return -1;
+			p++;
+			continue;
+		}
+		if (ch == '"') {
+			d->token = DT_STRING;
+		} else if (ch == '-' || ch == 't' || ch == 'f' || ch == 'n' ||
+			   (ch >= '0' && ch <= '9')) {
+			d->token = DT_BARE;
+		} else {
+			return decoder_fail(d, "Invalid json");
+		}
+		{
+			const char *q = token_end(d, p + 1, end);
+			if (q == NULL) {
+				cbuf_addlstr(&d->pending, p, end - p);
+				return 0;
+			}
+			if (decoder_token(L, d, st, p, q) < 0)
+				return -1;
+			p = q;
+		}
+	}
+	return 0;
+}
+
+static struct decoder *check_decoder(lua_State *L, int idx)
+{
+	return (struct decoder *)luaL_checkudata(L, idx, DECODER_METANAME);
+}
+
+/// decoder:feed(chunk) -> true when a value is complete, false for more
+static int ldecoder_feed(lua_State *L)
+{
+	size_t len;
+	struct decoder *d = check_decoder(L, 1);
+	const char *p = luaL_checklstring(L, 2, &len);
+	lua_settop(L, 2);
+	lua_getiuservalue(L, 1, DECODER_STATE);
+	lua_getiuservalue(L, 1, DECODER_NULL);
+	if (d->state != DS_ERROR && decoder_feed(L, d, 3, p, p + len) == 0) {
+		lua_pushboolean(L, d->state == DS_DONE);
+		return 1;
+	}
+	lua_pushnil(L);
+	lua_pushstring(L, d->error);
+	return 2;
+}
+
+/// decoder:finish() -> value | nil, err
+static int ldecoder_finish(lua_State *L)
+{
+	struct decoder *d = check_decoder(L, 1);
+	lua_settop(L, 1);
+	lua_getiuservalue(L, 1, DECODER_STATE);
+	lua_getiuservalue(L, 1, DECODER_NULL);
+	/* a top level number or literal is only complete at end of input */
+	if (d->token == DT_BARE && d->depth == 0 && d->state == DS_VALUE) {
+		struct cbuf *cb = &d->pending;
+		cbuf_addchar(cb, '\0');
+		cbuf_pop(cb, 1);
+		if (decoder_token(L, d, 2, cb->data, cb->data + cb->len) == 0)
+			cb->len = 0;
+	}
+	if (d->state == DS_DONE) {
+		lua_rawgeti(L, 2, 0);
+		return 1;
+	}
+	lua_pushnil(L);
+	if (d->state == DS_ERROR)
+		lua_pushstring(L, d->error);
+	else if (d->state == DS_VALUE && d->token == DT_NONE)
+		lua_pushliteral(L, "Empty input");
+	else
+		lua_pushliteral(L, "Unexpected end of input");
+	return 2;
+}
+
+static int ldecoder_gc(lua_State *L)
+{
+	struct decoder *d = (struct decoder *)lua_touserdata(L, 1);
+	cbuf_free(&d->pending);
+	return 0;
+}
+
+/// json.decoder() — upvalue 1 is json.null
+static int ldecoder(lua_State *L)
+{
+	luaL_Reg methods[] = {
+		{ "feed",   ldecoder_feed   },
+		{ "finish", ldecoder_finish },
+		{ NULL,     NULL            },
+	};
+	struct decoder *d;
+	d = (struct decoder *)lua_newuserdatauv(L, sizeof(*d), 2);
+	d->state = DS_VALUE;
+	d->token = DT_NONE;
+	d->escape = 0;
+	d->depth = 0;
+	d->error = NULL;
+	cbuf_init(&d->pending);
+	if (luaL_newmetatable(L, DECODER_METANAME)) {
+		luaL_newlib(L, methods);
+		lua_setfield(L, -2, "__index");
+		lua_pushcfunction(L, ldecoder_gc);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_setmetatable(L, -2);
+	lua_newtable(L);
+	lua_setiuservalue(L, -2, DECODER_STATE);
+	lua_pushvalue(L, NULL_UPVALUE);
+	lua_setiuservalue(L, -2, DECODER_NULL);
+	return 1;
+}
+
+/* -------------------- lazy decoding -------------------- */
+
+/*
+ * json.lazy(str) makes one structural pass over the document and records
+ * where each object/array starts and ends. The spans are stored in
+ * document order, so they are sorted by start. A proxy indexes its direct
+ * children (key -> value offset) on first access and skips nested
+ * containers through the span table. A child is decoded only when it is
+ * read.
+ */
+#define LAZYDOC_METANAME "silly.encoding.json.lazydoc"
+#define LAZY_METANAME "silly.encoding.json.lazy"
+#define LAZY_DOC 1
+#define LAZY_CHILDREN 2
+#define LAZY_CACHE 3
+
+struct lazyspan {
+	size_t start; /* offset of '{' or '[' */
+	size_t end;   /* offset of the matching '}' or ']' */
+};
+
+struct lazydoc {
+	const char *str; /* kept alive by uservalue 1 */
+	size_t len;
+	size_t n;
+	size_t cap;
+	struct lazyspan *spans;
+};
+
+struct lazynode {
+	struct lazydoc *doc;
+	size_t start;
+	size_t end;
+	lua_Integer count; /* direct children, valid once indexed */
+};
+
+/* p at the opening quote, return the byte after the closing quote */
+static const char *skip_string(const char *p, const char *end)
+{
+	const uint8_t *q = (const uint8_t *)p + 1;
+	const uint8_t *e = (const uint8_t *)end;
+	for (;;) {
+		q = scan_string(q, e);
+		if (q >= e)
+			return NULL;
+		if (*q == '"')
+			return (const char *)q + 1;
+		if (*q != '\\')
+			return NULL; /* unescaped control character */
+		q += 2;
+	}
+}
+
+/* p at '{' or '[', return the byte after the matching close */
+static const char *skip_container(const char *p, const char *end)
+{
+	int depth = 0;
+	const uint8_t *q = (const uint8_t *)p;
+	const uint8_t *e = (const uint8_t *)end;
+	for (;;) {
+		q = scan_structural(q, e);
+		if (q >= e)
+			return NULL;
+		switch (*q) {
+		case '"':
+			q = (const uint8_t *)skip_string((const char *)q, end);
+			if (q == NULL)
+				return NULL;
+			continue;
+		case '{':
+		case '[':
+			depth++;
+			break;
+		default:
+			if (--depth == 0)
+				return (const char *)q + 1;
+			break;
+		}
+		q++;
+	}
+}
+
+static size_t lazydoc_end(struct lazydoc *d, size_t start)
+{
+	size_t lo = 0, hi = d->n;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (d->spans[mid].start < start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	assert(lo < d->n && d->spans[lo].start == start);
+	return d->spans[lo].end;
+}
+
+/* p < end at a value; containers are skipped through the spans of d, or
+ * by counting brackets when d is NULL */
+static const char *skip_value(struct lazydoc *d, const char *p,
+			      const char *end)
+{
+	const char *q;
+	switch (*p) {
+	case '"':
+		return skip_string(p, end);
+	case '{':
+	case '[':
+		if (d != NULL)
+			return d->str + lazydoc_end(d, p - d->str) + 1;
+		return skip_container(p, end);
+	default:
+		q = p;
+		while (q < end && is_bare((uint8_t)*q))
+			q++;
+		return q > p ? q : NULL;
+	}
+}
+
+static const char *lazydoc_index(struct lazydoc *d)
+{
+	size_t stack[MAX_DEPTH];
+	int depth = 0;
+	const uint8_t *base = (const uint8_t *)d->str;
+	const uint8_t *p = base;
+	const uint8_t *end = base + d->len;
+	for (;;) {
+		struct lazyspan *sp;
+		p = scan_structural(p, end);
+		if (p >= end)
+			break;
+		switch (*p) {
+		case '"':
+			p = (const uint8_t *)skip_string((const char *)p,
+							 (const char *)end);
+			if (p == NULL)
+				return "Invalid json";
+			continue;
+		case '{':
+		case '[':
+			if (depth >= MAX_DEPTH)
+				return "nesting too deep";
+			if (d->n == d->cap) {
+				d->cap = d->cap ? d->cap * 2 : 16;
+				d->spans = (struct lazyspan *)silly_realloc(
+					d->spans, d->cap * sizeof(*d->spans));
+			}
+			d->spans[d->n].start = p - base;
+			stack[depth++] = d->n++;
+			break;
+		default:
+			if (depth == 0)
+				return "Invalid json";
+			sp = &d->spans[stack[--depth]];
+			if ((*p == '}') != (base[sp->start] == '{'))
+				return "Invalid json";
+			sp->end = p - base;
+			break;
+		}
+		p++;
+	}
+	return depth == 0 ? NULL : "Invalid json";
+}
+
+static void lazy_new(lua_State *L, int doc, size_t start)
+{
+	struct lazydoc *d = (struct lazydoc *)lua_touserdata(L, doc);
+	struct lazynode *n;
+	n = (struct lazynode *)lua_newuserdatauv(L, sizeof(*n), 3);
+	n->doc = d;
+	n->start = start;
+	n->end = lazydoc_end(d, start);
+	n->count = 0;
+	luaL_setmetatable(L, LAZY_METANAME);
+	lua_pushvalue(L, doc);
+	lua_setiuservalue(L, -2, LAZY_DOC);
+}
+
+/* index the direct children of the node at stack index `node` */
+static void lazy_build(lua_State *L, struct lazynode *n, int node)
+{
+	struct decode_state s;
+	struct lazydoc *d = n->doc;
+	const char *base = d->str;
+	const char *p = base + n->start + 1;
+	const char *end = base + n->end;
+	int array = base[n->start] == '[';
+	lua_Integer count = 0;
+	s.L = L;
+	s.end = end;
+	s.null_idx = NULL_UPVALUE;
+	lua_newtable(L);
+	p = (const char *)scan_space((const uint8_t *)p, (const uint8_t *)end);
+	while (p < end) {
+		if (!array) {
+			if (*p != '"')
+				goto fail;
+			s.ptr = p;
+			if (decode_string(&s) < 0)
+				goto fail;
+			p = (const char *)scan_space((const uint8_t *)s.ptr,
+						     (const uint8_t *)end);
+			if (p >= end || *p != ':')
+				goto fail;
+			p = (const char *)scan_space((const uint8_t *)p + 1,
+						     (const uint8_t *)end);
+			if (p >= end)
+				goto fail;
+		}
+		lua_pushinteger(L, (lua_Integer)(p - base));
+		if (array)
+			lua_rawseti(L, -2, count + 1);
+		else
+			lua_rawset(L, -3);
+		count++;
+		p = skip_value(d, p, end);
+		if (p == NULL)
+			goto fail;
+		p = (const char *)scan_space((const uint8_t *)p,
+					     (const uint8_t *)end);
+		if (p >= end)
+			break;
+		if (*p != ',')
+			goto fail;
+		p = (const char *)scan_space((const uint8_t *)p + 1,
+					     (const uint8_t *)end);
+		if (p >= end)
+			goto fail; /* trailing comma */
+	}
+	n->count = count;
+	lua_pushvalue(L, -1);
+	lua_setiuservalue(L, node, LAZY_CHILDREN);
+	lua_newtable(L);
+	lua_setiuservalue(L, node, LAZY_CACHE);
+	return;
+fail:
+	luaL_error(L, "Invalid json");
+}
+
+/* push the children table of the node at stack index `node` */
+static void lazy_children(lua_State *L, struct lazynode *n, int node)
+{
+	if (lua_getiuservalue(L, node, LAZY_CHILDREN) == LUA_TTABLE)
+		return;
+	lua_pop(L, 1);
+	lazy_build(L, n, node);
+}
+
+/* push the child `key` of the node, `children` is its children table */
+static void lazy_get(lua_State *L, int node, int children, int key)
+{
+	struct decode_state s;
+	struct lazydoc *d;
+	size_t off;
+	lua_getiuservalue(L, node, LAZY_CACHE);
+	lua_pushvalue(L, key);
+	if (lua_rawget(L, -2) != LUA_TNIL) {
+		lua_remove(L, -2);
+		return;
+	}
+	lua_pop(L, 1);
+	lua_pushvalue(L, key);
+	if (lua_rawget(L, children) != LUA_TNUMBER) {
+		lua_remove(L, -2);
+		return;
+	}
+	off = (size_t)lua_tointeger(L, -1);
+	lua_pop(L, 1);
+	/* stack: cache */
+	lua_getiuservalue(L, node, LAZY_DOC);
+	d = (struct lazydoc *)lua_touserdata(L, -1);
+	if (d->str[off] == '{' || d->str[off] == '[') {
+		lazy_new(L, lua_gettop(L), off);
+	} else {
+		s.L = L;
+		s.ptr = d->str + off;
+		s.end = d->str + d->len;
+		s.null_idx = NULL_UPVALUE;
+		if (decode_value(&s) < 0)
+			luaL_error(L, "Invalid json");
+	}
+	/* stack: cache, doc, value */
+	lua_remove(L, -2);
+	lua_pushvalue(L, key);
+	lua_pushvalue(L, -2);
+	lua_rawset(L, -4);
+	lua_remove(L, -2);
+}
+
+static int llazy_index(lua_State *L)
+{
+	struct lazynode *n = (struct lazynode *)lua_touserdata(L, 1);
+	lua_settop(L, 2);
+	lazy_children(L, n, 1);
+	lazy_get(L, 1, 3, 2);
+	return 1;
+}
+
+static int llazy_len(lua_State *L)
+{
+	struct lazynode *n = (struct lazynode *)lua_touserdata(L, 1);
+	lua_settop(L, 1);
+	lazy_children(L, n, 1);
+	if (n->doc->str[n->start] == '[')
+		lua_pushinteger(L, n->count);
+	else
+		lua_pushinteger(L, 0);
+	return 1;
+}
+
+static int llazy_next(lua_State *L)
+{
+	struct lazynode *n = (struct lazynode *)luaL_checkudata(L, 1, LAZY_METANAME);
+	lua_settop(L, 2);
+	lazy_children(L, n, 1);
+	lua_pushvalue(L, 2);
+	if (lua_next(L, 3) == 0)
+		return 0;
+	lua_pop(L, 1);
+	/* stack: node, prev, children, key */
+	lazy_get(L, 1, 3, 4);
+	return 2;
+}
+
+static int llazy_pairs(lua_State *L)
+{
+	luaL_checkudata(L, 1, LAZY_METANAME);
+	lua_pushvalue(L, NULL_UPVALUE);
+	lua_pushcclosure(L, llazy_next, 1);
+	lua_pushvalue(L, 1);
+	lua_pushnil(L);
+	return 3;
+}
+
+static int llazy_newindex(lua_State *L)
+{
+	return luaL_error(L, "attempt to modify lazy json");
+}
+
+static int llazydoc_gc(lua_State *L)
+{
+	struct lazydoc *d = (struct lazydoc *)lua_touserdata(L, 1);
+	silly_free(d->spans);
+	d->spans = NULL;
+	return 0;
+}
+
+/// json.lazy(str) — upvalue 1 is json.null
+static int llazy(lua_State *L)
+{
+	size_t len;
+	const char *err;
+	struct lazydoc *d;
+	struct decode_state s;
+	const char *str = luaL_checklstring(L, 1, &len);
+	lua_settop(L, 1);
+	s.L = L;
+	s.ptr = str;
+	s.end = str + len;
+	s.null_idx = NULL_UPVALUE;
+	skip_space(&s);
+	if (s.ptr >= s.end) {
+		lua_pushnil(L);
+		lua_pushliteral(L, "Empty input");
+		return 2;
+	}
+	if (*s.ptr != '{' && *s.ptr != '[') {
+		if (decode_value(&s) < 0) {
+			lua_pushnil(L);
+			lua_pushliteral(L, "Invalid json");
+			return 2;
+		}
+		return 1;
+	}
+	d = (struct lazydoc *)lua_newuserdatauv(L, sizeof(*d), 1);
+	d->str = str;
+	d->len = len;
+	d->n = 0;
+	d->cap = 0;
+	d->spans = NULL;
+	luaL_setmetatable(L, LAZYDOC_METANAME);
+	lua_pushvalue(L, 1);
+	lua_setiuservalue(L, 2, 1);
+	err = lazydoc_index(d);
+	if (err != NULL) {
+		lua_pushnil(L);
+		lua_pushstring(L, err);
+		return 2;
+	}
+	lazy_new(L, 2, s.ptr - str);
+	return 1;
+}
+
+/// json.materialize(v) — decode a lazy proxy into plain tables
+static int lmaterialize(lua_State *L)
+{
+	struct decode_state s;
+	struct lazynode *n;
+	n = (struct lazynode *)luaL_testudata(L, 1, LAZY_METANAME);
+	if (n == NULL) {
+		lua_settop(L, 1);
+		return 1;
+	}
+	s.L = L;
+	s.ptr = n->doc->str + n->start;
+	s.end = n->doc->str + n->end + 1;
+	s.null_idx = NULL_UPVALUE;
+	if (decode_value(&s) < 0)
+		return luaL_error(L, "Invalid json");
+	return 1;
+}
+
+/* -------------------- JSON pointer -------------------- */
+
+/* move *pp from '{' to the value of member `tok`,
+ * return 1 if found, 0 if absent, -1 on malformed input */
+static int pointer_member(lua_State *L, const char **pp, const char *end,
+			  const char *tok, size_t toklen)
+{
+	const char *p = *pp + 1;
+	p = (const char *)scan_space((const uint8_t *)p, (const uint8_t *)end);
+	if (p < end && *p == '}')
+		return 0;
+	for (;;) {
+		int match;
+		const char *key, *q;
+		if (p >= end || *p != '"')
+			return -1;
+		q = skip_string(p, end);
+		if (q == NULL)
+			return -1;
+		key = p + 1;
+		if (memchr(key, '\\', q - 1 - key) == NULL) {
+			match = (size_t)(q - 1 - key) == toklen &&
+				memcmp(key, tok, toklen) == 0;
+		} else {
+			size_t klen;
+			struct decode_state s;
+			s.L = L;
+			s.ptr = p;
+			s.end = end;
+			if (decode_string(&s) < 0)
+				return -1;
+			key = lua_tolstring(L, -1, &klen);
+			match = klen == toklen && memcmp(key, tok, toklen) == 0;
+			lua_pop(L, 1);
+		}
+		p = (const char *)scan_space((const uint8_t *)q,
+					     (const uint8_t *)end);
+		if (p >= end || *p != ':')
+			return -1;
+		p = (const char *)scan_space((const uint8_t *)p + 1,
+					     (const uint8_t *)end);
+		if (p >= end)
+			return -1;
+		if (match) {
+			*pp = p;
+			return 1;
+		}
+		p = skip_value(NULL, p, end);
+		if (p == NULL)
+			return -1;
+		p = (const char *)scan_space((const uint8_t *)p,
+					     (const uint8_t *)end);
+		if (p >= end)
+			return -1;
+		if (*p == '}')
+			return 0;
+		if (*p != ',')
+			return -1;
+		p = (const char *)scan_space((const uint8_t *)p + 1,
+					     (const uint8_t *)end);
+	}
+}
+
+/* move *pp from '[' to element `tok` (0-based), same returns as above */
+static int pointer_element(const char **pp, const char *end, const char *tok,
+			   size_t toklen)
+{
+	size_t i, idx = 0;
+	const char *p = *pp + 1;
+	/* "-" (past the end), leading zeros and non digits match nothing */
+	if (toklen == 0 || toklen > 18 || (tok[0] == '0' && toklen > 1))
+		return 0;
+	for (i = 0; i < toklen; i++) {
+		if (tok[i] < '0' || tok[i] > '9')
+			return 0;
+		idx = idx * 10 + (tok[i] - '0');
+	}
+	p = (const char *)scan_space((const uint8_t *)p, (const uint8_t *)end);
+	if (p < end && *p == ']')
+		return 0;
+	for (i = 0;; i++) {
+		if (p >= end)
+			return -1;
+		if (i == idx) {
+			*pp = p;
+			return 1;
+		}
+		p = skip_value(NULL, p, end);
+		if (p == NULL)
+			return -1;
+		p = (const char *)scan_space((const uint8_t *)p,
+					     (const uint8_t *)end);
+		if (p >= end)
+			return -1;
+		if (*p == ']')
+			return 0;
+		if (*p != ',')
+			return -1;
+		p = (const char *)scan_space((const uint8_t *)p + 1,
+					     (const uint8_t *)end);
+	}
+}
+
+/// json.get(str, pointer) — upvalue 1 is json.null
+static int lget(lua_State *L)
+{
+	size_t len, plen;
+	struct decode_state s;
+	const char *str = luaL_checklstring(L, 1, &len);
+	const char *ptr = luaL_checklstring(L, 2, &plen);
+	const char *pend = ptr + plen;
+	luaL_argcheck(L, plen == 0 || ptr[0] == '/', 2,
+		      "JSON pointer must start with '/'");
+	lua_settop(L, 2);
+	lua_pushnil(L); /* slot 3: unescaped token */
+	s.L = L;
+	s.ptr = str;
+	s.end = str + len;
+	s.null_idx = NULL_UPVALUE;
+	skip_space(&s);
+	if (s.ptr >= s.end) {
+		lua_pushnil(L);
+		lua_pushliteral(L, "Empty input");
+		return 2;
+	}
+	while (ptr < pend) {
+		int ret;
+		size_t toklen;
+		const char *tok = ++ptr;
+		const char *tokend = memchr(tok, '/', pend - tok);
+		if (tokend == NULL)
+			tokend = pend;
+		ptr = tokend;
+		toklen = tokend - tok;
+		if (memchr(tok, '~', toklen) != NULL) {
+			/* unescape "~1" -> '/', "~0" -> '~' */
+			size_t i;
+			luaL_Buffer b;
+			luaL_buffinit(L, &b);
+			for (i = 0; i < toklen; i++) {
+				char ch = tok[i];
+				if (ch == '~') {
+					char nxt = i + 1 < toklen ? tok[i + 1] : 0;
+					luaL_argcheck(L, nxt == '0' || nxt == '1', 2,
+						      "invalid '~' escape");
+					ch = nxt == '0' ? '~' : '/';
+					i++;
+				}
+				luaL_addchar(&b, ch);
+			}
+			luaL_pushresult(&b);
+			lua_replace(L, 3);
+			tok = lua_tolstring(L, 3, &toklen);
+		}
+		if (*s.ptr == '{')
+			ret = pointer_member(L, &s.ptr, s.end, tok, toklen);
+		else if (*s.ptr == '[')
+			ret = pointer_element(&s.ptr, s.end, tok, toklen);
+		else
+			ret = 0;
+		if (ret == 0) {
+			lua_pushnil(L);
+			return 1;
+		}
+		if (ret < 0)
+			goto invalid;
+	}
+	if (decode_value(&s) == 0)
+		return 1;
+invalid:
+	lua_pushnil(L);
+	lua_pushliteral(L, "Invalid json");
+	return 2;
+}
+
 /* json.null metatable */
 
 static int lnull_tostring(lua_State *L)
@@ -622,23 +2024,42 @@ static void create_json_null(lua_State *L)
 SILLY_MOD_API int luaopen_silly_encoding_json(lua_State *L)
 {
 	luaL_Reg tbl[] = {
-		{ "encode", lencode },
-		{ "decode", ldecode },
-		{ NULL,     NULL    },
+		{ "encode",      lencode      },
+		{ "decode",      ldecode      },
+		{ "encoder",     lencoder     },
+		{ "decoder",     ldecoder     },
+		{ "lazy",        llazy        },
+		{ "materialize", lmaterialize },
+		{ "get",         lget         },
+		{ NULL,          NULL         },
+	};
+	luaL_Reg lazy_mt[] = {
+		{ "__index",    llazy_index    },
+		{ "__len",      llazy_len      },
+		{ "__pairs",    llazy_pairs    },
+		{ "__newindex", llazy_newindex },
+		{ NULL,         NULL           },
 	};
 	luaL_checkversion(L);
-	luaL_newlibtable(L, tbl);
-	/* stack: lib */
 	create_json_null(L);
-	/* stack: lib, null */
-	lua_pushvalue(L, -1);
-	/* stack: lib, null, null_dup */
-	lua_insert(L, -3);
-	/* stack: null_dup, lib, null — lib at -(nup+1) for setfuncs */
+	/* stack: null */
+	luaL_newmetatable(L, LAZY_METANAME);
+	lua_pushvalue(L, -2);
+	luaL_setfuncs(L, lazy_mt, 1);
+	lua_pop(L, 1);
+	if (luaL_newmetatable(L, LAZYDOC_METANAME)) {
+		lua_pushcfunction(L, llazydoc_gc);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_pop(L, 1);
+	luaL_newlibtable(L, tbl);
+	/* stack: null, lib */
+	lua_pushvalue(L, -2);
+	/* stack: null, lib, null — lib at -(nup+1) for setfuncs */
 	luaL_setfuncs(L, tbl, 1);
-	/* stack: null_dup, lib */
+	/* stack: null, lib */
 	lua_insert(L, -2);
-	/* stack: lib, null_dup */
+	/* stack: lib, null */
 	lua_setfield(L, -2, "null");
 	/* stack: lib */
 	return 1;
@@ -3,16 +3,28 @@
 #include <string.h>
 #include <stdio.h>
 #include <inttypes.h>
+#include <time.h>
 #include <lua.h>
 #include <lauxlib.h>
+#include <lz4.h>
 
 #include "silly.h"
 
 #define ACK_BIT (1UL << 31)
+//payload is [raw size(4 bytes)][lz4 block]
+#define LZ4_BIT (1UL << 30)
+//sender can decode LZ4_BIT payloads, set on every frame when enabled
+#define LZ4CAP_BIT (1UL << 29)
+//request frame without payload, cancels the request with the same session
+#define CANCEL_BIT (1UL << 28)
+#define SESSION_MAX (CANCEL_BIT - 1)
+#define FLAG_BITS (LZ4_BIT | LZ4CAP_BIT)
 #define DEFAULT_QUEUE_SIZE 2048
 #define DEFAULT_HARDLIMIT (128u * 1024 * 1024)
 #define HASH_SIZE 2048
 #define HASH(a) (a % HASH_SIZE)
+#define OUTBUF_INIT_SIZE 512
+#define OUTBUF_FLUSH_SIZE (64 * 1024)
 
 typedef uint32_t cmd_t;
 typedef uint32_t session_t;
@@ -23,8 +35,10 @@ struct request_header {
 	session_t session;
 	cmd_t cmd;
 	silly_traceid_t traceid;
+	uint32_t timeout; //remaining time of the caller in ms, 0 means none
+	uint32_t reserved;
 };
-static_assert(sizeof(struct request_header) == 16,
+static_assert(sizeof(struct request_header) == 24,
 	"request_header layout mismatch");
 
 struct response_header {
@@ -35,7 +49,8 @@ static_assert(sizeof(struct response_header) == 4,
 struct packet {
 	silly_socket_id_t fd;
 	int size;
-	char *buff;
+	char *buff; //NULL when the request was cancelled while queued
+	uint64_t deadline; //silly_monotonic() ms, 0 means none
 };
 struct incomplete {
 	silly_socket_id_t fd;
@@ -50,14 +65,50 @@ struct incomplete {
 	struct incomplete *next;
 };
 
+//responses to the same fd are coalesced here until flush
+struct outbuf {
+	silly_socket_id_t fd;
+	uint32_t size;
+	uint32_t cap;
+	uint8_t *buf;
+};
+
+//per-connection state, dropped by clear when the fd closes
+struct conn {
+	silly_socket_id_t fd;
+	uint32_t inflight; //outstanding requests waiting for a response
+	int lz4;           //remote side advertised LZ4CAP_BIT
+	struct conn *next;
+};
+
+struct packetstat {
+	uint64_t compress_count;
+	uint64_t compress_in;
+	uint64_t compress_out;
+	uint64_t compress_ns;
+	uint64_t decompress_count;
+	uint64_t decompress_in;
+	uint64_t decompress_out;
+	uint64_t decompress_ns;
+	uint64_t expired;   //requests dropped in queue after their deadline
+	uint64_t cancelled; //requests dropped in queue by a cancel frame
+};
+
 struct netpacket {
 	int cap; //default DEFAULT_QUEUE_SIZE
 	int head;
 	int tail;
 	uint32_t hardlimit;
 	uint32_t softlimit;
+	uint32_t compress; //lz4 threshold of payload size, 0 disables
+	uint32_t pickidx;
+	struct packetstat stat;
 	struct packet *queue;
+	int outcount;
+	int outcap;
+	struct outbuf *out;
 	struct incomplete *hash[HASH_SIZE];
+	struct conn *conns[HASH_SIZE];
 };
 
 static session_t session_idx = 0;
@@ -65,6 +116,7 @@ static session_t session_idx = 0;
 enum error {
 	ERR_HARDLIMIT = -1,
 	ERR_PSIZE     = -2,
+	ERR_LZ4       = -3,
 };
 
 static const char *error_str(int err)
@@ -77,6 +129,9 @@ static const char *error_str(int err)
 	case ERR_PSIZE:
 		msg = "packet size too small";
 		break;
+	case ERR_LZ4:
+		msg = "lz4 decompress fail";
+		break;
 	default:
 		msg = "unknown error";
 		break;
@@ -89,12 +144,16 @@ static int lcreate(lua_State *L)
 	struct netpacket *r;
 	lua_Integer hardval = luaL_optinteger(L, 1, DEFAULT_HARDLIMIT);
 	lua_Integer softval = luaL_optinteger(L, 2, USHRT_MAX);
+	lua_Integer compress = luaL_optinteger(L, 3, 0);
 	if (hardval < 0 || hardval > UINT32_MAX) {
 		luaL_error(L, "hardlimit out of range: %d", (int)hardval);
 	}
 	if (softval < 0 || softval > UINT32_MAX) {
 		luaL_error(L, "softlimit out of range: %d", (int)softval);
 	}
+	if (compress < 0 || compress > UINT32_MAX) {
+		luaL_error(L, "compress out of range: %d", (int)compress);
+	}
 	if (hardval < softval) {
 		luaL_error(L, "hardlimit %d must >= softlimit %d",
 			   (int)hardval, (int)softval);
@@ -104,6 +163,7 @@ static int lcreate(lua_State *L)
 	r->cap = DEFAULT_QUEUE_SIZE;
 	r->hardlimit = (uint32_t)hardval;
 	r->softlimit = (uint32_t)softval;
+	r->compress = (uint32_t)compress;
 	r->queue = silly_malloc(r->cap * sizeof(r->queue[0]));
 	luaL_getmetatable(L, "silly.net.cluster.c");
 	lua_setmetatable(L, -2);
@@ -177,6 +237,13 @@ static void push_complete(struct netpacket *p, struct incomplete *ic)
 	pk->size = ic->rsize;
 	pk->buff = (char *)ic->buff;
 	pk->buff[pk->size] = '\0';
+	pk->deadline = 0;
+	if (pk->size >= (int)sizeof(struct request_header)) {
+		struct request_header hdr;
+		memcpy(&hdr, pk->buff, sizeof(hdr));
+		if ((hdr.session & (ACK_BIT | CANCEL_BIT)) == 0 && hdr.timeout > 0)
+			pk->deadline = silly_monotonic() + hdr.timeout;
+	}
 
 	assert(p->head < p->cap);
 	assert(p->tail < p->cap);
@@ -187,6 +254,39 @@ static void push_complete(struct netpacket *p, struct incomplete *ic)
 	return;
 }
 
+//drop a queued request of `fd` that is cancelled before being popped
+static int cancel_queued(struct netpacket *p, silly_socket_id_t fd,
+			 session_t session)
+{
+	int i;
+	for (i = p->tail; i != p->head; i = (i + 1) % p->cap) {
+		session_t x;
+		struct packet *pk = &p->queue[i];
+		if (pk->fd != fd || pk->buff == NULL)
+			continue;
+		memcpy(&x, pk->buff, sizeof(x));
+		if (x != session)
+			continue;
+		silly_free(pk->buff);
+		pk->buff = NULL;
+		p->stat.cancelled++;
+		return 1;
+	}
+	return 0;
+}
+
+static int push_cancel(struct netpacket *p, struct incomplete *ic)
+{
+	session_t session;
+	memcpy(&session, ic->buff, sizeof(session));
+	if ((session & (ACK_BIT | CANCEL_BIT)) != CANCEL_BIT)
+		return 0;
+	if (!cancel_queued(p, ic->fd, session & ~CANCEL_BIT))
+		return 0;
+	silly_free(ic->buff);
+	return 1;
+}
+
 static inline int validate_psize(struct netpacket *p, uint32_t psize)
 {
 	if (unlikely(psize < sizeof(struct response_header))) {
@@ -201,6 +301,104 @@ static inline int validate_psize(struct netpacket *p, uint32_t psize)
 	return 0;
 }
 
+static struct conn **find_conn(struct netpacket *np, silly_socket_id_t fd)
+{
+	struct conn **pp = &np->conns[HASH(fd)];
+	while (*pp != NULL && (*pp)->fd != fd)
+		pp = &(*pp)->next;
+	return pp;
+}
+
+static struct conn *get_conn(struct netpacket *np, silly_socket_id_t fd)
+{
+	struct conn *c;
+	struct conn **pp = find_conn(np, fd);
+	c = *pp;
+	if (c == NULL) {
+		c = silly_malloc(sizeof(*c));
+		c->fd = fd;
+		c->inflight = 0;
+		c->lz4 = 0;
+		c->next = NULL;
+		*pp = c;
+	}
+	return c;
+}
+
+static void drop_conn(struct netpacket *np, silly_socket_id_t fd)
+{
+	struct conn *c;
+	struct conn **pp = find_conn(np, fd);
+	c = *pp;
+	if (c == NULL)
+		return;
+	*pp = c->next;
+	silly_free(c);
+}
+
+static inline int can_lz4(struct netpacket *np, silly_socket_id_t fd)
+{
+	struct conn *c;
+	if (np->compress == 0)
+		return 0;
+	c = *find_conn(np, fd);
+	return c != NULL && c->lz4;
+}
+
+static inline uint64_t nanotime(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//decode the flag bits of a complete frame in place
+static int unpack_flags(struct netpacket *p, struct incomplete *ic)
+{
+	int n;
+	uint8_t *buf;
+	uint64_t start;
+	uint32_t hdrsz, rawsize, zsize;
+	session_t session, flags;
+	memcpy(&session, ic->buff, sizeof(session));
+	flags = session & FLAG_BITS;
+	if (flags == 0)
+		return 0;
+	session &= ~FLAG_BITS;
+	memcpy(ic->buff, &session, sizeof(session));
+	if ((flags & LZ4CAP_BIT) != 0)
+		get_conn(p, ic->fd)->lz4 = 1;
+	if ((flags & LZ4_BIT) == 0)
+		return 0;
+	if ((session & ACK_BIT) == ACK_BIT)
+		hdrsz = sizeof(struct response_header);
+	else
+		hdrsz = sizeof(struct request_header);
+	if (unlikely(ic->rsize < hdrsz + sizeof(rawsize)))
+		return ERR_PSIZE;
+	memcpy(&rawsize, ic->buff + hdrsz, sizeof(rawsize));
+	if (unlikely(rawsize > p->hardlimit - hdrsz))
+		return ERR_HARDLIMIT;
+	zsize = ic->rsize - hdrsz - sizeof(rawsize);
+	buf = silly_malloc(hdrsz + rawsize + 1);
+	memcpy(buf, ic->buff, hdrsz);
+	start = nanotime();
+	n = LZ4_decompress_safe((char *)ic->buff + hdrsz + sizeof(rawsize),
+				(char *)buf + hdrsz, zsize, rawsize);
+	p->stat.decompress_ns += nanotime() - start;
+	if (unlikely(n < 0 || (uint32_t)n != rawsize)) {
+		silly_free(buf);
+		return ERR_LZ4;
+	}
+	p->stat.decompress_count++;
+	p->stat.decompress_in += zsize + sizeof(rawsize);
+	p->stat.decompress_out += rawsize;
+	silly_free(ic->buff);
+	ic->buff = buf;
+	ic->rsize = ic->header.psize = hdrsz + rawsize;
+	return 0;
+}
+
 static inline int validate_payload(struct incomplete *ic)
 {
 	struct response_header resp_hdr;
@@ -260,10 +458,12 @@ static int push_once(struct netpacket *p, silly_socket_id_t fd, int size,
 		eat += copy;
 		if (ic->rsize >= ic->header.psize) {
 			int err = validate_payload(ic);
+			if (err == 0)
+				err = unpack_flags(p, ic);
 			if (err < 0) {
 				eat = err;
 				silly_free(ic->buff);
-			} else {
+			} else if (!push_cancel(p, ic)) {
 				push_complete(p, ic);
 			}
 			if (ic != &tmp)
@@ -345,15 +545,35 @@ static void *extstr_free(void *ud, void *ptr, size_t osize, size_t nsize)
 	return NULL;
 }
 
+//@output
+//	fd, payload, session, cmd, traceid, deadline
+//	cmd is nil for a response and false for a cancel frame
 static int lpop(lua_State *L)
 {
 	char *buf;
 	int size;
+	uint64_t now = 0;
 	session_t session;
+	struct packet *pk;
 	struct response_header rsp_hdr;
-	struct packet *pk = pop_packet(L);
-	if (pk == NULL)
-		return 0;
+	struct netpacket *np = get_netpacket(L);
+	for (;;) {
+		pk = pop_packet(L);
+		if (pk == NULL)
+			return 0;
+		if (pk->buff == NULL) //cancelled while queued
+			continue;
+		if (pk->deadline == 0)
+			break;
+		if (now == 0)
+			now = silly_monotonic();
+		if (pk->deadline > now)
+			break;
+		//the caller has already given up, don't bother to decode it
+		silly_free(pk->buff);
+		pk->buff = NULL;
+		np->stat.expired++;
+	}
 	buf = pk->buff;
 	pk->buff = NULL;
 	memcpy(&rsp_hdr, buf, sizeof(rsp_hdr));
@@ -372,6 +592,17 @@ static int lpop(lua_State *L)
 		lua_pushinteger(L, (lua_Integer)(session & ~ACK_BIT));
 		lua_pushnil(L);        //cmd
 		lua_pushinteger(L, 0); //traceid
+		lua_pushinteger(L, 0); //deadline
+	} else if ((session & CANCEL_BIT) == CANCEL_BIT) {
+		struct request_header req_hdr;
+		memcpy(&req_hdr, buf, sizeof(req_hdr));
+		silly_free(buf);
+		lua_pushinteger(L, pk->fd);
+		lua_pushliteral(L, "");
+		lua_pushinteger(L, (lua_Integer)(session & ~CANCEL_BIT));
+		lua_pushboolean(L, 0); //cmd
+		lua_pushinteger(L, (lua_Integer)req_hdr.traceid);
+		lua_pushinteger(L, 0); //deadline
 	} else {
 		struct request_header req_hdr;
 		memcpy(&req_hdr, buf, sizeof(req_hdr));
@@ -388,8 +619,9 @@ static int lpop(lua_State *L)
 		lua_pushinteger(L, req_hdr.session);
 		lua_pushinteger(L, req_hdr.cmd);
 		lua_pushinteger(L, (lua_Integer)req_hdr.traceid);
+		lua_pushinteger(L, (lua_Integer)pk->deadline);
 	}
-	return 5;
+	return 6;
 }
 
 static inline int validate_pack_size(struct netpacket *np, cmd_t cmd,
@@ -407,8 +639,60 @@ static inline int validate_pack_size(struct netpacket *np, cmd_t cmd,
 	return 0;
 }
 
+static inline int want_lz4(struct netpacket *np, silly_socket_id_t fd,
+			   size_t size)
+{
+	return size >= np->compress && can_lz4(np, fd);
+}
+
+//room needed by put_payload
+static inline size_t payload_bound(int lz4, size_t size)
+{
+	size_t bound;
+	if (!lz4)
+		return size;
+	bound = sizeof(uint32_t) + LZ4_compressBound(size);
+	return bound > size ? bound : size;
+}
+
+//write the payload at dst, compressing it when it pays off
+static uint32_t put_payload(struct netpacket *np, int lz4, uint8_t *dst,
+			    const char *src, size_t size, session_t *flags)
+{
+	if (lz4) {
+		int n;
+		uint32_t rawsize = size;
+		uint64_t start = nanotime();
+		n = LZ4_compress_default(src, (char *)dst + sizeof(rawsize),
+					 size, LZ4_compressBound(size));
+		np->stat.compress_ns += nanotime() - start;
+		np->stat.compress_count++;
+		np->stat.compress_in += size;
+		if (n > 0 && n + sizeof(rawsize) < size) {
+			memcpy(dst, &rawsize, sizeof(rawsize));
+			*flags |= LZ4_BIT;
+			np->stat.compress_out += n + sizeof(rawsize);
+			return n + sizeof(rawsize);
+		}
+		//incompressible, sent as is
+		np->stat.compress_out += size;
+	}
+	memcpy(dst, src, size);
+	return size;
+}
+
+//@input
+//	netpacket
+//	fd
+//	cmd
+//	traceid
+//	timeout (ms left to the caller, 0 means none)
+//	data (string|lightuserdata, size)
+//@output
+//	session, frame ptr, frame size or false, error
 static int lrequest(lua_State *L)
 {
+	int lz4;
 	cmd_t cmd;
 	uint8_t *p;
 	const char *str;
@@ -416,15 +700,21 @@ static int lrequest(lua_State *L)
 	uint64_t body;
 	uint32_t total;
 	session_t session;
+	silly_socket_id_t fd;
 	silly_traceid_t traceid;
+	lua_Integer timeout;
 	struct request_header req_hdr;
 	struct netpacket *np = get_netpacket(L);
-	cmd = luaL_checkinteger(L, 2);
-	traceid = luaL_checkinteger(L, 3);
-	str = getbuffer(L, 4, &size);
+	fd = luaL_checkinteger(L, 2);
+	cmd = luaL_checkinteger(L, 3);
+	traceid = luaL_checkinteger(L, 4);
+	timeout = luaL_checkinteger(L, 5);
+	str = getbuffer(L, 6, &size);
+	if (timeout < 0 || timeout > UINT32_MAX)
+		return luaL_error(L, "timeout out of range: %d", (int)timeout);
 	session = session_idx++;
-	if (session >= ACK_BIT) {
-		session_idx = 0;
+	if (session > SESSION_MAX) {
+		session_idx = 1;
 		session = 0;
 	}
 	body = sizeof(struct request_header) + size;
@@ -434,32 +724,120 @@ static int lrequest(lua_State *L)
 		lua_pushstring(L, error_str(err));
 		return 2;
 	}
-	total = HEADER_SIZE + body;
-	p = silly_malloc(total + 1);
-	memcpy(p, &body, HEADER_SIZE);
-	req_hdr.session = session;
+	lz4 = want_lz4(np, fd, size);
+	p = silly_malloc(HEADER_SIZE + sizeof(struct request_header) +
+			 payload_bound(lz4, size));
+	req_hdr.session = np->compress > 0 ? session | LZ4CAP_BIT : session;
 	req_hdr.cmd = cmd;
 	req_hdr.traceid = traceid;
+	req_hdr.timeout = (uint32_t)timeout;
+	req_hdr.reserved = 0;
+	body = sizeof(struct request_header) +
+	       put_payload(np, lz4, p + HEADER_SIZE + sizeof(req_hdr), str,
+			   size, &req_hdr.session);
+	total = HEADER_SIZE + body;
+	memcpy(p, &body, HEADER_SIZE);
 	memcpy(p + HEADER_SIZE, &req_hdr, sizeof(req_hdr));
-	memcpy(p + HEADER_SIZE + sizeof(struct request_header), str, size);
-	p[total] = '\0';
 	lua_pushinteger(L, session);
-	lua_pushexternalstring(L, (char *)p, total, extstr_free, p);
+	lua_pushlightuserdata(L, p);
+	lua_pushinteger(L, total);
+	return 3;
+}
+
+//@input
+//	netpacket
+//	session
+//@output
+//	frame ptr, frame size
+static int lcancel(lua_State *L)
+{
+	uint8_t *p;
+	uint32_t body;
+	struct request_header req_hdr;
+	struct netpacket *np = get_netpacket(L);
+	session_t session = luaL_checkinteger(L, 2);
+	body = sizeof(req_hdr);
+	p = silly_malloc(HEADER_SIZE + body);
+	memset(&req_hdr, 0, sizeof(req_hdr));
+	req_hdr.session = session | CANCEL_BIT;
+	if (np->compress > 0)
+		req_hdr.session |= LZ4CAP_BIT;
+	memcpy(p, &body, HEADER_SIZE);
+	memcpy(p + HEADER_SIZE, &req_hdr, sizeof(req_hdr));
+	lua_pushlightuserdata(L, p);
+	lua_pushinteger(L, HEADER_SIZE + body);
 	return 2;
 }
 
+static struct outbuf *get_outbuf(struct netpacket *np, silly_socket_id_t fd)
+{
+	int i;
+	struct outbuf *ob;
+	//a dispatch usually answers few peers, the newest one is most likely
+	for (i = np->outcount - 1; i >= 0; i--) {
+		if (np->out[i].fd == fd)
+			return &np->out[i];
+	}
+	if (np->outcount >= np->outcap) {
+		np->outcap = np->outcap == 0 ? 8 : np->outcap * 2;
+		np->out = silly_realloc(np->out,
+					np->outcap * sizeof(np->out[0]));
+	}
+	ob = &np->out[np->outcount++];
+	ob->fd = fd;
+	ob->size = 0;
+	ob->cap = 0;
+	ob->buf = NULL;
+	return ob;
+}
+
+static inline void send_outbuf(struct outbuf *ob)
+{
+	if (ob->buf == NULL)
+		return;
+	//silly_tcp_send takes the ownership of buf, even on error
+	silly_tcp_send(ob->fd, ob->buf, ob->size, NULL);
+	ob->buf = NULL;
+	ob->size = 0;
+	ob->cap = 0;
+}
+
+static uint8_t *reserve_outbuf(struct outbuf *ob, uint32_t need)
+{
+	uint32_t cap;
+	if (ob->size > 0 && ob->size + need > OUTBUF_FLUSH_SIZE)
+		send_outbuf(ob);
+	if (ob->size + need > ob->cap) {
+		cap = ob->cap > 0 ? ob->cap : OUTBUF_INIT_SIZE;
+		while (cap < ob->size + need)
+			cap *= 2;
+		ob->buf = silly_realloc(ob->buf, cap);
+		ob->cap = cap;
+	}
+	return ob->buf + ob->size;
+}
+
+//@input
+//	netpacket
+//	fd
+//	session
+//	data (string|lightuserdata, size)
+//@output
+//	true or false, error
 static int lresponse(lua_State *L)
 {
+	int lz4;
 	uint8_t *p;
 	const char *str;
 	size_t size;
 	uint64_t body;
-	uint32_t total;
-	session_t session;
+	silly_socket_id_t fd;
+	struct outbuf *ob;
 	struct response_header rsp_hdr;
 	struct netpacket *np = get_netpacket(L);
-	session = luaL_checkinteger(L, 2) | ACK_BIT;
-	str = getbuffer(L, 3, &size);
+	fd = luaL_checkinteger(L, 2);
+	rsp_hdr.session = luaL_checkinteger(L, 3) | ACK_BIT;
+	str = getbuffer(L, 4, &size);
 	body = sizeof(struct response_header) + size;
 	int err = validate_pack_size(np, 0, body);
 	if (unlikely(err < 0)) {
@@ -467,21 +845,173 @@ static int lresponse(lua_State *L)
 		lua_pushstring(L, error_str(err));
 		return 2;
 	}
-	total = HEADER_SIZE + body;
-	p = silly_malloc(total + 1);
+	if (np->compress > 0)
+		rsp_hdr.session |= LZ4CAP_BIT;
+	lz4 = want_lz4(np, fd, size);
+	ob = get_outbuf(np, fd);
+	p = reserve_outbuf(ob, HEADER_SIZE + sizeof(rsp_hdr) +
+				       payload_bound(lz4, size));
+	body = sizeof(rsp_hdr) + put_payload(np, lz4,
+					     p + HEADER_SIZE + sizeof(rsp_hdr),
+					     str, size, &rsp_hdr.session);
 	memcpy(p, &body, HEADER_SIZE);
-	rsp_hdr.session = session;
 	memcpy(p + HEADER_SIZE, &rsp_hdr, sizeof(rsp_hdr));
-	memcpy(p + HEADER_SIZE + sizeof(struct response_header), str, size);
-	p[total] = '\0';
-	lua_pushexternalstring(L, (char *)p, total, extstr_free, p);
+	ob->size += HEADER_SIZE + body;
+	lua_pushboolean(L, 1);
 	return 1;
 }
 
+//@input
+//	netpacket
+//@output
+//	number of fds flushed
+static int lflush(lua_State *L)
+{
+	int i, n;
+	struct netpacket *np = get_netpacket(L);
+	n = np->outcount;
+	for (i = 0; i < n; i++)
+		send_outbuf(&np->out[i]);
+	np->outcount = 0;
+	lua_pushinteger(L, n);
+	return 1;
+}
+
+static void drop_outbuf(struct netpacket *np, silly_socket_id_t fd)
+{
+	int i;
+	for (i = 0; i < np->outcount; i++) {
+		struct outbuf *ob = &np->out[i];
+		if (ob->fd != fd)
+			continue;
+		silly_free(ob->buf);
+		np->out[i] = np->out[--np->outcount];
+		return;
+	}
+}
+
+//@input
+//	netpacket
+//	fd
+//@output
+//	inflight count after increase
+static int lacquire(lua_State *L)
+{
+	struct conn *c;
+	struct netpacket *np = get_netpacket(L);
+	silly_socket_id_t fd = luaL_checkinteger(L, 2);
+	c = get_conn(np, fd);
+	c->inflight++;
+	lua_pushinteger(L, c->inflight);
+	return 1;
+}
+
+//@input
+//	netpacket
+//	fd
+//@output
+//	inflight count after decrease
+static int lrelease(lua_State *L)
+{
+	struct conn *c;
+	struct netpacket *np = get_netpacket(L);
+	silly_socket_id_t fd = luaL_checkinteger(L, 2);
+	c = *find_conn(np, fd);
+	//the fd may have been cleared while the caller was waiting
+	if (c == NULL || c->inflight == 0) {
+		lua_pushinteger(L, 0);
+		return 1;
+	}
+	c->inflight--;
+	lua_pushinteger(L, c->inflight);
+	return 1;
+}
+
+static int linflight(lua_State *L)
+{
+	struct netpacket *np = get_netpacket(L);
+	silly_socket_id_t fd = luaL_checkinteger(L, 2);
+	struct conn *c = *find_conn(np, fd);
+	lua_pushinteger(L, c != NULL ? c->inflight : 0);
+	return 1;
+}
+
+//@input
+//	netpacket
+//	fds: array of fd or false for a disconnected slot
+//@output
+//	fd with the least inflight requests or nil, and its inflight count
+static int lpick(lua_State *L)
+{
+	lua_Integer i, n, start;
+	struct conn *c;
+	silly_socket_id_t fd = 0;
+	uint32_t best = UINT32_MAX;
+	struct netpacket *np = get_netpacket(L);
+	luaL_checktype(L, 2, LUA_TTABLE);
+	n = luaL_len(L, 2);
+	if (n <= 0)
+		return 0;
+	//rotate the start slot so that ties spread over all connections
+	start = np->pickidx++ % n;
+	for (i = 0; i < n; i++) {
+		uint32_t count;
+		silly_socket_id_t x;
+		if (lua_rawgeti(L, 2, (start + i) % n + 1) != LUA_TNUMBER) {
+			lua_pop(L, 1);
+			continue;
+		}
+		x = lua_tointeger(L, -1);
+		lua_pop(L, 1);
+		c = *find_conn(np, x);
+		count = c != NULL ? c->inflight : 0;
+		if (count < best) {
+			best = count;
+			fd = x;
+			if (count == 0)
+				break;
+		}
+	}
+	if (best == UINT32_MAX)
+		return 0;
+	lua_pushinteger(L, fd);
+	lua_pushinteger(L, best);
+	return 2;
+}
+
+#define STAT_FIELD(name) \
+	lua_pushinteger(L, (lua_Integer)np->stat.name); \
+	lua_setfield(L, -2, #name)
+
+//@input
+//	netpacket
+//@output
+//	table of counters, *_ns are cpu time in nanoseconds
+static int lstats(lua_State *L)
+{
+	struct netpacket *np = get_netpacket(L);
+	lua_createtable(L, 0, 10);
+	STAT_FIELD(compress_count);
+	STAT_FIELD(compress_in);
+	STAT_FIELD(compress_out);
+	STAT_FIELD(compress_ns);
+	STAT_FIELD(decompress_count);
+	STAT_FIELD(decompress_in);
+	STAT_FIELD(decompress_out);
+	STAT_FIELD(decompress_ns);
+	STAT_FIELD(expired);
+	STAT_FIELD(cancelled);
+	return 1;
+}
+
+#undef STAT_FIELD
+
 static int lclear(lua_State *L)
 {
 	silly_socket_id_t sid = luaL_checkinteger(L, 2);
 	clear_incomplete(L, sid);
+	drop_outbuf(get_netpacket(L), sid);
+	drop_conn(get_netpacket(L), sid);
 	return 0;
 }
 
@@ -519,6 +1049,16 @@ static int packet_gc(lua_State *L)
 			silly_free(t);
 		}
 	}
+	for (i = 0; i < HASH_SIZE; i++) {
+		struct conn *c, *t;
+		c = pk->conns[i];
+		while (c) {
+			t = c;
+			c = c->next;
+			silly_free(t);
+		}
+		pk->conns[i] = NULL;
+	}
 	i = pk->tail;
 	while (i != pk->head) {
 		if (pk->queue[i].buff != NULL) {
@@ -528,6 +1068,11 @@ static int packet_gc(lua_State *L)
 	}
 	silly_free(pk->queue);
 	pk->queue = NULL;
+	for (i = 0; i < pk->outcount; i++)
+		silly_free(pk->out[i].buf);
+	silly_free(pk->out);
+	pk->out = NULL;
+	pk->outcount = 0;
 	return 0;
 }
 
@@ -538,7 +1083,14 @@ SILLY_MOD_API int luaopen_silly_net_cluster_c(lua_State *L)
 		{ "pop",      lpop      },
 		{ "push",     lpush     },
 		{ "request",  lrequest  },
+		{ "cancel",   lcancel   },
 		{ "response", lresponse },
+		{ "flush",    lflush    },
+		{ "acquire",  lacquire  },
+		{ "release",  lrelease  },
+		{ "inflight", linflight },
+		{ "pick",     lpick     },
+		{ "stats",    lstats    },
 		{ "clear",    lclear    },
 		{ NULL,       NULL      },
 	};
@@ -13,6 +13,7 @@
 
 #include "silly.h"
 #include "luastr.h"
+#include "blob.h"
 
 #define MT_HIVE "silly.hive"
 #define MT_WORKER "silly.hive.worker"
@@ -54,10 +55,27 @@ struct hive {
 	int thread_max;
 	int thread_live;
 
-	uint32_t round_robin;
 	int table_capacity;
 	struct thread_context **table;
 	struct thread_context *wait_for_join;
+
+	// shared task queue, every idle thread takes the next task from it,
+	// so a long task never holds up the tasks queued behind it
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct worker *head;
+	struct worker **tail;
+
+	// finished tasks, delivered to the worker in batches
+	pthread_mutex_t done_lock;
+	struct worker *done_head;
+	struct worker **done_tail;
+	int done_pending;
+
+	// statistics
+	atomic_uint_fast64_t tasks;
+	atomic_uint_fast64_t wait_ns;
+	atomic_uint_fast64_t run_ns;
 };
 
 struct worker {
@@ -65,6 +83,7 @@ struct worker {
 	struct worker *next;
 	uint32_t task_id;
 	int pcall_status;
+	uint64_t push_ns;
 };
 
 struct thread_context {
@@ -73,21 +92,72 @@ struct thread_context {
 	uint8_t shutdown;
 	atomic_int_fast8_t status;
 	time_t idle_start;
-
-	pthread_mutex_t lock;
-	pthread_cond_t cond;
-	struct worker *head;
-	struct worker **tail;
 	struct thread_context *next;
 };
 
 struct task_message {
 	struct silly_message hdr;
-	struct worker *w;
+	struct task_message *next;
 };
 
 static int MSG_TYPE_HIVE_DONE = 0;
 
+// At most one DONE message is in flight at a time, the pool only needs to
+// absorb the short overlap between the worker freeing the old message and a
+// hive thread pushing the next one.
+static pthread_mutex_t msg_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct task_message *msg_pool = NULL;
+static int msg_pool_closed = 0;
+
+static struct task_message *msg_alloc()
+{
+	struct task_message *msg;
+	pthread_mutex_lock(&msg_pool_lock);
+	msg = msg_pool;
+	if (msg != NULL)
+		msg_pool = msg->next;
+	pthread_mutex_unlock(&msg_pool_lock);
+	if (msg == NULL)
+		msg = (struct task_message *)MALLOC(sizeof(*msg));
+	return msg;
+}
+
+static void msg_free(void *ptr)
+{
+	struct task_message *msg = (struct task_message *)ptr;
+	pthread_mutex_lock(&msg_pool_lock);
+	if (!msg_pool_closed) {
+		msg->next = msg_pool;
+		msg_pool = msg;
+		msg = NULL;
+	}
+	pthread_mutex_unlock(&msg_pool_lock);
+	if (msg != NULL)
+		FREE(msg);
+}
+
+static void msg_pool_close()
+{
+	struct task_message *msg;
+	pthread_mutex_lock(&msg_pool_lock);
+	msg = msg_pool;
+	msg_pool = NULL;
+	msg_pool_closed = 1;
+	pthread_mutex_unlock(&msg_pool_lock);
+	while (msg != NULL) {
+		struct task_message *next = msg->next;
+		FREE(msg);
+		msg = next;
+	}
+}
+
+static inline uint64_t nanotime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
 static void copy_value_r(lua_State *L_from, lua_State *L_to, int index,
 			 int depth)
 {
@@ -95,6 +165,7 @@ static void copy_value_r(lua_State *L_from, lua_State *L_to, int index,
 		return;
 	size_t len;
 	const char *s;
+	struct blobdata *d;
 	int type = lua_type(L_from, index);
 	switch (type) {
 	case LUA_TNIL:
@@ -126,6 +197,13 @@ static void copy_value_r(lua_State *L_from, lua_State *L_to, int index,
 			lua_pop(L_from, 1);
 		}
 		break;
+	case LUA_TUSERDATA:
+		d = blob_test(L_from, index);
+		if (d != NULL)
+			blob_push(L_to, d); // shared, no copy
+		else
+			lua_pushnil(L_to);
+		break;
 	default:
 		lua_pushnil(L_to);
 		break;
@@ -173,6 +251,7 @@ static const char *whitelist_prefix[] = {
 	"encoding",
 	"security",
 	"perf",
+	"metrics.native",
 	NULL
 };
 
@@ -220,21 +299,29 @@ static void install_safe_require(lua_State *L)
 
 static int msg_unpack(lua_State *L, struct silly_message *m)
 {
-	int n;
-	struct task_message *tm = container_of(m, struct task_message, hdr);
-	lua_pushinteger(L, tm->w->task_id);
-	lua_pushboolean(L, tm->w->pcall_status == LUA_OK);
-	if (tm->w->pcall_status != LUA_OK) {
-		n = 1;
-		copy_value(tm->w->L, L, -1);
-	} else {
-		n = lua_gettop(tm->w->L);
-		copy_values(tm->w->L, L, 2, n);
-		n = n - 1;
-	}
-	lua_settop(tm->w->L, 1);
-	tm->w->task_id = 0;
-	return n + 2;
+	(void)L;
+	(void)m;
+	return 0;
+}
+
+static void complete_task(struct hive *h, struct worker *w)
+{
+	int notify;
+	struct task_message *msg;
+	w->next = NULL;
+	pthread_mutex_lock(&h->done_lock);
+	*h->done_tail = w;
+	h->done_tail = &w->next;
+	notify = h->done_pending == 0;
+	h->done_pending = 1;
+	pthread_mutex_unlock(&h->done_lock);
+	if (!notify)
+		return;
+	msg = msg_alloc();
+	msg->hdr.type = MSG_TYPE_HIVE_DONE;
+	msg->hdr.unpack = msg_unpack;
+	msg->hdr.free = msg_free;
+	silly_push(&msg->hdr);
 }
 
 static struct thread_context **try_join_dead_threads(struct hive *h, int force)
@@ -245,8 +332,6 @@ static struct thread_context **try_join_dead_threads(struct hive *h, int force)
 		struct thread_context *next = ptr->next;
 		if (force || acquire(&ptr->status) == THREAD_DEAD) {
 			pthread_join(ptr->thread_id, NULL);
-			pthread_mutex_destroy(&ptr->lock);
-			pthread_cond_destroy(&ptr->cond);
 			FREE(ptr);
 		} else {
 			*tail = ptr;
@@ -264,24 +349,26 @@ static int l_hive_gc(lua_State *L)
 	if (h->table == NULL) {
 		return 0;
 	}
+	pthread_mutex_lock(&h->lock);
 	for (int i = 0; i < h->thread_live; i++) {
-		struct thread_context *ctx = h->table[i];
-		pthread_mutex_lock(&ctx->lock);
-		ctx->shutdown = 1;
-		pthread_cond_signal(&ctx->cond);
-		pthread_mutex_unlock(&ctx->lock);
+		h->table[i]->shutdown = 1;
 	}
+	pthread_cond_broadcast(&h->cond);
+	pthread_mutex_unlock(&h->lock);
 	try_join_dead_threads(h, 1);
 	for (int i = 0; i < h->thread_live; i++) {
 		struct thread_context *ctx = h->table[i];
 		pthread_join(ctx->thread_id, NULL);
-		pthread_mutex_destroy(&ctx->lock);
-		pthread_cond_destroy(&ctx->cond);
 		FREE(ctx);
 	}
 	FREE(h->table);
+	h->table = NULL;
 	h->table_capacity = 0;
 	h->thread_live = 0;
+	pthread_mutex_destroy(&h->lock);
+	pthread_cond_destroy(&h->cond);
+	pthread_mutex_destroy(&h->done_lock);
+	msg_pool_close();
 	return 0;
 }
 
@@ -316,7 +403,6 @@ static void new_hive(lua_State *L)
 	int n = silly_cpu_count();
 	h->id = 0;
 	h->thread_live = 0;
-	h->round_robin = 0;
 	h->table_capacity = n;
 	h->table = MALLOC(n * sizeof(h->table[0]));
 	for (int i = 0; i < n; i++) {
@@ -327,6 +413,17 @@ static void new_hive(lua_State *L)
 	h->wait_for_join = NULL;
 	atomic_init(&h->thread_busy, 0);
 	atomic_init(&h->worker_waiting, 0);
+	pthread_mutex_init(&h->lock, NULL);
+	pthread_cond_init(&h->cond, NULL);
+	h->head = NULL;
+	h->tail = &h->head;
+	pthread_mutex_init(&h->done_lock, NULL);
+	h->done_head = NULL;
+	h->done_tail = &h->done_head;
+	h->done_pending = 0;
+	atomic_init(&h->tasks, 0);
+	atomic_init(&h->wait_ns, 0);
+	atomic_init(&h->run_ns, 0);
 	lua_pushvalue(L, -1);
 	lua_rawsetp(L, LUA_REGISTRYINDEX, new_hive);
 }
@@ -337,37 +434,39 @@ static void *thread_func(void *arg)
 	struct hive *h = ctx->h;
 	for (;;) {
 		struct worker *w;
-		struct task_message *msg;
+		uint64_t start, stop;
 
-		pthread_mutex_lock(&ctx->lock);
-		while (ctx->head == NULL && !ctx->shutdown) {
+		pthread_mutex_lock(&h->lock);
+		if (h->head == NULL && !ctx->shutdown) {
 			ctx->idle_start = time(NULL);
 			release(&ctx->status, THREAD_IDLE);
-			pthread_cond_wait(&ctx->cond, &ctx->lock);
+			do {
+				pthread_cond_wait(&h->cond, &h->lock);
+			} while (h->head == NULL && !ctx->shutdown);
 			release(&ctx->status, THREAD_WORKING);
 		}
-		if (ctx->shutdown && ctx->head == NULL) {
-			pthread_mutex_unlock(&ctx->lock);
+		if (ctx->shutdown && h->head == NULL) {
+			pthread_mutex_unlock(&h->lock);
 			release(&ctx->status, THREAD_DEAD);
 			return NULL;
 		}
-		w = ctx->head;
-		ctx->head = w->next;
-		if (ctx->head == NULL) {
-			ctx->tail = &ctx->head;
+		w = h->head;
+		h->head = w->next;
+		if (h->head == NULL) {
+			h->tail = &h->head;
 		}
-		pthread_mutex_unlock(&ctx->lock);
+		pthread_mutex_unlock(&h->lock);
 		sub(&h->worker_waiting, 1);
 		add(&h->thread_busy, 1);
+		start = nanotime();
 		w->pcall_status =
 			lua_pcall(w->L, lua_gettop(w->L) - 2, LUA_MULTRET, 0);
+		stop = nanotime();
 		sub(&h->thread_busy, 1);
-		msg = (struct task_message *)MALLOC(sizeof(*msg));
-		msg->hdr.type = MSG_TYPE_HIVE_DONE;
-		msg->hdr.unpack = msg_unpack;
-		msg->hdr.free = silly_free;
-		msg->w = w;
-		silly_push(&msg->hdr);
+		add(&h->tasks, 1);
+		add(&h->wait_ns, start - w->push_ns);
+		add(&h->run_ns, stop - start);
+		complete_task(h, w);
 	}
 	return NULL;
 }
@@ -378,14 +477,9 @@ static void create_thread(struct hive *h)
 	ctx->h = h;
 	ctx->shutdown = 0;
 	ctx->next = NULL;
+	ctx->idle_start = time(NULL);
 	atomic_init(&ctx->status, THREAD_IDLE);
-	pthread_mutex_init(&ctx->lock, NULL);
-	pthread_cond_init(&ctx->cond, NULL);
-	ctx->head = NULL;
-	ctx->tail = &ctx->head;
 	if (pthread_create(&ctx->thread_id, NULL, thread_func, ctx) != 0) {
-		pthread_mutex_destroy(&ctx->lock);
-		pthread_cond_destroy(&ctx->cond);
 		FREE(ctx);
 		return;
 	}
@@ -404,7 +498,6 @@ static lua_Integer push_into_hive(lua_State *L, struct hive *h,
 				  struct worker *w)
 {
 	lua_Integer id;
-	struct thread_context *ctx;
 	int waiting = load(&h->worker_waiting);
 	int idle = h->thread_live - load(&h->thread_busy);
 	if ((idle - waiting) <= 0 && h->thread_live < h->thread_max) {
@@ -417,14 +510,14 @@ static lua_Integer push_into_hive(lua_State *L, struct hive *h,
 	w->task_id = id;
 	lua_pushvalue(w->L, 1);
 	copy_values(L, w->L, 2, lua_gettop(L));
-	ctx = h->table[h->round_robin++ % h->thread_live];
-	assert(ctx->shutdown == 0);
-	pthread_mutex_lock(&ctx->lock);
-	*ctx->tail = w;
-	ctx->tail = &w->next;
-	pthread_cond_signal(&ctx->cond);
-	pthread_mutex_unlock(&ctx->lock);
+	w->next = NULL;
+	w->push_ns = nanotime();
 	add(&h->worker_waiting, 1);
+	pthread_mutex_lock(&h->lock);
+	*h->tail = w;
+	h->tail = &w->next;
+	pthread_cond_signal(&h->cond);
+	pthread_mutex_unlock(&h->lock);
 	return id;
 }
 
@@ -442,7 +535,8 @@ static int llimit(lua_State *L)
 	return 0;
 }
 
-static int try_kill_thread(struct thread_context *ctx, time_t dead_time)
+static int try_kill_thread(struct hive *h, struct thread_context *ctx,
+			   time_t dead_time)
 {
 	if (acquire(&ctx->status) != THREAD_IDLE) {
 		return 0;
@@ -450,13 +544,13 @@ static int try_kill_thread(struct thread_context *ctx, time_t dead_time)
 	if (ctx->idle_start > dead_time) {
 		return 0;
 	}
-	pthread_mutex_lock(&ctx->lock);
+	pthread_mutex_lock(&h->lock);
 	if (acquire(&ctx->status) == THREAD_IDLE &&
-	    ctx->idle_start < dead_time && ctx->head == NULL) {
+	    ctx->idle_start < dead_time && h->head == NULL) {
 		ctx->shutdown = 1;
-		pthread_cond_signal(&ctx->cond);
+		pthread_cond_broadcast(&h->cond);
 	}
-	pthread_mutex_unlock(&ctx->lock);
+	pthread_mutex_unlock(&h->lock);
 	return ctx->shutdown;
 }
 
@@ -477,7 +571,7 @@ static int lprune(lua_State *L)
 	dead_time = time(NULL) - IDLE_TIMEOUT;
 	for (int i = 0; i < h->thread_live; i++) {
 		struct thread_context *ctx = h->table[i];
-		if (max_kill > 0 && try_kill_thread(ctx, dead_time)) {
+		if (max_kill > 0 && try_kill_thread(h, ctx, dead_time)) {
 			max_kill--;
 			*tail = ctx;
 			tail = &ctx->next;
@@ -501,6 +595,7 @@ static int lspawn(lua_State *L)
 	w->next = NULL;
 	w->task_id = 0;
 	w->pcall_status = 0;
+	w->push_ns = 0;
 	if (luaL_newmetatable(L, MT_WORKER)) {
 		lua_pushstring(L, "__gc");
 		lua_pushcfunction(L, l_worker_gc);
@@ -544,12 +639,58 @@ static int lpush(lua_State *L)
 	return 1;
 }
 
+static int lpop(lua_State *L)
+{
+	int n;
+	struct worker *w;
+	struct hive *h = (struct hive *)(lua_touserdata(
+		L, lua_upvalueindex(UPVAL_HIVE)));
+	pthread_mutex_lock(&h->done_lock);
+	w = h->done_head;
+	if (w != NULL) {
+		h->done_head = w->next;
+		if (h->done_head == NULL)
+			h->done_tail = &h->done_head;
+	} else {
+		// the next finished task must send a new DONE message
+		h->done_pending = 0;
+	}
+	pthread_mutex_unlock(&h->done_lock);
+	if (w == NULL)
+		return 0;
+	w->next = NULL;
+	lua_pushinteger(L, w->task_id);
+	lua_pushboolean(L, w->pcall_status == LUA_OK);
+	if (w->pcall_status != LUA_OK) {
+		n = 1;
+		copy_value(w->L, L, -1);
+	} else {
+		n = lua_gettop(w->L);
+		copy_values(w->L, L, 2, n);
+		n = n - 1;
+	}
+	lua_settop(w->L, 1);
+	w->task_id = 0;
+	return n + 2;
+}
+
 static int lthreads(lua_State *L)
 {
 	struct hive *h = (struct hive *)(lua_touserdata(
 		L, lua_upvalueindex(UPVAL_HIVE)));
 	lua_pushinteger(L, h->thread_live);
-	return 1;
+	lua_createtable(L, 0, 5);
+	lua_pushinteger(L, load(&h->thread_busy));
+	lua_setfield(L, -2, "busy");
+	lua_pushinteger(L, load(&h->worker_waiting));
+	lua_setfield(L, -2, "queue");
+	lua_pushinteger(L, (lua_Integer)load(&h->tasks));
+	lua_setfield(L, -2, "tasks");
+	lua_pushinteger(L, (lua_Integer)load(&h->wait_ns));
+	lua_setfield(L, -2, "wait_ns");
+	lua_pushinteger(L, (lua_Integer)load(&h->run_ns));
+	lua_setfield(L, -2, "run_ns");
+	return 2;
 }
 
 SILLY_MOD_API int luaopen_silly_hive_c(lua_State *L)
@@ -559,6 +700,7 @@ SILLY_MOD_API int luaopen_silly_hive_c(lua_State *L)
                 { "prune",   lprune   },
 		{ "spawn",   lspawn   },
                 { "push",    lpush    },
+		{ "pop",     lpop     },
 		{ "threads", lthreads },
                 { NULL,      NULL     }
 	};
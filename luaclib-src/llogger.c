@@ -21,6 +21,7 @@
 #define LOG_TABLE_DEEP (5)
 
 #define BUF_UPVALUE lua_upvalueindex(1)
+#define LIMIT_UPVALUE lua_upvalueindex(2)
 
 /* Use cbuf as the log buffer (lazy allocation, 1024 initial capacity) */
 #define CBUF_INIT_SIZE 1024
@@ -161,6 +162,242 @@ static inline void log_file_line(lua_State *L, struct cbuf *b)
 	}
 }
 
+/* ---- binary items (--log-format=binary) ---- */
+
+static inline void bin_addu32(struct cbuf *b, uint32_t n)
+{
+	cbuf_addlstr(b, (const char *)&n, sizeof(n));
+}
+
+static inline void bin_addstr(struct cbuf *b, int tag, const char *s,
+			      size_t len)
+{
+	cbuf_addchar(b, (char)tag);
+	bin_addu32(b, (uint32_t)len);
+	cbuf_addlstr(b, s, len);
+}
+
+/* Copy the raw value, rendering only what can change after the call */
+static void bin_field(lua_State *L, struct cbuf *b, int stk)
+{
+	size_t pos;
+	uint32_t len;
+	int type = lua_type(L, stk);
+	switch (type) {
+	case LUA_TNUMBER:
+		if (lua_isinteger(L, stk)) {
+			int64_t n = (int64_t)lua_tointeger(L, stk);
+			cbuf_addchar(b, SILLY_LOG_INT);
+			cbuf_addlstr(b, (const char *)&n, sizeof(n));
+		} else {
+			double n = (double)lua_tonumber(L, stk);
+			cbuf_addchar(b, SILLY_LOG_NUM);
+			cbuf_addlstr(b, (const char *)&n, sizeof(n));
+		}
+		break;
+	case LUA_TBOOLEAN:
+		cbuf_addchar(b, lua_toboolean(L, stk) ? SILLY_LOG_TRUE :
+							SILLY_LOG_FALSE);
+		break;
+	case LUA_TNIL:
+		cbuf_addchar(b, SILLY_LOG_NIL);
+		break;
+	default: /* strings as is, tables and the rest as text */
+		cbuf_addchar(b, SILLY_LOG_STR);
+		pos = b->len;
+		bin_addu32(b, 0);
+		log_field(L, b, stk, type, 0);
+		len = (uint32_t)(b->len - pos - sizeof(len));
+		memcpy(b->data + pos, &len, sizeof(len));
+		break;
+	}
+}
+
+static inline void bin_file_line(lua_State *L, struct cbuf *b)
+{
+	lua_Debug ar;
+	if (lua_getstack(L, 1, &ar)) {
+		lua_getinfo(L, "Sl", &ar);
+		if (ar.currentline > 0) {
+			size_t len = strlen(ar.short_src);
+			cbuf_addchar(b, SILLY_LOG_SRC);
+			bin_addu32(b, (uint32_t)ar.currentline);
+			bin_addu32(b, (uint32_t)len);
+			cbuf_addlstr(b, ar.short_src, len);
+		}
+	}
+}
+
+/* ---- per call site rate limiting ---- */
+
+/*
+** Every call site (source + line of the caller) or user key owns a token
+** bucket refilled at 'rate' lines per second up to 'burst'. A suppressed
+** line costs a lookup only, it is neither formatted nor queued. Sites
+** are never freed; past LOG_LIMIT_SITES new sites are not limited.
+*/
+struct site {
+	struct site *next;
+	const void *source; /* ar.source of the call site, NULL for a key */
+	int line;
+	unsigned int hash;
+	enum silly_log_level level; /* highest level seen, for the summary */
+	double tokens;
+	uint64_t stamp;
+	uint64_t suppressed; /* since the last summary */
+	uint64_t total;
+	char name[1];
+};
+
+struct limiter {
+	double rate; /* 0: off */
+	double burst;
+	int count;
+	int size;
+	struct site **slots;
+};
+
+static int limiter_gc(lua_State *L)
+{
+	int i;
+	struct limiter *lim = (struct limiter *)lua_touserdata(L, 1);
+	for (i = 0; i < lim->size; i++) {
+		struct site *s = lim->slots[i];
+		while (s != NULL) {
+			struct site *next = s->next;
+			silly_free(s);
+			s = next;
+		}
+	}
+	silly_free(lim->slots);
+	lim->slots = NULL;
+	lim->size = 0;
+	return 0;
+}
+
+static void limiter_grow(struct limiter *lim)
+{
+	int i;
+	int size = lim->size * 2;
+	struct site **slots = silly_malloc(size * sizeof(*slots));
+	memset(slots, 0, size * sizeof(*slots));
+	for (i = 0; i < lim->size; i++) {
+		struct site *s = lim->slots[i];
+		while (s != NULL) {
+			struct site *next = s->next;
+			s->next = slots[s->hash & (size - 1)];
+			slots[s->hash & (size - 1)] = s;
+			s = next;
+		}
+	}
+	silly_free(lim->slots);
+	lim->slots = slots;
+	lim->size = size;
+}
+
+static struct site *site_new(struct limiter *lim, unsigned int hash,
+			     const char *name, size_t len)
+{
+	struct site *s;
+	if (lim->count >= LOG_LIMIT_SITES)
+		return NULL;
+	if (lim->count >= lim->size)
+		limiter_grow(lim);
+	s = silly_malloc(sizeof(*s) + len);
+	memset(s, 0, sizeof(*s));
+	memcpy(s->name, name, len);
+	s->name[len] = '\0';
+	s->hash = hash;
+	s->tokens = lim->burst;
+	s->stamp = silly_monotonic();
+	s->next = lim->slots[hash & (lim->size - 1)];
+	lim->slots[hash & (lim->size - 1)] = s;
+	lim->count++;
+	return s;
+}
+
+static struct site *site_of_caller(lua_State *L, struct limiter *lim)
+{
+	int n;
+	char name[PATH_MAX + 32];
+	struct site *s;
+	unsigned int hash;
+	lua_Debug ar;
+	if (!lua_getstack(L, 1, &ar))
+		return NULL;
+	lua_getinfo(L, "Sl", &ar);
+	hash = (unsigned int)((uintptr_t)ar.source >> 3) ^
+	       ((unsigned int)ar.currentline * 2654435761u);
+	for (s = lim->slots[hash & (lim->size - 1)]; s != NULL; s = s->next) {
+		if (s->source == ar.source && s->line == ar.currentline)
+			return s;
+	}
+	n = snprintf(name, sizeof(name), "%s:%d", ar.short_src,
+		     ar.currentline);
+	if (n < 0 || (size_t)n >= sizeof(name))
+		return NULL;
+	s = site_new(lim, hash, name, n);
+	if (s != NULL) {
+		s->source = ar.source;
+		s->line = ar.currentline;
+	}
+	return s;
+}
+
+static struct site *site_of_key(struct limiter *lim, const char *key,
+				size_t len)
+{
+	size_t i;
+	struct site *s;
+	unsigned int hash = 2166136261u;
+	for (i = 0; i < len; i++)
+		hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+	for (s = lim->slots[hash & (lim->size - 1)]; s != NULL; s = s->next) {
+		if (s->source == NULL && strlen(s->name) == len &&
+		    memcmp(s->name, key, len) == 0)
+			return s;
+	}
+	return site_new(lim, hash, key, len);
+}
+
+static void site_summary(struct site *s)
+{
+	silly_log_(s->level, "[logger] %s suppressed %llu messages\n", s->name,
+		   (unsigned long long)s->suppressed);
+	s->suppressed = 0;
+}
+
+static int site_take(struct limiter *lim, struct site *s,
+		     enum silly_log_level level)
+{
+	uint64_t now = silly_monotonic();
+	s->tokens += (double)(now - s->stamp) * lim->rate / 1000.0;
+	if (s->tokens > lim->burst)
+		s->tokens = lim->burst;
+	s->stamp = now;
+	if (level > s->level)
+		s->level = level;
+	if (s->tokens >= 1.0) {
+		s->tokens -= 1.0;
+		if (s->suppressed > 0)
+			site_summary(s);
+		return 1;
+	}
+	s->suppressed++;
+	s->total++;
+	return 0;
+}
+
+static inline int log_allow(lua_State *L, enum silly_log_level level)
+{
+	struct site *s;
+	struct limiter *lim = (struct limiter *)lua_touserdata(L, LIMIT_UPVALUE);
+	if (likely(lim->rate <= 0.0))
+		return 1;
+	s = site_of_caller(L, lim);
+	return s == NULL || site_take(lim, s, level);
+}
+
 /* ---- log entry formatting ---- */
 
 /// log(...)
@@ -168,11 +405,20 @@ static int llog(lua_State *L, enum silly_log_level log_level)
 {
 	int stk, top;
 	struct cbuf *b = (struct cbuf *)lua_touserdata(L, BUF_UPVALUE);
-	if (!silly_log_visible(log_level)) {
+	if (!silly_log_visible(log_level) || !log_allow(L, log_level)) {
 		return 0;
 	}
 	top = lua_gettop(L);
 	cbuf_reset(b);
+	if (silly_log_binary()) {
+#ifdef LOG_ENABLE_FILE_LINE
+		bin_file_line(L, b);
+#endif
+		for (stk = 1; stk <= top; stk++)
+			bin_field(L, b, stk);
+		silly_log_writeb(log_level, b->data, b->len);
+		return 0;
+	}
 #ifdef LOG_ENABLE_FILE_LINE
 	log_file_line(L, b);
 #endif
@@ -186,6 +432,42 @@ static int llog(lua_State *L, enum silly_log_level log_level)
 	return 0;
 }
 
+static void logf_invalid(lua_State *L, char c)
+{
+	const char *err = "invalid option '%%%c' to 'format', only support '%%s'";
+	luaL_error(L, err, c);
+}
+
+/* The format travels as is, its '%s' are checked and filled by items */
+static int bin_logf(lua_State *L, struct cbuf *b, enum silly_log_level level,
+		    const struct luastr *fmt)
+{
+	int arg = 1;
+	int top = lua_gettop(L);
+	const char *strfmt = (const char *)fmt->str;
+	const char *strfmt_end = strfmt + fmt->len;
+#ifdef LOG_ENABLE_FILE_LINE
+	bin_file_line(L, b);
+#endif
+	bin_addstr(b, SILLY_LOG_FMT, strfmt, fmt->len);
+	while (strfmt < strfmt_end) {
+		if (*strfmt++ != LOG_ESC)
+			continue;
+		if (*strfmt == LOG_ESC) { /* %% */
+			strfmt++;
+			continue;
+		}
+		if (*strfmt != 's')
+			logf_invalid(L, *strfmt);
+		++strfmt;
+		if (++arg > top)
+			luaL_error(L, "no value");
+		bin_field(L, b, arg);
+	}
+	silly_log_writeb(level, b->data, b->len);
+	return 0;
+}
+
 /// logf(fmt, ...)
 static int llogf(lua_State *L, enum silly_log_level log_level)
 {
@@ -194,15 +476,17 @@ static int llogf(lua_State *L, enum silly_log_level log_level)
 	struct luastr fmt;
 	struct cbuf *b = (struct cbuf *)lua_touserdata(L, BUF_UPVALUE);
 	const char *strfmt, *strfmt_end;
-	if (!silly_log_visible(log_level)) {
+	if (!silly_log_visible(log_level) || !log_allow(L, log_level)) {
 		return 0;
 	}
 	top = lua_gettop(L);
 	cbuf_reset(b);
+	luastr_check(L, 1, &fmt);
+	if (silly_log_binary())
+		return bin_logf(L, b, log_level, &fmt);
 #ifdef LOG_ENABLE_FILE_LINE
 	log_file_line(L, b);
 #endif
-	luastr_check(L, 1, &fmt);
 	strfmt = (const char *)fmt.str;
 	strfmt_end = strfmt + fmt.len;
 	while (strfmt < strfmt_end) {
@@ -211,12 +495,8 @@ static int llogf(lua_State *L, enum silly_log_level log_level)
 		} else if (*++strfmt == LOG_ESC) {
 			cbuf_addchar(b, *strfmt++); /* %% */
 		} else { /* format item */
-			if (*strfmt != 's') {
-				const char *err = "invalid option "
-						  "'%%%c' to 'format',"
-						  " only support '%%s'";
-				luaL_error(L, err, *strfmt);
-			}
+			if (*strfmt != 's')
+				logf_invalid(L, *strfmt);
 			++strfmt;
 			if (++arg > top) {
 				luaL_error(L, "no value");
@@ -253,6 +533,69 @@ static int lsetlevel(lua_State *L)
 	return 0;
 }
 
+/// ratelimit(rate, burst)
+static int lratelimit(lua_State *L)
+{
+	struct limiter *lim = (struct limiter *)lua_touserdata(L, LIMIT_UPVALUE);
+	lua_Number rate = luaL_checknumber(L, 1);
+	lua_Number burst = luaL_optnumber(L, 2, rate);
+	luaL_argcheck(L, rate >= 0, 1, "rate must be >= 0");
+	luaL_argcheck(L, rate == 0 || burst >= 1, 2, "burst must be >= 1");
+	lim->rate = rate;
+	lim->burst = burst;
+	return 0;
+}
+
+/// allow(key [, level]) -> boolean
+static int lallow(lua_State *L)
+{
+	size_t len;
+	struct site *s;
+	struct limiter *lim = (struct limiter *)lua_touserdata(L, LIMIT_UPVALUE);
+	const char *key = luaL_checklstring(L, 1, &len);
+	int level = (int)luaL_optinteger(L, 2, SILLY_LOG_WARN);
+	if (lim->rate <= 0.0) {
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	s = site_of_key(lim, key, len);
+	lua_pushboolean(L, s == NULL || site_take(lim, s, level));
+	return 1;
+}
+
+/// report(): write a summary for every site suppressing lines
+static int lreport(lua_State *L)
+{
+	int i;
+	struct limiter *lim = (struct limiter *)lua_touserdata(L, LIMIT_UPVALUE);
+	for (i = 0; i < lim->size; i++) {
+		struct site *s;
+		for (s = lim->slots[i]; s != NULL; s = s->next) {
+			if (s->suppressed > 0)
+				site_summary(s);
+		}
+	}
+	return 0;
+}
+
+/// suppressed() -> {[site] = total}
+static int lsuppressed(lua_State *L)
+{
+	int i;
+	struct limiter *lim = (struct limiter *)lua_touserdata(L, LIMIT_UPVALUE);
+	lua_newtable(L);
+	for (i = 0; i < lim->size; i++) {
+		struct site *s;
+		for (s = lim->slots[i]; s != NULL; s = s->next) {
+			if (s->total == 0)
+				continue;
+			lua_pushinteger(L, (lua_Integer)s->total);
+			lua_setfield(L, -2, s->name);
+		}
+	}
+	return 1;
+}
+
 static int ldebug(lua_State *L)
 {
 	return llog(L, SILLY_LOG_DEBUG);
@@ -296,23 +639,29 @@ static int lerrorf(lua_State *L)
 SILLY_MOD_API int luaopen_silly_logger_c(lua_State *L)
 {
 	luaL_Reg tbl[] = {
-		{ "openfile", lopenfile },
-		{ "getlevel", lgetlevel },
-		{ "setlevel", lsetlevel },
+		{ "openfile",   lopenfile   },
+		{ "getlevel",   lgetlevel   },
+		{ "setlevel",   lsetlevel   },
+		// rate limiting
+		{ "ratelimit",  lratelimit  },
+		{ "allow",      lallow      },
+		{ "report",     lreport     },
+		{ "suppressed", lsuppressed },
 		// log print
-		{ "debug",    ldebug    },
-		{ "info",     linfo     },
-		{ "warn",     lwarn     },
-		{ "error",    lerror    },
+		{ "debug",      ldebug      },
+		{ "info",       linfo       },
+		{ "warn",       lwarn       },
+		{ "error",      lerror      },
 		// log printf
-		{ "debugf",   ldebugf   },
-		{ "infof",    linfof    },
-		{ "warnf",    lwarnf    },
-		{ "errorf",   lerrorf   },
+		{ "debugf",     ldebugf     },
+		{ "infof",      linfof      },
+		{ "warnf",      lwarnf      },
+		{ "errorf",     lerrorf     },
 		//end
-		{ NULL,       NULL      },
+		{ NULL,         NULL        },
 	};
 	struct cbuf *b;
+	struct limiter *lim;
 	luaL_checkversion(L);
 	luaL_newlibtable(L, tbl);
 	/* create logger_buf userdata as shared upvalue */
@@ -323,8 +672,18 @@ SILLY_MOD_API int luaopen_silly_logger_c(lua_State *L)
 	lua_pushcfunction(L, lbuf_gc);
 	lua_setfield(L, -2, "__gc");
 	lua_setmetatable(L, -2);
-	/* stack: lib, udata */
-	luaL_setfuncs(L, tbl, 1);
+	/* create the rate limiter userdata as the second upvalue */
+	lim = (struct limiter *)lua_newuserdatauv(L, sizeof(*lim), 0);
+	memset(lim, 0, sizeof(*lim));
+	lim->size = 64;
+	lim->slots = silly_malloc(lim->size * sizeof(*lim->slots));
+	memset(lim->slots, 0, lim->size * sizeof(*lim->slots));
+	lua_newtable(L);
+	lua_pushcfunction(L, limiter_gc);
+	lua_setfield(L, -2, "__gc");
+	lua_setmetatable(L, -2);
+	/* stack: lib, udata, udata */
+	luaL_setfuncs(L, tbl, 2);
 	/* stack: lib */
 	return 1;
 }
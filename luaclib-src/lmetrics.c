@@ -7,6 +7,7 @@
 #include <stddef.h>
 #include <dirent.h>
 #include <string.h>
+#include <math.h>
 #include <sys/time.h>
 #include <lua.h>
 #include <lualib.h>
@@ -75,6 +76,32 @@ static int lworkerstat(lua_State *L)
 	return 1;
 }
 
+static int lgcstat(lua_State *L)
+{
+	struct silly_gcstat stat;
+	silly_gcstat(&stat);
+	lua_pushinteger(L, stat.dispatch);
+	lua_pushinteger(L, stat.idle_steps);
+	lua_pushinteger(L, stat.idle_cycles);
+	lua_pushinteger(L, stat.idle_ns);
+	lua_pushinteger(L, stat.throttled);
+	return 5;
+}
+
+static int llogstat(lua_State *L)
+{
+	struct silly_logstat stat;
+	silly_logstat(&stat);
+	lua_pushinteger(L, stat.written_bytes);
+	lua_pushinteger(L, stat.dropped_bytes);
+	lua_pushinteger(L, stat.dropped_lines);
+	lua_pushinteger(L, stat.blocked);
+	lua_pushinteger(L, stat.flushes);
+	lua_pushinteger(L, stat.flush_ns);
+	lua_pushinteger(L, stat.flush_ns_max);
+	return 7;
+}
+
 static inline void table_set_int(lua_State *L, int table, const char *k,
 				 lua_Integer v)
 {
@@ -129,6 +156,534 @@ static int lsocketstat(lua_State *L)
 	return 1;
 }
 
+static const char *close_reason[] = {
+	[SILLY_PEER_CLOSE_LOCAL] = "local",
+	[SILLY_PEER_CLOSE_EOF] = "eof",
+	[SILLY_PEER_CLOSE_RESET] = "reset",
+	[SILLY_PEER_CLOSE_TIMEOUT] = "timeout",
+	[SILLY_PEER_CLOSE_REFUSED] = "refused",
+	[SILLY_PEER_CLOSE_ERROR] = "error",
+};
+
+static int lpeerstat(lua_State *L)
+{
+	int i, j;
+	struct silly_peerstat stat;
+	lua_newtable(L);
+	for (i = 0; silly_peerstat(i, &stat); i++) {
+		lua_createtable(L, 0, 14);
+		table_set_str(L, -1, "kind", stat.kind);
+		table_set_str(L, -1, "addr", stat.addr);
+		table_set_int(L, -1, "opens", stat.opens);
+		table_set_int(L, -1, "sent_bytes", stat.sent_bytes);
+		table_set_int(L, -1, "received_bytes", stat.received_bytes);
+		table_set_int(L, -1, "eagain", stat.eagain);
+		table_set_int(L, -1, "drains", stat.drains);
+		table_set_int(L, -1, "drain_ns", stat.drain_ns);
+		table_set_int(L, -1, "wlist_max", stat.wlist_max);
+		table_set_int(L, -1, "retransmits", stat.retransmits);
+		table_set_int(L, -1, "rtt_us", stat.rtt_us);
+		table_set_int(L, -1, "cwnd", stat.cwnd);
+		lua_createtable(L, 0, SILLY_PEER_CLOSE_COUNT);
+		for (j = 0; j < SILLY_PEER_CLOSE_COUNT; j++)
+			table_set_int(L, -1, close_reason[j], stat.closes[j]);
+		lua_setfield(L, -2, "closes");
+		lua_rawseti(L, -2, i + 1);
+	}
+	return 1;
+}
+
+static int ltcpinfo(lua_State *L)
+{
+	int enable = lua_toboolean(L, 1);
+	lua_pushboolean(L, silly_socket_tcpinfo(enable) == 0);
+	return 1;
+}
+
+/* ---- silly.metrics.native: handles to the C metric registry ---- */
+
+#define MT_COUNTER "silly.metrics.native.counter"
+#define MT_GAUGE "silly.metrics.native.gauge"
+#define MT_HISTOGRAM "silly.metrics.native.histogram"
+#define MT_LOGHIST "silly.metrics.native.loghistogram"
+#define MT_SNAPSHOT "silly.metrics.native.snapshot"
+#define LABEL_MAX (32)
+#define QUANTILE_MAX (32)
+
+static const char *metatable_of[] = {
+	[SILLY_METRIC_COUNTER] = MT_COUNTER,
+	[SILLY_METRIC_GAUGE] = MT_GAUGE,
+	[SILLY_METRIC_HISTOGRAM] = MT_HISTOGRAM,
+	[SILLY_METRIC_LOGHIST] = MT_LOGHIST,
+};
+
+/* a family, or one series of it once 's' is resolved */
+struct handle {
+	struct silly_metric *m;
+	struct silly_metric_series *s;
+};
+
+/* the buckets of one or more series of the same layout */
+struct snapshot {
+	const struct silly_metric_desc *desc;
+	struct silly_metric_sample sample;
+	uint64_t counts[];
+};
+
+static inline int bucketed(enum silly_metric_kind kind)
+{
+	return kind == SILLY_METRIC_HISTOGRAM || kind == SILLY_METRIC_LOGHIST;
+}
+
+static void handle_push(lua_State *L, struct silly_metric *m,
+			struct silly_metric_series *s)
+{
+	const struct silly_metric_desc *desc = silly_metric_desc(m);
+	struct handle *h = (struct handle *)lua_newuserdatauv(L, sizeof(*h), 0);
+	h->m = m;
+	h->s = s;
+	luaL_setmetatable(L, metatable_of[desc->kind]);
+}
+
+static struct silly_metric_series *series_of(lua_State *L, const char *mt)
+{
+	struct handle *h = (struct handle *)luaL_checkudata(L, 1, mt);
+	if (unlikely(h->s == NULL)) {
+		luaL_error(L, "metric '%s' has labels, resolve them by labels()",
+			   silly_metric_desc(h->m)->name);
+	}
+	return h->s;
+}
+
+static double opt_number(lua_State *L, int opts, const char *k)
+{
+	double v;
+	lua_getfield(L, opts, k);
+	v = luaL_optnumber(L, -1, 0);
+	lua_pop(L, 1);
+	return v;
+}
+
+/* loghistogram(name, help, labels, {min, max, precision, quantiles, window}) */
+static void loghist_opts(lua_State *L, struct silly_metric_desc *desc,
+			 double *quantiles)
+{
+	int n;
+	if (lua_isnoneornil(L, 4))
+		return;
+	luaL_checktype(L, 4, LUA_TTABLE);
+	desc->min = opt_number(L, 4, "min");
+	desc->max = opt_number(L, 4, "max");
+	desc->precision = (int)opt_number(L, 4, "precision");
+	desc->window = opt_number(L, 4, "window");
+	if (lua_getfield(L, 4, "quantiles") == LUA_TTABLE) {
+		n = (int)lua_rawlen(L, -1);
+		luaL_argcheck(L, n <= QUANTILE_MAX, 4, "too many quantiles");
+		for (int i = 0; i < n; i++) {
+			lua_rawgeti(L, -1, i + 1);
+			quantiles[i] = luaL_checknumber(L, -1);
+			lua_pop(L, 1);
+		}
+		desc->quantilecount = n;
+		desc->quantiles = quantiles;
+	}
+	lua_pop(L, 1);
+}
+
+static int new_metric(lua_State *L, enum silly_metric_kind kind)
+{
+	int n = 0;
+	struct silly_metric *m;
+	struct silly_metric_desc desc;
+	const char *labelnames[LABEL_MAX];
+	double quantiles[QUANTILE_MAX];
+	memset(&desc, 0, sizeof(desc));
+	desc.kind = kind;
+	desc.name = luaL_checkstring(L, 1);
+	desc.help = luaL_optstring(L, 2, "");
+	if (!lua_isnoneornil(L, 3)) {
+		luaL_checktype(L, 3, LUA_TTABLE);
+		n = (int)lua_rawlen(L, 3);
+		luaL_argcheck(L, n <= LABEL_MAX, 3, "too many labels");
+		for (int i = 0; i < n; i++) {
+			if (lua_rawgeti(L, 3, i + 1) != LUA_TSTRING)
+				luaL_argerror(L, 3, "label names must be strings");
+			labelnames[i] = lua_tostring(L, -1);
+			lua_pop(L, 1); // still referenced by the table
+		}
+	}
+	desc.labelcount = n;
+	desc.labelnames = labelnames;
+	if (kind == SILLY_METRIC_HISTOGRAM && !lua_isnoneornil(L, 4)) {
+		double *buckets;
+		luaL_checktype(L, 4, LUA_TTABLE);
+		n = (int)lua_rawlen(L, 4);
+		buckets = (double *)lua_newuserdatauv(L, n * sizeof(double), 0);
+		for (int i = 0; i < n; i++) {
+			lua_rawgeti(L, 4, i + 1);
+			buckets[i] = luaL_checknumber(L, -1);
+			lua_pop(L, 1);
+		}
+		desc.bucketcount = n;
+		desc.buckets = buckets;
+	}
+	if (kind == SILLY_METRIC_LOGHIST)
+		loghist_opts(L, &desc, quantiles);
+	m = silly_metric_new(&desc);
+	if (m == NULL) {
+		return luaL_error(L, "metric '%s' has invalid options or is "
+				     "registered with another type, labels "
+				     "or buckets",
+				  desc.name);
+	}
+	handle_push(L, m, desc.labelcount == 0 ?
+		    silly_metric_series(m, NULL) : NULL);
+	return 1;
+}
+
+static int lnative_counter(lua_State *L)
+{
+	return new_metric(L, SILLY_METRIC_COUNTER);
+}
+
+static int lnative_gauge(lua_State *L)
+{
+	return new_metric(L, SILLY_METRIC_GAUGE);
+}
+
+static int lnative_histogram(lua_State *L)
+{
+	return new_metric(L, SILLY_METRIC_HISTOGRAM);
+}
+
+static int lnative_loghistogram(lua_State *L)
+{
+	return new_metric(L, SILLY_METRIC_LOGHIST);
+}
+
+static int lnative_labels(lua_State *L)
+{
+	const char *values[LABEL_MAX];
+	struct handle *h;
+	const struct silly_metric_desc *desc;
+	h = (struct handle *)luaL_checkudata(L, 1,
+		lua_tostring(L, lua_upvalueindex(1)));
+	desc = silly_metric_desc(h->m);
+	if (lua_gettop(L) - 1 != desc->labelcount) {
+		return luaL_error(L, "metric '%s' expects %d label values",
+				  desc->name, desc->labelcount);
+	}
+	for (int i = 0; i < desc->labelcount; i++)
+		values[i] = luaL_checkstring(L, i + 2);
+	handle_push(L, h->m, silly_metric_series(h->m, values));
+	return 1;
+}
+
+static int lcounter_inc(lua_State *L)
+{
+	silly_metric_add(series_of(L, MT_COUNTER), 1.0);
+	return 0;
+}
+
+static int lcounter_add(lua_State *L)
+{
+	struct silly_metric_series *s = series_of(L, MT_COUNTER);
+	lua_Number v = luaL_checknumber(L, 2);
+	luaL_argcheck(L, v >= 0, 2, "counter can only increase");
+	silly_metric_add(s, v);
+	return 0;
+}
+
+static int lgauge_set(lua_State *L)
+{
+	struct silly_metric_series *s = series_of(L, MT_GAUGE);
+	silly_metric_set(s, luaL_checknumber(L, 2));
+	return 0;
+}
+
+static int lgauge_add(lua_State *L)
+{
+	struct silly_metric_series *s = series_of(L, MT_GAUGE);
+	silly_metric_add(s, luaL_checknumber(L, 2));
+	return 0;
+}
+
+static int lgauge_sub(lua_State *L)
+{
+	struct silly_metric_series *s = series_of(L, MT_GAUGE);
+	silly_metric_add(s, -luaL_checknumber(L, 2));
+	return 0;
+}
+
+static int lgauge_inc(lua_State *L)
+{
+	silly_metric_add(series_of(L, MT_GAUGE), 1.0);
+	return 0;
+}
+
+static int lgauge_dec(lua_State *L)
+{
+	silly_metric_add(series_of(L, MT_GAUGE), -1.0);
+	return 0;
+}
+
+static int lhistogram_observe(lua_State *L)
+{
+	struct silly_metric_series *s = series_of(L, MT_HISTOGRAM);
+	silly_metric_observe(s, luaL_checknumber(L, 2));
+	return 0;
+}
+
+static int lloghist_observe(lua_State *L)
+{
+	struct silly_metric_series *s = series_of(L, MT_LOGHIST);
+	silly_metric_observe(s, luaL_checknumber(L, 2));
+	return 0;
+}
+
+static struct snapshot *snapshot_new(lua_State *L,
+				     const struct silly_metric_desc *desc)
+{
+	struct snapshot *snap;
+	size_t sz = sizeof(*snap) + desc->bucketcount * sizeof(uint64_t);
+	snap = (struct snapshot *)lua_newuserdatauv(L, sz, 0);
+	memset(snap, 0, sz);
+	snap->desc = desc;
+	snap->sample.buckets = snap->counts;
+	luaL_setmetatable(L, MT_SNAPSHOT);
+	return snap;
+}
+
+/* h:snapshot(), the summed buckets of the series at this moment */
+static int lnative_snapshot(lua_State *L)
+{
+	const char *mt = lua_tostring(L, lua_upvalueindex(1));
+	struct silly_metric_series *s = series_of(L, mt);
+	struct handle *h = (struct handle *)lua_touserdata(L, 1);
+	struct snapshot *snap = snapshot_new(L, silly_metric_desc(h->m));
+	silly_metric_read(s, &snap->sample);
+	return 1;
+}
+
+static struct snapshot *check_snapshot(lua_State *L, int idx)
+{
+	return (struct snapshot *)luaL_checkudata(L, idx, MT_SNAPSHOT);
+}
+
+static int same_buckets(const struct silly_metric_desc *a,
+			const struct silly_metric_desc *b)
+{
+	if (a == b)
+		return 1;
+	return a->bucketcount == b->bucketcount &&
+	       memcmp(a->buckets, b->buckets,
+		      a->bucketcount * sizeof(double)) == 0;
+}
+
+// snap:merge(other), adds the other snapshot in place and returns snap
+static int lsnapshot_merge(lua_State *L)
+{
+	struct snapshot *a = check_snapshot(L, 1);
+	struct snapshot *b = check_snapshot(L, 2);
+	luaL_argcheck(L, same_buckets(a->desc, b->desc), 2,
+		      "snapshots have different buckets");
+	for (int i = 0; i < a->desc->bucketcount; i++)
+		a->counts[i] += b->counts[i];
+	a->sample.count += b->sample.count;
+	a->sample.sum += b->sample.sum;
+	lua_settop(L, 1);
+	return 1;
+}
+
+static int lsnapshot_quantile(lua_State *L)
+{
+	struct snapshot *snap = check_snapshot(L, 1);
+	double q = luaL_checknumber(L, 2);
+	luaL_argcheck(L, q >= 0 && q <= 1, 2, "quantile must be in [0, 1]");
+	lua_pushnumber(L, silly_metric_quantile(snap->desc, &snap->sample, q));
+	return 1;
+}
+
+static int lsnapshot_count(lua_State *L)
+{
+	struct snapshot *snap = check_snapshot(L, 1);
+	lua_pushinteger(L, (lua_Integer)snap->sample.count);
+	return 1;
+}
+
+static int lsnapshot_sum(lua_State *L)
+{
+	struct snapshot *snap = check_snapshot(L, 1);
+	lua_pushnumber(L, snap->sample.sum);
+	return 1;
+}
+
+static void push_value(lua_State *L, double v)
+{
+	if (v == floor(v) && fabs(v) < 9007199254740992.0) // 2^53
+		lua_pushinteger(L, (lua_Integer)v);
+	else
+		lua_pushnumber(L, v);
+}
+
+static inline int is_summary(const struct silly_metric_desc *desc)
+{
+	return desc->kind == SILLY_METRIC_LOGHIST && desc->quantilecount > 0;
+}
+
+/* scratch and shared tables of one family while it is collected */
+struct family_ctx {
+	const struct silly_metric_desc *desc;
+	uint64_t *counts;
+	double *quantiles;
+	int bounds; // stack index of the bucket bounds, or the quantiles
+};
+
+/*
+** fill 'tbl' in the shape of silly.metrics.counter/gauge/histogram, a
+** loghist with quantiles as {quantiles, quantilevalues, sum, count}
+*/
+static void push_sample(lua_State *L, struct family_ctx *ctx,
+			struct silly_metric_series *s, int tbl)
+{
+	const struct silly_metric_desc *desc = ctx->desc;
+	struct silly_metric_sample sample;
+	sample.value = 0;
+	sample.sum = 0;
+	sample.count = 0;
+	sample.buckets = ctx->counts;
+	if (bucketed(desc->kind))
+		memset(ctx->counts, 0, desc->bucketcount * sizeof(uint64_t));
+	if (s != NULL)
+		silly_metric_read(s, &sample);
+	if (!bucketed(desc->kind)) {
+		push_value(L, sample.value);
+		lua_setfield(L, tbl, "value");
+		return;
+	}
+	if (is_summary(desc)) {
+		int n = desc->quantilecount;
+		lua_pushvalue(L, ctx->bounds);
+		lua_setfield(L, tbl, "quantiles");
+		lua_createtable(L, n, 0);
+		if (s != NULL)
+			silly_metric_quantiles(s, ctx->quantiles);
+		for (int i = 0; i < n; i++) {
+			lua_pushnumber(L, s != NULL ? ctx->quantiles[i] : NAN);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, tbl, "quantilevalues");
+	} else {
+		lua_pushvalue(L, ctx->bounds);
+		lua_setfield(L, tbl, "buckets");
+		lua_createtable(L, desc->bucketcount, 0);
+		for (int i = 0; i < desc->bucketcount; i++) {
+			lua_pushinteger(L, (lua_Integer)ctx->counts[i]);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, tbl, "bucketcounts");
+	}
+	push_value(L, sample.sum);
+	lua_setfield(L, tbl, "sum");
+	lua_pushinteger(L, (lua_Integer)sample.count);
+	lua_setfield(L, tbl, "count");
+}
+
+static const char *kind_name(const struct silly_metric_desc *desc)
+{
+	switch (desc->kind) {
+	case SILLY_METRIC_COUNTER:
+		return "counter";
+	case SILLY_METRIC_GAUGE:
+		return "gauge";
+	default:
+		return is_summary(desc) ? "summary" : "histogram";
+	}
+}
+
+static void ctx_init(lua_State *L, struct family_ctx *ctx,
+		       const struct silly_metric_desc *desc)
+{
+	const double *v = desc->buckets;
+	int n = desc->bucketcount;
+	ctx->desc = desc;
+	ctx->counts = NULL;
+	ctx->quantiles = NULL;
+	ctx->bounds = 0;
+	if (!bucketed(desc->kind))
+		return;
+	ctx->counts = (uint64_t *)lua_newuserdatauv(L, n * sizeof(uint64_t), 0);
+	if (is_summary(desc)) {
+		ctx->quantiles = (double *)lua_newuserdatauv(
+			L, desc->quantilecount * sizeof(double), 0);
+		v = desc->quantiles;
+		n = desc->quantilecount;
+	}
+	lua_createtable(L, n, 0);
+	for (int i = 0; i < n; i++) {
+		lua_pushnumber(L, v[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+	ctx->bounds = lua_gettop(L);
+}
+
+/* collector interface: native:collect(buf), aggregates the shards */
+static int lnative_collect(lua_State *L)
+{
+	lua_Integer n;
+	struct silly_metric *m = NULL;
+	luaL_checktype(L, 2, LUA_TTABLE);
+	n = (lua_Integer)lua_rawlen(L, 2);
+	while ((m = silly_metric_next(m)) != NULL) {
+		int tbl;
+		struct family_ctx ctx;
+		int top = lua_gettop(L);
+		const struct silly_metric_desc *desc = silly_metric_desc(m);
+		ctx_init(L, &ctx, desc);
+		lua_createtable(L, 0, 8);
+		tbl = lua_gettop(L);
+		lua_pushstring(L, desc->name);
+		lua_setfield(L, tbl, "name");
+		lua_pushstring(L, desc->help);
+		lua_setfield(L, tbl, "help");
+		lua_pushstring(L, kind_name(desc));
+		lua_setfield(L, tbl, "kind");
+		if (desc->labelcount == 0) {
+			struct silly_metric_series *s;
+			s = silly_metric_series_next(m, NULL);
+			push_sample(L, &ctx, s, tbl);
+		} else {
+			struct silly_metric_series *s = NULL;
+			lua_newtable(L);
+			while ((s = silly_metric_series_next(m, s)) != NULL) {
+				lua_createtable(L, 0, 4);
+				push_sample(L, &ctx, s, lua_gettop(L));
+				lua_setfield(L, -2, silly_metric_series_labels(s));
+			}
+			lua_setfield(L, tbl, "metrics");
+			if (ctx.bounds != 0) {
+				lua_pushvalue(L, ctx.bounds);
+				lua_setfield(L, tbl, is_summary(desc) ?
+					     "quantiles" : "buckets");
+			}
+		}
+		lua_pushvalue(L, tbl);
+		lua_rawseti(L, 2, ++n);
+		lua_settop(L, top);
+	}
+	return 0;
+}
+
+static void new_metatable(lua_State *L, const char *name, const luaL_Reg *tbl)
+{
+	luaL_newmetatable(L, name);
+	lua_newtable(L);
+	lua_pushstring(L, name);
+	luaL_setfuncs(L, tbl, 1);
+	lua_setfield(L, -2, "__index");
+	lua_pop(L, 1);
+}
+
 SILLY_MOD_API int luaopen_silly_metrics_c(lua_State *L)
 {
 	luaL_Reg tbl[] = {
@@ -141,9 +696,13 @@ SILLY_MOD_API int luaopen_silly_metrics_c(lua_State *L)
 		{ "jestat",          ljestat          },
 		//core
 		{ "workerstat",      lworkerstat      },
+		{ "gcstat",          lgcstat          },
+		{ "logstat",         llogstat         },
 		{ "timerstat",       ltimerstat       },
 		{ "netstat",         lnetstat         },
 		{ "socketstat",        lsocketstat      },
+		{ "peerstat",        lpeerstat        },
+		{ "tcpinfo",         ltcpinfo         },
 		//end
 		{ NULL,              NULL             },
 	};
@@ -151,4 +710,59 @@ SILLY_MOD_API int luaopen_silly_metrics_c(lua_State *L)
 	luaL_checkversion(L);
 	luaL_newlib(L, tbl);
 	return 1;
-}
\ No newline at end of file
+}
+
+SILLY_MOD_API int luaopen_silly_metrics_native(lua_State *L)
+{
+	luaL_Reg tbl[] = {
+		{ "counter",      lnative_counter      },
+		{ "gauge",        lnative_gauge        },
+		{ "histogram",    lnative_histogram    },
+		{ "loghistogram", lnative_loghistogram },
+		{ "collect",      lnative_collect      },
+		{ NULL,           NULL                 },
+	};
+	luaL_Reg counter[] = {
+		{ "labels", lnative_labels },
+		{ "inc",    lcounter_inc   },
+		{ "add",    lcounter_add   },
+		{ NULL,     NULL           },
+	};
+	luaL_Reg gauge[] = {
+		{ "labels", lnative_labels },
+		{ "set",    lgauge_set     },
+		{ "add",    lgauge_add     },
+		{ "sub",    lgauge_sub     },
+		{ "inc",    lgauge_inc     },
+		{ "dec",    lgauge_dec     },
+		{ NULL,     NULL           },
+	};
+	luaL_Reg histogram[] = {
+		{ "labels",   lnative_labels     },
+		{ "observe",  lhistogram_observe },
+		{ "snapshot", lnative_snapshot   },
+		{ NULL,       NULL               },
+	};
+	luaL_Reg loghist[] = {
+		{ "labels",   lnative_labels   },
+		{ "observe",  lloghist_observe },
+		{ "snapshot", lnative_snapshot },
+		{ NULL,       NULL             },
+	};
+	luaL_Reg snapshot[] = {
+		{ "merge",    lsnapshot_merge    },
+		{ "quantile", lsnapshot_quantile },
+		{ "count",    lsnapshot_count    },
+		{ "sum",      lsnapshot_sum      },
+		{ NULL,       NULL               },
+	};
+
+	luaL_checkversion(L);
+	new_metatable(L, MT_COUNTER, counter);
+	new_metatable(L, MT_GAUGE, gauge);
+	new_metatable(L, MT_HISTOGRAM, histogram);
+	new_metatable(L, MT_LOGHIST, loghist);
+	new_metatable(L, MT_SNAPSHOT, snapshot);
+	luaL_newlib(L, tbl);
+	return 1;
+}
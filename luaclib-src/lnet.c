@@ -40,6 +40,17 @@ static void multifinalizer(void *buff)
 	return;
 }
 
+static struct multicasthdr *multinew(const uint8_t *buf, size_t size,
+				     int refcount)
+{
+	struct multicasthdr *hdr;
+	hdr = (struct multicasthdr *)silly_malloc(size + MULTICAST_SIZE);
+	memcpy(hdr->data, buf, size);
+	hdr->mask = 'M';
+	hdr->ref = refcount;
+	return hdr;
+}
+
 static int lmultipack(lua_State *L)
 {
 	size_t size;
@@ -57,12 +68,9 @@ static int lmultipack(lua_State *L)
 		size = luaL_checkinteger(L, 2);
 	}
 	refcount = luaL_checkinteger(L, stk);
-	hdr = (struct multicasthdr *)silly_malloc(size + MULTICAST_SIZE);
-	memcpy(hdr->data, buf, size);
+	hdr = multinew(buf, size, refcount);
 	if (type != LUA_TSTRING)
 		silly_free(buf);
-	hdr->mask = 'M';
-	hdr->ref = refcount;
 	lua_pushlightuserdata(L, &hdr->data);
 	lua_pushinteger(L, size);
 	return 2;
@@ -117,6 +125,20 @@ static inline void *tablebuffer(lua_State *L, int idx, size_t *size)
 	return p;
 }
 
+// ok, err, paused: paused until the drain message of a watermark
+static int push_sendresult(lua_State *L, int err)
+{
+	if (err < 0) {
+		lua_pushboolean(L, 0);
+		push_error(L, -err);
+		return 2;
+	}
+	lua_pushboolean(L, 1);
+	lua_pushnil(L);
+	lua_pushboolean(L, err > 0);
+	return 3;
+}
+
 typedef silly_socket_id_t(connect_t)(const char *ip, const char *port,
 				     const char *bip, const char *bport);
 
@@ -186,14 +208,7 @@ static int ltcpsend(lua_State *L)
 				  lua_typename(L, 2));
 	}
 	err = silly_tcp_send(sid, buff, size, NULL);
-	if (err < 0) {
-		lua_pushboolean(L, 0);
-		push_error(L, -err);
-	} else {
-		lua_pushboolean(L, 1);
-		lua_pushnil(L);
-	}
-	return 2;
+	return push_sendresult(L, err);
 }
 
 static int ltcpmulticast(lua_State *L)
@@ -206,6 +221,59 @@ static int ltcpmulticast(lua_State *L)
 	buff = lua_touserdata(L, 2);
 	size = luaL_checkinteger(L, 3);
 	err = silly_tcp_send(sid, buff, size, multifinalizer);
+	return push_sendresult(L, err);
+}
+
+//one payload and one socket operation for all the sids,
+//the payload is released when the last of them has sent it
+static int lmulticast(lua_State *L)
+{
+	int i, n, type;
+	size_t size;
+	uint8_t *buf;
+	silly_socket_id_t *sids;
+	struct multicasthdr *hdr;
+	luaL_checktype(L, 1, LUA_TTABLE);
+	type = lua_type(L, 2);
+	if (type == LUA_TSTRING) {
+		buf = (uint8_t *)lua_tolstring(L, 2, &size);
+	} else {
+		luaL_checktype(L, 2, LUA_TLIGHTUSERDATA);
+		buf = lua_touserdata(L, 2);
+		size = luaL_checkinteger(L, 3);
+	}
+	n = (int)lua_rawlen(L, 1);
+	sids = lua_newuserdatauv(L, n * sizeof(*sids), 0);
+	for (i = 0; i < n; i++) {
+		lua_rawgeti(L, 1, i + 1);
+		sids[i] = luaL_checkinteger(L, -1);
+		lua_pop(L, 1);
+	}
+	if (n == 0) {
+		if (type != LUA_TSTRING)
+			silly_free(buf);
+		lua_pushinteger(L, 0);
+		return 1;
+	}
+	hdr = multinew(buf, size, n);
+	if (type != LUA_TSTRING)
+		silly_free(buf);
+	n = silly_tcp_multicast(sids, n, hdr->data, size, multifinalizer);
+	lua_pushinteger(L, n);
+	return 1;
+}
+
+static int ltcpwatermark(lua_State *L)
+{
+	int err;
+	silly_socket_id_t sid;
+	lua_Integer high, low;
+	sid = luaL_checkinteger(L, 1);
+	high = luaL_optinteger(L, 2, 0);
+	low = luaL_optinteger(L, 3, high / 2);
+	luaL_argcheck(L, high >= 0 && high <= UINT32_MAX, 2, "out of range");
+	luaL_argcheck(L, low >= 0 && low <= high, 3, "out of range");
+	err = silly_tcp_watermark(sid, high, low);
 	if (err < 0) {
 		lua_pushboolean(L, 0);
 		push_error(L, -err);
@@ -348,6 +416,7 @@ static void set_message_type(lua_State *L, int tbl)
 	SET("TCPDATA", msg_id->tcp_data);
 	SET("UDPDATA", msg_id->udp_data);
 	SET("CLOSE", msg_id->socket_close);
+	SET("DRAIN", msg_id->tcp_drain);
 #undef SET
 }
 
@@ -358,6 +427,8 @@ SILLY_MOD_API int luaopen_silly_net_c(lua_State *L)
 		{ "tcp_listen",    ltcplisten    },
 		{ "tcp_send",      ltcpsend      },
 		{ "tcp_multicast", ltcpmulticast },
+		{ "multicast",     lmulticast    },
+		{ "tcp_watermark", ltcpwatermark },
 		{ "udp_bind",      ludpbind      },
 		{ "udp_connect",   ludpconnect   },
 		{ "udp_send",      ludpsend      },
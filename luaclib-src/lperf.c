@@ -1,12 +1,21 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* dladdr */
+#endif
 #include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <errno.h>
 #include <lua.h>
 #include <lualib.h>
 #include <lauxlib.h>
 #include <time.h>
 #include "silly.h"
+#ifndef __WIN32
+#include <dlfcn.h>
+#endif
 #ifdef __macosx__
 #include <mach/mach_init.h>
 #include <mach/thread_act.h>
@@ -255,6 +264,560 @@ static int lhrtime(lua_State *L)
 	return 1;
 }
 
+/*
+** Sampling profilers. The worker arms a one-shot hook (from SIGPROF for the
+** CPU profiler, from the allocator for the allocation profiler) and calls
+** it at the next instruction/call/return of the running coroutine; every
+** sample is folded into "root;...;leaf" and counted in a hash table, so
+** memory grows with the number of distinct stacks, not with time.
+**
+** The bookkeeping uses libc malloc, so that the allocation profiler never
+** traces (or recurses into) its own allocations.
+*/
+#define SAMPLE_DEPTH (64)
+#define SAMPLE_KEYSIZE (4096)
+#define SAMPLE_MAXSTACKS (8192)
+#define SAMPLE_ROOT "worker_dispatch"
+#define ALLOC_PENDING (64)
+
+struct sample {
+	struct sample *next;
+	uint32_t hash;
+	uint64_t count;   // cpu: samples, alloc: sampled allocations
+	uint64_t bytes;   // alloc: estimated allocated bytes
+	uint64_t live;    // alloc: estimated bytes still in use
+	size_t len;
+	char stack[1];
+};
+
+struct stacks {
+	struct sample **slots;
+	size_t cap;
+	size_t count;
+	uint64_t dropped;
+};
+
+// a sampled allocation which is still alive
+struct liveobj {
+	struct liveobj *next;
+	const void *ptr;
+	struct sample *site;
+	size_t weight;
+};
+
+struct pending {
+	const void *ptr;
+	const void *caller;
+	size_t weight;
+};
+
+static char key[SAMPLE_KEYSIZE];
+
+static struct {
+	struct stacks t;
+	struct silly_profilestat base;
+} S;
+
+static struct {
+	struct stacks t;
+	size_t rate;
+	size_t acc;
+	uint64_t samples;
+	struct liveobj **slots;
+	size_t cap;
+	size_t count;
+	int npending;
+	struct pending pending[ALLOC_PENDING];
+} A;
+
+static uint32_t sample_hash(const char *str, size_t len)
+{
+	size_t i;
+	uint32_t h = 2166136261u;
+	for (i = 0; i < len; i++) {
+		h ^= (uint8_t)str[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static void stacks_rehash(struct stacks *t)
+{
+	size_t i, cap = t->cap == 0 ? 256 : t->cap * 2;
+	struct sample **slots = calloc(cap, sizeof(*slots));
+	for (i = 0; i < t->cap; i++) {
+		struct sample *s = t->slots[i];
+		while (s != NULL) {
+			struct sample *next = s->next;
+			size_t h = s->hash & (cap - 1);
+			s->next = slots[h];
+			slots[h] = s;
+			s = next;
+		}
+	}
+	free(t->slots);
+	t->slots = slots;
+	t->cap = cap;
+}
+
+//remove the stacks 'keep' returns false for, all of them if 'keep' is NULL
+static void stacks_clear(struct stacks *t, int (*keep)(struct sample *s))
+{
+	size_t i;
+	for (i = 0; i < t->cap; i++) {
+		struct sample **pp = &t->slots[i];
+		while (*pp != NULL) {
+			struct sample *s = *pp;
+			if (keep != NULL && keep(s)) {
+				pp = &s->next;
+				continue;
+			}
+			*pp = s->next;
+			free(s);
+			t->count--;
+		}
+	}
+	t->dropped = 0;
+	if (keep == NULL) {
+		free(t->slots);
+		t->slots = NULL;
+		t->cap = 0;
+	}
+}
+
+static struct sample *stacks_get(struct stacks *t, const char *str, size_t len)
+{
+	struct sample *s;
+	uint32_t hash = sample_hash(str, len);
+	if (t->count >= t->cap)
+		stacks_rehash(t);
+	for (s = t->slots[hash & (t->cap - 1)]; s != NULL; s = s->next) {
+		if (s->hash == hash && s->len == len &&
+		    memcmp(s->stack, str, len) == 0)
+			return s;
+	}
+	if (t->count >= SAMPLE_MAXSTACKS) {
+		t->dropped++;
+		return NULL;
+	}
+	s = malloc(offsetof(struct sample, stack) + len + 1);
+	memset(s, 0, offsetof(struct sample, stack));
+	s->hash = hash;
+	s->len = len;
+	memcpy(s->stack, str, len);
+	s->stack[len] = '\0';
+	s->next = t->slots[hash & (t->cap - 1)];
+	t->slots[hash & (t->cap - 1)] = s;
+	t->count++;
+	return s;
+}
+
+static size_t fold_frame(lua_State *L, lua_Debug *ar, size_t n)
+{
+	int w;
+	size_t left = sizeof(key) - n;
+	const char *name;
+	if (left <= 1 || !lua_getinfo(L, "Sn", ar))
+		return n;
+	name = ar->name != NULL ? ar->name : "?";
+	if (ar->what[0] == 'C')
+		w = snprintf(key + n, left, ";%s [C]", name);
+	else if (ar->what[0] == 'm')
+		w = snprintf(key + n, left, ";main (%s)", ar->short_src);
+	else
+		w = snprintf(key + n, left, ";%s (%s:%d)", name,
+			     ar->short_src, ar->linedefined);
+	if (w < 0)
+		return n;
+	return (size_t)w < left ? n + (size_t)w : sizeof(key) - 1;
+}
+
+//append the stack of 'L' from the outermost frame to the innermost one
+static size_t fold_thread(lua_State *L, size_t n)
+{
+	int level, depth = 0;
+	lua_Debug ar;
+	while (lua_getstack(L, depth, &ar))
+		depth++;
+	level = depth - 1;
+	if (depth > SAMPLE_DEPTH) {
+		level = SAMPLE_DEPTH - 1;
+		if (n + 5 < sizeof(key)) {
+			memcpy(key + n, ";...", 5);
+			n += 4;
+		}
+	}
+	for (; level >= 0; level--) {
+		if (lua_getstack(L, level, &ar))
+			n = fold_frame(L, &ar, n);
+	}
+	return n;
+}
+
+//fold the stack of the main thread and of 'L' (NULL: outside Lua) into 'key'
+static size_t fold_stack(lua_State *L)
+{
+	lua_State *main;
+	size_t n = sizeof(SAMPLE_ROOT) - 1;
+	memcpy(key, SAMPLE_ROOT, n);
+	if (L == NULL)
+		return n;
+	lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+	main = lua_tothread(L, -1);
+	lua_pop(L, 1);
+	if (main != NULL && main != L)
+		n = fold_thread(main, n);
+	return fold_thread(L, n);
+}
+
+static size_t fold_caller(const void *caller, size_t n)
+{
+	int w;
+	size_t left = sizeof(key) - n;
+	if (left <= 1)
+		return n;
+#ifndef __WIN32
+	Dl_info info;
+	//static functions show up as the nearest exported symbol plus offset,
+	//or as module+offset which addr2line can resolve
+	if (dladdr(caller, &info) == 0) {
+		w = snprintf(key + n, left, ";%p [C]", caller);
+	} else if (info.dli_sname != NULL) {
+		w = snprintf(key + n, left, ";%s+0x%tx [C]", info.dli_sname,
+			     (const char *)caller - (const char *)info.dli_saddr);
+	} else {
+		const char *name = strrchr(info.dli_fname, '/');
+		name = name != NULL ? name + 1 : info.dli_fname;
+		w = snprintf(key + n, left, ";%s+0x%tx [C]", name,
+			     (const char *)caller - (const char *)info.dli_fbase);
+	}
+#else
+	w = snprintf(key + n, left, ";%p [C]", caller);
+#endif
+	if (w < 0)
+		return n;
+	return (size_t)w < left ? n + (size_t)w : sizeof(key) - 1;
+}
+
+static void push_stacks(lua_State *L, struct stacks *t, int field)
+{
+	size_t i;
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	for (i = 0; i < t->cap; i++) {
+		struct sample *s;
+		for (s = t->slots[i]; s != NULL; s = s->next) {
+			uint64_t v = field == 0 ? s->count :
+				     (field == 1 ? s->bytes : s->live);
+			if (v == 0)
+				continue;
+			luaL_addlstring(&b, s->stack, s->len);
+			lua_pushfstring(L, " %I\n", (lua_Integer)v);
+			luaL_addvalue(&b);
+		}
+	}
+	luaL_pushresult(&b);
+}
+
+static void push_error(lua_State *L, int err)
+{
+	int t;
+	silly_error_table(L);
+	t = lua_gettop(L);
+	silly_push_error(L, t, err);
+	lua_remove(L, t);
+}
+
+static void sample_hook(lua_State *L, lua_Debug *ar)
+{
+	struct sample *s;
+	(void)ar;
+	s = stacks_get(&S.t, key, fold_stack(L));
+	if (s != NULL)
+		s->count++;
+}
+
+// samplestart([hz]) -> err?
+static int lsamplestart(lua_State *L)
+{
+	int err;
+	int hz = (int)luaL_optinteger(L, 1, 99);
+	err = silly_profile_start(hz, sample_hook);
+	if (err != 0) {
+		push_error(L, err);
+		return 1;
+	}
+	lua_pushnil(L);
+	return 1;
+}
+
+static int lsamplestop(lua_State *L)
+{
+	(void)L;
+	silly_profile_stop();
+	return 0;
+}
+
+static int lsamplestat(lua_State *L)
+{
+	struct silly_profilestat st;
+	silly_profilestat(&st);
+	lua_createtable(L, 0, 6);
+	lua_pushinteger(L, (lua_Integer)(st.ticks - S.base.ticks));
+	lua_setfield(L, -2, "ticks");
+	lua_pushinteger(L, (lua_Integer)(st.samples - S.base.samples));
+	lua_setfield(L, -2, "samples");
+	lua_pushinteger(L, (lua_Integer)(st.native - S.base.native));
+	lua_setfield(L, -2, "native");
+	lua_pushinteger(L, (lua_Integer)(st.skipped - S.base.skipped));
+	lua_setfield(L, -2, "skipped");
+	lua_pushinteger(L, (lua_Integer)S.t.dropped);
+	lua_setfield(L, -2, "dropped");
+	lua_pushinteger(L, (lua_Integer)S.t.count);
+	lua_setfield(L, -2, "stacks");
+	return 1;
+}
+
+// sampledump([reset]) -> folded stacks, one "frame;frame;... count" per line
+static int lsampledump(lua_State *L)
+{
+	uint64_t native;
+	struct silly_profilestat st;
+	int reset = lua_toboolean(L, 1);
+	silly_profilestat(&st);
+	push_stacks(L, &S.t, 0);
+	native = st.native - S.base.native;
+	if (native > 0) {
+		lua_pushfstring(L, "%s" SAMPLE_ROOT " %I\n", lua_tostring(L, -1),
+				(lua_Integer)native);
+		lua_remove(L, -2);
+	}
+	if (reset) {
+		stacks_clear(&S.t, NULL);
+		S.base = st;
+	}
+	return 1;
+}
+
+static void alloc_untrack(const void *ptr)
+{
+	int i;
+	struct liveobj **pp;
+	for (i = 0; i < A.npending; i++) {
+		if (A.pending[i].ptr == ptr)
+			A.pending[i].ptr = NULL;
+	}
+	if (A.count == 0)
+		return;
+	pp = &A.slots[((uintptr_t)ptr >> 4) & (A.cap - 1)];
+	for (; *pp != NULL; pp = &(*pp)->next) {
+		struct liveobj *o = *pp;
+		if (o->ptr == ptr) {
+			o->site->live -= o->weight;
+			*pp = o->next;
+			free(o);
+			A.count--;
+			return;
+		}
+	}
+}
+
+static void alloc_track(const void *ptr, struct sample *site, size_t weight)
+{
+	size_t h;
+	struct liveobj *o;
+	if (A.count >= A.cap) {
+		size_t i, cap = A.cap == 0 ? 256 : A.cap * 2;
+		struct liveobj **slots = calloc(cap, sizeof(*slots));
+		for (i = 0; i < A.cap; i++) {
+			struct liveobj *x = A.slots[i];
+			while (x != NULL) {
+				struct liveobj *next = x->next;
+				h = ((uintptr_t)x->ptr >> 4) & (cap - 1);
+				x->next = slots[h];
+				slots[h] = x;
+				x = next;
+			}
+		}
+		free(A.slots);
+		A.slots = slots;
+		A.cap = cap;
+	}
+	o = malloc(sizeof(*o));
+	o->ptr = ptr;
+	o->site = site;
+	o->weight = weight;
+	h = ((uintptr_t)ptr >> 4) & (A.cap - 1);
+	o->next = A.slots[h];
+	A.slots[h] = o;
+	A.count++;
+	site->live += weight;
+}
+
+static void alloc_untrack_all(void)
+{
+	size_t i;
+	for (i = 0; i < A.cap; i++) {
+		struct liveobj *o = A.slots[i];
+		while (o != NULL) {
+			struct liveobj *next = o->next;
+			o->site->live -= o->weight;
+			free(o);
+			o = next;
+		}
+	}
+	free(A.slots);
+	A.slots = NULL;
+	A.cap = 0;
+	A.count = 0;
+	A.npending = 0;
+}
+
+//runs inside the allocator, only remember the allocation
+static int alloc_sample(void *ptr, size_t size, const void *caller)
+{
+	struct pending *p;
+	A.acc += size;
+	if (A.acc < A.rate)
+		return 0;
+	if (A.npending >= ALLOC_PENDING) {
+		A.t.dropped++;
+		return 0;
+	}
+	p = &A.pending[A.npending++];
+	p->ptr = ptr;
+	p->caller = caller;
+	p->weight = A.acc;
+	A.acc = 0;
+	return 1;
+}
+
+static void alloc_free(void *ptr)
+{
+	if (A.count != 0 || A.npending != 0)
+		alloc_untrack(ptr);
+}
+
+static void alloc_hook(lua_State *L, lua_Debug *ar)
+{
+	int i;
+	size_t base;
+	(void)ar;
+	base = fold_stack(L);
+	for (i = 0; i < A.npending; i++) {
+		struct sample *s;
+		struct pending *p = &A.pending[i];
+		size_t n = base;
+		if (p->caller != NULL)
+			n = fold_caller(p->caller, n);
+		s = stacks_get(&A.t, key, n);
+		if (s == NULL)
+			continue;
+		A.samples++;
+		s->count++;
+		s->bytes += p->weight;
+		if (p->ptr != NULL)
+			alloc_track(p->ptr, s, p->weight);
+	}
+	A.npending = 0;
+}
+
+static const struct silly_memtrace alloc_trace = {
+	.alloc = alloc_sample,
+	.free = alloc_free,
+	.hook = alloc_hook,
+};
+
+// allocstart([rate]) -> err?, sample every 'rate' allocated bytes
+static int lallocstart(lua_State *L)
+{
+	lua_Integer rate = luaL_optinteger(L, 1, 512 * 1024);
+	if (rate <= 0) {
+		push_error(L, EINVAL);
+		return 1;
+	}
+	if (A.rate != 0) {
+		push_error(L, EALREADY);
+		return 1;
+	}
+	A.rate = (size_t)rate;
+	A.acc = 0;
+	silly_memtrace(&alloc_trace);
+	lua_pushnil(L);
+	return 1;
+}
+
+// the sampled allocations are no longer followed, so 'live' drops to 0
+static int lallocstop(lua_State *L)
+{
+	(void)L;
+	if (A.rate == 0)
+		return 0;
+	silly_memtrace(NULL);
+	A.rate = 0;
+	alloc_untrack_all();
+	return 0;
+}
+
+static int lallocstat(lua_State *L)
+{
+	size_t i;
+	uint64_t bytes = 0, live = 0;
+	for (i = 0; i < A.t.cap; i++) {
+		struct sample *s;
+		for (s = A.t.slots[i]; s != NULL; s = s->next) {
+			bytes += s->bytes;
+			live += s->live;
+		}
+	}
+	lua_createtable(L, 0, 6);
+	lua_pushinteger(L, (lua_Integer)A.samples);
+	lua_setfield(L, -2, "samples");
+	lua_pushinteger(L, (lua_Integer)bytes);
+	lua_setfield(L, -2, "bytes");
+	lua_pushinteger(L, (lua_Integer)live);
+	lua_setfield(L, -2, "live");
+	lua_pushinteger(L, (lua_Integer)A.count);
+	lua_setfield(L, -2, "liveobjs");
+	lua_pushinteger(L, (lua_Integer)A.t.dropped);
+	lua_setfield(L, -2, "dropped");
+	lua_pushinteger(L, (lua_Integer)A.t.count);
+	lua_setfield(L, -2, "stacks");
+	return 1;
+}
+
+static int alloc_keep(struct sample *s)
+{
+	s->count = 0;
+	s->bytes = 0;
+	return s->live != 0;
+}
+
+// allocdump(["bytes"|"live"|"count"] [, reset]) -> folded stacks
+static int lallocdump(lua_State *L)
+{
+	static const char *const opts[] = { "count", "bytes", "live", NULL };
+	int field = luaL_checkoption(L, 1, "bytes", opts);
+	int reset = lua_toboolean(L, 2);
+	push_stacks(L, &A.t, field);
+	if (reset) { //sites of live objects stay, with their totals cleared
+		stacks_clear(&A.t, alloc_keep);
+		A.samples = 0;
+	}
+	return 1;
+}
+
+//release the stacks when the Lua state is closed
+static int lsamplegc(lua_State *L)
+{
+	(void)L;
+	silly_profile_stop();
+	lallocstop(L);
+	stacks_clear(&S.t, NULL);
+	stacks_clear(&A.t, NULL);
+	return 0;
+}
+
 static inline void newmetatable(lua_State *L)
 {
 	lua_newtable(L);
@@ -273,6 +836,14 @@ SILLY_MOD_API int luaopen_silly_perf(lua_State *L)
 		{ "resume", lresume },
 		{ "dump",   ldump   },
 		{ "hrtime", lhrtime },
+		{ "samplestart", lsamplestart },
+		{ "samplestop",  lsamplestop  },
+		{ "samplestat",  lsamplestat  },
+		{ "sampledump",  lsampledump  },
+		{ "allocstart",  lallocstart  },
+		{ "allocstop",   lallocstop   },
+		{ "allocstat",   lallocstat   },
+		{ "allocdump",   lallocdump   },
 		{ NULL,     NULL    },
 	};
 
@@ -301,5 +872,12 @@ SILLY_MOD_API int luaopen_silly_perf(lua_State *L)
 
 	luaL_setfuncs(L, tbl, 6);
 
+	lua_newuserdatauv(L, 0, 0);
+	lua_newtable(L);
+	lua_pushcfunction(L, lsamplegc);
+	lua_setfield(L, -2, "__gc");
+	lua_setmetatable(L, -2);
+	lua_rawsetp(L, LUA_REGISTRYINDEX, &S);
+
 	return 1;
 }
\ No newline at end of file
@@ -0,0 +1,630 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <zlib.h>
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include "silly.h"
+
+/*
+** Text exposition (Prometheus 0.0.4 or OpenMetrics 1.0) written into one
+** growing buffer. Lua metric tables are read field by field and the C
+** registry straight from its storage, so a scrape allocates no Lua
+** string besides the chunks handed out by take(). With gzip the text is
+** deflated into a second buffer as it grows.
+*/
+
+#define MT_WRITER "silly.metrics.prometheus.writer"
+#define NUM_LEN (40)
+#define DEFLATE_MIN (32 * 1024)
+
+struct bytes {
+	char *buf;
+	size_t len;
+	size_t cap;
+};
+
+struct writer {
+	struct bytes text;
+	struct bytes out;     // gzip output
+	uint64_t *counts;     // scratch for the native histograms
+	int countcap;
+	double *quantiles;    // scratch for the native summaries
+	int quantilecap;
+	char (*le)[NUM_LEN];  // bounds of the last Lua bucket table
+	const char **lenames;
+	int lecap;
+	const void *lekey;    // that bucket table
+	int lecount;
+	int openmetrics;
+	int gzip;
+	int finished;
+	z_stream z;
+};
+
+static void reserve(struct bytes *b, size_t n)
+{
+	size_t need = b->len + n;
+	if (need <= b->cap)
+		return;
+	size_t cap = b->cap ? b->cap : 4096;
+	while (cap < need)
+		cap *= 2;
+	b->buf = (char *)silly_realloc(b->buf, cap);
+	b->cap = cap;
+}
+
+static inline void put(struct writer *w, const char *s, size_t n)
+{
+	reserve(&w->text, n);
+	memcpy(w->text.buf + w->text.len, s, n);
+	w->text.len += n;
+}
+
+static inline void putstr(struct writer *w, const char *s)
+{
+	put(w, s, strlen(s));
+}
+
+static inline void putch(struct writer *w, char c)
+{
+	reserve(&w->text, 1);
+	w->text.buf[w->text.len++] = c;
+}
+
+static int fmt_int(char *p, int64_t v)
+{
+	char tmp[24];
+	int n = 0, len = 0;
+	uint64_t u = v < 0 ? -(uint64_t)v : (uint64_t)v;
+	do {
+		tmp[n++] = '0' + u % 10;
+		u /= 10;
+	} while (u);
+	if (v < 0)
+		p[len++] = '-';
+	while (n > 0)
+		p[len++] = tmp[--n];
+	return len;
+}
+
+static int fmt_double(char *p, double v)
+{
+	int n;
+	if (isnan(v)) {
+		memcpy(p, "NaN", 3);
+		return 3;
+	}
+	if (isinf(v)) {
+		memcpy(p, v > 0 ? "+Inf" : "-Inf", 4);
+		return 4;
+	}
+	if (v == floor(v) && fabs(v) < 9007199254740992.0) // 2^53
+		return fmt_int(p, (int64_t)v);
+	n = snprintf(p, NUM_LEN, "%.15g", v);
+	if (strtod(p, NULL) != v)
+		n = snprintf(p, NUM_LEN, "%.17g", v);
+	return n;
+}
+
+static inline void put_int(struct writer *w, int64_t v)
+{
+	reserve(&w->text, NUM_LEN);
+	w->text.len += fmt_int(w->text.buf + w->text.len, v);
+}
+
+static inline void put_double(struct writer *w, double v)
+{
+	reserve(&w->text, NUM_LEN);
+	w->text.len += fmt_double(w->text.buf + w->text.len, v);
+}
+
+static void put_value(struct writer *w, lua_State *L, int idx)
+{
+	if (lua_isinteger(L, idx))
+		put_int(w, lua_tointeger(L, idx));
+	else
+		put_double(w, lua_tonumber(L, idx));
+}
+
+static inline const char *total_suffix(struct writer *w, const char *kind)
+{
+	if (w->openmetrics && strcmp(kind, "counter") == 0)
+		return "_total";
+	return NULL;
+}
+
+/* HELP text: '\\' and newline, and '"' as well for OpenMetrics */
+static void put_help(struct writer *w, const char *s)
+{
+	for (; *s; s++) {
+		switch (*s) {
+		case '\\':
+			put(w, "\\\\", 2);
+			break;
+		case '\n':
+			put(w, "\\n", 2);
+			break;
+		case '"':
+			if (w->openmetrics)
+				put(w, "\\\"", 2);
+			else
+				putch(w, '"');
+			break;
+		default:
+			putch(w, *s);
+			break;
+		}
+	}
+}
+
+/*
+** OpenMetrics names a counter family without its '_total' suffix and
+** requires the suffix on the sample, returns the family name length
+*/
+static size_t family_header(struct writer *w, const char *name,
+			    const char *help, const char *kind)
+{
+	size_t nlen = strlen(name);
+	if (total_suffix(w, kind) && nlen > 6 &&
+	    strcmp(name + nlen - 6, "_total") == 0)
+		nlen -= 6;
+	put(w, "# HELP ", 7);
+	put(w, name, nlen);
+	putch(w, ' ');
+	put_help(w, help);
+	put(w, "\n# TYPE ", 8);
+	put(w, name, nlen);
+	putch(w, ' ');
+	putstr(w, kind);
+	putch(w, '\n');
+	return nlen;
+}
+
+/* 'lname' is "le" or "quantile" */
+static void sample_head_with(struct writer *w, const char *name, size_t nlen,
+			     const char *suffix, const char *labels,
+			     size_t llen, const char *lname, const char *lvalue)
+{
+	put(w, name, nlen);
+	if (suffix != NULL)
+		putstr(w, suffix);
+	if (llen > 0 || lvalue != NULL) {
+		putch(w, '{');
+		put(w, labels, llen);
+		if (lvalue != NULL) {
+			if (llen > 0)
+				putch(w, ',');
+			putstr(w, lname);
+			put(w, "=\"", 2);
+			putstr(w, lvalue);
+			putch(w, '"');
+		}
+		putch(w, '}');
+	}
+	putch(w, ' ');
+}
+
+static inline void sample_head(struct writer *w, const char *name,
+			       size_t nlen, const char *suffix,
+			       const char *labels, size_t llen, const char *le)
+{
+	sample_head_with(w, name, nlen, suffix, labels, llen, "le", le);
+}
+
+static void put_count_sum(struct writer *w, const char *name, size_t nlen,
+			  const char *labels, size_t llen, uint64_t count,
+			  double sum)
+{
+	sample_head(w, name, nlen, "_count", labels, llen, NULL);
+	put_int(w, (int64_t)count);
+	putch(w, '\n');
+	sample_head(w, name, nlen, "_sum", labels, llen, NULL);
+	put_double(w, sum);
+	putch(w, '\n');
+}
+
+/*
+** 'counts' are per bucket, the exposition wants them cumulative. A
+** sparse histogram (loghist) leaves out its empty buckets, the
+** cumulative counts of the others are unchanged by that.
+*/
+static void put_histogram(struct writer *w, const char *name, size_t nlen,
+			  const char *labels, size_t llen, int n,
+			  const char *const *le, const uint64_t *counts,
+			  uint64_t count, double sum, int sparse)
+{
+	uint64_t acc = 0;
+	for (int i = 0; i < n; i++) {
+		if (sparse && counts[i] == 0)
+			continue;
+		acc += counts[i];
+		sample_head(w, name, nlen, "_bucket", labels, llen, le[i]);
+		put_int(w, (int64_t)acc);
+		putch(w, '\n');
+	}
+	sample_head(w, name, nlen, "_bucket", labels, llen, "+Inf");
+	put_int(w, (int64_t)count);
+	putch(w, '\n');
+	put_count_sum(w, name, nlen, labels, llen, count, sum);
+}
+
+static void put_quantile(struct writer *w, const char *name, size_t nlen,
+			 const char *labels, size_t llen, double q, double v)
+{
+	char buf[NUM_LEN];
+	buf[fmt_double(buf, q)] = '\0';
+	sample_head_with(w, name, nlen, NULL, labels, llen, "quantile", buf);
+	put_double(w, v);
+	putch(w, '\n');
+}
+
+static uint64_t *counts_of(struct writer *w, int n)
+{
+	if (n > w->countcap) {
+		w->counts = (uint64_t *)silly_realloc(w->counts,
+						      n * sizeof(uint64_t));
+		w->countcap = n;
+	}
+	return w->counts;
+}
+
+static struct writer *check_writer(lua_State *L)
+{
+	struct writer *w = (struct writer *)luaL_checkudata(L, 1, MT_WRITER);
+	if (w->finished)
+		luaL_error(L, "prometheus writer is finished");
+	return w;
+}
+
+/* ---- Lua metric tables (silly.metrics.counter/gauge/histogram) ---- */
+
+/* the 'le' names of a bucket table, cached within one family */
+static const char *const *lua_bounds(struct writer *w, lua_State *L,
+				     int idx, int *n)
+{
+	const void *key = lua_topointer(L, idx);
+	if (key == w->lekey) {
+		*n = w->lecount;
+		return w->lenames;
+	}
+	int cnt = (int)lua_rawlen(L, idx);
+	if (cnt > w->lecap) {
+		w->le = silly_realloc(w->le, cnt * sizeof(*w->le));
+		w->lenames = (const char **)silly_realloc(
+			w->lenames, cnt * sizeof(char *));
+		w->lecap = cnt;
+	}
+	for (int i = 0; i < cnt; i++) {
+		char *p = w->le[i];
+		int len;
+		lua_rawgeti(L, idx, i + 1);
+		len = fmt_double(p, lua_tonumber(L, -1));
+		lua_pop(L, 1);
+		if (strspn(p, "-0123456789") == (size_t)len) {
+			memcpy(p + len, ".0", 2);
+			len += 2;
+		}
+		p[len] = '\0';
+		w->lenames[i] = p;
+	}
+	w->lekey = key;
+	w->lecount = cnt;
+	*n = cnt;
+	return w->lenames;
+}
+
+static void lua_summary(struct writer *w, lua_State *L, int sub,
+			const char *name, size_t nlen, const char *labels,
+			size_t llen)
+{
+	int n;
+	lua_getfield(L, sub, "quantiles");
+	lua_getfield(L, sub, "quantilevalues");
+	n = lua_istable(L, -2) ? (int)lua_rawlen(L, -2) : 0;
+	for (int i = 1; i <= n; i++) {
+		double q, v;
+		lua_rawgeti(L, -2, i);
+		lua_rawgeti(L, -2, i);
+		q = lua_tonumber(L, -2);
+		v = lua_isnumber(L, -1) ? lua_tonumber(L, -1) : NAN;
+		lua_pop(L, 2);
+		put_quantile(w, name, nlen, labels, llen, q, v);
+	}
+	lua_getfield(L, sub, "count");
+	lua_getfield(L, sub, "sum");
+	put_count_sum(w, name, nlen, labels, llen,
+		      (uint64_t)lua_tointeger(L, -2), lua_tonumber(L, -1));
+	lua_pop(L, 4);
+}
+
+/* 'suffix' is NULL for a histogram and a summary */
+static void lua_sample(struct writer *w, lua_State *L, int sub,
+		       const char *name, size_t nlen, const char *suffix,
+		       int summary, const char *labels, size_t llen)
+{
+	int n;
+	uint64_t count;
+	const char *const *le;
+	if (summary) {
+		lua_summary(w, L, sub, name, nlen, labels, llen);
+		return;
+	}
+	if (suffix != NULL) {
+		sample_head(w, name, nlen, *suffix ? suffix : NULL,
+			    labels, llen, NULL);
+		lua_getfield(L, sub, "value");
+		put_value(w, L, -1);
+		lua_pop(L, 1);
+		putch(w, '\n');
+		return;
+	}
+	lua_getfield(L, sub, "buckets");
+	le = lua_bounds(w, L, lua_gettop(L), &n);
+	lua_getfield(L, sub, "bucketcounts");
+	lua_getfield(L, sub, "count");
+	lua_getfield(L, sub, "sum");
+	count = (uint64_t)lua_tointeger(L, -2);
+	uint64_t *counts = counts_of(w, n);
+	for (int i = 0; i < n; i++) {
+		lua_rawgeti(L, -3, i + 1);
+		counts[i] = (uint64_t)lua_tointeger(L, -1);
+		lua_pop(L, 1);
+	}
+	put_histogram(w, name, nlen, labels, llen, n, le, counts, count,
+		      lua_tonumber(L, -1), 0);
+	lua_pop(L, 4);
+}
+
+// writer:lua(metric)
+static int lwriter_lua(lua_State *L)
+{
+	size_t nlen;
+	int summary;
+	const char *suffix;
+	struct writer *w = check_writer(L);
+	luaL_checktype(L, 2, LUA_TTABLE);
+	lua_settop(L, 2);
+	lua_getfield(L, 2, "name");
+	lua_getfield(L, 2, "help");
+	lua_getfield(L, 2, "kind");
+	const char *name = luaL_checkstring(L, 3);
+	const char *help = luaL_optstring(L, 4, "");
+	const char *kind = luaL_checkstring(L, 5);
+	w->lekey = NULL;
+	summary = strcmp(kind, "summary") == 0;
+	suffix = total_suffix(w, kind);
+	if (suffix == NULL && !summary && strcmp(kind, "histogram") != 0)
+		suffix = "";
+	nlen = family_header(w, name, help, kind);
+	if (lua_getfield(L, 2, "metrics") != LUA_TTABLE) {
+		lua_sample(w, L, 2, name, nlen, suffix, summary, "", 0);
+		return 0;
+	}
+	lua_pushnil(L);
+	while (lua_next(L, 6) != 0) {
+		size_t llen;
+		const char *labels = lua_tolstring(L, -2, &llen);
+		lua_sample(w, L, lua_gettop(L), name, nlen, suffix, summary,
+			   labels, llen);
+		lua_pop(L, 1);
+	}
+	return 0;
+}
+
+/* ---- C registry (silly.metrics.native) ---- */
+
+static const char *native_kind(const struct silly_metric_desc *desc)
+{
+	switch (desc->kind) {
+	case SILLY_METRIC_COUNTER:
+		return "counter";
+	case SILLY_METRIC_GAUGE:
+		return "gauge";
+	case SILLY_METRIC_LOGHIST:
+		if (desc->quantilecount > 0)
+			return "summary";
+		return "histogram";
+	default:
+		return "histogram";
+	}
+}
+
+static double *quantiles_of(struct writer *w, int n)
+{
+	if (n > w->quantilecap) {
+		w->quantiles = (double *)silly_realloc(w->quantiles,
+						       n * sizeof(double));
+		w->quantilecap = n;
+	}
+	return w->quantiles;
+}
+
+static void native_family(struct writer *w, struct silly_metric *m)
+{
+	size_t nlen;
+	const char *suffix;
+	struct silly_metric_series *s = NULL;
+	const struct silly_metric_desc *desc = silly_metric_desc(m);
+	const char *kind = native_kind(desc);
+	int summary = desc->kind == SILLY_METRIC_LOGHIST &&
+		      desc->quantilecount > 0;
+	suffix = total_suffix(w, kind);
+	nlen = family_header(w, desc->name, desc->help, kind);
+	while ((s = silly_metric_series_next(m, s)) != NULL) {
+		struct silly_metric_sample sample;
+		const char *labels = silly_metric_series_labels(s);
+		size_t llen = strlen(labels);
+		if (desc->kind == SILLY_METRIC_COUNTER ||
+		    desc->kind == SILLY_METRIC_GAUGE) {
+			sample.buckets = NULL;
+			silly_metric_read(s, &sample);
+			sample_head(w, desc->name, nlen, suffix, labels, llen,
+				    NULL);
+			put_double(w, sample.value);
+			putch(w, '\n');
+			continue;
+		}
+		if (summary) {
+			double *v = quantiles_of(w, desc->quantilecount);
+			sample.buckets = NULL;
+			silly_metric_read(s, &sample);
+			silly_metric_quantiles(s, v);
+			for (int i = 0; i < desc->quantilecount; i++) {
+				put_quantile(w, desc->name, nlen, labels, llen,
+					     desc->quantiles[i], v[i]);
+			}
+			put_count_sum(w, desc->name, nlen, labels, llen,
+				      sample.count, sample.sum);
+			continue;
+		}
+		sample.buckets = counts_of(w, desc->bucketcount);
+		silly_metric_read(s, &sample);
+		put_histogram(w, desc->name, nlen, labels, llen,
+			      desc->bucketcount, desc->bucketnames,
+			      sample.buckets, sample.count, sample.sum,
+			      desc->kind == SILLY_METRIC_LOGHIST);
+	}
+}
+
+// writer:native()
+static int lwriter_native(lua_State *L)
+{
+	struct silly_metric *m = NULL;
+	struct writer *w = check_writer(L);
+	while ((m = silly_metric_next(m)) != NULL)
+		native_family(w, m);
+	return 0;
+}
+
+/* ---- output ---- */
+
+static int deflate_text(lua_State *L, struct writer *w, int flush)
+{
+	int ret;
+	z_stream *z = &w->z;
+	z->next_in = (Bytef *)w->text.buf;
+	z->avail_in = (uInt)w->text.len;
+	do {
+		reserve(&w->out, deflateBound(z, z->avail_in) + 64);
+		z->next_out = (Bytef *)(w->out.buf + w->out.len);
+		z->avail_out = (uInt)(w->out.cap - w->out.len);
+		ret = deflate(z, flush);
+		if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+			return luaL_error(L, "prometheus deflate: %d", ret);
+		w->out.len = w->out.cap - z->avail_out;
+	} while (z->avail_in > 0 || z->avail_out == 0 ||
+		 (flush == Z_FINISH && ret != Z_STREAM_END));
+	w->text.len = 0;
+	return 0;
+}
+
+static struct bytes *pending(lua_State *L, struct writer *w, int flush)
+{
+	if (!w->gzip)
+		return &w->text;
+	if (w->text.len >= DEFLATE_MIN || flush != Z_NO_FLUSH)
+		deflate_text(L, w, flush);
+	return &w->out;
+}
+
+// writer:size(), bytes ready for take()
+static int lwriter_size(lua_State *L)
+{
+	struct writer *w = check_writer(L);
+	struct bytes *b = pending(L, w, Z_NO_FLUSH);
+	lua_pushinteger(L, (lua_Integer)b->len);
+	return 1;
+}
+
+// writer:take(), the output so far
+static int lwriter_take(lua_State *L)
+{
+	struct writer *w = check_writer(L);
+	struct bytes *b = pending(L, w, w->gzip ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+	lua_pushlstring(L, b->buf, b->len);
+	b->len = 0;
+	return 1;
+}
+
+// writer:finish(), the rest of the output
+static int lwriter_finish(lua_State *L)
+{
+	struct bytes *b;
+	struct writer *w = check_writer(L);
+	if (w->openmetrics)
+		put(w, "# EOF\n", 6);
+	b = pending(L, w, Z_FINISH);
+	lua_pushlstring(L, b->buf, b->len);
+	b->len = 0;
+	w->finished = 1;
+	return 1;
+}
+
+static int lwriter_gc(lua_State *L)
+{
+	struct writer *w = (struct writer *)luaL_checkudata(L, 1, MT_WRITER);
+	if (w->gzip) {
+		deflateEnd(&w->z);
+		w->gzip = 0;
+	}
+	silly_free(w->text.buf);
+	silly_free(w->out.buf);
+	silly_free(w->counts);
+	silly_free(w->quantiles);
+	silly_free(w->le);
+	silly_free(w->lenames);
+	memset(w, 0, sizeof(*w));
+	w->finished = 1;
+	return 0;
+}
+
+// writer(openmetrics, gzip)
+static int lwriter(lua_State *L)
+{
+	struct writer *w;
+	int openmetrics = lua_toboolean(L, 1);
+	int gzip = lua_toboolean(L, 2);
+	w = (struct writer *)lua_newuserdatauv(L, sizeof(*w), 0);
+	memset(w, 0, sizeof(*w));
+	w->openmetrics = openmetrics;
+	luaL_setmetatable(L, MT_WRITER);
+	if (gzip) {
+		int ret = deflateInit2(&w->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+				       15 + 16, 8, Z_DEFAULT_STRATEGY);
+		if (ret != Z_OK)
+			return luaL_error(L, "deflateInit2 failed: %d", ret);
+		w->gzip = 1;
+	}
+	return 1;
+}
+
+SILLY_MOD_API int luaopen_silly_metrics_prometheus_c(lua_State *L)
+{
+	luaL_Reg tbl[] = {
+		{ "writer", lwriter },
+		{ NULL,     NULL    },
+	};
+	luaL_Reg methods[] = {
+		{ "lua",    lwriter_lua    },
+		{ "native", lwriter_native },
+		{ "size",   lwriter_size   },
+		{ "take",   lwriter_take   },
+		{ "finish", lwriter_finish },
+		{ NULL,     NULL           },
+	};
+
+	luaL_checkversion(L);
+	if (luaL_newmetatable(L, MT_WRITER)) {
+		luaL_newlib(L, methods);
+		lua_setfield(L, -2, "__index");
+		lua_pushcfunction(L, lwriter_gc);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_pop(L, 1);
+	luaL_newlib(L, tbl);
+	return 1;
+}
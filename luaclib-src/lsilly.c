@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stddef.h>
+#include <limits.h>
 #include <sys/time.h>
 #include <lua.h>
 #include <lualib.h>
@@ -95,6 +96,57 @@ static int lsignal(lua_State *L)
 	return 1;
 }
 
+static int gcfield(lua_State *L, const char *name, int val)
+{
+	int isnum;
+	lua_Integer n;
+	if (lua_getfield(L, 1, name) == LUA_TNIL) {
+		lua_pop(L, 1);
+		return val;
+	}
+	n = lua_tointegerx(L, -1, &isnum);
+	if (!isnum || n < 0 || n > INT_MAX)
+		luaL_error(L, "gctune: invalid '%s'", name);
+	lua_pop(L, 1);
+	return (int)n;
+}
+
+static int lgctune(lua_State *L)
+{
+	struct silly_gcconf conf;
+	silly_gctune(NULL, &conf);
+	if (!lua_isnoneornil(L, 1)) {
+		luaL_checktype(L, 1, LUA_TTABLE);
+		if (lua_getfield(L, 1, "mode") != LUA_TNIL) {
+			static const char *const modes[] = {
+				"incremental", "generational", NULL
+			};
+			conf.generational = luaL_checkoption(L, -1, NULL, modes);
+		}
+		lua_pop(L, 1);
+		conf.pause = gcfield(L, "pause", conf.pause);
+		conf.stepmul = gcfield(L, "stepmul", conf.stepmul);
+		conf.minormul = gcfield(L, "minormul", conf.minormul);
+		conf.idle = gcfield(L, "idle", conf.idle);
+		conf.busy = gcfield(L, "busy", conf.busy);
+		silly_gctune(&conf, NULL);
+	}
+	lua_createtable(L, 0, 6);
+	lua_pushstring(L, conf.generational ? "generational" : "incremental");
+	lua_setfield(L, -2, "mode");
+	lua_pushinteger(L, conf.pause);
+	lua_setfield(L, -2, "pause");
+	lua_pushinteger(L, conf.stepmul);
+	lua_setfield(L, -2, "stepmul");
+	lua_pushinteger(L, conf.minormul);
+	lua_setfield(L, -2, "minormul");
+	lua_pushinteger(L, conf.idle);
+	lua_setfield(L, -2, "idle");
+	lua_pushinteger(L, conf.busy);
+	lua_setfield(L, -2, "busy");
+	return 1;
+}
+
 SILLY_MOD_API int luaopen_silly_c(lua_State *L)
 {
 	luaL_Reg tbl[] = {
@@ -104,6 +156,7 @@ SILLY_MOD_API int luaopen_silly_c(lua_State *L)
 		{ "genid",      lgenid     },
 		{ "tostring",   ltostring  },
 		{ "exit",       lexit      },
+		{ "gctune",     lgctune    },
 		{ NULL,         NULL       },
 	};
 
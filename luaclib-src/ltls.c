@@ -601,11 +601,13 @@ static int ltls_write(lua_State *L)
 	}
 	ret = flushwrite(tls);
 	lua_pushboolean(L, ret >= 0);
-	if (ret < 0)
+	if (ret < 0) {
 		push_error(L, -ret);
-	else
-		lua_pushnil(L);
-	return 2;
+		return 2;
+	}
+	lua_pushnil(L);
+	lua_pushboolean(L, ret > 0); // paused by the watermark
+	return 3;
 }
 
 static int ltls_handshake(lua_State *L)
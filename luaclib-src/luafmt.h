@@ -56,4 +56,242 @@ static inline int luafmt_uint64(char *buf, uint64_t n)
 	return len;
 }
 
+/*
+ * Shortest round-trip double to string (Grisu2, after Florian Loitsch's
+ * "Printing Floating-Point Numbers Quickly and Accurately with Integers").
+ * The output always parses back to the same double and is the shortest
+ * such string in all but a tiny fraction of inputs.
+ * d must be finite and non-zero; buf must have at least 32 bytes.
+ * Returns the length of the string.
+ */
+struct luafmt_diyfp {
+	uint64_t f;
+	int e;
+};
+
+static inline struct luafmt_diyfp luafmt_diyfp_mul(struct luafmt_diyfp a,
+						   struct luafmt_diyfp b)
+{
+	struct luafmt_diyfp r;
+	__uint128_t p = (__uint128_t)a.f * b.f;
+	r.f = (uint64_t)(p >> 64);
+	if ((uint64_t)p & (1ULL << 63))
+		r.f++; /* round */
+	r.e = a.e + b.e + 64;
+	return r;
+}
+
+static inline struct luafmt_diyfp luafmt_cached_pow10(int e, int *K)
+{
+	/* 10^k normalized to 64 bits, for k = -348, -340, ..., 340 */
+	static const uint64_t F[] = {
+	0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+	0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+	0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+	0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+	0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+	0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+	0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+	0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+	0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+	0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+	0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+	0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+	0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+	0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+	0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+	0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+	0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+	0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+	0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+	0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+	0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+	0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+	0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+	0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+	0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+	0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+	0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+	0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+	0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+	};
+	static const int16_t E[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+	-954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+	-688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+	-422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+	-157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+	109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+	641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+	907, 933, 960, 986, 1013, 1039, 1066,
+	};
+	struct luafmt_diyfp r;
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int k = (int)dk;
+	unsigned int index;
+	if (dk - k > 0.0)
+		k++;
+	index = (unsigned int)((k >> 3) + 1);
+	*K = -(-348 + (int)(index << 3));
+	r.f = F[index];
+	r.e = E[index];
+	return r;
+}
+
+static inline void luafmt_grisu_round(char *buf, int len, uint64_t delta,
+				      uint64_t rest, uint64_t ten_kappa,
+				      uint64_t wp_w)
+{
+	while (rest < wp_w && delta - rest >= ten_kappa &&
+	       (rest + ten_kappa < wp_w ||
+		wp_w - rest > rest + ten_kappa - wp_w)) {
+		buf[len - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+static inline int luafmt_grisu2(double d, char *buf, int *K)
+{
+	static const uint32_t pow10_32[] = {
+		1, 10, 100, 1000, 10000, 100000, 1000000, 10000000,
+		100000000, 1000000000,
+	};
+	static const uint64_t pow10_64[] = {
+		1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL,
+		1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL,
+		10000000000ULL, 100000000000ULL, 1000000000000ULL,
+		10000000000000ULL, 100000000000000ULL, 1000000000000000ULL,
+		10000000000000000ULL, 100000000000000000ULL,
+		1000000000000000000ULL, 10000000000000000000ULL,
+	};
+	uint64_t u, delta, p2, tmp;
+	uint32_t p1;
+	int len = 0, kappa, shift;
+	struct luafmt_diyfp v, w, wp, wm, c, W, Wp, Wm;
+	__builtin_memcpy(&u, &d, sizeof(u));
+	u &= ~(1ULL << 63);
+	if ((u >> 52) != 0) {
+		v.f = (u & ((1ULL << 52) - 1)) | (1ULL << 52);
+		v.e = (int)(u >> 52) - 1075;
+	} else {
+		v.f = u;
+		v.e = -1074;
+	}
+	/* boundaries m+ and m-, both with the exponent of normalized m+ */
+	wp.f = (v.f << 1) + 1;
+	wp.e = v.e - 1;
+	shift = __builtin_clzll(wp.f);
+	wp.f <<= shift;
+	wp.e -= shift;
+	if (v.f == (1ULL << 52)) {
+		wm.f = (v.f << 2) - 1;
+		wm.e = v.e - 2;
+	} else {
+		wm.f = (v.f << 1) - 1;
+		wm.e = v.e - 1;
+	}
+	wm.f <<= wm.e - wp.e;
+	wm.e = wp.e;
+	shift = __builtin_clzll(v.f);
+	w.f = v.f << shift;
+	w.e = v.e - shift;
+
+	c = luafmt_cached_pow10(wp.e, K);
+	W = luafmt_diyfp_mul(w, c);
+	Wp = luafmt_diyfp_mul(wp, c);
+	Wm = luafmt_diyfp_mul(wm, c);
+	Wm.f++;
+	Wp.f--;
+	delta = Wp.f - Wm.f;
+
+	/* digit generation */
+	shift = -Wp.e;
+	p1 = (uint32_t)(Wp.f >> shift);
+	p2 = Wp.f & ((1ULL << shift) - 1);
+	for (kappa = 1; kappa < 10 && p1 >= pow10_32[kappa]; kappa++)
+		;
+	while (kappa > 0) {
+		uint32_t dg = p1 / pow10_32[kappa - 1];
+		p1 %= pow10_32[kappa - 1];
+		if (dg || len)
+			buf[len++] = (char)('0' + dg);
+		kappa--;
+		tmp = ((uint64_t)p1 << shift) + p2;
+		if (tmp <= delta) {
+			*K += kappa;
+			luafmt_grisu_round(buf, len, delta, tmp,
+					   (uint64_t)pow10_32[kappa] << shift,
+					   Wp.f - W.f);
+			return len;
+		}
+	}
+	for (;;) {
+		char dg;
+		p2 *= 10;
+		delta *= 10;
+		dg = (char)(p2 >> shift);
+		if (dg || len)
+			buf[len++] = (char)('0' + dg);
+		p2 &= (1ULL << shift) - 1;
+		kappa--;
+		if (p2 < delta) {
+			*K += kappa;
+			luafmt_grisu_round(buf, len, delta, p2, 1ULL << shift,
+				(Wp.f - W.f) *
+				(-kappa < 20 ? pow10_64[-kappa] : 0));
+			return len;
+		}
+	}
+}
+
+static inline int luafmt_double(char *buf, double d)
+{
+	char *p = buf;
+	int len, K, kk;
+	if (d < 0) {
+		*p++ = '-';
+		d = -d;
+	}
+	len = luafmt_grisu2(d, p, &K);
+	kk = len + K; /* 10^(kk-1) <= d < 10^kk */
+	if (0 < kk && kk <= 21 && K < 0) {
+		/* 1234e-2 -> 12.34 */
+		__builtin_memmove(&p[kk + 1], &p[kk], len - kk);
+		p[kk] = '.';
+		len += 1;
+	} else if (-6 < kk && kk <= 0) {
+		/* 1234e-6 -> 0.001234 */
+		int offset = 2 - kk;
+		__builtin_memmove(&p[offset], &p[0], len);
+		p[0] = '0';
+		p[1] = '.';
+		for (int i = 2; i < offset; i++)
+			p[i] = '0';
+		len += offset;
+	} else {
+		/* 1234e30 -> 1.234e33, 1e30 */
+		int exp = kk - 1;
+		if (len > 1) {
+			__builtin_memmove(&p[2], &p[1], len - 1);
+			p[1] = '.';
+			len += 1;
+		}
+		p[len++] = 'e';
+		if (exp < 0) {
+			p[len++] = '-';
+			exp = -exp;
+		}
+		if (exp >= 100) {
+			p[len++] = (char)('0' + exp / 100);
+			exp %= 100;
+			p[len++] = (char)('0' + exp / 10);
+		} else if (exp >= 10) {
+			p[len++] = (char)('0' + exp / 10);
+		}
+		p[len++] = (char)('0' + exp % 10);
+	}
+	return (int)(p - buf) + len;
+}
+
 #endif  /* _LUAFMT_H */
@@ -144,6 +144,8 @@ typedef struct lpb_State {
     int defs_index;
     int enc_hooks_index;
     int dec_hooks_index;
+    int codecs_index[2];  /* compiled codecs, per layout */
+    unsigned codec_gen;   /* bumped whenever the schema changes */
     unsigned use_dec_hooks : 1;
     unsigned use_enc_hooks : 1;
     unsigned enum_as_value : 1;
@@ -175,6 +177,15 @@ static void lpb_pushenchooktable(lua_State *L, lpb_State *LS)
 static void lpb_pushdechooktable(lua_State *L, lpb_State *LS)
 { LS->dec_hooks_index = lpb_reftable(L, LS->dec_hooks_index); }
 
+static void lpbC_reset(lua_State *L, lpb_State *LS) {
+    int i;
+    for (i = 0; i < 2; ++i) {
+        luaL_unref(L, LUA_REGISTRYINDEX, LS->codecs_index[i]);
+        LS->codecs_index[i] = LUA_NOREF;
+    }
+    ++LS->codec_gen;
+}
+
 static int Lpb_delete(lua_State *L) {
     lpb_State *LS = (lpb_State*)luaL_testudata(L, 1, PB_STATE);
     if (LS != NULL) {
@@ -187,6 +198,7 @@ static int Lpb_delete(lua_State *L) {
         luaL_unref(L, LUA_REGISTRYINDEX, LS->defs_index);
         luaL_unref(L, LUA_REGISTRYINDEX, LS->enc_hooks_index);
         luaL_unref(L, LUA_REGISTRYINDEX, LS->dec_hooks_index);
+        lpbC_reset(L, LS);
     }
     return 0;
 }
@@ -204,6 +216,7 @@ LUALIB_API lpb_State *lpb_lstate(lua_State *L) {
         LS->defs_index = LUA_NOREF;
         LS->enc_hooks_index = LUA_NOREF;
         LS->dec_hooks_index = LUA_NOREF;
+        LS->codecs_index[0] = LS->codecs_index[1] = LUA_NOREF;
         LS->state = &LS->local;
         pb_init(&LS->local);
         pb_initbuffer(&LS->buffer);
@@ -1235,6 +1248,7 @@ static int Lpb_load(lua_State *L) {
     lpb_State *LS = lpb_lstate(L);
     pb_Slice s = lpb_checkslice(L, 1);
     int r = pb_load(&LS->local, &s);
+    lpbC_reset(L, LS);
     if (r == PB_OK) global_state = &LS->local;
     lua_pushboolean(L, r == PB_OK);
     lua_pushinteger(L, pb_pos(s)+1);
@@ -1249,6 +1263,7 @@ static int Lpb_load_unsafe(lua_State *L) {
     int r;
     if (data == NULL) lpb_typeerror(L, 1, "userdata");
     r = pb_load(&LS->local, &s);
+    lpbC_reset(L, LS);
     if (r == PB_OK) global_state = &LS->local;
     lua_pushboolean(L, r == PB_OK);
     lua_pushinteger(L, pb_pos(s)+1);
@@ -1275,6 +1290,7 @@ static int Lpb_loadfile(lua_State *L) {
     fclose(fp);
     s = pb_result(&b);
     ret = pb_load(&LS->local, &s);
+    lpbC_reset(L, LS);
     if (ret == PB_OK) global_state = &LS->local;
     pb_resetbuffer(&b);
     lua_pushboolean(L, ret == PB_OK);
@@ -1543,8 +1559,10 @@ static int Lpb_clear(lua_State *L) {
         LS->enc_hooks_index = LUA_NOREF;
         luaL_unref(L, LUA_REGISTRYINDEX, LS->dec_hooks_index);
         LS->dec_hooks_index = LUA_NOREF;
+        lpbC_reset(L, LS);
         return 0;
     }
+    lpbC_reset(L, LS);
     LS->state = &LS->local;
     t = (pb_Type*)lpb_type(L, LS, lpb_checkslice(L, 1));
     if (lua_isnoneornil(L, 2)) pb_deltype(&LS->local, t);
@@ -1594,6 +1612,45 @@ typedef struct lpb_Env {
 
 static void lpbE_encode (lpb_Env *e, const pb_Type *t, int idx);
 
+/* compiled codec, see "protobuf compiled codec" below */
+
+#define PB_CODEC "pb.Codec"
+
+enum lpbC_Layout { LPBC_NAME, LPBC_INDEX };
+enum lpbC_Kind { LPBC_SKIP, LPBC_SCALAR, LPBC_MESSAGE, LPBC_REPEATED, LPBC_MAP };
+
+typedef struct lpb_Codec lpb_Codec;
+
+typedef struct lpb_CField {
+    const pb_Field  *f;
+    const lpb_Codec *sub;   /* codec of the (map value) message type */
+    unsigned kind       : 3; /* lpbC_Kind */
+    unsigned ignorezero : 1;
+    unsigned oneof      : 1;
+    unsigned defvalue   : 1; /* keys[3n+i+1] is the decode default */
+    unsigned defarray   : 1; /* decode default is an empty table */
+    unsigned taglen     : 3;
+    char     tag[5];        /* precomputed varint of the field key */
+} lpb_CField;
+
+struct lpb_Codec {
+    const lpb_State *LS;
+    const pb_Type   *t;
+    unsigned gen;
+    unsigned layout; /* lpbC_Layout */
+    unsigned nfield;
+    unsigned ndense;
+    unsigned defmode; /* options the decode defaults are built for */
+    unsigned fastdef : 1;
+    lpb_CField *fields;  /* sorted by field number */
+    uint16_t   *dense;   /* field number -> index + 1 */
+};
+
+static const lpb_Codec *lpbC_cached(lua_State *L, lpb_State *LS, const pb_Type *t);
+static void lpbC_encode(lpb_Env *e, const lpb_Codec *c, int keys, int idx);
+static void lpbC_decode(lpb_Env *e, const lpb_Codec *c, int keys);
+static void lpbC_newtable(lua_State *L, lpb_State *LS, const lpb_Codec *c, int keys);
+
 static void lpb_checktable(lua_State *L, const pb_Field *f, int idx) {
     argcheck(L, lua_istable(L, idx),
             2, "table expected at field '%s', got %s",
@@ -1760,6 +1817,7 @@ static void lpbE_encode(lpb_Env *e, const pb_Type *t, int idx) {
 static int Lpb_encode(lua_State *L) {
     lpb_State *LS = lpb_lstate(L);
     const pb_Type *t = lpb_type(L, LS, lpb_checkslice(L, 1));
+    const lpb_Codec *c;
     lpb_Env e;
     argcheck(L, t!=NULL, 1, "type '%s' does not exists", lua_tostring(L, 1));
     luaL_checktype(L, 2, LUA_TTABLE);
@@ -1767,7 +1825,11 @@ static int Lpb_encode(lua_State *L) {
     if (e.b == NULL) pb_resetbuffer(e.b = &LS->buffer);
     lua_pushvalue(L, 2);
     if (e.LS->use_enc_hooks) lpb_useenchooks(L, e.LS, t);
-    lpbE_encode(&e, t, -1);
+    if (!LS->use_enc_hooks && !LS->encode_order
+            && (c = lpbC_cached(L, LS, t)) != NULL)
+        lpbC_encode(&e, c, lua_gettop(L), lua_gettop(L)-1);
+    else
+        lpbE_encode(&e, t, -1);
     if (e.b != &LS->buffer)
         lua_settop(L, 3);
     else {
@@ -1976,14 +2038,24 @@ static int lpbD_message(lpb_Env *e, const pb_Type *t) {
 static int lpbD_decode(lua_State *L, pb_Slice s, int start) {
     lpb_State *LS = lpb_lstate(L);
     const pb_Type *t = lpb_type(L, LS, lpb_checkslice(L, 1));
+    const lpb_Codec *c;
     lpb_Env e;
     argcheck(L, t!=NULL, 1, "type '%s' does not exists", lua_tostring(L, 1));
     lua_settop(L, start);
+    e.L = L, e.LS = LS, e.s = &s;
+    if (!LS->use_dec_hooks && (c = lpbC_cached(L, LS, t)) != NULL) {
+        if (!lua_istable(L, start)) {
+            lpbC_newtable(L, LS, c, start+1);
+            lua_replace(L, start);
+        }
+        lua_pushvalue(L, start);
+        lpbC_decode(&e, c, start+1);
+        return 1;
+    }
     if (!lua_istable(L, start)) {
         lua_pop(L, 1);
         lpb_pushtypetable(L, LS, t);
     }
-    e.L = L, e.LS = LS, e.s = &s;
     return lpbD_message(&e, t);
 }
 
@@ -2064,6 +2136,482 @@ static int Lpb_unpack(lua_State* L) {
     return lpbD_unpack(&e, t);
 }
 
+/* protobuf compiled codec */
+
+/* A codec flattens a message type once: fields sorted by number, the
+ * varint of every field key precomputed, and a dense number -> field map
+ * for the common case of small field numbers. The keys table (uservalue
+ * of the codec) holds for field i: keys[i+1] the table key (field name,
+ * or i+1 in the index layout), keys[n+i+1] the oneof name, keys[2n+i+1]
+ * the keys table of the sub message codec and keys[3n+i+1] the default
+ * value filled in by decode. keys.codec anchors the codec itself. */
+
+#define lpbC_keyindex(i)     ((int)(i)+1)
+#define lpbC_oneofindex(c,i) ((int)((c)->nfield+(i))+1)
+#define lpbC_subindex(c,i)   ((int)((c)->nfield*2+(i))+1)
+#define lpbC_defindex(c,i)   ((int)((c)->nfield*3+(i))+1)
+
+static void lpbC_pushcodectable(lua_State *L, lpb_State *LS, int layout)
+{ LS->codecs_index[layout] = lpb_reftable(L, LS->codecs_index[layout]); }
+
+static const lpb_Codec *lpbC_cached(lua_State *L, lpb_State *LS, const pb_Type *t) {
+    const lpb_Codec *c;
+    if (LS->codecs_index[LPBC_NAME] == LUA_NOREF) return NULL;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, LS->codecs_index[LPBC_NAME]);
+    if (lua53_rawgetp(L, -1, t) != LUA_TUSERDATA) {
+        lua_pop(L, 2);
+        return NULL;
+    }
+    c = (const lpb_Codec*)lua_touserdata(L, -1);
+    lua_getuservalue(L, -1);
+    lua_replace(L, -3);
+    lua_pop(L, 1);
+    return c;
+}
+
+static int lpbC_find(const lpb_Codec *c, uint32_t number) {
+    int lo = 0, hi = (int)c->nfield - 1;
+    if (number < c->ndense) return (int)c->dense[number] - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) >> 1;
+        uint32_t n = (uint32_t)c->fields[mid].f->number;
+        if (n == number) return mid;
+        if (n < number) lo = mid + 1; else hi = mid - 1;
+    }
+    return -1;
+}
+
+static unsigned lpbC_defmode(const lpb_State *LS, const pb_Type *t) {
+    unsigned mode = t->is_proto3 && LS->encode_mode == LPB_DEFDEF ?
+        LPB_COPYDEF : LS->encode_mode;
+    return mode | LS->decode_default_array << 2
+        | LS->decode_default_message << 3 | LS->enum_as_value << 4
+        | LS->int64_mode << 5;
+}
+
+/* same table as lpb_pushtypetable, with the defaults taken from keys */
+static void lpbC_newtable(lua_State *L, lpb_State *LS, const lpb_Codec *c, int keys) {
+    unsigned i;
+    if (c->layout == LPBC_INDEX) {
+        lua_createtable(L, (int)c->nfield, 0);
+        return;
+    }
+    if (!c->fastdef || c->defmode != lpbC_defmode(LS, c->t)) {
+        lpb_pushtypetable(L, LS, c->t);
+        return;
+    }
+    lpb_newmsgtable(L, c->t);
+    for (i = 0; i < c->nfield; ++i) {
+        const lpb_CField *cf = &c->fields[i];
+        if (!cf->defvalue && !cf->defarray) continue;
+        lua_rawgeti(L, keys, lpbC_keyindex(i));
+        if (cf->defvalue)
+            lua_rawgeti(L, keys, lpbC_defindex(c, i));
+        else
+            lua_newtable(L);
+        lua_rawset(L, -3);
+    }
+}
+
+static void lpbC_pushsubkeys(lua_State *L, const lpb_Codec *c, int keys, unsigned i)
+{ lua_rawgeti(L, keys, lpbC_subindex(c, i)); }
+
+static void lpbC_fetchtable(lua_State *L, int keys, unsigned i) {
+    lua_rawgeti(L, keys, lpbC_keyindex(i));
+    lua_pushvalue(L, -1);
+    lua_rawget(L, -3);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_insert(L, -3);
+        lua_rawset(L, -4);
+    } else
+        lua_remove(L, -2);
+}
+
+/* decode a length delimited message of field i, push the result table */
+static void lpbC_submessage(lpb_Env *e, const lpb_Codec *c, int keys, unsigned i) {
+    lua_State *L = e->L;
+    const lpb_Codec *sub = c->fields[i].sub;
+    pb_Slice sv, *s = e->s;
+    lpb_readbytes(L, s, &sv);
+    lpbC_pushsubkeys(L, c, keys, i);
+    lpbC_newtable(L, e->LS, sub, lua_gettop(L));
+    lpb_withinput(e, &sv, lpbC_decode(e, sub, lua_gettop(L)-1));
+    lua_remove(L, -2);
+}
+
+static void lpbC_map(lpb_Env *e, const lpb_Codec *c, int keys, unsigned i) {
+    lua_State *L = e->L;
+    const pb_Field *f = c->fields[i].f;
+    const pb_Field *vf = pb_field(f->type, 2);
+    pb_Slice p, *s = e->s;
+    int mask = 0, top = lua_gettop(L);
+    uint32_t tag;
+    lpb_readbytes(L, s, &p);
+    lua_pushnil(L);
+    lua_pushnil(L);
+    while (pb_readvarint32(&p, &tag)) {
+        int n = pb_gettag(tag);
+        if (n == 2 && c->fields[i].sub != NULL) {
+            mask |= n;
+            lpbD_checktype(e, vf, tag);
+            lpb_withinput(e, &p, lpbC_submessage(e, c, keys, i));
+            lua_replace(L, top+n);
+        } else if (n == 1 || n == 2) {
+            mask |= n;
+            lpb_withinput(e, &p, lpbD_field(e, pb_field(f->type, n), tag));
+            lua_replace(L, top+n);
+        }
+    }
+    if (!(mask & 1) && lpb_pushdeffield(L, e->LS, pb_field(f->type, 1), 1))
+        lua_replace(L, top + 1), mask |= 1;
+    if (!(mask & 2) && lpb_pushdeffield(L, e->LS, vf, 1))
+        lua_replace(L, top + 2), mask |= 2;
+    if (mask == 3) lua_rawset(L, -3); else lua_pop(L, 2);
+}
+
+static void lpbC_decode(lpb_Env *e, const lpb_Codec *c, int keys) {
+    lua_State *L = e->L;
+    pb_Slice *s = e->s;
+    uint32_t tag;
+    luaL_checkstack(L, 6, "message too many levels");
+    while (pb_readvarint32(s, &tag)) {
+        int i = lpbC_find(c, pb_gettag(tag));
+        const lpb_CField *cf;
+        if (i < 0) {
+            pb_skipvalue(s, tag);
+            continue;
+        }
+        cf = &c->fields[i];
+        switch (cf->kind) {
+        case LPBC_SCALAR: case LPBC_MESSAGE:
+            lua_rawgeti(L, keys, lpbC_keyindex(i));
+            if (cf->oneof) {
+                lua_rawgeti(L, keys, lpbC_oneofindex(c, i));
+                lua_pushvalue(L, -2);
+                lua_rawset(L, -4);
+            }
+            if (cf->kind == LPBC_SCALAR)
+                lpbD_field(e, cf->f, tag);
+            else {
+                lpbD_checktype(e, cf->f, tag);
+                lpbC_submessage(e, c, keys, i);
+            }
+            lua_rawset(L, -3);
+            break;
+        case LPBC_REPEATED:
+            lpbC_fetchtable(L, keys, i);
+            if (cf->sub == NULL)
+                lpbD_repeated(e, cf->f, tag);
+            else {
+                lpbD_checktype(e, cf->f, tag);
+                lpbC_submessage(e, c, keys, i);
+                lua_rawseti(L, -2, (lua_Integer)lua_rawlen(L, -2) + 1);
+            }
+            lua_pop(L, 1);
+            break;
+        case LPBC_MAP:
+            lpbC_fetchtable(L, keys, i);
+            lpbD_checktype(e, cf->f, tag);
+            lpbC_map(e, c, keys, i);
+            lua_pop(L, 1);
+            break;
+        default:
+            pb_skipvalue(s, tag);
+        }
+    }
+}
+
+static void lpbC_addtag(lpb_Env *e, const lpb_CField *cf) {
+    char *p = pb_prepbuffsize(e->b, cf->taglen);
+    if (p == NULL) luaL_error(e->L, "out of memory");
+    memcpy(p, cf->tag, cf->taglen);
+    pb_addsize(e->b, cf->taglen);
+}
+
+/* encode the message at the top of stack as a length delimited value */
+static size_t lpbC_subvalue(lpb_Env *e, const lpb_Codec *c, int keys, unsigned i, int *pexist) {
+    lua_State *L = e->L;
+    pb_Buffer *b = e->b;
+    size_t len;
+    lpb_checktable(L, c->fields[i].f, -1);
+    lpb_checkmem(L, pb_addvarint32(b, 0));
+    len = pb_bufflen(b);
+    lpbC_pushsubkeys(L, c, keys, i);
+    lpbC_encode(e, c->fields[i].sub, lua_gettop(L), lua_gettop(L)-1);
+    lua_pop(L, 1);
+    *pexist = (len < pb_bufflen(b));
+    return lpb_addlength(L, b, len, 1);
+}
+
+static void lpbC_tagfield(lpb_Env *e, const lpb_Codec *c, int keys, unsigned i, int ignorezero) {
+    const lpb_CField *cf = &c->fields[i];
+    size_t len;
+    int exist;
+    lpbC_addtag(e, cf);
+    if (cf->sub != NULL)
+        len = lpbC_subvalue(e, c, keys, i, &exist);
+    else
+        len = lpbE_field(e, cf->f, &exist, -1);
+    if (!e->LS->encode_default_values && !exist && ignorezero)
+        e->b->size -= (unsigned)(len + cf->taglen);
+}
+
+static void lpbC_encodemap(lpb_Env *e, const lpb_Codec *c, int keys, unsigned i) {
+    lua_State *L = e->L;
+    const pb_Field *f = c->fields[i].f;
+    const pb_Field *kf = pb_field(f->type, 1);
+    const pb_Field *vf = pb_field(f->type, 2);
+    if (kf == NULL || vf == NULL) return;
+    lpb_checktable(L, f, -1);
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        size_t len;
+        lpbC_addtag(e, &c->fields[i]);
+        lpb_checkmem(L, pb_addvarint32(e->b, 0));
+        len = pb_bufflen(e->b);
+        lpbE_tagfield(e, kf, 1, -2);
+        if (c->fields[i].sub == NULL)
+            lpbE_tagfield(e, vf, 1, -1);
+        else {
+            size_t hlen = lpb_checkmem(L, pb_addvarint32(e->b,
+                        pb_pair(2, PB_TBYTES)));
+            int exist;
+            size_t vlen = lpbC_subvalue(e, c, keys, i, &exist);
+            if (!e->LS->encode_default_values && !exist)
+                e->b->size -= (unsigned)(vlen + hlen);
+        }
+        lpb_addlength(L, e->b, len, 1);
+        lua_pop(L, 1);
+    }
+}
+
+static void lpbC_encode(lpb_Env *e, const lpb_Codec *c, int keys, int idx) {
+    lua_State *L = e->L;
+    unsigned i;
+    luaL_checkstack(L, 6, "message too many levels");
+    for (i = 0; i < c->nfield; ++i) {
+        const lpb_CField *cf = &c->fields[i];
+        int j;
+        lua_rawgeti(L, keys, lpbC_keyindex(i));
+        lua_rawget(L, idx);
+        if (lua_isnil(L, -1)) {
+            lua_pop(L, 1);
+            continue;
+        }
+        switch (cf->kind) {
+        case LPBC_SCALAR: case LPBC_MESSAGE:
+            lpbC_tagfield(e, c, keys, i, cf->ignorezero);
+            break;
+        case LPBC_REPEATED:
+            if (cf->sub == NULL) {
+                lpbE_repeated(e, cf->f, -1);
+                break;
+            }
+            lpb_checktable(L, cf->f, -1);
+            for (j = 1; lua53_rawgeti(L, -1, j) != LUA_TNIL; ++j) {
+                lpbC_tagfield(e, c, keys, i, 0);
+                lua_pop(L, 1);
+            }
+            lua_pop(L, 1);
+            break;
+        case LPBC_MAP:
+            lpbC_encodemap(e, c, keys, i);
+            break;
+        }
+        lua_pop(L, 1);
+    }
+}
+
+static void lpbC_initfield(lpb_CField *cf, const pb_Type *t, const pb_Field *f) {
+    uint32_t key;
+    cf->f = f;
+    cf->sub = NULL;
+    cf->oneof = f->oneof_idx != 0;
+    cf->ignorezero = 0;
+    if (f->type && f->type->is_map)
+        cf->kind = LPBC_MAP, key = pb_pair(f->number, PB_TBYTES);
+    else if (f->repeated)
+        cf->kind = LPBC_REPEATED, key = pb_pair(f->number, f->packed ?
+                PB_TBYTES : pb_wtypebytype(f->type_id));
+    else if (f->type_id == PB_Tmessage)
+        cf->kind = LPBC_MESSAGE, key = pb_pair(f->number, PB_TBYTES);
+    else {
+        cf->kind = LPBC_SCALAR, key = pb_pair(f->number, pb_wtypebytype(f->type_id));
+        cf->ignorezero = t->is_proto3 && !f->oneof_idx;
+    }
+    if (f->type_id == PB_Tmessage && (f->type == NULL || f->type->is_dead))
+        cf->kind = LPBC_SKIP;
+    for (cf->taglen = 0; key >= 0x80; key >>= 7)
+        cf->tag[cf->taglen++] = (char)(key | 0x80);
+    cf->tag[cf->taglen++] = (char)key;
+}
+
+/* precompute what lpb_setdeffields would put into a decoded table */
+static void lpbC_initdefault(lua_State *L, lpb_State *LS, lpb_Codec *c, unsigned i) {
+    lpb_CField *cf = &c->fields[i];
+    const pb_Field *f = cf->f;
+    unsigned mode = c->defmode & 3, array = (c->defmode >> 2) & 1;
+    cf->defvalue = cf->defarray = 0;
+    if (!c->fastdef) return;
+    if (f->repeated)
+        cf->defarray = (mode == LPB_COPYDEF || array)
+            && (c->t->is_proto3 || array);
+    else if (mode == LPB_COPYDEF && !f->oneof_idx && f->type_id != PB_Tmessage
+            && lpb_pushdeffield(L, LS, f, c->t->is_proto3)) {
+        cf->defvalue = 1;
+        lua_rawseti(L, -2, lpbC_defindex(c, i));
+    }
+}
+
+static const pb_Type *lpbC_subtype(const pb_Field *f) {
+    if (f->type_id != PB_Tmessage || f->type == NULL || f->type->is_dead)
+        return NULL;
+    if (f->type->is_map) {
+        const pb_Field *vf = pb_field(f->type, 2);
+        return vf ? lpbC_subtype(vf) : NULL;
+    }
+    return f->type;
+}
+
+/* push the codec of t, compiling it (and the types it refers) if needed */
+static lpb_Codec *lpbC_compile(lua_State *L, lpb_State *LS, const pb_Type *t, int layout) {
+    pb_Field **list;
+    lpb_Codec *c;
+    unsigned i, n = t->field_count, ndense = 0;
+    luaL_checkstack(L, 6, "message too many levels");
+    lpbC_pushcodectable(L, LS, layout);
+    if (lua53_rawgetp(L, -1, t) == LUA_TUSERDATA) {
+        lua_remove(L, -2);
+        return (lpb_Codec*)lua_touserdata(L, -1);
+    }
+    lua_pop(L, 1);
+    list = pb_sortfield((pb_Type*)t);
+    if (n != 0 && n < 0xFFFF && (unsigned)list[n-1]->number < n*4 + 16)
+        ndense = (unsigned)list[n-1]->number + 1;
+    c = (lpb_Codec*)lua_newuserdata(L, sizeof(lpb_Codec)
+            + n*sizeof(lpb_CField) + ndense*sizeof(uint16_t));
+    c->LS = LS, c->t = t, c->gen = LS->codec_gen;
+    c->layout = layout, c->nfield = n, c->ndense = ndense;
+    c->defmode = lpbC_defmode(LS, t);
+    c->fastdef = (c->defmode & 3) != LPB_METADEF && !LS->decode_default_message;
+    c->fields = (lpb_CField*)(c + 1);
+    c->dense = (uint16_t*)(c->fields + n);
+    memset(c->dense, 0, ndense*sizeof(uint16_t));
+    luaL_setmetatable(L, PB_CODEC);
+    lua_createtable(L, (int)n*4, 2);
+    lua_rawgetp(L, LUA_REGISTRYINDEX, state_name);
+    lua_setfield(L, -2, "state"); /* keeps c->LS alive */
+    lua_pushvalue(L, -2);
+    lua_setfield(L, -2, "codec");
+    lua_pushvalue(L, -1);
+    lua_setuservalue(L, -3);
+    lua_pushvalue(L, -2);
+    lua_rawsetp(L, -4, t); /* register first for recursive types */
+    for (i = 0; i < n; ++i) {
+        const pb_Field *f = list[i];
+        const pb_Type *st = lpbC_subtype(f);
+        lpbC_initfield(&c->fields[i], t, f);
+        if (layout == LPBC_NAME) lpbC_initdefault(L, LS, c, i);
+        if (ndense != 0) c->dense[f->number] = (uint16_t)(i + 1);
+        if (layout == LPBC_INDEX)
+            lua_pushinteger(L, (lua_Integer)i + 1);
+        else
+            lua_pushstring(L, (const char*)f->name);
+        lua_rawseti(L, -2, lpbC_keyindex(i));
+        if (layout == LPBC_INDEX)
+            c->fields[i].oneof = 0;
+        else if (f->oneof_idx) {
+            lua_pushstring(L, (const char*)pb_oneofname(t, f->oneof_idx));
+            lua_rawseti(L, -2, lpbC_oneofindex(c, i));
+        }
+        if (st != NULL && c->fields[i].kind != LPBC_SKIP) {
+            c->fields[i].sub = lpbC_compile(L, LS, st, layout);
+            lua_getuservalue(L, -1);
+            lua_rawseti(L, -3, lpbC_subindex(c, i));
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+    lua_remove(L, -2);
+    return c;
+}
+
+static const lpb_Codec *lpbC_check(lua_State *L, int idx) {
+    const lpb_Codec *c = (const lpb_Codec*)luaL_checkudata(L, idx, PB_CODEC);
+    const lpb_State *LS = lpb_lstate(L);
+    argcheck(L, c->LS == LS && c->gen == LS->codec_gen,
+            idx, "codec is outdated, the schema has changed since compiled");
+    return c;
+}
+
+static int Lpb_compile(lua_State *L) {
+    static const char *layouts[] = { "name", "index", NULL };
+    lpb_State *LS = lpb_lstate(L);
+    const pb_Type *t = NULL;
+    int count = 0;
+    if (lua_isnoneornil(L, 1)) {
+        if (LS->state == &LS->local) {
+            while (pb_nexttype(LS->state, &t)) {
+                if (t->is_map || t->is_enum) continue;
+                lpbC_compile(L, LS, t, LPBC_NAME);
+                lua_pop(L, 1);
+                ++count;
+            }
+        }
+        lua_pushinteger(L, count);
+        return 1;
+    }
+    t = lpb_type(L, LS, lpb_checkslice(L, 1));
+    argcheck(L, t!=NULL, 1, "type '%s' does not exists", lua_tostring(L, 1));
+    argcheck(L, LS->state == &LS->local,
+            1, "can not compile types of the global state");
+    lpbC_compile(L, LS, t, luaL_checkoption(L, 2, "name", layouts));
+    return 1;
+}
+
+static int Lpb_codec_decode(lua_State *L) {
+    const lpb_Codec *c = lpbC_check(L, 1);
+    pb_Slice s = lua_isnoneornil(L, 2) ?
+        pb_lslice(NULL, 0) : lpb_checkslice(L, 2);
+    lpb_Env e;
+    e.L = L, e.LS = lpb_lstate(L), e.s = &s;
+    lua_settop(L, 3);
+    lua_getuservalue(L, 1);
+    if (lua_istable(L, 3))
+        lua_pushvalue(L, 3);
+    else
+        lpbC_newtable(L, e.LS, c, 4);
+    lpbC_decode(&e, c, 4);
+    return 1;
+}
+
+static int Lpb_codec_encode(lua_State *L) {
+    const lpb_Codec *c = lpbC_check(L, 1);
+    lpb_State *LS = lpb_lstate(L);
+    lpb_Env e;
+    luaL_checktype(L, 2, LUA_TTABLE);
+    e.L = L, e.LS = LS, e.b = test_buffer(L, 3);
+    if (e.b == NULL) pb_resetbuffer(e.b = &LS->buffer);
+    lua_getuservalue(L, 1);
+    lpbC_encode(&e, c, lua_gettop(L), 2);
+    if (e.b != &LS->buffer)
+        lua_settop(L, 3);
+    else {
+        lua_pushlstring(L, pb_buffer(e.b), pb_bufflen(e.b));
+        pb_resetbuffer(e.b);
+    }
+    return 1;
+}
+
+static int Lpb_codec_type(lua_State *L) {
+    const lpb_Codec *c = lpbC_check(L, 1);
+    lua_pushstring(L, (const char*)c->t->name);
+    return 1;
+}
+
 /* pb module interface */
 
 static int Lpb_option(lua_State *L) {
@@ -2130,6 +2678,7 @@ LUALIB_API int luaopen_pb(lua_State *L) {
         ENTRY(state),
         ENTRY(pack),
         ENTRY(unpack),
+        ENTRY(compile),
 #undef  ENTRY
         { NULL, NULL }
     };
@@ -2138,11 +2687,23 @@ LUALIB_API int luaopen_pb(lua_State *L) {
         { "setdefault", Lpb_state },
         { NULL, NULL }
     };
+    luaL_Reg codec_meta[] = {
+        { "decode", Lpb_codec_decode },
+        { "encode", Lpb_codec_encode },
+        { "type",   Lpb_codec_type   },
+        { NULL, NULL }
+    };
     if (luaL_newmetatable(L, PB_STATE)) {
         luaL_setfuncs(L, meta, 0);
         lua_pushvalue(L, -1);
         lua_setfield(L, -2, "__index");
     }
+    if (luaL_newmetatable(L, PB_CODEC)) {
+        luaL_setfuncs(L, codec_meta, 0);
+        lua_pushvalue(L, -1);
+        lua_setfield(L, -2, "__index");
+    }
+    lua_pop(L, 1);
     luaL_newlib(L, libs);
     return 1;
 }
@@ -2176,6 +2737,7 @@ static int Lpb_use(lua_State *L) {
     case 0: if (GS) LS->state = GS; break;
     case 1: LS->state = &LS->local; break;
     }
+    lpbC_reset(L, LS);
     lua_pushboolean(L, GS != NULL);
     return 1;
 }
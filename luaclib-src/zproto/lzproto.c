@@ -6,6 +6,7 @@
 #include "lua.h"
 #include "lualib.h"
 #include "lauxlib.h"
+#include "silly.h"
 #include "zproto.h"
 
 #define MAX_RECURSIVE (64)
@@ -319,23 +320,14 @@ resizebuffer(lua_State *L, size_t sz)
 	return data;
 }
 
+//encode the table at 'top' into the function buffer, which only grows
 static int
-lencode(lua_State *L)
+encode_buffer(lua_State *L, struct zproto_struct *st, int top, uint8_t **out)
 {
+	int sz;
 	uint8_t *data;
 	size_t datasz;
-	int sz, top, raw = 0;
-	struct zproto_struct *st;
 	struct lencode_ud ud;
-	st = (struct zproto_struct *)lua_touserdata(L, 1);
-	if (st == NULL)
-		return luaL_error(L, "encode: 'struct' is null");
-	top = lua_gettop(L);
-	if (top >= 3) {
-		raw = lua_toboolean(L, 3);
-		lua_pop(L, 1);
-		--top;
-	}
 	lua_checkstack(L, MAX_RECURSIVE * 3 + 8);
 	ud.level = 0;
 	ud.L = L;
@@ -351,6 +343,26 @@ lencode(lua_State *L)
 		break;
 	}
 	lua_settop(L, top);
+	*out = data;
+	return sz;
+}
+
+static int
+lencode(lua_State *L)
+{
+	uint8_t *data;
+	int sz, top, raw = 0;
+	struct zproto_struct *st;
+	st = (struct zproto_struct *)lua_touserdata(L, 1);
+	if (st == NULL)
+		return luaL_error(L, "encode: 'struct' is null");
+	top = lua_gettop(L);
+	if (top >= 3) {
+		raw = lua_toboolean(L, 3);
+		lua_pop(L, 1);
+		--top;
+	}
+	sz = encode_buffer(L, st, top, &data);
 	if (sz <= 0) {
 		return 0;
 	}else if(raw == 1) {
@@ -363,13 +375,82 @@ lencode(lua_State *L)
 	}
 }
 
+//@input
+//	struct
+//	table
+//	pack
+//@output
+//	ptr, size: owned by the caller, can be passed to net.tcpsend
+static int
+lencodebuf(lua_State *L)
+{
+	int sz, pack;
+	uint8_t *data, *buf;
+	struct zproto_struct *st;
+	st = (struct zproto_struct *)lua_touserdata(L, 1);
+	if (st == NULL)
+		return luaL_error(L, "encodebuf: 'struct' is null");
+	luaL_checktype(L, 2, LUA_TTABLE);
+	pack = lua_toboolean(L, 3);
+	lua_settop(L, 2);
+	sz = encode_buffer(L, st, 2, &data);
+	if (sz <= 0)
+		return 0;
+	if (pack) {	//pack straight into the buffer handed out
+		int need = ((sz + 2047) / 2048) * 2 + sz + 1;
+		buf = (uint8_t *)silly_malloc(need);
+		sz = zproto_pack(data, sz, buf, need);
+		assert(sz > 0);
+	} else {
+		buf = (uint8_t *)silly_malloc(sz);
+		memcpy(buf, data, sz);
+	}
+	lua_pushlightuserdata(L, buf);
+	lua_pushinteger(L, sz);
+	return 2;
+}
+
 struct ldecode_ud {
 	int level;
 	lua_State *L;
 	int duptag;
 	int dupidx;
+	int pool;	//stack index of the table pool, 0 if none
 };
 
+static void
+newtable(lua_State *L, struct ldecode_ud *ud)
+{
+	lua_Integer n;
+	if (ud->pool != 0 && (n = (lua_Integer)lua_rawlen(L, ud->pool)) > 0) {
+		lua_rawgeti(L, ud->pool, n);
+		lua_pushnil(L);
+		lua_rawseti(L, ud->pool, n);
+	} else {
+		lua_newtable(L);
+	}
+}
+
+//clear the table at 'idx', sub-tables are cleared and put into the pool
+static void
+recycle(lua_State *L, int idx, int pool, int level)
+{
+	if (level >= MAX_RECURSIVE)
+		luaL_error(L, "recycle table too deep:%d", level);
+	lua_pushnil(L);
+	while (lua_next(L, idx)) {
+		if (pool != 0 && lua_type(L, -1) == LUA_TTABLE) {
+			recycle(L, lua_gettop(L), pool, level + 1);
+			lua_rawseti(L, pool, (lua_Integer)lua_rawlen(L, pool) + 1);
+		} else {
+			lua_pop(L, 1);
+		}
+		lua_pushvalue(L, -1);
+		lua_pushnil(L);
+		lua_rawset(L, idx);
+	}
+}
+
 static int decode_table(struct zproto_args *args);
 
 static int
@@ -418,6 +499,7 @@ decode_field(struct zproto_args *args)
 	case ZPROTO_STRUCT:
 		ud.L = L;
 		ud.level = now->level + 1;
+		ud.pool = now->pool;
 		if (args->maptag) {
 			int dupidx;
 			lua_pushnil(L);
@@ -429,7 +511,7 @@ decode_field(struct zproto_args *args)
 			ud.duptag = 0;
 			ud.dupidx = 0;
 		}
-		lua_newtable(L);
+		newtable(L, &ud);
 		return zproto_decode(args->sttype, args->buff, args->buffsz, decode_table, &ud);
 	}
 	return ZPROTO_ERROR;
@@ -443,7 +525,7 @@ decode_array(struct zproto_args *args)
 	struct ldecode_ud *now = args->ud;
 	L = now->L;
 	if (args->idx == 0)
-		lua_newtable(L);
+		newtable(L, now);
 	if (args->len == 0)	//empty array
 		return 0;
 	//array can't be mapkey
@@ -511,6 +593,12 @@ get_buffer(lua_State *L, int *stk, size_t *sz)
 	return ptr;
 }
 
+//@input
+//	struct
+//	data (string|lightuserdata, size)
+//	into (optional): table cleared and refilled instead of a new one
+//	pool (optional): array of spare tables, sub-tables of 'into' go
+//	back into it and decode takes its tables from it
 static int
 ldecode(lua_State *L)
 {
@@ -523,7 +611,13 @@ ldecode(lua_State *L)
 		return luaL_error(L, "decode: 'struct' is null");
 	lua_checkstack(L, MAX_RECURSIVE * 3 + 8);
 	data = (uint8_t *)get_buffer(L, &stk, &datasz);
-	lua_newtable(L);
+	ud.pool = lua_type(L, 5) == LUA_TTABLE ? 5 : 0;
+	if (lua_type(L, 4) == LUA_TTABLE) {
+		recycle(L, 4, ud.pool, 0);
+		lua_pushvalue(L, 4);
+	} else {
+		lua_newtable(L);
+	}
 	top = lua_gettop(L);
 	ud.L = L;
 	ud.level = 1;
@@ -809,6 +903,7 @@ luaopen_zproto_c(lua_State *L)
 	luaL_Reg tbl2[] = {
 		//encode/decode
 		{"encode", lencode},
+		{"encodebuf", lencodebuf},
 		{"pack", lpack},
 		{"unpack", lunpack},
 		{NULL, NULL},
@@ -1174,14 +1174,20 @@ end
 function Parser:load(s, name)
    if self == Parser then self = Parser.new() end
    local ret, pos = pb.load(self:compile(s, name))
-   if ret then return ret, pos end
+   if ret then
+      pb.compile()
+      return ret, pos
+   end
    error("load failed at offset "..pos)
 end
 
 function Parser:loadfile(fn)
    if self == Parser then self = Parser.new() end
    local ret, pos = pb.load(self:compilefile(fn))
-   if ret then return ret, pos end
+   if ret then
+      pb.compile()
+      return ret, pos
+   end
    error("load failed at offset "..pos)
 end
 
@@ -38,6 +38,7 @@ silly.timerresolution = c.timerresolution
 silly.genid = c.genid
 silly.tostring = c.tostring
 silly.register = c.register
+silly.gctune = c.gctune
 silly.pcall = silly_pcall
 silly.exit = task._exit
 silly._start = task._start
@@ -5,9 +5,11 @@ local prometheus = require "silly.metrics.prometheus"
 local logger = require "silly.logger"
 local tcp = require "silly.net.tcp"
 local debugger = require "silly.debugger"
+local perf = require "silly.perf"
 local type = type
 local pairs = pairs
 local pcall = pcall
+local tonumber = tonumber
 local loadfile = loadfile
 local lower = string.lower
 local format = string.format
@@ -23,6 +25,8 @@ local desc = {
 "SOCKET: Show socket detail information. [SOCKET]",
 "TASK: Show all task status and traceback. [TASK]",
 "INJECT: INJECT code. [INJECT <path>]",
+"PROFILE: CPU sampling profiler, DUMP prints folded stacks. [PROFILE START <hz>|STOP|DUMP]",
+"MEMPROF: Sampled allocation profiler, DUMP prints folded stacks. [MEMPROF START <rate>|STOP|DUMP <bytes|live|count>]",
 "DEBUG: Enter Debug mode. [DEBUG]",
 "QUIT: Quit the console. [QUIT]",
 }
@@ -134,6 +138,50 @@ function console.inject(_, filepath)
 	end
 end
 
+function console.profile(_, op, hz)
+	op = op and lower(op)
+	if op == "start" then
+		local err = perf.samplestart(tonumber(hz))
+		if err then
+			return "ERR " .. err
+		end
+		return "OK"
+	elseif op == "stop" then
+		perf.samplestop()
+		return "OK"
+	elseif op == "dump" then
+		local st = perf.samplestat()
+		return format("#Profile ticks:%d samples:%d native:%d skipped:%d dropped:%d\r\n%s",
+			st.ticks, st.samples, st.native, st.skipped, st.dropped,
+			perf.sampledump(true))
+	end
+	return "ERR usage: PROFILE START <hz>|STOP|DUMP"
+end
+
+function console.memprof(_, op, arg)
+	op = op and lower(op)
+	if op == "start" then
+		local err = perf.allocstart(tonumber(arg))
+		if err then
+			return "ERR " .. err
+		end
+		return "OK"
+	elseif op == "stop" then
+		perf.allocstop()
+		return "OK"
+	elseif op == "dump" then
+		arg = arg and lower(arg) or "bytes"
+		if arg ~= "bytes" and arg ~= "live" and arg ~= "count" then
+			return "ERR usage: MEMPROF DUMP <bytes|live|count>"
+		end
+		local st = perf.allocstat()
+		return format("#Memprof %s samples:%d bytes:%d live:%d liveobjs:%d dropped:%d\r\n%s",
+			arg, st.samples, st.bytes, st.live, st.liveobjs, st.dropped,
+			perf.allocdump(arg, true))
+	end
+	return "ERR usage: MEMPROF START <rate>|STOP|DUMP <bytes|live|count>"
+end
+
 function console.debug(fd)
 	local read = function ()
 		return tcp.read(fd, "\n")
@@ -14,6 +14,7 @@ local task_resume = task._resume
 
 local M = {}
 local working = {}
+local done = {}
 local lock = mutex.new()
 
 local prune_timer
@@ -25,7 +26,14 @@ prune_timer()
 
 ---@type fun(min:integer, max:integer)
 M.limit = c.limit
----@type fun():integer
+---@class silly.hive.stats
+---@field busy integer threads running a task
+---@field queue integer tasks waiting for a thread
+---@field tasks integer tasks finished since start
+---@field wait_ns integer total time tasks spent in the queue
+---@field run_ns integer total time tasks spent running
+
+---@type fun():integer, silly.hive.stats
 M.threads = c.threads
 ---@type fun(code:string, ...):silly.hive.worker
 M.spawn = c.spawn
@@ -41,15 +49,29 @@ function M.invoke(worker, ...)
 	working[id] = t
 	local ok, dat = task_yield("HIVE")
 	if not ok then
-		error(dat[1])
+		error(dat[3])
 	end
 	working[id] = nil
-	return unpack(dat)
+	return unpack(dat, 3, dat.n)
 end
 
-silly.register(c.DONE, function(id, ok, ...)
-	local t = working[id]
-	task_resume(t, ok, pack(...))
+-- one DONE message carries every task finished since the last one,
+-- drain them all before resuming so no result is left behind
+silly.register(c.DONE, function()
+	local n = 0
+	while true do
+		local dat = pack(c.pop())
+		if dat.n == 0 then
+			break
+		end
+		n = n + 1
+		done[n] = dat
+	end
+	for i = 1, n do
+		local dat = done[i]
+		done[i] = nil
+		task_resume(working[dat[1]], dat[2], dat)
+	end
 end)
 
 return M
\ No newline at end of file
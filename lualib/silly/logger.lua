@@ -1,10 +1,13 @@
 local silly = require "silly"
 local signal = require "silly.signal"
 local env = require "silly.env"
+local time = require "silly.time"
 local c = require "silly.logger.c"
 
 local function nop(...)end
 
+local REPORT_INTERVAL<const> = 5000
+
 local logger = {
 	--const from silly_log.h
 	DEBUG = 0,
@@ -14,6 +17,9 @@ local logger = {
 	--logger function export
 	getlevel = c.getlevel,
 	setlevel = nil,
+	ratelimit = nil,
+	allow = c.allow,
+	suppressed = c.suppressed,
 	debug = nop,
 	info = nop,
 	warn = nop,
@@ -53,6 +59,32 @@ function logger.setlevel(level)
 	c.setlevel(level)
 end
 
+local reporting = false
+local limited = false
+
+local function report()
+	c.report()
+	if limited then
+		time.after(REPORT_INTERVAL, report)
+	else
+		reporting = false
+	end
+end
+
+---Limit every call site (file:line of the caller) to `rate` lines per
+---second with bursts of `burst` lines, 0 turns limiting off. Suppressed
+---lines are counted and summarized every few seconds.
+---@param rate number
+---@param burst number?
+function logger.ratelimit(rate, burst)
+	c.ratelimit(rate, burst)
+	limited = rate > 0
+	if limited and not reporting then
+		reporting = true
+		time.after(REPORT_INTERVAL, report)
+	end
+end
+
 signal("SIGUSR1", function(_)
 	local path = env.get("logpath")
 	if not path then
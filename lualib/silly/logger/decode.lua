@@ -0,0 +1,179 @@
+-- Decoder of the records written with --log-format=binary, the layout
+-- is described next to SILLY_LOG_MAGIC in silly.h.
+
+local json = require "silly.encoding.json"
+
+local byte = string.byte
+local find = string.find
+local sub = string.sub
+local gsub = string.gsub
+local format = string.format
+local unpack = string.unpack
+local concat = table.concat
+local date = os.date
+
+local MAGIC<const> = 0xb1
+local VERSION<const> = 1
+local HEAD<const> = "=BBBBI4I8I8"
+local HEAD_LEN<const> = 24
+
+local RAW<const> = 1
+local STR<const> = 2
+local INT<const> = 3
+local NUM<const> = 4
+local TRUE<const> = 5
+local FALSE<const> = 6
+local NIL<const> = 7
+local SRC<const> = 8
+local FMT<const> = 9
+
+local level_names = {[0] = "D", "I", "W", "E"}
+
+---@class silly.logger.record
+---@field level integer? nil for a line that is not a record
+---@field time integer? milliseconds since the epoch
+---@field traceid integer?
+---@field src string? "file:line" of the Lua call
+---@field msg string
+---@field raw boolean? msg is C text, written as is
+
+local M = {}
+
+local function item(data, pos)
+	local tag, v
+	tag, pos = unpack("B", data, pos)
+	if tag == RAW or tag == STR or tag == FMT then
+		v, pos = unpack("=s4", data, pos)
+	elseif tag == INT then
+		v, pos = unpack("=i8", data, pos)
+		v = format("%d", v)
+	elseif tag == NUM then
+		v, pos = unpack("=d", data, pos)
+		v = format("%.14g", v)
+	elseif tag == TRUE then
+		v = "true"
+	elseif tag == FALSE then
+		v = "false"
+	elseif tag == NIL then
+		v = "nil"
+	elseif tag == SRC then
+		local line, src
+		line, src, pos = unpack("=I4s4", data, pos)
+		v = format("%s:%d", src, line)
+	else
+		error(format("unknown log item %d at %d", tag, pos - 1))
+	end
+	return tag, v, pos
+end
+
+-- Render the items the way the text format lays out the same call
+local function message(rec, data, pos, stop)
+	local n = 0
+	local tags, vals = {}, {}
+	while pos < stop do
+		n = n + 1
+		tags[n], vals[n], pos = item(data, pos)
+	end
+	local buf = {}
+	local i = 1
+	while i <= n do
+		local tag, v = tags[i], vals[i]
+		if tag == FMT then
+			buf[#buf + 1] = gsub(v, "%%(.?)", function(c)
+				if c == "%" then
+					return "%"
+				end
+				i = i + 1
+				return (vals[i] or "") .. " "
+			end)
+		elseif tag == RAW then
+			rec.raw = true
+			buf[#buf + 1] = v
+		elseif tag == SRC then
+			rec.src = v
+		else
+			buf[#buf + 1] = v .. " "
+		end
+		i = i + 1
+	end
+	rec.msg = concat(buf)
+end
+
+---Decode the record starting at `pos`. Bytes that are not a record, like
+---the output of print(), come back as a record holding one text line.
+---@param data string
+---@param pos integer? default 1
+---@param final boolean? no more data follows, flush a partial text line
+---@return silly.logger.record? rec nil when `data` ends inside the record
+---@return integer next position after the record
+function M.decode(data, pos, final)
+	pos = pos or 1
+	if #data - pos + 1 <= 0 then
+		return nil, pos
+	end
+	local magic, version = byte(data, pos, pos + 1)
+	if magic ~= MAGIC or version ~= VERSION then
+		local e = find(data, "\n", pos, true)
+		if not e then
+			if not final then
+				return nil, pos
+			end
+			e = #data
+		end
+		return {msg = sub(data, pos, e)}, e + 1
+	end
+	if #data - pos + 1 < HEAD_LEN then
+		return nil, pos
+	end
+	local _, _, level, _, size, time, traceid = unpack(HEAD, data, pos)
+	local stop = pos + size
+	if stop - 1 > #data then
+		return nil, pos
+	end
+	local rec = {level = level, time = time, traceid = traceid}
+	message(rec, data, pos + HEAD_LEN, stop)
+	return rec, stop
+end
+
+---Render a record exactly as --log-format=text would have written it
+---@param rec silly.logger.record
+---@return string
+function M.text(rec)
+	if not rec.level then
+		return rec.msg
+	end
+	local time = rec.time
+	local buf = {
+		date("%Y-%m-%d %H:%M:%S ", time // 1000),
+		format("%016x ", rec.traceid),
+		level_names[rec.level] or "?", " ",
+		rec.src and (rec.src .. " ") or "",
+		rec.msg,
+	}
+	if not rec.raw then
+		buf[#buf + 1] = "\n"
+	end
+	return concat(buf)
+end
+
+---Render a record as one JSON object per line
+---@param rec silly.logger.record
+---@return string
+function M.json(rec)
+	local msg = gsub(rec.msg, "%s+$", "")
+	if not rec.level then
+		return json.encode({msg = msg}) .. "\n"
+	end
+	local time = rec.time
+	return json.encode({
+		time = date("%Y-%m-%d %H:%M:%S", time // 1000) ..
+			format(".%03d", time % 1000),
+		ts = time,
+		trace = format("%016x", rec.traceid),
+		level = level_names[rec.level],
+		src = rec.src,
+		msg = msg,
+	}) .. "\n"
+end
+
+return M
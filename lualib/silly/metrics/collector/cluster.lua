@@ -0,0 +1,106 @@
+local cluster = require "silly.net.cluster"
+local counter = require "silly.metrics.counter"
+
+local M = {}
+M.__index = M
+
+---@return silly.metrics.collector
+function M.new()
+	local cluster_compress_total = counter(
+		"cluster_compress_total",
+		"Total number of payloads passed through lz4 compression."
+	)
+	local cluster_compress_in_bytes_total = counter(
+		"cluster_compress_in_bytes_total",
+		"Total number of payload bytes before compression."
+	)
+	local cluster_compress_out_bytes_total = counter(
+		"cluster_compress_out_bytes_total",
+		"Total number of payload bytes sent after compression."
+	)
+	local cluster_compress_seconds_total = counter(
+		"cluster_compress_seconds_total",
+		"Total CPU time spent compressing payloads."
+	)
+	local cluster_decompress_total = counter(
+		"cluster_decompress_total",
+		"Total number of compressed payloads received."
+	)
+	local cluster_decompress_in_bytes_total = counter(
+		"cluster_decompress_in_bytes_total",
+		"Total number of compressed payload bytes received."
+	)
+	local cluster_decompress_out_bytes_total = counter(
+		"cluster_decompress_out_bytes_total",
+		"Total number of payload bytes after decompression."
+	)
+	local cluster_decompress_seconds_total = counter(
+		"cluster_decompress_seconds_total",
+		"Total CPU time spent decompressing payloads."
+	)
+	local cluster_expired_total = counter(
+		"cluster_expired_total",
+		"Total number of queued requests dropped after their deadline."
+	)
+	local cluster_cancelled_total = counter(
+		"cluster_cancelled_total",
+		"Total number of queued requests dropped by a cancel frame."
+	)
+	local last = {
+		compress_count = 0,
+		compress_in = 0,
+		compress_out = 0,
+		compress_ns = 0,
+		decompress_count = 0,
+		decompress_in = 0,
+		decompress_out = 0,
+		decompress_ns = 0,
+		expired = 0,
+		cancelled = 0,
+	}
+	local function delta(st, key)
+		local n = st[key] - last[key]
+		if n < 0 then
+			n = 0
+		end
+		return n
+	end
+
+	---@param buf silly.metrics.metric[]
+	local collect = function(_, buf)
+		local st = cluster.stats()
+		if not st then
+			return
+		end
+		cluster_compress_total:add(delta(st, "compress_count"))
+		cluster_compress_in_bytes_total:add(delta(st, "compress_in"))
+		cluster_compress_out_bytes_total:add(delta(st, "compress_out"))
+		cluster_compress_seconds_total:add(delta(st, "compress_ns") / 1e9)
+		cluster_decompress_total:add(delta(st, "decompress_count"))
+		cluster_decompress_in_bytes_total:add(delta(st, "decompress_in"))
+		cluster_decompress_out_bytes_total:add(delta(st, "decompress_out"))
+		cluster_decompress_seconds_total:add(delta(st, "decompress_ns") / 1e9)
+		cluster_expired_total:add(delta(st, "expired"))
+		cluster_cancelled_total:add(delta(st, "cancelled"))
+		last = st
+		local len = #buf
+		buf[len+1] = cluster_compress_total
+		buf[len+2] = cluster_compress_in_bytes_total
+		buf[len+3] = cluster_compress_out_bytes_total
+		buf[len+4] = cluster_compress_seconds_total
+		buf[len+5] = cluster_decompress_total
+		buf[len+6] = cluster_decompress_in_bytes_total
+		buf[len+7] = cluster_decompress_out_bytes_total
+		buf[len+8] = cluster_decompress_seconds_total
+		buf[len+9] = cluster_expired_total
+		buf[len+10] = cluster_cancelled_total
+	end
+	local c = {
+		name = "Cluster",
+		new = M.new,
+		collect = collect,
+	}
+	return c
+end
+
+return M
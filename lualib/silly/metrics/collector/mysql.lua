@@ -0,0 +1,105 @@
+local gauge = require "silly.metrics.gauge"
+local counter = require "silly.metrics.counter"
+
+local pairs = pairs
+local setmetatable = setmetatable
+
+local M = {}
+M.__index = M
+
+---@param pools table<string, pool> pool name -> pool, may be changed after new
+---@return silly.metrics.collector
+function M.new(pools)
+	local mysql_pool_max_open_connections = gauge(
+		"mysql_pool_max_open_connections",
+		"Maximum number of open connections to the database, 0 means unlimited.",
+		{"pool"}
+	)
+	local mysql_pool_open_connections = gauge(
+		"mysql_pool_open_connections",
+		"Number of established connections both in use and idle.",
+		{"pool"}
+	)
+	local mysql_pool_in_use_connections = gauge(
+		"mysql_pool_in_use_connections",
+		"Number of connections currently in use.",
+		{"pool"}
+	)
+	local mysql_pool_idle_connections = gauge(
+		"mysql_pool_idle_connections",
+		"Number of idle connections.",
+		{"pool"}
+	)
+	local mysql_pool_wait_total = counter(
+		"mysql_pool_wait_total",
+		"Total number of connections waited for.",
+		{"pool"}
+	)
+	local mysql_pool_wait_seconds_total = counter(
+		"mysql_pool_wait_seconds_total",
+		"Total time blocked waiting for a new connection.",
+		{"pool"}
+	)
+	local mysql_pool_idle_closed_total = counter(
+		"mysql_pool_idle_closed_total",
+		"Total number of connections closed due to max_idle_time.",
+		{"pool"}
+	)
+	local mysql_pool_lifetime_closed_total = counter(
+		"mysql_pool_lifetime_closed_total",
+		"Total number of connections closed due to max_lifetime.",
+		{"pool"}
+	)
+	---@type table<pool, pool_stats>
+	local last = setmetatable({}, {__mode = "k"})
+
+	---@param buf silly.metrics.metric[]
+	local collect = function(_, buf)
+		for name, pool in pairs(pools) do
+			local st = pool:stats()
+			local prev = last[pool]
+			if not prev then
+				prev = {
+					wait_count = 0,
+					wait_duration = 0,
+					idle_closed = 0,
+					lifetime_closed = 0,
+				}
+			end
+			mysql_pool_max_open_connections:labels(name):set(st.max_open_conns)
+			mysql_pool_open_connections:labels(name):set(st.open_conns)
+			mysql_pool_in_use_connections:labels(name):set(st.in_use)
+			mysql_pool_idle_connections:labels(name):set(st.idle)
+			if st.wait_count > prev.wait_count then
+				mysql_pool_wait_total:labels(name):add(st.wait_count - prev.wait_count)
+			end
+			if st.wait_duration > prev.wait_duration then
+				mysql_pool_wait_seconds_total:labels(name):add((st.wait_duration - prev.wait_duration) / 1000)
+			end
+			if st.idle_closed > prev.idle_closed then
+				mysql_pool_idle_closed_total:labels(name):add(st.idle_closed - prev.idle_closed)
+			end
+			if st.lifetime_closed > prev.lifetime_closed then
+				mysql_pool_lifetime_closed_total:labels(name):add(st.lifetime_closed - prev.lifetime_closed)
+			end
+			last[pool] = st
+		end
+		local len = #buf
+		buf[len+1] = mysql_pool_max_open_connections
+		buf[len+2] = mysql_pool_open_connections
+		buf[len+3] = mysql_pool_in_use_connections
+		buf[len+4] = mysql_pool_idle_connections
+		buf[len+5] = mysql_pool_wait_total
+		buf[len+6] = mysql_pool_wait_seconds_total
+		buf[len+7] = mysql_pool_idle_closed_total
+		buf[len+8] = mysql_pool_lifetime_closed_total
+	end
+	local c = {
+		name = "MySQL",
+		new = M.new,
+		collect = collect,
+	}
+	return c
+end
+
+return M
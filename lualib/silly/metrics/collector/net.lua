@@ -0,0 +1,144 @@
+local c = require "silly.metrics.c"
+local gauge = require "silly.metrics.gauge"
+local counter = require "silly.metrics.counter"
+
+local pairs = pairs
+
+local M = {}
+M.__index = M
+
+local tcpinfo = false
+
+---Turn TCP_INFO sampling (RTT, congestion window, retransmits) on or off.
+---@param enable boolean
+---@return boolean supported false when the platform has no TCP_INFO
+function M.tcpinfo(enable)
+	local ok = c.tcpinfo(enable)
+	tcpinfo = ok and enable and true or false
+	return ok
+end
+
+---@return silly.metrics.collector
+function M.new()
+	local kind_addr = {"kind", "addr"}
+	local silly_net_connections_total = counter(
+		"silly_net_connections_total",
+		"Total number of accepted or attempted TCP connections.",
+		kind_addr
+	)
+	local silly_net_closes_total = counter(
+		"silly_net_closes_total",
+		"Total number of closed TCP connections by reason.",
+		{"kind", "addr", "reason"}
+	)
+	local silly_net_sent_bytes_total = counter(
+		"silly_net_sent_bytes_total",
+		"Total number of bytes queued for sending.",
+		kind_addr
+	)
+	local silly_net_received_bytes_total = counter(
+		"silly_net_received_bytes_total",
+		"Total number of bytes received.",
+		kind_addr
+	)
+	local silly_net_eagain_total = counter(
+		"silly_net_eagain_total",
+		"Total number of writes the kernel did not take in full.",
+		kind_addr
+	)
+	local silly_net_drains_total = counter(
+		"silly_net_drains_total",
+		"Total number of write backlogs written out after an EAGAIN.",
+		kind_addr
+	)
+	local silly_net_drain_seconds_total = counter(
+		"silly_net_drain_seconds_total",
+		"Total time from an EAGAIN until the write backlog was empty.",
+		kind_addr
+	)
+	local silly_net_wlist_max_bytes = gauge(
+		"silly_net_wlist_max_bytes",
+		"Largest write backlog of a connection since the last collection.",
+		kind_addr
+	)
+	local silly_net_rtt_seconds = gauge(
+		"silly_net_rtt_seconds",
+		"Smoothed RTT of the last TCP_INFO sample.",
+		kind_addr
+	)
+	local silly_net_cwnd_segments = gauge(
+		"silly_net_cwnd_segments",
+		"Congestion window of the last TCP_INFO sample.",
+		kind_addr
+	)
+	local silly_net_retransmits_total = counter(
+		"silly_net_retransmits_total",
+		"Total number of retransmitted segments of closed connections.",
+		kind_addr
+	)
+	local last = {}
+
+	local function delta(metric, l, field, n, ...)
+		local d = n - (l[field] or 0)
+		if d > 0 then
+			metric:labels(...):add(d)
+		end
+		l[field] = n
+	end
+
+	---@param buf silly.metrics.metric[]
+	local collect = function(_, buf)
+		local stats = c.peerstat()
+		for i = 1, #stats do
+			local st = stats[i]
+			local kind, addr = st.kind, st.addr
+			local key = kind .. addr
+			local l = last[key]
+			if not l then
+				l = {}
+				last[key] = l
+			end
+			delta(silly_net_connections_total, l, "opens", st.opens, kind, addr)
+			delta(silly_net_sent_bytes_total, l, "sent_bytes", st.sent_bytes, kind, addr)
+			delta(silly_net_received_bytes_total, l, "received_bytes", st.received_bytes, kind, addr)
+			delta(silly_net_eagain_total, l, "eagain", st.eagain, kind, addr)
+			delta(silly_net_drains_total, l, "drains", st.drains, kind, addr)
+			local drain_ns = st.drain_ns - (l.drain_ns or 0)
+			if drain_ns > 0 then
+				silly_net_drain_seconds_total:labels(kind, addr):add(drain_ns / 1e9)
+			end
+			l.drain_ns = st.drain_ns
+			for reason, n in pairs(st.closes) do
+				delta(silly_net_closes_total, l, reason, n, kind, addr, reason)
+			end
+			silly_net_wlist_max_bytes:labels(kind, addr):set(st.wlist_max)
+			if tcpinfo then
+				silly_net_rtt_seconds:labels(kind, addr):set(st.rtt_us / 1e6)
+				silly_net_cwnd_segments:labels(kind, addr):set(st.cwnd)
+				delta(silly_net_retransmits_total, l, "retransmits", st.retransmits, kind, addr)
+			end
+		end
+		local len = #buf
+		buf[len+1] = silly_net_connections_total
+		buf[len+2] = silly_net_closes_total
+		buf[len+3] = silly_net_sent_bytes_total
+		buf[len+4] = silly_net_received_bytes_total
+		buf[len+5] = silly_net_eagain_total
+		buf[len+6] = silly_net_drains_total
+		buf[len+7] = silly_net_drain_seconds_total
+		buf[len+8] = silly_net_wlist_max_bytes
+		if tcpinfo then
+			buf[len+9] = silly_net_rtt_seconds
+			buf[len+10] = silly_net_cwnd_segments
+			buf[len+11] = silly_net_retransmits_total
+		end
+	end
+	local c = {
+		name = "Net",
+		new = M.new,
+		collect = collect,
+	}
+	return c
+end
+
+return M
@@ -1,9 +1,12 @@
 local silly = require "silly"
 local task = require "silly.task"
 local c = require "silly.metrics.c"
+local logger = require "silly.logger.c"
 local gauge = require "silly.metrics.gauge"
 local counter = require "silly.metrics.counter"
 
+local pairs = pairs
+
 local M = {}
 M.__index = M
 
@@ -53,6 +56,67 @@ function M.new()
 		"silly_network_received_bytes_total",
 		"Total number of bytes received via network."
 	)
+	local silly_worker_dispatch_total = counter(
+		"silly_worker_dispatch_total",
+		"Total number of worker dispatch cycles."
+	)
+	local silly_gc_heap_bytes = gauge(
+		"silly_gc_heap_bytes",
+		"Bytes in use by the Lua heap."
+	)
+	local silly_gc_idle_seconds_total = counter(
+		"silly_gc_idle_seconds_total",
+		"Total time spent in GC steps while the worker is idle."
+	)
+	local silly_gc_idle_steps_total = counter(
+		"silly_gc_idle_steps_total",
+		"Total number of GC steps run while the worker is idle."
+	)
+	local silly_gc_idle_cycles_total = counter(
+		"silly_gc_idle_cycles_total",
+		"Total number of GC cycles finished while the worker is idle."
+	)
+	local silly_gc_throttled_total = counter(
+		"silly_gc_throttled_total",
+		"Total number of times a long backlog throttled the inline GC."
+	)
+	local silly_gc_idle_seconds_per_dispatch = gauge(
+		"silly_gc_idle_seconds_per_dispatch",
+		"Idle GC time per dispatch cycle since the last collection."
+	)
+	local silly_log_written_bytes_total = counter(
+		"silly_log_written_bytes_total",
+		"Total number of log bytes written."
+	)
+	local silly_log_dropped_bytes_total = counter(
+		"silly_log_dropped_bytes_total",
+		"Total number of log bytes dropped on a full buffer."
+	)
+	local silly_log_dropped_lines_total = counter(
+		"silly_log_dropped_lines_total",
+		"Total number of log lines dropped on a full buffer."
+	)
+	local silly_log_blocked_total = counter(
+		"silly_log_blocked_total",
+		"Total number of times a thread waited for log buffer space."
+	)
+	local silly_log_flushes_total = counter(
+		"silly_log_flushes_total",
+		"Total number of log flushes."
+	)
+	local silly_log_flush_seconds_total = counter(
+		"silly_log_flush_seconds_total",
+		"Total time spent writing log flushes."
+	)
+	local silly_log_flush_max_seconds = gauge(
+		"silly_log_flush_max_seconds",
+		"Slowest log flush since the last collection."
+	)
+	local silly_log_suppressed_total = counter(
+		"silly_log_suppressed_total",
+		"Total number of log lines suppressed by the rate limiter.",
+		{"site"}
+	)
 	local last_timer_scheduled = 0
 	local last_timer_fired = 0
 	local last_timer_canceled = 0
@@ -60,6 +124,18 @@ function M.new()
 	local last_socket_processed = 0
 	local last_sent_bytes = 0
 	local last_received_bytes = 0
+	local last_dispatch = 0
+	local last_idle_steps = 0
+	local last_idle_cycles = 0
+	local last_idle_ns = 0
+	local last_throttled = 0
+	local last_log_written = 0
+	local last_log_dropped = 0
+	local last_log_dropped_lines = 0
+	local last_log_blocked = 0
+	local last_log_flushes = 0
+	local last_log_flush_ns = 0
+	local last_log_suppressed = {}
 
 	---@param buf silly.metrics.metric[]
 	local collect = function(_, buf)
@@ -68,6 +144,9 @@ function M.new()
 		local task_runnable_size = task.readycount()
 		local tcp_connections, sent_bytes, received_bytes,
 			socket_operate_request, socket_operate_processed = c.netstat()
+		local dispatch, idle_steps, idle_cycles, idle_ns, throttled = c.gcstat()
+		local log_written, log_dropped, log_dropped_lines, log_blocked,
+			log_flushes, log_flush_ns, log_flush_max = c.logstat()
 
 		silly_worker_backlog:set(worker_backlog)
 		silly_timer_pending:set(timer_pending)
@@ -94,6 +173,50 @@ function M.new()
 		if received_bytes > last_received_bytes then
 			silly_network_received_bytes_total:add(received_bytes - last_received_bytes)
 		end
+		silly_gc_heap_bytes:set(collectgarbage("count") * 1024)
+		if dispatch > last_dispatch then
+			silly_worker_dispatch_total:add(dispatch - last_dispatch)
+			silly_gc_idle_seconds_per_dispatch:set(
+				(idle_ns - last_idle_ns) / 1e9 / (dispatch - last_dispatch))
+		end
+		if idle_ns > last_idle_ns then
+			silly_gc_idle_seconds_total:add((idle_ns - last_idle_ns) / 1e9)
+		end
+		if idle_steps > last_idle_steps then
+			silly_gc_idle_steps_total:add(idle_steps - last_idle_steps)
+		end
+		if idle_cycles > last_idle_cycles then
+			silly_gc_idle_cycles_total:add(idle_cycles - last_idle_cycles)
+		end
+		if throttled > last_throttled then
+			silly_gc_throttled_total:add(throttled - last_throttled)
+		end
+		if log_written > last_log_written then
+			silly_log_written_bytes_total:add(log_written - last_log_written)
+		end
+		if log_dropped > last_log_dropped then
+			silly_log_dropped_bytes_total:add(log_dropped - last_log_dropped)
+		end
+		if log_dropped_lines > last_log_dropped_lines then
+			silly_log_dropped_lines_total:add(log_dropped_lines - last_log_dropped_lines)
+		end
+		if log_blocked > last_log_blocked then
+			silly_log_blocked_total:add(log_blocked - last_log_blocked)
+		end
+		if log_flushes > last_log_flushes then
+			silly_log_flushes_total:add(log_flushes - last_log_flushes)
+		end
+		if log_flush_ns > last_log_flush_ns then
+			silly_log_flush_seconds_total:add((log_flush_ns - last_log_flush_ns) / 1e9)
+		end
+		silly_log_flush_max_seconds:set(log_flush_max / 1e9)
+		local suppressed = logger.suppressed()
+		for site, n in pairs(suppressed) do
+			local last = last_log_suppressed[site] or 0
+			if n > last then
+				silly_log_suppressed_total:labels(site):add(n - last)
+			end
+		end
 		last_timer_scheduled = timer_scheduled
 		last_timer_fired = timer_fired
 		last_timer_canceled = timer_canceled
@@ -101,6 +224,18 @@ function M.new()
 		last_socket_processed = socket_operate_processed
 		last_sent_bytes = sent_bytes
 		last_received_bytes = received_bytes
+		last_dispatch = dispatch
+		last_idle_steps = idle_steps
+		last_idle_cycles = idle_cycles
+		last_idle_ns = idle_ns
+		last_throttled = throttled
+		last_log_written = log_written
+		last_log_dropped = log_dropped
+		last_log_dropped_lines = log_dropped_lines
+		last_log_blocked = log_blocked
+		last_log_flushes = log_flushes
+		last_log_flush_ns = log_flush_ns
+		last_log_suppressed = suppressed
 
 		local len = #buf
 		buf[len+1] = silly_worker_backlog
@@ -114,6 +249,21 @@ function M.new()
 		buf[len+9] = silly_socket_processed_total
 		buf[len+10] = silly_network_sent_bytes_total
 		buf[len+11] = silly_network_received_bytes_total
+		buf[len+12] = silly_worker_dispatch_total
+		buf[len+13] = silly_gc_heap_bytes
+		buf[len+14] = silly_gc_idle_seconds_total
+		buf[len+15] = silly_gc_idle_steps_total
+		buf[len+16] = silly_gc_idle_cycles_total
+		buf[len+17] = silly_gc_throttled_total
+		buf[len+18] = silly_gc_idle_seconds_per_dispatch
+		buf[len+19] = silly_log_written_bytes_total
+		buf[len+20] = silly_log_dropped_bytes_total
+		buf[len+21] = silly_log_dropped_lines_total
+		buf[len+22] = silly_log_blocked_total
+		buf[len+23] = silly_log_flushes_total
+		buf[len+24] = silly_log_flush_seconds_total
+		buf[len+25] = silly_log_flush_max_seconds
+		buf[len+26] = silly_log_suppressed_total
 	end
 	local c = {
 		name = "Silly",
@@ -36,14 +36,20 @@ function M:observe(value)
 	self.sum = self.sum + value
 	self.count = self.count + 1
 	local buckets = self.buckets
-	local bucketcounts = self.bucketcounts
-	if value <= buckets[#buckets] then
-		for i = 1, #buckets do
-			if value <= buckets[i] then
-				bucketcounts[i] = bucketcounts[i] + 1
-				break
+	local hi = #buckets
+	if value <= buckets[hi] then
+		-- binary search the first bucket with value <= bound
+		local lo = 1
+		while lo < hi do
+			local mid = (lo + hi) // 2
+			if value <= buckets[mid] then
+				hi = mid
+			else
+				lo = mid + 1
 			end
 		end
+		local bucketcounts = self.bucketcounts
+		bucketcounts[lo] = bucketcounts[lo] + 1
 	end
 end
 
@@ -4,8 +4,10 @@ local counter = require "silly.metrics.counter"
 local gauge = require "silly.metrics.gauge"
 local histogram = require "silly.metrics.histogram"
 
-local tostring = tostring
-local concat = table.concat
+local pc = require "silly.metrics.prometheus.c"
+local native = require "silly.metrics.native"
+
+local find = string.find
 
 local M ={}
 
@@ -33,141 +35,72 @@ function M.registry()
 	return R
 end
 
-local strcache = setmetatable({}, {__index = function(t, v)
-	local s = tostring(v)
-	t[v] = s
-	return s
-end})
-
-local function format_count(buf, name, label, v)
-	local n = #buf
-	buf[n + 1] = name
-	n = n + 1
-	if label then
-		buf[n + 1] = "{"
-		buf[n + 2] = label
-		buf[n + 3] = "}"
-		n = n + 3
-	end
-	buf[n + 1] = "\t"
-	buf[n + 2] = v.value
-	buf[n + 3] = "\n"
-end
+local CHUNK<const> = 64 * 1024
 
-local function format_histogram(buf, name, label, v)
-	local buckets = v.buckets
-	local bucketcounts = v.bucketcounts
-	local count = 0
-	local n = #buf
-
-	-- Bucket entries
-	for i = 1, #bucketcounts do
-		buf[n + 1] = name
-		buf[n + 2] = '_bucket'
-		buf[n + 3] = '{'
-		n = n + 3
-		if label then
-			buf[n + 1] = label
-			buf[n + 2] = ','
-			n = n + 2
+local function render(r, w, sink)
+	local list = {}
+	for i = 1, #r do
+		local col = r[i]
+		if col == native then
+			w:native()
+		else
+			col:collect(list)
+			for j = 1, #list do
+				w:lua(list[j])
+				list[j] = nil
+				if sink and w:size() >= CHUNK then
+					sink(w:take())
+				end
+			end
+		end
+		if sink and w:size() >= CHUNK then
+			sink(w:take())
 		end
-		local bc = bucketcounts[i]
-		count = count + bc
-		buf[n + 1] = 'le="'
-		buf[n + 2] = strcache[buckets[i]]
-		buf[n + 3] = '"}\t'
-		buf[n + 4] = tostring(bc)
-		buf[n + 5] = "\n"
-		n = n + 5
 	end
+end
 
-	-- +Inf bucket
-	buf[n + 1] = name
-	buf[n + 2] = '_bucket'
-	buf[n + 3] = '{'
-	n = n + 3
-	if label then
-		buf[n + 1] = label
-		buf[n + 2] = ','
-		n = n + 2
-	end
-	buf[n + 1] = 'le="+Inf"}\t'
-	buf[n + 2] = tostring(v.count - count)
-	buf[n + 3] = "\n"
-	n = n + 3
-
-	-- _count
-	buf[n + 1] = name
-	buf[n + 2] = '_count'
-	n = n + 2
-	if label then
-		buf[n + 1] = '{'
-		buf[n + 2] = label
-		buf[n + 3] = '}'
-		n = n + 3
-	end
-	buf[n + 1] = "\t"
-	buf[n + 2] = tostring(v.count)
-	buf[n + 3] = "\n"
-	n = n + 3
-
-	-- _sum
-	buf[n + 1] = name
-	buf[n + 2] = '_sum'
-	n = n + 2
-	if label then
-		buf[n + 1] = '{'
-		buf[n + 2] = label
-		buf[n + 3] = '}'
-		n = n + 3
-	end
-	buf[n + 1] = "\t"
-	buf[n + 2] = tostring(v.sum)
-	buf[n + 3] = "\n"
+--- @param r silly.metrics.registry?
+--- @param format "openmetrics"?
+--- @return string
+function M.gather(r, format)
+	local w = pc.writer(format == "openmetrics", false)
+	render(r or R, w)
+	return w:finish()
 end
 
-local buf = {}
---- @param r silly.metrics.registry
-function M.gather(r)
-	r = r or R
-	local collectors = r:collect()
-	for i = 1, #collectors do
-		local m = collectors[i]
-		local kind = m.kind
-		local name = m.name
-
-		-- Write HELP line
-		local n = #buf
-		buf[n + 1] = "# HELP "
-		buf[n + 2] = name
-		buf[n + 3] = " "
-		buf[n + 4] = m.help
-		buf[n + 5] = "\n"
-
-		-- Write TYPE line
-		buf[n + 6] = "# TYPE "
-		buf[n + 7] = name
-		buf[n + 8] = " "
-		buf[n + 9] = kind
-		buf[n + 10] = "\n"
-
-		local fmt = kind == "histogram" and format_histogram or format_count
-		local metrics = m.metrics
-		if metrics then
-			local count = 0
-			for k, v in pairs(metrics) do
-				count = count + 1
-				fmt(buf, name, k, v)
+local TEXT<const> = "text/plain; version=0.0.4; charset=utf-8"
+local OPENMETRICS<const> = "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+--- Serve a scrape on an http stream, in chunks, honoring Accept
+--- (OpenMetrics) and Accept-Encoding (gzip).
+--- @param stream silly.net.http.h1.stream.server|silly.net.http.h2.stream
+--- @param r silly.metrics.registry?
+--- @return boolean, string?
+function M.respond(stream, r)
+	local header = stream.header
+	local accept = header["accept"]
+	local encoding = header["accept-encoding"]
+	local openmetrics = accept and find(accept, "application/openmetrics-text", 1, true) ~= nil
+	local gzip = encoding and find(encoding, "gzip", 1, true) ~= nil
+	local w = pc.writer(openmetrics, gzip)
+	local err
+	stream:respond(200, {
+		["content-type"] = openmetrics and OPENMETRICS or TEXT,
+		["content-encoding"] = gzip and "gzip" or nil,
+	})
+	render(r or R, w, function(chunk)
+		if not err then
+			local ok, e = stream:write(chunk)
+			if not ok then
+				err = e or "write failed"
 			end
-		else
-			fmt(buf, name, nil, m)
 		end
+	end)
+	if err then
+		return false, err
 	end
-	local str = concat(buf, "")
-	for i = 1, #buf do
-		buf[i] = nil
-	end
-	return str
+	stream:closewrite(w:finish())
+	return true, nil
 end
 
 --register default collector
@@ -176,6 +109,11 @@ R:register(silly_collector.new())
 
 local process_collector = require "silly.metrics.collector.process"
 R:register(process_collector.new())
+
+local net_collector = require "silly.metrics.collector.net"
+R:register(net_collector.new())
+-- metrics kept in C (silly.metrics.native), written from any thread
+R:register(native)
 if c.jestat then
 	local je_collector = require "silly.metrics.collector.jemalloc"
 	R:register(je_collector.new())
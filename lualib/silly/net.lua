@@ -32,12 +32,14 @@ local M = {}
 ---@field accept fun(fd:integer, listenid:integer, addr:string)?
 ---@field close fun(fd:integer, errno:silly.errno)
 ---@field data fun(fd:integer, msg:lightuserdata, size:integer)|fun(fd:integer, msg:lightuserdata, size:integer, addr:string?)
+---@field drain fun(fd:integer)? unsent bytes fell to the low watermark
 
 --socket
 local socket_pending = {}
 local accept_callback = {}
 local data_callback = {}
 local close_callback = {}
+local drain_callback = {}
 
 local tcp_listen = assert(c.tcp_listen)
 local tcp_connect = assert(c.tcp_connect)
@@ -47,8 +49,11 @@ local socket_close = assert(c.close)
 M.tcpsend = assert(c.tcp_send)
 M.udpsend = assert(c.udp_send)
 M.tcpmulticast = assert(c.tcp_multicast)
+M.multicast = assert(c.multicast)
+M.tcpwatermark = assert(c.tcp_watermark)
 M.readenable = assert(c.readenable)
 M.tostring = assert(c.tostring)
+M.free = assert(c.free)
 
 M.multipack = assert(c.multipack)
 M.sendsize = assert(c.sendsize)
@@ -80,6 +85,7 @@ local function listen_wrap(listen)
 			accept_callback[fd] = event.accept
 			close_callback[fd] = assert(event.close)
 			data_callback[fd] = assert(event.data)
+			drain_callback[fd] = event.drain
 			return fd, nil
 		end
 		return nil, err
@@ -135,6 +141,7 @@ local function connect_wrap(connect)
 			end
 			data_callback[fd] = assert(event.data)
 			close_callback[fd] = assert(event.close)
+			drain_callback[fd] = event.drain
 			return fd, nil
 		end
 		return nil, err
@@ -157,6 +164,7 @@ function M.close(fd)
 	accept_callback[fd] = nil
 	data_callback[fd] = nil
 	close_callback[fd] = nil
+	drain_callback[fd] = nil
 	assert(socket_pending[fd] == nil)
 	local ok, err = socket_close(fd)
 	if not ok then
@@ -173,6 +181,7 @@ silly.register(c.ACCEPT, function(fd, listenid, addr)
 	-- inherit the callback from listenid
 	data_callback[fd] = data_callback[listenid]
 	close_callback[fd] = close_callback[listenid]
+	drain_callback[fd] = drain_callback[listenid]
 	local t = task_create(cb)
 	task_resume(t, fd, listenid, addr)
 end)
@@ -209,6 +218,15 @@ silly.register(c.CONNECT, function(fd, err)
 	task_resume(t, err)
 end)
 
+---@param fd integer
+silly.register(c.DRAIN, function(fd)
+	local f = drain_callback[fd]
+	if f then
+		local t = task_create(f)
+		task_resume(t, fd)
+	end
+end)
+
 ---@param fd integer
 ---@param ptr lightuserdata
 ---@param size integer
@@ -11,6 +11,10 @@ local c = require "silly.net.cluster.c"
 
 local assert = assert
 local format = string.format
+local min = math.min
+local now = time.now
+local monotonic = time.monotonic
+local running = task.running
 local tcp_connect = net.tcpconnect
 local tcp_send = net.tcpsend
 local tcp_close = net.close
@@ -25,11 +29,24 @@ local trace_propagate = trace.propagate
 local trace_attach = trace.attach
 local errno = require "silly.errno"
 local ETIMEDOUT<const> = errno.TIMEDOUT
+local BACKOFF_MIN<const> = 100
+local BACKOFF_MAX<const> = 5000
 
 ---@class silly.net.cluster.peer
----@field fd integer?
+---@field fd integer? --A live connection of the peer; nil when none is established.
 ---@field remoteaddr string --Remote address; set for both incoming and outgoing connections.
 ---@field addr string? --Set for outgoing connections; used for auto-reconnect. Incoming connections lack this field.
+---@field fds (integer|false)[]? --Outgoing only: fd of each connection slot, false while disconnected.
+---@field slots silly.net.cluster.slot[]? --Outgoing only: reconnect state of each connection slot.
+---@field alive integer? --Outgoing only: number of established connections.
+
+---@class silly.net.cluster.slot
+---@field peer silly.net.cluster.peer
+---@field index integer
+---@field backoff integer --Current reconnect backoff in ms, 0 after a successful connect.
+---@field retryat integer --Earliest time (ms) of the next connect attempt.
+---@field err string? --Last connect error, returned while backing off.
+---@field connecting boolean
 
 ---@class silly.net.cluster.listener
 ---@field fd integer
@@ -55,14 +72,28 @@ local expire
 
 local wait_pool = {}
 local fd_to_peer = {}
+local fd_to_slot = {}
+--deadline (time.monotonic ms) of the request a task is handling, 0 once cancelled
+local task_deadline = {}
+--fd -> session -> task handling that request
+local fd_handling = {}
 local connect_lock = lock.new()
 ---@type silly.net.cluster.context
 local ctx
+local flush_pending = false
+
+--Responses are appended to per-fd batches by `c.response`; this
+--runs once after the current dispatch so that every response produced
+--for the same peer leaves in a single write.
+local function flush()
+	flush_pending = false
+	c.flush(ctx)
+end
 
 ---@class silly.net.cluster
 local M = {}
 local function process()
-	local fd, buf, session, cmd, traceid = c.pop(ctx)
+	local fd, buf, session, cmd, traceid, deadline = c.pop(ctx)
 	if not fd then
 		return
 	end
@@ -82,28 +113,55 @@ local function process()
 				logger.error("[cluster] peer not found", fd)
 				break
 			end
+			local co = running()
+			local handling = fd_handling[fd]
+			if not handling then
+				handling = {}
+				fd_handling[fd] = handling
+			end
+			handling[session] = co
+			if deadline ~= 0 then
+				task_deadline[co] = deadline
+			end
 			local ok, res = pcall(call, peer, cmd, req)
+			handling[session] = nil
+			deadline = task_deadline[co]
+			task_deadline[co] = nil
 			if not ok then
 				logger.error("[cluster] call error", res)
 				break
 			end
+			if deadline and deadline <= monotonic() then
+				logger.debug("[cluster] drop response of expired request",
+					session, cmd)
+				break
+			end
 			local id, res_data = marshal("response", cmd, res)
 			if not id then
 				break
 			end
-			resp, err = c.response(ctx, session, res_data)
+			resp, err = c.response(ctx, fd, session, res_data)
 			if not resp then
 				logger.error("[cluster] response cmd:", cmd, "error:", err)
 				break
 			end
-			tcp_send(fd, resp)
+			if not flush_pending then
+				flush_pending = true
+				task.fork(flush)
+			end
+		elseif cmd == false then --cancel of a request being handled
+			local handling = fd_handling[fd]
+			local co = handling and handling[session]
+			if co then
+				task_deadline[co] = 0
+			end
 		else	-- rpc response
 			local co = wait_pool[session]
 			wait_pool[session] = nil
 			task.wakeup(co, buf)
 		end
 		--next
-		fd, buf, session, cmd, traceid = c.pop(ctx)
+		fd, buf, session, cmd, traceid, deadline = c.pop(ctx)
 		if not fd then
 			break
 		end
@@ -115,11 +173,22 @@ end
 local function close_fd(fd, errno)
 	c.clear(ctx, fd)
 	tcp_close(fd)
+	fd_handling[fd] = nil
 	local peer = fd_to_peer[fd]
 	if peer then
 		fd_to_peer[fd] = nil
-		peer.fd = nil
-		if close then
+		local fds = peer.fds
+		local i = fd_to_slot[fd]
+		if i then
+			fd_to_slot[fd] = nil
+			fds[i] = false
+			peer.alive = peer.alive - 1
+		end
+		if peer.fd == fd then
+			peer.fd = fds and c.pick(ctx, fds) or nil
+		end
+		--one dead connection doesn't close a peer that has others alive
+		if close and not peer.fd then
 			local ok, err = pcall(close, peer, errno)
 			if not ok then
 				logger.error("[cluster] close callback fd:", fd,
@@ -134,9 +203,21 @@ end
 ---@param peer silly.net.cluster.peer|silly.net.cluster.listener
 local function close_peer(peer)
 	local fd = peer.fd
+	local fds = peer.fds
 	peer.addr = nil
-	if fd then
-		peer.fd = nil
+	peer.fd = nil
+	if fds then
+		for i = 1, #fds do
+			local x = fds[i]
+			if x then
+				fds[i] = false
+				tcp_close(x)
+				fd_to_peer[x] = nil
+				fd_to_slot[x] = nil
+			end
+		end
+		peer.alive = 0
+	elseif fd then
 		tcp_close(fd)
 		fd_to_peer[fd] = nil
 	end
@@ -176,33 +257,54 @@ data = function(fd, ptr, size)
 end
 }
 
----@param peer silly.net.cluster.peer
-local function connect(peer)
+---@param slot silly.net.cluster.slot
+---@param err string
+local function slot_fail(slot, err)
+	local backoff = slot.backoff
+	if backoff == 0 then
+		backoff = BACKOFF_MIN
+	else
+		backoff = min(backoff * 2, BACKOFF_MAX)
+	end
+	slot.err = err
+	slot.backoff = backoff
+	slot.retryat = now() + backoff
+	return nil, err
+end
+
+---@param slot silly.net.cluster.slot
+local function connect(slot)
+	local peer = slot.peer
+	local l<close> = connect_lock:lock(slot)
 	local addr = peer.addr
 	if not addr then
 		return nil, "Peer closed"
 	end
-	local l<close> = connect_lock:lock(peer)
-	local fd = peer.fd
+	local i = slot.index
+	local fd = peer.fds[i]
 	if fd then
 		return fd, nil
 	end
+	if slot.retryat > now() then
+		return nil, slot.err
+	end
 	local name, port = parse_addr(addr)
 	if not name or not port then
-		return nil, "Invalid address:" .. addr
+		return slot_fail(slot, "Invalid address:" .. addr)
 	end
 	if is_host(name) then
 		local ip, err = dns.lookup(name, dns.A)
 		if not ip then
-			return nil, format("dns lookup %s failed: %s", name, err)
+			return slot_fail(slot,
+				format("dns lookup %s failed: %s", name, err))
 		end
 		addr = join_addr(ip, port)
 	end
 	local err
 	fd, err = tcp_connect(addr, EVENT)
-	logger.info("[cluster] connect", addr, "fd:", fd, "err:", err)
+	logger.info("[cluster] connect", addr, "slot:", i, "fd:", fd, "err:", err)
 	if not fd then
-		return nil, err
+		return slot_fail(slot, err)
 	end
 	-- The peer may have been closed by another coroutine while we were
 	-- yielded in dns.lookup or tcp_connect. In that case peer.addr has
@@ -212,21 +314,100 @@ local function connect(peer)
 		tcp_close(fd)
 		return nil, "Peer closed"
 	end
-	peer.fd = fd
+	slot.backoff = 0
+	slot.retryat = 0
+	slot.err = nil
+	peer.fds[i] = fd
+	peer.alive = peer.alive + 1
+	if not peer.fd then
+		peer.fd = fd
+	end
 	fd_to_peer[fd] = peer
+	fd_to_slot[fd] = i
 	return fd, nil
 end
 
+---@param slot silly.net.cluster.slot
+local function reconnect(slot)
+	connect(slot)
+	slot.connecting = false
+end
+
+---Pick the connection with the least outstanding calls, (re)connecting
+---dead slots on the way.
+---@param peer silly.net.cluster.peer
+---@return integer? fd, string? error
+local function choose(peer)
+	local fds = peer.fds
+	if not fds then --incoming connection, never reconnects
+		local fd = peer.fd
+		if not fd then
+			return nil, "Peer closed"
+		end
+		return fd, nil
+	end
+	if not peer.addr then
+		return nil, "Peer closed"
+	end
+	local slots = peer.slots
+	local n = #slots
+	local alive = peer.alive
+	if alive > 0 then
+		if alive < n then
+			local t = now()
+			for i = 1, n do
+				local slot = slots[i]
+				if not fds[i] and not slot.connecting and
+					slot.retryat <= t then
+					slot.connecting = true
+					task.fork(reconnect, slot)
+				end
+			end
+		end
+		local fd = c.pick(ctx, fds)
+		if fd then
+			return fd, nil
+		end
+	end
+	local fd, err
+	for i = 1, n do
+		fd, err = connect(slots[i])
+		if fd then
+			return fd, nil
+		end
+	end
+	return nil, err
+end
+
 ---@param addr string
+---@param conns integer? number of connections to the peer (default 1)
 ---@return silly.net.cluster.peer
-function M.connect(addr)
+function M.connect(addr, conns)
+	conns = conns or 1
+	assert(conns >= 1, "conns must be >= 1")
+	local fds = {}
+	local slots = {}
 	---@type silly.net.cluster.peer
 	local peer = {
 		fd = nil,
 		addr = addr,
 		remoteaddr = addr,
+		fds = fds,
+		slots = slots,
+		alive = 0,
 	}
-	logger.info("[cluster] connect peer", addr)
+	for i = 1, conns do
+		fds[i] = false
+		slots[i] = {
+			peer = peer,
+			index = i,
+			backoff = 0,
+			retryat = 0,
+			err = nil,
+			connecting = false,
+		}
+	end
+	logger.info("[cluster] connect peer", addr, "conns:", conns)
 	return peer
 end
 
@@ -258,16 +439,20 @@ local timer_func = function(session)
 	task.wakeup(co, nil)
 end
 
-local waitfor = function(session, cmd)
+local waitfor = function(fd, session, cmd, timeout)
 	local co = task.running()
-	local timer_id = after(expire, timer_func, session)
+	local timer_id = after(timeout, timer_func, session)
 	wait_pool[session] = co
+	c.acquire(ctx, fd)
 	local body = task.wait()
+	c.release(ctx, fd)
 	if body then
 		cancel(timer_id)
 		local obj, err = unmarshal("response", cmd, body)
 		return obj, err
 	end
+	--tell the callee to stop working on it
+	tcp_send(fd, c.cancel(ctx, session))
 	return nil, ETIMEDOUT
 end
 
@@ -277,31 +462,38 @@ local function callx(is_send)
 	---@param obj table
 	---@return table|boolean|nil result, string? error
 	return function(peer, cmd, obj)
-		local fd = peer.fd
-		if not fd then
-			local err
-			fd, err = connect(peer)
-			if not fd then
-				return nil, err
+		--a call made while handling a request can't outlive its deadline
+		local timeout = expire
+		local deadline = task_deadline[running()]
+		if deadline then
+			local left = deadline - monotonic()
+			if left <= 0 then
+				return nil, ETIMEDOUT
 			end
+			timeout = min(timeout, left)
+		end
+		local fd, err = choose(peer)
+		if not fd then
+			return nil, err
 		end
 		local cmdn, dat = marshal("request", cmd, obj)
 		if not cmdn then
 			return nil, dat
 		end
 		local traceid = trace_propagate()
-		local session, body = c.request(ctx, cmdn, traceid, dat)
+		local session, body, size = c.request(ctx, fd, cmdn, traceid, timeout, dat)
 		if not session then
 			return nil, body
 		end
-		local ok, err = tcp_send(fd, body)
+		local ok
+		ok, err = tcp_send(fd, body, size)
 		if not ok then
 			return nil, err
 		end
 		if is_send then
 			return true, nil
 		end
-		return waitfor(session, cmd)
+		return waitfor(fd, session, cmd, timeout)
 	end
 end
 
@@ -312,6 +504,7 @@ M.send = callx(true)
 ---	timeout: integer, -- default 5000 ms
 ---	hardlimit: integer?, -- max body size before error (default 128MB)
 ---	softlimit: integer?, -- max body size before warning (default 65535)
+---	compress: integer?, -- lz4 compress payloads of at least this many bytes (default disabled)
 ---	marshal: silly.net.cluster.marshal,
 ---	unmarshal: silly.net.cluster.unmarshal,
 ---	call: silly.net.cluster.call,
@@ -325,7 +518,35 @@ function M.serve(conf)
 	call = assert(conf.call)
 	accept = conf.accept
 	close = conf.close
-	ctx = c.create(conf.hardlimit, conf.softlimit)
+	ctx = c.create(conf.hardlimit, conf.softlimit, conf.compress)
+end
+
+---Deadline of the request being handled by the current task, in
+---`time.monotonic()` milliseconds. It is 0 once the caller cancelled the
+---request, and nil outside a request handler or when the caller set none.
+---@return integer?
+function M.deadline()
+	return task_deadline[running()]
+end
+
+---@class silly.net.cluster.stats
+---@field compress_count integer payloads that went through lz4 compression
+---@field compress_in integer bytes before compression
+---@field compress_out integer bytes sent for those payloads
+---@field compress_ns integer cpu time spent compressing, in nanoseconds
+---@field decompress_count integer compressed payloads received
+---@field decompress_in integer compressed bytes received
+---@field decompress_out integer bytes after decompression
+---@field decompress_ns integer cpu time spent decompressing, in nanoseconds
+---@field expired integer queued requests dropped because their deadline passed
+---@field cancelled integer queued requests dropped by a cancel frame
+
+---@return silly.net.cluster.stats? nil before `serve`
+function M.stats()
+	if not ctx then
+		return nil
+	end
+	return c.stats(ctx)
 end
 
 return M
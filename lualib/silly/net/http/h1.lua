@@ -385,6 +385,10 @@ local function write(s, data)
 		-- No body expected, writing is an error
 		return false, "Write not allowed (no body expected)"
 	end
+	if #data == 0 then
+		-- an empty chunk would terminate a chunked body
+		return true, nil
+	end
 	local buf = s.sendbuf
 	local size = s.sendsize
 	size = size + #data
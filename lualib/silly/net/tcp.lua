@@ -18,6 +18,8 @@ local bappend = buffer.append
 local bread = buffer.read
 local bsize = buffer.size
 local readenable = net.readenable
+local tcpsend = net.tcpsend
+local multicast = net.multicast
 local running = task.running
 local wait = task.wait
 local wakeup = task.wakeup
@@ -25,6 +27,7 @@ local TIMEOUT<const> = {}
 
 local ECLOSED<const> = errno.CLOSED
 local ETIMEDOUT<const> = errno.TIMEDOUT
+local EAGAIN<const> = errno.AGAIN
 
 ---@class silly.net.tcp
 local M = {}
@@ -38,6 +41,9 @@ local M = {}
 ---@field package buflimit integer?
 ---@field package delim string|integer|nil
 ---@field package readpause boolean
+---@field package wpaused boolean
+---@field package wnowait boolean
+---@field package wco thread[]?
 local conn = {}
 
 ---@class silly.net.tcp.listener
@@ -74,6 +80,9 @@ local function new_socket(fd, addr)
 		err = nil,
 		delim = nil,
 		readpause = false,
+		wpaused = false,
+		wnowait = false,
+		wco = nil,
 		buf = bnew(),
 		buflimit = nil,
 	}, conn_mt)
@@ -97,6 +106,36 @@ local function check_limit(s, buflimit, size)
 	end
 end
 
+---@param s silly.net.tcp.conn
+---@param err silly.errno?
+local function wakeup_writers(s, err)
+	local wco = s.wco
+	s.wpaused = false
+	if wco then
+		s.wco = nil
+		for i = 1, #wco do
+			wakeup(wco[i], err)
+		end
+	end
+end
+
+---@async
+---@param s silly.net.tcp.conn
+---@return boolean, silly.errno? error
+local function wait_drain(s)
+	local wco = s.wco
+	if not wco then
+		wco = {}
+		s.wco = wco
+	end
+	wco[#wco + 1] = running()
+	local err = wait()
+	if err then
+		return false, err
+	end
+	return true, nil
+end
+
 ---@type silly.net.event
 local EVENT = {
 
@@ -122,6 +161,14 @@ close = function(fd, err)
 		s.delim = nil
 		wakeup(co, nil)
 	end
+	wakeup_writers(s, err)
+end,
+
+drain = function(fd)
+	local s = conn_pool[fd]
+	if s then
+		wakeup_writers(s, nil)
+	end
 end,
 
 data = function(fd, ptr, chunk_size)
@@ -240,6 +287,7 @@ function conn.close(s)
 		s.delim = nil
 		wakeup(co, nil)
 	end
+	wakeup_writers(s, ECLOSED)
 	return net.close(fd)
 end
 conn_mt.__gc = conn.close
@@ -303,15 +351,71 @@ end
 ---@deprecated
 conn.readline = conn.read
 
+---Set the write watermarks. Once the unsent bytes reach `high`, `write`
+---waits until they fall to `low` (or fails with EAGAIN when `nowait`).
+---@param s silly.net.tcp.conn
+---@param high integer? nil turns the watermarks off
+---@param low integer? default `high // 2`
+---@param nowait boolean?
+---@return boolean, silly.errno? error
+function conn.watermark(s, high, low, nowait)
+	local fd = s.fd
+	if not fd then
+		return false, ECLOSED
+	end
+	s.wnowait = nowait and true or false
+	return net.tcpwatermark(fd, high, low)
+end
+
+---@async
+---@param s silly.net.tcp.conn
+---@return boolean, silly.errno? error
+function conn.drain(s)
+	if not s.fd then
+		return false, ECLOSED
+	end
+	if not s.wpaused then
+		return true, nil
+	end
+	return wait_drain(s)
+end
+
+---@async
 ---@param s silly.net.tcp.conn
----@param data string|string[]
+---@param data string|string[]|lightuserdata
+---@param size integer? size of `data` when it is a lightuserdata
 ---@return boolean, silly.errno? error
-function conn.write(s, data)
+function conn.write(s, data, size)
 	local fd = s.fd
+	if fd and s.wpaused then
+		local ok, err
+		if s.wnowait then
+			ok, err = false, EAGAIN
+		else
+			ok, err = wait_drain(s)
+			fd = s.fd
+		end
+		if not ok then
+			if size then
+				net.free(data)
+			end
+			return false, err
+		end
+	end
 	if not fd then
+		if size then
+			net.free(data)
+		end
 		return false, ECLOSED
 	end
-	return net.tcpsend(fd, data)
+	local ok, err, paused = tcpsend(fd, data, size)
+	if paused then
+		s.wpaused = true
+		if not s.wnowait then
+			return wait_drain(s)
+		end
+	end
+	return ok, err
 end
 
 ---@param s silly.net.tcp.conn
@@ -336,6 +440,26 @@ function conn.unsentbytes(s)
 	return net.sendsize(fd)
 end
 
+---Queue the same data on every open connection of `conns` with a single
+---socket operation, the payload is shared instead of copied per connection.
+---Watermarks are not checked, the bytes still count towards them.
+---@param conns silly.net.tcp.conn[]
+---@param data string|lightuserdata
+---@param size integer? size of `data` when it is a lightuserdata
+---@return integer n number of connections the data was queued on
+function M.multicast(conns, data, size)
+	local n = 0
+	local fds = {}
+	for i = 1, #conns do
+		local fd = conns[i].fd
+		if fd then
+			n = n + 1
+			fds[n] = fd
+		end
+	end
+	return multicast(fds, data, size)
+end
+
 -- for compatibility
 ---@deprecated
 M.limit = conn.limit
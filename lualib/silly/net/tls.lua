@@ -33,6 +33,7 @@ local TIMEOUT<const> = {}
 local EINVAL<const> = errno.INVAL
 local ECLOSED<const> = errno.CLOSED
 local ETIMEDOUT<const> = errno.TIMEDOUT
+local EAGAIN<const> = errno.AGAIN
 
 local client_ctx = ctx.client()
 
@@ -54,6 +55,9 @@ local M = {}
 ---@field package buflimit integer?
 ---@field package delim string|integer|table|nil
 ---@field package readpause boolean
+---@field package wpaused boolean
+---@field package wnowait boolean
+---@field package wco thread[]?
 local conn = {}
 
 ---@class silly.net.tls.listener
@@ -115,6 +119,9 @@ local function new_socket(fd, remoteaddr, ctx, hostname, alpnprotos)
 		buflimit = nil,
 		delim = nil,
 		readpause = false,
+		wpaused = false,
+		wnowait = false,
+		wco = nil,
 	}, conn_mt)
 	assert(not conn_pool[fd])
 	conn_pool[fd] = s
@@ -206,6 +213,36 @@ local function handshake(s, timeout)
 	return block_read(s, HANDSHAKE, timeout)
 end
 
+---@param s silly.net.tls.conn
+---@param err silly.errno?
+local function wakeup_writers(s, err)
+	local wco = s.wco
+	s.wpaused = false
+	if wco then
+		s.wco = nil
+		for i = 1, #wco do
+			wakeup(wco[i], err)
+		end
+	end
+end
+
+---@async
+---@param s silly.net.tls.conn
+---@return boolean, silly.errno? error
+local function wait_drain(s)
+	local wco = s.wco
+	if not wco then
+		wco = {}
+		s.wco = wco
+	end
+	wco[#wco + 1] = running()
+	local err = wait()
+	if err then
+		return false, err
+	end
+	return true, nil
+end
+
 ---@type silly.net.event
 local EVENT = {
 accept = function(fd, listenid, addr)
@@ -237,6 +274,14 @@ close = function(fd, err)
 		s.delim = nil
 		wakeup(co, nil)
 	end
+	wakeup_writers(s, err)
+end,
+
+drain = function(fd)
+	local s = conn_pool[fd]
+	if s then
+		wakeup_writers(s, nil)
+	end
 end,
 
 data = function(fd, ptr, size)
@@ -423,6 +468,7 @@ function conn.close(s)
 		s.delim = nil
 		wakeup(co, nil)
 	end
+	wakeup_writers(s, ECLOSED)
 	return net.close(fd)
 end
 conn_mt.__gc = conn.close
@@ -449,14 +495,60 @@ end
 
 conn.readline = conn.read
 
+---Set the write watermarks. Once the unsent bytes reach `high`, `write`
+---waits until they fall to `low` (or fails with EAGAIN when `nowait`).
+---@param s silly.net.tls.conn
+---@param high integer? nil turns the watermarks off
+---@param low integer? default `high // 2`
+---@param nowait boolean?
+---@return boolean, silly.errno? error
+function conn.watermark(s, high, low, nowait)
+	local fd = s.fd
+	if not fd then
+		return false, ECLOSED
+	end
+	s.wnowait = nowait and true or false
+	return net.tcpwatermark(fd, high, low)
+end
+
+---@async
+---@param s silly.net.tls.conn
+---@return boolean, silly.errno? error
+function conn.drain(s)
+	if not s.fd then
+		return false, ECLOSED
+	end
+	if not s.wpaused then
+		return true, nil
+	end
+	return wait_drain(s)
+end
+
+---@async
 ---@param s silly.net.tls.conn
 ---@param data string|string[]
 ---@return boolean, silly.errno? error
 function conn.write(s, data)
+	if s.fd and s.wpaused then
+		if s.wnowait then
+			return false, EAGAIN
+		end
+		local ok, err = wait_drain(s)
+		if not ok then
+			return false, err
+		end
+	end
 	if not s.fd then
 		return false, ECLOSED
 	end
-	return tls.write(s.ssl, data)
+	local ok, err, paused = tls.write(s.ssl, data)
+	if paused then
+		s.wpaused = true
+		if not s.wnowait then
+			return wait_drain(s)
+		end
+	end
+	return ok, err
 end
 
 ---@param s silly.net.tls.conn
@@ -97,13 +97,13 @@ end
 
 ---@param conn silly.net.tcp.conn|silly.net.tls.conn
 ---@param fin integer
+---@param fin integer
 ---@param op integer
 ---@param mask integer
----@param dat string
----@return boolean, string?
-local function write_frame(conn, fin, op, mask, dat)
-	local hdr
-	local len = #dat
+---@param size integer
+---@return string
+local function frame_header(fin, op, mask, size)
+	local len = size
 	if len < 125 then
 	elseif len < 0xffff then
 		len = 126
@@ -112,12 +112,20 @@ local function write_frame(conn, fin, op, mask, dat)
 	end
 	local h, l = fin << 7 | op, mask << 7 | len
 	if len == 126 then
-		hdr = pack(">I1I1I2", h, l, #dat)
+		return pack(">I1I1I2", h, l, size)
 	elseif len == 127 then
-		hdr = pack(">I1I1I8", h, l, #dat)
+		return pack(">I1I1I8", h, l, size)
 	else
-		hdr = pack(">I1I1", h, l)
+		return pack(">I1I1", h, l)
 	end
+end
+
+---@param op integer
+---@param mask integer
+---@param dat string
+---@return boolean, string?
+local function write_frame(conn, fin, op, mask, dat)
+	local hdr = frame_header(fin, op, mask, #dat)
 	if mask == 1 then
 		local masking_key = randomkey(4)
 		dat = xor(masking_key, dat)
@@ -213,6 +221,32 @@ function s.write(sock, dat, typ)
 	return ok, err
 end
 
+---unmasked frames of a whole message, fragmented the same way as `s.write`
+---@param dat string
+---@param op integer
+---@return string
+local function pack_frames(dat, op)
+	local len = #dat
+	if len < 2^16 then
+		return frame_header(1, op, 0, len) .. dat
+	end
+	local buf = {}
+	local off = 1
+	local fin = 0
+	while fin == 0 do
+		local nxt = off + 2^16 - 1
+		local tmp = dat:sub(off, nxt)
+		if nxt >= len then
+			fin = 1
+		end
+		off = nxt + 1
+		buf[#buf + 1] = frame_header(fin, op, 0, #tmp)
+		buf[#buf + 1] = tmp
+		op = 0
+	end
+	return concat(buf)
+end
+
 ---@param sock silly.net.websocket.socket
 ---@return boolean, string?
 function s.close(sock)
@@ -330,6 +364,46 @@ function M.connect(url, header)
 	return newsocket(stream, true), nil
 end
 
+---Send one message to many sockets. The frames are built once and queued
+---on all server-side plain TCP sockets with a single `tcp.multicast`;
+---TLS and client sockets (whose frames are masked) are written one by one.
+---@async
+---@param socks silly.net.websocket.socket[]
+---@param dat string?
+---@param typ string?
+---@return integer n, string? error number of sockets the message was queued on
+function M.broadcast(socks, dat, typ)
+	typ = typ or "binary"
+	dat = dat or NIL
+	if #dat > 125 and typ ~= "text" and typ ~= "binary" then
+		return 0, "All control frames MUST have a payload length of 125 bytes or less"
+	end
+	local op = assert(data_type[typ], typ)
+	local conns = {}
+	local others = {}
+	for i = 1, #socks do
+		local sock = socks[i]
+		local conn = sock.conn
+		if not conn then
+		elseif sock.wmask == 0 and not conn.alpnproto then
+			conns[#conns + 1] = conn
+		else
+			others[#others + 1] = sock
+		end
+	end
+	local n = 0
+	if #conns > 0 then
+		---@cast conns silly.net.tcp.conn[]
+		n = tcp.multicast(conns, pack_frames(dat, op))
+	end
+	for i = 1, #others do
+		if others[i]:write(dat, typ) then
+			n = n + 1
+		end
+	end
+	return n, nil
+end
+
 ---@param stream silly.net.http.h1.stream.server
 function M.upgrade(stream)
 	local ok, err = handshake(stream)
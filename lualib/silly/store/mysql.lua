@@ -15,7 +15,10 @@ local strrep = string.rep
 local strunpack = string.unpack
 local strpack = string.pack
 local setmetatable = setmetatable
+local pairs = pairs
+local unpack = table.unpack
 local tremove = table.remove
+local tsort = table.sort
 local timenow = time.monotonic
 
 local tcp_connect = tcp.connect
@@ -70,10 +73,29 @@ local pmt
 --- @field max_idle_conns number
 --- @field max_idle_time number
 --- @field max_lifetime number
+--- @field min_idle_conns number
+--- @field max_warm_stmts number
 --- @field conns_idle conn[]
 --- @field open_count number
 --- @field waiting_for_conn thread[]
+--- @field stmt_hits table<string, number>	#execute count of each sql
+--- @field stmt_hits_n number			#number of sql tracked by stmt_hits
+--- @field is_warming boolean
 --- @field is_closed boolean
+--- @field wait_count number			#total number of waits for a connection
+--- @field wait_duration number			#total time blocked waiting (ms)
+--- @field idle_closed number			#connections closed due to max_idle_time
+--- @field lifetime_closed number		#connections closed due to max_lifetime
+
+--- @class pool_stats
+--- @field max_open_conns number
+--- @field open_conns number
+--- @field in_use number
+--- @field idle number
+--- @field wait_count number
+--- @field wait_duration number		#milliseconds
+--- @field idle_closed number
+--- @field lifetime_closed number
 
 --- @class open_opts
 --- @field addr string  #host:port
@@ -81,6 +103,8 @@ local pmt
 --- @field password string
 --- @field max_open_conns number? #default 0
 --- @field max_idle_conns number? #default 0
+--- @field min_idle_conns number? #default 0
+--- @field max_warm_stmts number? #default 64
 --- @field max_idle_time number? #default 0
 --- @field max_lifetime number? #default 0
 --- @field database string? #default ""
@@ -143,6 +167,7 @@ local COM_COMMIT<const> = COM_QUERY .. "COMMIT"
 local COM_ROLLBACK<const> = COM_QUERY .. "ROLLBACK"
 
 local CURSOR_TYPE_NO_CURSOR<const> = 0x00
+local STMT_HITS_MAX<const> = 1024
 local SERVER_MORE_RESULTS_EXISTS<const> = 8
 
 local OK<const> = 0x00
@@ -797,18 +822,9 @@ local function recv_col_def_packet(conn, array)
 end
 
 --- @param conn conn
---- @param sql string
 --- @return stmt|? stmt, err_packet? error
-local function prepare(conn, sql)
+local function read_prepare(conn)
 	local ok, data ,err
-	ok, err = tcp_write(conn.fd, prepare_pkt_cache[sql])
-	if not ok then
-		conn.is_broken = true
-		return nil, {
-			type = "ERR",
-			message = "failed to write prepare packet: " .. err,
-		}
-	end
 	data, err = read_packet(conn)
 	if not data then
 		return nil, {
@@ -846,6 +862,57 @@ local function prepare(conn, sql)
 	}, nil
 end
 
+--- @param conn conn
+--- @param sql string
+--- @return stmt|? stmt, err_packet? error
+local function prepare(conn, sql)
+	local ok, err = tcp_write(conn.fd, prepare_pkt_cache[sql])
+	if not ok then
+		conn.is_broken = true
+		return nil, {
+			type = "ERR",
+			message = "failed to write prepare packet: " .. err,
+		}
+	end
+	return read_prepare(conn)
+end
+
+--- The server handles commands in order, so all COM_STMT_PREPARE
+--- packets are sent in one write and the responses are read back
+--- in the same order.
+--- @param conn conn
+--- @param sqls string[]
+--- @return table<string, err_packet>? errs, err_packet? error
+local function prepare_batch(conn, sqls)
+	local n = #sqls
+	local pkts = {}
+	for i = 1, n do
+		pkts[i] = prepare_pkt_cache[sqls[i]]
+	end
+	local ok, err = tcp_write(conn.fd, pkts)
+	if not ok then
+		conn.is_broken = true
+		return nil, {
+			type = "ERR",
+			message = "failed to write prepare packet: " .. err,
+		}
+	end
+	local errs = {}
+	local cache = conn.stmt_cache
+	for i = 1, n do
+		local sql = sqls[i]
+		local stmt, err = read_prepare(conn)
+		if stmt then
+			cache[sql] = stmt
+		elseif conn.is_broken then
+			return nil, err
+		else
+			errs[sql] = err
+		end
+	end
+	return errs, nil
+end
+
 -----------------------------connection--------------------------
 
 --- @param self conn
@@ -869,32 +936,22 @@ local function conn_ping(self)
 	return parse_ok_packet(data), nil
 end
 
---- @param conn conn
+--- @param pool pool
 --- @param sql string
---- @vararg any
---- @return ok_packet|row[]|nil result, err_packet? error
-local function conn_query(conn, sql, ...)
-	local err
-	local cache = conn.stmt_cache
-	local stmt = cache[sql]
-	if not stmt then
-		stmt, err = prepare(conn, sql)
-		if not stmt then
-			return nil, err
-		end
-		cache[sql] = stmt
-	end
-	conn.packet_no = -1
-	local stmt_packet = compose_stmt_execute(stmt.prepare_id, stmt.param_count, CURSOR_TYPE_NO_CURSOR, ...)
-	local querypacket = compose_packet(conn, stmt_packet)
-	local ok, err = tcp_write(conn.fd, querypacket)
-	if not ok then
-		conn.is_broken = true
-		return nil, {
-			type = "ERR",
-			message = "failed to write execute packet: " .. err,
-		}
+local function stmt_hit(pool, sql)
+	local hits = pool.stmt_hits
+	local n = hits[sql]
+	if n then
+		hits[sql] = n + 1
+	elseif pool.stmt_hits_n < STMT_HITS_MAX then
+		pool.stmt_hits_n = pool.stmt_hits_n + 1
+		hits[sql] = 1
 	end
+end
+
+--- @param conn conn
+--- @return ok_packet|row[]|nil result, err_packet? error
+local function read_result(conn)
 	-- read execute result
 	local data, errstr = read_packet(conn)
 	if not data then
@@ -945,6 +1002,109 @@ local function conn_query(conn, sql, ...)
 	return rows, nil
 end
 
+--- @param conn conn
+--- @param sql string
+--- @vararg any
+--- @return ok_packet|row[]|nil result, err_packet? error
+local function conn_query(conn, sql, ...)
+	local err
+	local cache = conn.stmt_cache
+	local stmt = cache[sql]
+	if not stmt then
+		stmt, err = prepare(conn, sql)
+		if not stmt then
+			return nil, err
+		end
+		cache[sql] = stmt
+	end
+	stmt_hit(conn.pool, sql)
+	conn.packet_no = -1
+	local stmt_packet = compose_stmt_execute(stmt.prepare_id, stmt.param_count, CURSOR_TYPE_NO_CURSOR, ...)
+	local querypacket = compose_packet(conn, stmt_packet)
+	local ok, err = tcp_write(conn.fd, querypacket)
+	if not ok then
+		conn.is_broken = true
+		return nil, {
+			type = "ERR",
+			message = "failed to write execute packet: " .. err,
+		}
+	end
+	return read_result(conn)
+end
+
+--- Statements missing from the cache are prepared in one round trip,
+--- then every COM_STMT_EXECUTE is written at once and the results are
+--- read back in request order.
+--- @param conn conn
+--- @param reqs table[]	#{ {sql, ...}, ... }
+--- @return table? results, err_packet? error
+local function conn_pipeline(conn, reqs)
+	local n = #reqs
+	local cache = conn.stmt_cache
+	local missing, seen
+	for i = 1, n do
+		local sql = reqs[i][1]
+		if not cache[sql] then
+			if not missing then
+				missing, seen = {}, {}
+			end
+			if not seen[sql] then
+				seen[sql] = true
+				missing[#missing + 1] = sql
+			end
+		end
+	end
+	local errs
+	if missing then
+		local err
+		errs, err = prepare_batch(conn, missing)
+		if not errs then
+			return nil, err
+		end
+	end
+	local pool = conn.pool
+	local pkts = {}
+	for i = 1, n do
+		local req = reqs[i]
+		local sql = req[1]
+		local stmt = cache[sql]
+		if stmt then
+			stmt_hit(pool, sql)
+			local pkt = compose_stmt_execute(stmt.prepare_id, stmt.param_count,
+				CURSOR_TYPE_NO_CURSOR, unpack(req, 2, req.n or #req))
+			local size = #pkt
+			pkts[#pkts + 1] = strpack(pkt_fmt_cache[size], size, 0, pkt)
+		end
+	end
+	if #pkts > 0 then
+		local ok, err = tcp_write(conn.fd, pkts)
+		if not ok then
+			conn.is_broken = true
+			return nil, {
+				type = "ERR",
+				message = "failed to write execute packet: " .. err,
+			}
+		end
+	end
+	local results = {}
+	local j = 1
+	for i = 1, n do
+		local sql = reqs[i][1]
+		if cache[sql] then
+			local res, err = read_result(conn)
+			if conn.is_broken then
+				return nil, err
+			end
+			results[j] = res
+			results[j + 1] = err
+		else
+			results[j + 1] = errs[sql]
+		end
+		j = j + 2
+	end
+	return results, nil
+end
+
 local function conn_close_transaction(packet)
 	--- @param conn conn
 	--- @return ok_packet? result, err_packet? error
@@ -1015,36 +1175,8 @@ end
 
 --- @param pool pool
 --- @return conn? conn, err_packet? error
-local function conn_new(pool)
-	local lifetime_since
+local function conn_open(pool)
 	local now = timenow() // 1000
-	local conns_idle = pool.conns_idle
-	local max_lifetime = pool.max_lifetime
-	if max_lifetime > 0 then
-		lifetime_since = now - max_lifetime
-	end
-	while #conns_idle > 0 do
-		local conn = tremove(conns_idle)
-		if not conn then
-			break
-		end
-		if not lifetime_since or conn.returned_at > lifetime_since then
-			return conn
-		end
-		--- old conn will be closed
-		tcp_close(conn.fd)
-		conn.fd = nil
-	end
-	local max_open_conns = pool.max_open_conns
-	if max_open_conns > 0 and pool.open_count >= max_open_conns then
-		local co = task.running()
-		local waiting_for_conn = pool.waiting_for_conn
-		waiting_for_conn[#waiting_for_conn + 1] = co
-		local conn = task.wait()
-		if conn then
-			return conn
-		end
-	end
 	pool.open_count = pool.open_count + 1
 	local fd , err = tcp_connect(pool.addr)
 	if not fd then
@@ -1079,7 +1211,104 @@ local function conn_new(pool)
 	return conn, nil
 end
 
+--- @param pool pool
+--- @return conn? conn, err_packet? error
+local function conn_new(pool)
+	local lifetime_since
+	local now = timenow() // 1000
+	local conns_idle = pool.conns_idle
+	local max_lifetime = pool.max_lifetime
+	if max_lifetime > 0 then
+		lifetime_since = now - max_lifetime
+	end
+	while #conns_idle > 0 do
+		local conn = tremove(conns_idle)
+		if not conn then
+			break
+		end
+		if not lifetime_since or conn.returned_at > lifetime_since then
+			return conn
+		end
+		--- old conn will be closed
+		pool.open_count = pool.open_count - 1
+		pool.lifetime_closed = pool.lifetime_closed + 1
+		tcp_close(conn.fd)
+		conn.fd = nil
+	end
+	local max_open_conns = pool.max_open_conns
+	if max_open_conns > 0 and pool.open_count >= max_open_conns then
+		local co = task.running()
+		local waiting_for_conn = pool.waiting_for_conn
+		waiting_for_conn[#waiting_for_conn + 1] = co
+		local start = timenow()
+		local conn = task.wait()
+		pool.wait_count = pool.wait_count + 1
+		pool.wait_duration = pool.wait_duration + (timenow() - start)
+		if conn then
+			return conn
+		end
+	end
+	return conn_open(pool)
+end
+
 --------------------------connection pool--------------------------
+--- @param pool pool
+--- @return string[]
+local function hot_stmts(pool)
+	local sqls = {}
+	local max = pool.max_warm_stmts
+	if max <= 0 then
+		return sqls
+	end
+	local hits = pool.stmt_hits
+	for sql in pairs(hits) do
+		sqls[#sqls + 1] = sql
+	end
+	tsort(sqls, function(a, b)
+		return hits[a] > hits[b]
+	end)
+	for i = max + 1, #sqls do
+		sqls[i] = nil
+	end
+	return sqls
+end
+
+--- @param pool pool
+local function pool_warm_task(pool)
+	local conns_idle = pool.conns_idle
+	while not pool.is_closed and #conns_idle < pool.min_idle_conns do
+		local max_open_conns = pool.max_open_conns
+		if max_open_conns > 0 and pool.open_count >= max_open_conns then
+			break
+		end
+		local conn, err = conn_open(pool)
+		if not conn then
+			logger.error("[silly.store.mysql] warm connection failed:", err and err.message)
+			break
+		end
+		-- replay the hot statements, so the first queries on this
+		-- connection don't pay for the COM_STMT_PREPARE round trip
+		local sqls = hot_stmts(pool)
+		if #sqls > 0 then
+			prepare_batch(conn, sqls)
+		end
+		conn_close(conn)
+	end
+	pool.is_warming = false
+end
+
+--- @param pool pool
+local function pool_warm(pool)
+	if pool.is_warming or pool.is_closed then
+		return
+	end
+	if #pool.conns_idle >= pool.min_idle_conns then
+		return
+	end
+	pool.is_warming = true
+	task.fork(pool_warm_task, pool)
+end
+
 --- @param pool pool
 local function pool_clear(pool)
 	if pool.is_closed then
@@ -1096,11 +1325,22 @@ local function pool_clear(pool)
 		created_since = now - max_lifetime
 	end
 	local conns_idle = pool.conns_idle
+	local min_idle_conns = pool.min_idle_conns
+	local n = #conns_idle
 	local wi = 1
-	for i = 1, #conns_idle do
+	for i = 1, n do
 		local conn = conns_idle[i]
-		if idle_since and conn.returned_at < idle_since or
-			created_since and conn.created_at < created_since then
+		local close = false
+		if created_since and conn.created_at < created_since then
+			close = true
+			pool.lifetime_closed = pool.lifetime_closed + 1
+		elseif idle_since and conn.returned_at < idle_since and
+			n - (i - wi) > min_idle_conns then -- keep min_idle_conns
+			close = true
+			pool.idle_closed = pool.idle_closed + 1
+		end
+		if close then
+			pool.open_count = pool.open_count - 1
 			tcp_close(conn.fd)
 			conn.fd = nil
 		else
@@ -1108,9 +1348,10 @@ local function pool_clear(pool)
 			wi = wi + 1
 		end
 	end
-	for i = wi, #conns_idle do -- clear old conn
+	for i = wi, n do -- clear old conn
 		conns_idle[i] = nil
 	end
+	pool_warm(pool)
 	time.after(1000, pool_clear, pool)
 end
 
@@ -1138,6 +1379,11 @@ end
 --- @param opts open_opts
 --- @return pool
 local function pool_open(opts)
+	local min_idle_conns = opts.min_idle_conns or 0
+	local max_idle_conns = opts.max_idle_conns or 0
+	if max_idle_conns < min_idle_conns then
+		max_idle_conns = min_idle_conns
+	end
 	local pool = setmetatable({
 		addr = opts.addr or "127.0.0.1:3306",
 		database = opts.database or "",
@@ -1146,17 +1392,27 @@ local function pool_open(opts)
 		charset = strchar(CHARSET_MAP[opts.charset or "_default"]),
 		max_packet_size = opts.max_packet_size or (1024 * 1024), -- default 1 MB
 		max_open_conns = opts.max_open_conns or 0,
-		max_idle_conns = opts.max_idle_conns or 0,
+		max_idle_conns = max_idle_conns,
+		min_idle_conns = min_idle_conns,
 		max_idle_time = opts.max_idle_time or 0,
 		max_lifetime = opts.max_lifetime or 0,
+		max_warm_stmts = opts.max_warm_stmts or 64,
 		open_count = 0,
 		conns_idle = {},
 		waiting_for_conn = {},
+		stmt_hits = {},
+		stmt_hits_n = 0,
+		is_warming = false,
 		is_closed = false,
+		wait_count = 0,
+		wait_duration = 0,
+		idle_closed = 0,
+		lifetime_closed = 0,
 	}, pmt)
-	if pool.max_idle_time > 0 or pool.max_lifetime > 0 then
+	if pool.max_idle_time > 0 or pool.max_lifetime > 0 or min_idle_conns > 0 then
 		time.after(1000, pool_clear, pool)
 	end
+	pool_warm(pool)
 	return pool
 end
 
@@ -1188,6 +1444,40 @@ local function pool_query(self, sql, ...)
 	return conn_query(conn, sql, ...)
 end
 
+--- @param self pool
+--- @param reqs table[]	#{ {sql, ...}, ... }
+--- @return table? results, err_packet? error
+local function pool_pipeline(self, reqs)
+	if self.is_closed then
+		return nil, {
+			type = "ERR",
+			message = "pool is closed",
+		}
+	end
+	local conn<close>, err = conn_new(self)
+	if not conn then
+		return nil, err
+	end
+	return conn_pipeline(conn, reqs)
+end
+
+--- @param self pool
+--- @return pool_stats
+local function pool_stats(self)
+	local open = self.open_count
+	local idle = #self.conns_idle
+	return {
+		max_open_conns = self.max_open_conns,
+		open_conns = open,
+		in_use = open - idle,
+		idle = idle,
+		wait_count = self.wait_count,
+		wait_duration = self.wait_duration,
+		idle_closed = self.idle_closed,
+		lifetime_closed = self.lifetime_closed,
+	}
+end
+
 --- @param self pool
 --- @return conn? conn, err_packet? error
 local function pool_begin(self)
@@ -1228,6 +1518,7 @@ C = {
 	close = conn_close,
 	ping = conn_ping,
 	query = conn_query,
+	pipeline = conn_pipeline,
 	commit = conn_commit,
 	rollback = conn_rollback,
 }
@@ -1253,6 +1544,8 @@ P = {
 	close = pool_close,
 	ping = pool_ping,
 	query = pool_query,
+	pipeline = pool_pipeline,
+	stats = pool_stats,
 	begin = pool_begin,
 }
 
@@ -56,6 +56,26 @@ function buffer:reset(...) end
 ---@return pb.buffer self
 function buffer:pack(fmt, ...) end
 
+---@class pb.codec
+---Compiled codec of one message type, see pb.compile
+local codec = {}
+
+---Decode protobuf binary with the compiled field table
+---@param data string? Binary protobuf data
+---@param table table? Existing table to decode into
+---@return table message Decoded Lua table
+function codec:decode(data, table) end
+
+---Encode Lua table with the compiled field table, fields are written in number order
+---@param data table Lua table to encode
+---@param buffer pb.buffer? Optional buffer to use
+---@return string encoded Binary protobuf data
+function codec:encode(data, buffer) end
+
+---Get the full name of the compiled message type
+---@return string name
+function codec:type() end
+
 ---@class pb.slice
 ---slice for reading protobuf messages
 local slice = {}
@@ -370,6 +390,19 @@ function M.pack(typename, buffer, ...) end
 ---@return ... any Unpacked values
 function M.unpack(typename, data) end
 
+---Compile message types into flattened codecs.
+---Without typename all loaded message types are compiled with the "name"
+---layout and pb.encode/pb.decode use them while hooks and encode_order are
+---off; the cache is dropped by pb.load/pb.clear/pb.unsafe.use.
+---With typename the codec of that type is returned. The "index" layout
+---keys fields by their position in field number order (as pb.pack/pb.unpack)
+---instead of by name, and does not record the active oneof member.
+---@overload fun(): integer
+---@param typename string Message type name
+---@param layout "name"|"index"|nil Table layout (default: "name")
+---@return pb.codec codec
+function M.compile(typename, layout) end
+
 M.Buffer = buffer
 M.Slice = slice
 
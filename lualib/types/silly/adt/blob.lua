@@ -0,0 +1,37 @@
+--- @meta silly.adt.blob
+
+---@class silly.adt.blob
+local M = {}
+
+---@param data string
+---@return silly.adt.blob
+function M.new(data) end
+
+---@param self silly.adt.blob
+---@return integer
+function M.len(self) end
+
+---Zero-copy string view of the blob
+---@param self silly.adt.blob
+---@return string
+function M.view(self) end
+
+---@param self silly.adt.blob
+---@param i integer
+---@param j? integer
+---@return string
+function M.sub(self, i, j) end
+
+---@param self silly.adt.blob
+---@param i? integer
+---@param j? integer
+---@return integer ...
+function M.byte(self, i, j) end
+
+---@param self silly.adt.blob
+---@param fmt string
+---@param pos? integer
+---@return any ...
+function M.unpack(self, fmt, pos) end
+
+return M
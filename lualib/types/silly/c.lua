@@ -37,4 +37,17 @@ function M.tostring(ptr, size) end
 ---@param status integer?
 function M.exit(status) end
 
+---@class silly.gcconf
+---@field mode? "incremental"|"generational"
+---@field pause? integer
+---@field stepmul? integer
+---@field minormul? integer
+---@field idle? integer microseconds of GC steps per idle period, 0 disables
+---@field busy? integer backlog that throttles the inline GC, 0 disables
+
+---Tune the worker GC, fields left out keep their value
+---@param conf silly.gcconf?
+---@return silly.gcconf current
+function M.gctune(conf) end
+
 return M
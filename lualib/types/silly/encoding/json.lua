@@ -17,4 +17,42 @@ function M.encode(obj) end
 ---@return table? result, string? err
 function M.decode(str) end
 
+---@class silly.encoding.json.decoder
+local decoder = {}
+
+---Feed the next chunk of input
+---@param chunk string
+---@return boolean? done, string? err
+function decoder:feed(chunk) end
+
+---End of input, return the decoded value
+---@return any result, string? err
+function decoder:finish() end
+
+---Create an incremental decoder
+---@return silly.encoding.json.decoder
+function M.decoder() end
+
+---Iterate over the encoding of obj in pieces of about chunk bytes
+---@param obj table|string|number|boolean
+---@param chunk integer? default 4096
+---@return fun():string?
+function M.encoder(obj, chunk) end
+
+---Extract one value by RFC 6901 JSON Pointer without building the tree
+---@param str string
+---@param pointer string e.g. "/data/0/name", array indices are 0-based
+---@return any value, string? err
+function M.get(str, pointer) end
+
+---Read-only proxy over the document, subtrees are decoded on access
+---@param str string
+---@return any proxy, string? err
+function M.lazy(str) end
+
+---Decode a lazy proxy into plain tables, other values are returned as is
+---@param v any
+---@return any
+function M.materialize(v) end
+
 return M
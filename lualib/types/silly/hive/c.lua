@@ -27,8 +27,15 @@ function M.spawn(func, ...) end
 ---@return integer task_id
 function M.push(worker, data) end
 
----Get active threads count
+---Pop the next finished task
+---@return integer? task_id
+---@return boolean? ok
+---@return any ...
+function M.pop() end
+
+---Get active threads count and queue statistics
 ---@return integer
+---@return silly.hive.stats
 function M.threads() end
 
 return M
@@ -15,6 +15,24 @@ function M.getlevel() end
 ---@param level integer?
 function M.setlevel(level) end
 
+---Limit every call site to `rate` lines per second, 0 turns it off
+---@param rate number
+---@param burst number? default `rate`
+function M.ratelimit(rate, burst) end
+
+---Take a token from the bucket of `key`, true if the line may be logged
+---@param key string
+---@param level integer? level of the summary line, default WARN
+---@return boolean
+function M.allow(key, level) end
+
+---Write a summary line for every site that suppressed lines
+function M.report() end
+
+---Lines suppressed so far, by "file:line" site or key
+---@return table<string, integer>
+function M.suppressed() end
+
 ---Log debug message
 ---@param ... any
 function M.debug(...) end
@@ -33,6 +33,24 @@ function M.jestat() end
 ---@return integer
 function M.workerstat() end
 
+---Get worker GC scheduling statistics
+---@return integer dispatch
+---@return integer idle_steps
+---@return integer idle_cycles
+---@return integer idle_ns
+---@return integer throttled
+function M.gcstat() end
+
+---Get log writer statistics
+---@return integer written_bytes
+---@return integer dropped_bytes
+---@return integer dropped_lines
+---@return integer blocked
+---@return integer flushes
+---@return integer flush_ns
+---@return integer flush_ns_max slowest flush since the last call
+function M.logstat() end
+
 ---Get timer statistics
 ---@return integer pending
 ---@return integer scheduled
@@ -53,4 +71,28 @@ function M.netstat() end
 ---@return table info {fd, os_fd, sent_bytes, type, protocol, localaddr, remoteaddr}
 function M.socketstat(sid) end
 
+---@class silly.metrics.c.peerstat
+---@field kind "listener"|"peer"|"other"
+---@field addr string listening address, remote address, or "*"
+---@field opens integer accepted or attempted connections
+---@field closes table<string, integer> closes by reason: local, eof, reset, timeout, refused, error
+---@field sent_bytes integer
+---@field received_bytes integer
+---@field eagain integer writes the kernel did not take in full
+---@field drains integer backlogs written out after an eagain
+---@field drain_ns integer total time from the eagain to the empty write list
+---@field wlist_max integer largest write list since the last call
+---@field retransmits integer retransmitted segments of closed sockets (TCP_INFO)
+---@field rtt_us integer smoothed RTT of the last sample (TCP_INFO)
+---@field cwnd integer congestion window of the last sample (TCP_INFO)
+
+---Get TCP statistics by listener and by remote peer
+---@return silly.metrics.c.peerstat[]
+function M.peerstat() end
+
+---Turn TCP_INFO sampling on or off
+---@param enable boolean
+---@return boolean supported false when the platform has no TCP_INFO
+function M.tcpinfo(enable) end
+
 return M
@@ -0,0 +1,126 @@
+--- @meta silly.metrics.native
+
+---A family created by counter(); without label names it is also its series
+---@class silly.metrics.native.counter
+local counter = {}
+
+---Resolve the series of a label set, keep it for the hot path
+---@param ... string|number
+---@return silly.metrics.native.counter
+function counter:labels(...) end
+
+---@param v number must not be negative
+function counter:add(v) end
+
+function counter:inc() end
+
+---@class silly.metrics.native.gauge
+local gauge = {}
+
+---@param ... string|number
+---@return silly.metrics.native.gauge
+function gauge:labels(...) end
+
+---@param v number
+function gauge:set(v) end
+
+---@param v number
+function gauge:add(v) end
+
+---@param v number
+function gauge:sub(v) end
+
+function gauge:inc() end
+
+function gauge:dec() end
+
+---@class silly.metrics.native.histogram
+local histogram = {}
+
+---@param ... string|number
+---@return silly.metrics.native.histogram
+function histogram:labels(...) end
+
+---@param v number
+function histogram:observe(v) end
+
+---Summed buckets of the series at this moment
+---@return silly.metrics.native.snapshot
+function histogram:snapshot() end
+
+---@class silly.metrics.native.loghistogram
+local loghistogram = {}
+
+---@param ... string|number
+---@return silly.metrics.native.loghistogram
+function loghistogram:labels(...) end
+
+---@param v number
+function loghistogram:observe(v) end
+
+---@return silly.metrics.native.snapshot
+function loghistogram:snapshot() end
+
+---@class silly.metrics.native.snapshot
+local snapshot = {}
+
+---Add a snapshot with the same buckets in place
+---@param other silly.metrics.native.snapshot
+---@return silly.metrics.native.snapshot self
+function snapshot:merge(other) end
+
+---Estimate a quantile, NaN without observations
+---@param q number in [0, 1]
+---@return number
+function snapshot:quantile(q) end
+
+---@return integer
+function snapshot:count() end
+
+---@return number
+function snapshot:sum() end
+
+---@class silly.metrics.native.loghistogram.opts
+---@field min number? lowest bucket bound, 1e-6 by default
+---@field max number? highest bucket bound, 1e3 by default
+---@field precision integer? 2^precision buckets per power of two, 3 by default, up to 8
+---@field quantiles number[]? export as a summary with these quantiles
+---@field window number? seconds the summary quantiles cover, 60 by default
+
+---@class silly.metrics.native : silly.metrics.collector
+local M = {}
+
+---Create a counter, or return the registered one with the same layout
+---@param name string
+---@param help string?
+---@param labelnames string[]?
+---@return silly.metrics.native.counter
+function M.counter(name, help, labelnames) end
+
+---@param name string
+---@param help string?
+---@param labelnames string[]?
+---@return silly.metrics.native.gauge
+function M.gauge(name, help, labelnames) end
+
+---@param name string
+---@param help string?
+---@param labelnames string[]?
+---@param buckets number[]? upper bounds, the Prometheus defaults if nil
+---@return silly.metrics.native.histogram
+function M.histogram(name, help, labelnames, buckets) end
+
+---Create a log-linear histogram
+---@param name string
+---@param help string?
+---@param labelnames string[]?
+---@param opts silly.metrics.native.loghistogram.opts?
+---@return silly.metrics.native.loghistogram
+function M.loghistogram(name, help, labelnames, opts) end
+
+---Append every C metric, summed over the thread shards, to `buf`
+---@param self silly.metrics.native
+---@param buf silly.metrics.metric[]
+function M.collect(self, buf) end
+
+return M
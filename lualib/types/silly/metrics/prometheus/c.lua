@@ -0,0 +1,34 @@
+--- @meta silly.metrics.prometheus.c
+
+---@class silly.metrics.prometheus.c
+local M = {}
+
+---@class silly.metrics.prometheus.writer
+local W = {}
+
+---Create a text exposition writer
+---@param openmetrics boolean? write OpenMetrics 1.0 instead of Prometheus 0.0.4
+---@param gzip boolean? gzip the output
+---@return silly.metrics.prometheus.writer
+function M.writer(openmetrics, gzip) end
+
+---Write one metric returned by a Lua collector
+---@param metric silly.metrics.metric
+function W:lua(metric) end
+
+---Write every metric of the C registry (silly.metrics.native)
+function W:native() end
+
+---Bytes ready for take()
+---@return integer
+function W:size() end
+
+---Return the output written so far
+---@return string
+function W:take() end
+
+---Return the rest of the output, the writer can't be used afterwards
+---@return string
+function W:finish() end
+
+return M
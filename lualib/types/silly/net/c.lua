@@ -7,6 +7,7 @@
 ---@field CONNECT integer
 ---@field TCPDATA integer
 ---@field UDPDATA integer
+---@field DRAIN integer
 local M = {}
 
 ---@param ptr lightuserdata
@@ -45,8 +46,15 @@ function M.close(fd) end
 ---@param data string|lightuserdata|table
 ---@param size integer?
 ---@return boolean, string? error
+---@return boolean? paused wait for DRAIN before writing more
 function M.tcp_send(fd, data, size) end
 
+---@param fd integer
+---@param high integer? 0 or nil turns the watermarks off
+---@param low integer? default `high // 2`
+---@return boolean, string? error
+function M.tcp_watermark(fd, high, low) end
+
 ---@param fd integer
 ---@param data string|lightuserdata|table
 ---@param size_or_addr integer|string?
@@ -61,6 +69,12 @@ function M.udp_send(fd, data, size_or_addr, addr) end
 ---@return boolean, string? error
 function M.tcp_multicast(fd, data, size, addr) end
 
+---@param fds integer[]
+---@param data string|lightuserdata
+---@param size integer?
+---@return integer
+function M.multicast(fds, data, size) end
+
 ---@param fd integer
 ---@param enable boolean
 function M.readenable(fd, enable) end
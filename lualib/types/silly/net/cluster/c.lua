@@ -8,16 +8,18 @@ local M = {}
 ---Create a new cluster instance
 ---@param hardlimit? integer max body size before error (default 128MB)
 ---@param softlimit? integer max body size before warning (default 65535)
+---@param compress? integer lz4 compress payloads of at least this size, 0 disables (default 0)
 ---@return silly.net.cluster.context cluster
-function M.create(hardlimit, softlimit) end
+function M.create(hardlimit, softlimit, compress) end
 
----Pop a message from cluster
+---Pop a message from cluster, requests whose deadline passed are dropped
 ---@param cluster silly.net.cluster.context
 ---@return integer fd
 ---@return string  dat
 ---@return integer session
----@return integer? cmd
+---@return integer|false|nil cmd request cmd, nil for a response, false for a cancel frame
 ---@return integer traceid
+---@return integer deadline time.monotonic() ms of the request deadline, 0 for none
 function M.pop(cluster) end
 
 ---Push a message to cluster
@@ -31,20 +33,63 @@ function M.push(cluster, fd, ptr, size) end
 
 ---Send a request to cluster
 ---@param cluster silly.net.cluster.context
+---@param fd integer file descriptor the request is sent to
 ---@param cmd integer
 ---@param traceid integer
+---@param timeout integer time left to the caller in ms, 0 for none
 ---@param data string|lightuserdata
 ---@param size? integer
----@return integer|false session_id, string body_or_error
-function M.request(cluster, cmd, traceid, data, size) end
+---@return integer|false session_id, lightuserdata|string body_or_error, integer? size
+function M.request(cluster, fd, cmd, traceid, timeout, data, size) end
 
----Send a response to cluster
+---Build a cancel frame for a request sent earlier
 ---@param cluster silly.net.cluster.context
 ---@param session_id integer
+---@return lightuserdata ptr, integer size
+function M.cancel(cluster, session_id) end
+
+---Append a response frame to the pending batch of `fd`
+---@param cluster silly.net.cluster.context
+---@param fd integer file descriptor
+---@param session_id integer
 ---@param data string|lightuserdata
 ---@param size? integer
----@return string|false body, string? error
-function M.response(cluster, session_id, data, size) end
+---@return boolean ok, string? error
+function M.response(cluster, fd, session_id, data, size) end
+
+---Send every pending response batch, one write per fd
+---@param cluster silly.net.cluster.context
+---@return integer count number of fds flushed
+function M.flush(cluster) end
+
+---Increase the outstanding call count of `fd`
+---@param cluster silly.net.cluster.context
+---@param fd integer
+---@return integer count
+function M.acquire(cluster, fd) end
+
+---Decrease the outstanding call count of `fd`
+---@param cluster silly.net.cluster.context
+---@param fd integer
+---@return integer count
+function M.release(cluster, fd) end
+
+---Outstanding call count of `fd`
+---@param cluster silly.net.cluster.context
+---@param fd integer
+---@return integer count
+function M.inflight(cluster, fd) end
+
+---Pick the fd with the least outstanding calls, `false` entries are skipped
+---@param cluster silly.net.cluster.context
+---@param fds (integer|false)[]
+---@return integer? fd, integer? count
+function M.pick(cluster, fds) end
+
+---Compression and dropped request counters
+---@param cluster silly.net.cluster.context
+---@return silly.net.cluster.stats
+function M.stats(cluster) end
 
 ---Clear cluster
 ---@param cluster silly.net.cluster.context
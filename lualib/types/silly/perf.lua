@@ -27,4 +27,39 @@ function M.resume(co) end
 ---@return table stats {[name] = {time = ns, call = count}, ...} or {time = ns, call = count}
 function M.dump(name) end
 
+---Start the CPU sampling profiler of the worker (SIGPROF driven)
+---@param hz? integer samples per second of worker CPU time, default 99
+---@return string? err
+function M.samplestart(hz) end
+
+---Stop the CPU sampling profiler, collected stacks are kept until dumped
+function M.samplestop() end
+
+---Counters of the sampling profiler since the last reset
+---@return {ticks:integer, samples:integer, native:integer, skipped:integer, dropped:integer, stacks:integer}
+function M.samplestat() end
+
+---Folded stacks ("frame;frame;... count" per line) for flamegraph tools
+---@param reset? boolean clear the collected stacks after dumping
+---@return string folded
+function M.sampledump(reset) end
+
+---Start the sampled allocation profiler of the worker heap
+---@param rate? integer average bytes allocated between two samples, default 512 KiB
+---@return string? err
+function M.allocstart(rate) end
+
+---Stop the allocation profiler, the live view is dropped, totals are kept until dumped
+function M.allocstop() end
+
+---Counters of the allocation profiler since the last reset
+---@return {samples:integer, bytes:integer, live:integer, liveobjs:integer, dropped:integer, stacks:integer}
+function M.allocstat() end
+
+---Folded allocation stacks weighted by sample count, allocated bytes or live bytes
+---@param kind? "count"|"bytes"|"live" default "bytes"
+---@param reset? boolean clear the totals after dumping (live objects are kept)
+---@return string folded
+function M.allocdump(kind, reset) end
+
 return M
@@ -62,6 +62,13 @@ function zproto:encode(typ, packet, raw)
 	return encode(query(self, typ), packet, raw)
 end
 
+--encode (and zero-byte pack if 'pack' is true) into a buffer owned by
+--the caller, returns ptr, size which can be passed to net.tcpsend/conn:write
+local encodebuf = engine.encodebuf
+function zproto:encodebuf(typ, packet, pack)
+	return encodebuf(query(self, typ), packet, pack)
+end
+
 function zproto:tag(typ)
 	local nametag = self.nametag
 	local tag = nametag[typ]
@@ -72,9 +79,11 @@ function zproto:tag(typ)
 	return tag
 end
 
+--'into' is cleared and refilled instead of creating a new table,
+--its sub-tables go into 'pool' and are reused by later decodes
 local decode = engine.decode
-function zproto:decode(typ, data, sz)
-	return decode(query(self, typ), data, sz)
+function zproto:decode(typ, data, sz, into, pool)
+	return decode(query(self, typ), data, sz, into, pool)
 end
 
 function zproto:default(typ)
@@ -9,14 +9,15 @@
 #include "timer.h"
 #include "trace.h"
 #include "engine.h"
+#include "metrics.h"
 
 SILLY_API void *silly_malloc(size_t sz)
 {
-	return mem_alloc(sz);
+	return mem_alloc_from(sz, __builtin_return_address(0));
 }
 SILLY_API void *silly_realloc(void *ptr, size_t sz)
 {
-	return mem_realloc(ptr, sz);
+	return mem_realloc_from(ptr, sz, __builtin_return_address(0));
 }
 SILLY_API void silly_free(void *ptr)
 {
@@ -56,10 +57,47 @@ SILLY_API void silly_log_write(enum silly_log_level level, const char *buf, size
 {
 	log_write(level, buf, len);
 }
+SILLY_API int silly_log_binary()
+{
+	return log_binary();
+}
+SILLY_API void silly_log_writeb(enum silly_log_level level, const char *items, size_t len)
+{
+	log_writeb(level, items, len);
+}
+SILLY_API void silly_logstat(struct silly_logstat *stat)
+{
+	log_stat(stat);
+}
 SILLY_API int silly_signal_watch(int signum)
 {
 	return worker_signal_watch(signum);
 }
+SILLY_API int silly_profile_start(int hz, lua_Hook hook)
+{
+	return worker_profile_start(hz, hook);
+}
+SILLY_API void silly_profile_stop()
+{
+	worker_profile_stop();
+}
+SILLY_API void silly_profilestat(struct silly_profilestat *stat)
+{
+	worker_profilestat(stat);
+}
+SILLY_API void silly_memtrace(const struct silly_memtrace *mt)
+{
+	worker_memtrace(mt);
+}
+SILLY_API void silly_gctune(const struct silly_gcconf *conf,
+			    struct silly_gcconf *old)
+{
+	worker_gctune(conf, old);
+}
+SILLY_API void silly_gcstat(struct silly_gcstat *stat)
+{
+	worker_gcstat(stat);
+}
 SILLY_API silly_socket_id_t silly_tcp_listen(const char *ip, const char *port,
 					     int backlog)
 {
@@ -98,12 +136,23 @@ SILLY_API int silly_tcp_send(silly_socket_id_t sid, uint8_t *buff, size_t sz,
 {
 	return socket_tcp_send(sid, buff, sz, freex);
 }
+SILLY_API int silly_tcp_multicast(const silly_socket_id_t *sids, int n,
+				  uint8_t *buff, size_t sz,
+				  void (*freex)(void *))
+{
+	return socket_tcp_multicast(sids, n, buff, sz, freex);
+}
 SILLY_API int silly_udp_send(silly_socket_id_t sid, uint8_t *buff, size_t sz,
 			     const uint8_t *addr, size_t addrlen,
 			     void (*freex)(void *))
 {
 	return socket_udp_send(sid, buff, sz, addr, addrlen, freex);
 }
+SILLY_API int silly_tcp_watermark(silly_socket_id_t sid, uint32_t high,
+				  uint32_t low)
+{
+	return socket_tcp_watermark(sid, high, low);
+}
 SILLY_API int silly_socket_close(silly_socket_id_t sid)
 {
 	return socket_close(sid);
@@ -121,6 +170,14 @@ SILLY_API void silly_socketstat(silly_socket_id_t sid,
 {
 	socket_stat(sid, info);
 }
+SILLY_API int silly_peerstat(int i, struct silly_peerstat *stat)
+{
+	return socket_peerstat(i, stat);
+}
+SILLY_API int silly_socket_tcpinfo(int enable)
+{
+	return socket_tcpinfo(enable);
+}
 
 SILLY_API void silly_timerstat(struct silly_timerstat *stat)
 {
@@ -154,6 +211,60 @@ SILLY_API silly_traceid_t silly_trace_new()
 {
 	return trace_new();
 }
+SILLY_API struct silly_metric *silly_metric_new(const struct silly_metric_desc *desc)
+{
+	return metrics_new(desc);
+}
+SILLY_API struct silly_metric *silly_metric_next(struct silly_metric *m)
+{
+	return metrics_next(m);
+}
+SILLY_API const struct silly_metric_desc *silly_metric_desc(const struct silly_metric *m)
+{
+	return metrics_desc(m);
+}
+SILLY_API struct silly_metric_series *silly_metric_series(struct silly_metric *m,
+							  const char *const *values)
+{
+	return metrics_series(m, values);
+}
+SILLY_API struct silly_metric_series *silly_metric_series_next(struct silly_metric *m,
+							       struct silly_metric_series *s)
+{
+	return metrics_series_next(m, s);
+}
+SILLY_API const char *silly_metric_series_labels(const struct silly_metric_series *s)
+{
+	return metrics_series_labels(s);
+}
+SILLY_API void silly_metric_add(struct silly_metric_series *s, double v)
+{
+	metrics_add(s, v);
+}
+SILLY_API void silly_metric_set(struct silly_metric_series *s, double v)
+{
+	metrics_set(s, v);
+}
+SILLY_API void silly_metric_observe(struct silly_metric_series *s, double v)
+{
+	metrics_observe(s, v);
+}
+SILLY_API void silly_metric_read(const struct silly_metric_series *s,
+				 struct silly_metric_sample *sample)
+{
+	metrics_read(s, sample);
+}
+SILLY_API void silly_metric_quantiles(struct silly_metric_series *s,
+				      double *values)
+{
+	metrics_quantiles(s, values);
+}
+SILLY_API double silly_metric_quantile(const struct silly_metric_desc *desc,
+				       const struct silly_metric_sample *sample,
+				       double q)
+{
+	return metrics_quantile(desc, sample, q);
+}
 SILLY_API void silly_push(struct silly_message *msg)
 {
 	worker_push(msg);
@@ -222,6 +333,7 @@ SILLY_API const struct silly_message_id *silly_messages()
 		.socket_listen = MESSAGE_SOCKET_LISTEN,
 		.socket_connect = MESSAGE_SOCKET_CONNECT,
 		.socket_close = MESSAGE_SOCKET_CLOSE,
+		.tcp_drain = MESSAGE_TCP_DRAIN,
 	};
 	return &p;
 }
@@ -1,10 +1,18 @@
 #ifndef _ARGS_H
 #define _ARGS_H
 
+#include <stddef.h>
 #include "silly_conf.h"
 
 struct boot_args {
 	int daemon;
+	int logdrop;
+	int logbinary;
+	int logrotate_interval;
+	int logrotate_keep;
+	int logrotate_time;
+	int logrotate_compress;
+	size_t logrotate_size;
 	int socketaffinity;
 	int workeraffinity;
 	int timeraffinity;
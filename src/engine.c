@@ -72,6 +72,8 @@ static void *thread_worker(void *arg)
 	worker_start(c);
 	pthread_mutex_lock(&R.mutex);
 	while (R.running) {
+		//collect garbage before parking, bounded by the next message
+		worker_idle();
 		//allow spurious wakeup, it's harmless
 		R.workerstatus = 0;
 		if (worker_backlog() == 0) //double check
@@ -95,7 +97,6 @@ static void thread_monitor()
 			break;
 		nanosleep(&req, NULL);
 		monitor_check();
-		log_flush();
 	}
 	log_info("[monitor] stop\n");
 	return;
@@ -132,9 +133,10 @@ int engine_run(const struct boot_args *config)
 	pthread_t workertid;
 	pthread_mutex_init(&R.mutex, NULL);
 	pthread_cond_init(&R.cond, NULL);
-	/* Block SIGUSR2 before creating threads, so all threads inherit
-	 * the blocked signal mask. Only worker thread will unblock it. */
+	/* Block SIGUSR2/SIGPROF before creating threads, so all threads inherit
+	 * the blocked signal mask. Only worker thread will unblock them. */
 	signal_block_usr2();
+	signal_block_prof();
 	err = socket_init();
 	if (unlikely(err < 0)) {
 		log_error("%s socket init fail:%d\n", config->selfname, err);
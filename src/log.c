@@ -3,7 +3,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 #include <pthread.h>
@@ -17,23 +16,61 @@
 #include "timer.h"
 #include "trace.h"
 #include "log.h"
+#include "logrotate.h"
 
 static int is_daemon = 0;
+static int is_binary = 0;
 static enum silly_log_level log_level = SILLY_LOG_INFO;
 
 #define BUILD_SEC (1)
 #define BUILD_TRACE (2)
 #define BUILD_NONE (3)
 
-struct log_buf {
+/*
+** Every producer thread owns a single-producer/single-consumer ring,
+** registered on its first log line. A dedicated writer thread drains
+** all rings with one writev() every LOG_FLUSH_INTERVAL, or earlier when
+** a ring fills past a quarter. Producers never touch the fd unless a
+** line does not fit in a ring at all.
+**
+** 'wlock' serializes the drainers (writer thread, log_flush, oversized
+** lines), so each ring has exactly one reader at a time. 'lock' guards
+** the ring list and the writer/producer wakeups.
+*/
+struct log_ring {
+	struct log_ring *next;
 	char *buf;
 	size_t size;
 	atomic_uint_least32_t read_pos;
 	atomic_uint_least32_t write_pos;
+	atomic_int dead; // owner thread exited, free once drained
+};
+
+struct log_buf {
+	struct log_ring *rings;
 	pthread_mutex_t lock;
+	pthread_mutex_t wlock;
+	pthread_cond_t cond;  // wakes the writer
+	pthread_cond_t space; // wakes producers blocked on a full ring
+	pthread_key_t key;
+	pthread_t tid;
+	int running;
+	int waiting;
+	int drop;
+	atomic_int sleeping;
+	atomic_int reopening; // log_open_file() left a path in 'reopen'
+	char reopen[PATH_MAX];
+	atomic_uint_least64_t written_bytes;
+	atomic_uint_least64_t dropped_bytes;
+	atomic_uint_least64_t dropped_lines;
+	atomic_uint_least64_t blocked;
+	atomic_uint_least64_t flushes;
+	atomic_uint_least64_t flush_ns;
+	atomic_uint_least64_t flush_ns_max;
 };
 
 static struct log_buf *LB;
+static THREAD_LOCAL struct log_ring *ring;
 
 /* ---- head formatting (per-thread, lock-free) ---- */
 static THREAD_LOCAL struct {
@@ -51,6 +88,20 @@ static THREAD_LOCAL struct {
 
 #define HEAD_LEN(h) ((size_t)((h).term + 2 - (h).buf))
 
+/* ---- binary records (--log-format=binary) ---- */
+struct record_head {
+	uint8_t magic;
+	uint8_t version;
+	uint8_t level;
+	uint8_t pad;
+	uint32_t size;
+	uint64_t time;
+	uint64_t traceid;
+};
+
+/* u8 SILLY_LOG_RAW + u32 len, wraps the text lines of the C side */
+#define RAW_HEAD_LEN (5)
+
 static char level_names[] = {
 	'D',
 	'I',
@@ -104,67 +155,37 @@ static inline void fmttime(uint64_t now)
 	return;
 }
 
-/* ---- ring buffer write ---- */
+/* ---- ring buffer ---- */
 
-static inline size_t ring_used(void)
+static inline size_t ring_used(struct log_ring *r)
 {
-	size_t w = atomic_load_explicit(&LB->write_pos, memory_order_relaxed);
-	size_t r = atomic_load_explicit(&LB->read_pos, memory_order_relaxed);
-	if (w >= r)
-		return w - r;
-	return LB->size - r + w;
+	size_t w = atomic_load_explicit(&r->write_pos, memory_order_acquire);
+	size_t r_ = atomic_load_explicit(&r->read_pos, memory_order_acquire);
+	if (w >= r_)
+		return w - r_;
+	return r->size - r_ + w;
 }
 
-static inline size_t ring_available(void)
+static inline size_t ring_available(struct log_ring *r)
 {
-	return LB->size - ring_used() - 1;
+	return r->size - ring_used(r) - 1;
 }
 
-static size_t block_write(int fd, const char *buf, size_t len)
+static size_t block_writev(int fd, struct iovec *iov, int cnt)
 {
-	size_t total = 0;
-	while (len > 0) {
-		ssize_t n = write(fd, buf, len);
-		if (n > 0) {
-			buf += n;
-			len -= n;
-			total += n;
-		} else if (n == 0) {
-			/* write returned 0, shouldn't happen but avoid infinite loop */
-			break;
-		} else if (errno == EINTR) {
-			/* interrupted, retry */
-			continue;
-		} else {
-			/* real error: write errno to stderr */
-			fprintf(stderr, "[log] write error:%d\n", errno);
-			break;
-		}
-	}
-	return total;
-}
-
-static size_t block_writev(int fd, const char *buf1, size_t len1,
-			   const char *buf2, size_t len2)
-{
-	struct iovec iov[2];
-	size_t total = len1 + len2;
 	size_t written = 0;
-	iov[0].iov_base = (void *)buf1;
-	iov[0].iov_len  = len1;
-	iov[1].iov_base = (void *)buf2;
-	iov[1].iov_len  = len2;
-	while (written < total) {
-		ssize_t n = writev(fd, iov, 2);
+	while (cnt > 0) {
+		ssize_t n = writev(fd, iov, cnt);
 		if (n > 0) {
 			written += n;
-			size_t consume = min((size_t)n, iov[0].iov_len);
-			iov[0].iov_base = (char *)iov[0].iov_base + consume;
-			iov[0].iov_len -= consume;
-			n -= consume;
-			if (n > 0) {
-				iov[1].iov_base = (char *)iov[1].iov_base + n;
-				iov[1].iov_len -= n;
+			while (cnt > 0 && (size_t)n >= iov->iov_len) {
+				n -= iov->iov_len;
+				iov++;
+				cnt--;
+			}
+			if (cnt > 0) {
+				iov->iov_base = (char *)iov->iov_base + n;
+				iov->iov_len -= n;
 			}
 		} else if (n == 0) {
 			/* write returned 0, shouldn't happen but avoid infinite loop */
@@ -181,68 +202,249 @@ static size_t block_writev(int fd, const char *buf1, size_t len1,
 	return written;
 }
 
-static void ring_flush(void)
+static inline uint64_t clock_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+struct drain_batch {
+	int iovcnt;
+	int n;
+	struct iovec iov[LOG_IOV_MAX];
+	struct log_ring *ring[LOG_IOV_MAX / 2];
+	uint32_t end[LOG_IOV_MAX / 2];
+};
+
+static void batch_write(struct drain_batch *b)
 {
-	size_t start = atomic_load_explicit(&LB->read_pos, memory_order_relaxed);
-	size_t end = atomic_load_explicit(&LB->write_pos, memory_order_relaxed);
+	int i;
 	size_t n;
+	uint64_t ns, max;
+	uint64_t start = clock_ns();
+	fflush(stdout);
+	n = block_writev(STDOUT_FILENO, b->iov, b->iovcnt);
+	logrotate_written(n);
+	/* data the fd refused is dropped, keeping it would wedge the ring */
+	for (i = 0; i < b->n; i++) {
+		atomic_store_explicit(&b->ring[i]->read_pos, b->end[i],
+				      memory_order_release);
+	}
+	ns = clock_ns() - start;
+	atomic_fetch_add_explicit(&LB->written_bytes, n, memory_order_relaxed);
+	atomic_fetch_add_explicit(&LB->flushes, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&LB->flush_ns, ns, memory_order_relaxed);
+	max = atomic_load_explicit(&LB->flush_ns_max, memory_order_relaxed);
+	while (ns > max && !atomic_compare_exchange_weak_explicit(
+			&LB->flush_ns_max, &max, ns, memory_order_relaxed,
+			memory_order_relaxed))
+		;
+	b->iovcnt = 0;
+	b->n = 0;
+}
+
+static void batch_add(struct drain_batch *b, struct log_ring *r)
+{
+	uint32_t start = atomic_load_explicit(&r->read_pos, memory_order_relaxed);
+	uint32_t end = atomic_load_explicit(&r->write_pos, memory_order_acquire);
 	if (start == end)
 		return;
-	fflush(stdout);
 	if (end > start) {
-		/* Simple case: data is contiguous */
-		n = block_write(STDOUT_FILENO, LB->buf + start, end - start);
-		atomic_store_explicit(&LB->read_pos, start + n,
-				      memory_order_relaxed);
+		b->iov[b->iovcnt].iov_base = r->buf + start;
+		b->iov[b->iovcnt++].iov_len = end - start;
 	} else {
-		/* Wrapped case: write both segments atomically */
-		n = block_writev(STDOUT_FILENO,
-			LB->buf + start, LB->size - start,
-			LB->buf, end);
-		atomic_store_explicit(&LB->read_pos,
-				      (start + n) % LB->size,
-				      memory_order_relaxed);
+		b->iov[b->iovcnt].iov_base = r->buf + start;
+		b->iov[b->iovcnt++].iov_len = r->size - start;
+		b->iov[b->iovcnt].iov_base = r->buf;
+		b->iov[b->iovcnt++].iov_len = end;
+	}
+	b->ring[b->n] = r;
+	b->end[b->n++] = end;
+	if (b->n == ARRAY_SIZE(b->ring))
+		batch_write(b);
+}
+
+static void ring_free(struct log_ring *r)
+{
+	mem_free(r->buf);
+	mem_free(r);
+}
+
+/* Drain every ring into the fd (called with wlock held) */
+static void rings_drain(void)
+{
+	struct log_ring *r, **pp;
+	struct drain_batch b;
+	b.iovcnt = 0;
+	b.n = 0;
+	pthread_mutex_lock(&LB->lock);
+	r = LB->rings;
+	pthread_mutex_unlock(&LB->lock);
+	/* rings are only pushed at the head, the tail is stable here */
+	for (; r != NULL; r = r->next)
+		batch_add(&b, r);
+	if (b.n > 0)
+		batch_write(&b);
+	if (atomic_exchange_explicit(&LB->reopening, 0, memory_order_acquire)) {
+		char path[PATH_MAX];
+		pthread_mutex_lock(&LB->lock);
+		memcpy(path, LB->reopen, sizeof(path));
+		pthread_mutex_unlock(&LB->lock);
+		logrotate_open(path);
+	}
+	logrotate_check();
+	pthread_mutex_lock(&LB->lock);
+	pp = &LB->rings;
+	while ((r = *pp) != NULL) {
+		if (atomic_load_explicit(&r->dead, memory_order_acquire) &&
+		    ring_used(r) == 0) {
+			*pp = r->next;
+			ring_free(r);
+		} else {
+			pp = &r->next;
+		}
 	}
+	if (LB->waiting > 0)
+		pthread_cond_broadcast(&LB->space);
+	pthread_mutex_unlock(&LB->lock);
+}
+
+static void ring_release(void *ud)
+{
+	struct log_ring *r = (struct log_ring *)ud;
+	atomic_store_explicit(&r->dead, 1, memory_order_release);
+}
+
+static struct log_ring *ring_get(void)
+{
+	struct log_ring *r = ring;
+	if (likely(r != NULL))
+		return r;
+	r = (struct log_ring *)mem_alloc(sizeof(*r));
+	r->buf = (char *)mem_alloc(LOG_BUF_SIZE);
+	r->size = LOG_BUF_SIZE;
+	atomic_init(&r->read_pos, 0);
+	atomic_init(&r->write_pos, 0);
+	atomic_init(&r->dead, 0);
+	pthread_mutex_lock(&LB->lock);
+	r->next = LB->rings;
+	LB->rings = r;
+	pthread_mutex_unlock(&LB->lock);
+	pthread_setspecific(LB->key, r);
+	ring = r;
+	return r;
 }
 
 /* Copy data into ring buffer, handling wrap-around */
-static inline void ring_copy(size_t pos, const char *src, size_t n)
+static inline void ring_copy(struct log_ring *r, size_t pos, const char *src,
+			     size_t n)
 {
-	size_t tail = LB->size - pos;
+	size_t tail = r->size - pos;
 	if (n <= tail) {
-		memcpy(LB->buf + pos, src, n);
+		memcpy(r->buf + pos, src, n);
 	} else {
-		memcpy(LB->buf + pos, src, tail);
-		memcpy(LB->buf, src + tail, n - tail);
+		memcpy(r->buf + pos, src, tail);
+		memcpy(r->buf, src + tail, n - tail);
+	}
+}
+
+static inline void writer_wakeup(void)
+{
+	if (atomic_load_explicit(&LB->sleeping, memory_order_relaxed))
+		pthread_cond_signal(&LB->cond);
+}
+
+/* Wait until the writer made room, 0 if it is not running */
+static int ring_wait(struct log_ring *r, size_t total)
+{
+	int ok;
+	atomic_fetch_add_explicit(&LB->blocked, 1, memory_order_relaxed);
+	pthread_mutex_lock(&LB->lock);
+	LB->waiting++;
+	while (LB->running && ring_available(r) < total) {
+		pthread_cond_signal(&LB->cond);
+		pthread_cond_wait(&LB->space, &LB->lock);
 	}
+	LB->waiting--;
+	ok = LB->running;
+	pthread_mutex_unlock(&LB->lock);
+	return ok;
+}
+
+/* Write a line too large for the ring, after what this thread queued */
+static size_t line_write(struct iovec *iov, int cnt)
+{
+	size_t n;
+	pthread_mutex_lock(&LB->wlock);
+	rings_drain();
+	n = block_writev(STDOUT_FILENO, iov, cnt);
+	logrotate_written(n);
+	pthread_mutex_unlock(&LB->wlock);
+	atomic_fetch_add_explicit(&LB->written_bytes, n, memory_order_relaxed);
+	return n;
 }
 
-/* Write head + body to ring buffer (called with lock held) */
-static size_t ring_write(const char *data, size_t len)
+/* Write the pieces of one line to the ring of the calling thread */
+static size_t ring_write(struct iovec *iov, int cnt)
 {
-	size_t head_len = HEAD_LEN(head_cache);
-	size_t total = len + head_len;
-	if (ring_used() > 0 && ring_available() < total) {
-		ring_flush();
-		if (ring_used() > 0) // Still data left but no space, means fd error
-			return 0;
+	int i;
+	size_t wpos;
+	size_t total = 0;
+	struct log_ring *r = ring_get();
+	for (i = 0; i < cnt; i++)
+		total += iov[i].iov_len;
+	if (unlikely(total >= r->size))
+		return line_write(iov, cnt);
+	if (unlikely(ring_available(r) < total)) {
+		if (LB->drop) {
+			writer_wakeup();
+			atomic_fetch_add_explicit(&LB->dropped_bytes, total,
+						  memory_order_relaxed);
+			atomic_fetch_add_explicit(&LB->dropped_lines, 1,
+						  memory_order_relaxed);
+			return total;
+		}
+		if (!ring_wait(r, total)) {
+			pthread_mutex_lock(&LB->wlock);
+			rings_drain();
+			pthread_mutex_unlock(&LB->wlock);
+		}
 	}
-	if (ring_used() == 0 && total >= LB->size) {
-		/* If buffer is empty but log is too large, write directly */
-		size_t n = block_writev(STDOUT_FILENO,
-			head_cache.buf, head_len, data, len);
-		if (n == 0)
-			return 0;
-		return total;
+	wpos = atomic_load_explicit(&r->write_pos, memory_order_relaxed);
+	for (i = 0; i < cnt; i++) {
+		ring_copy(r, wpos, iov[i].iov_base, iov[i].iov_len);
+		wpos = (wpos + iov[i].iov_len) % r->size;
 	}
-	size_t wpos = atomic_load_explicit(&LB->write_pos, memory_order_relaxed);
-	ring_copy(wpos, head_cache.buf, head_len);
-	ring_copy((wpos + head_len) % LB->size, data, len);
-	atomic_store_explicit(&LB->write_pos, (wpos + total) % LB->size,
-			      memory_order_relaxed);
+	atomic_store_explicit(&r->write_pos, wpos, memory_order_release);
+	if (ring_used(r) > r->size / 4)
+		writer_wakeup();
 	return total;
 }
 
+static void *log_writer(void *arg)
+{
+	struct timespec ts;
+	(void)arg;
+	pthread_mutex_lock(&LB->lock);
+	while (LB->running) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += LOG_FLUSH_INTERVAL * 1000000;
+		ts.tv_sec += ts.tv_nsec / 1000000000;
+		ts.tv_nsec %= 1000000000;
+		atomic_store_explicit(&LB->sleeping, 1, memory_order_relaxed);
+		pthread_cond_timedwait(&LB->cond, &LB->lock, &ts);
+		atomic_store_explicit(&LB->sleeping, 0, memory_order_relaxed);
+		pthread_mutex_unlock(&LB->lock);
+		pthread_mutex_lock(&LB->wlock);
+		rings_drain();
+		pthread_mutex_unlock(&LB->wlock);
+		pthread_mutex_lock(&LB->lock);
+	}
+	pthread_mutex_unlock(&LB->lock);
+	return NULL;
+}
+
 /* Format log head (thread-local, lock-free) */
 static void build_head(uint64_t now, enum silly_log_level level)
 {
@@ -251,17 +453,73 @@ static void build_head(uint64_t now, enum silly_log_level level)
 	head_cache.term[1] = ' ';
 }
 
-/* Write head (from head_cache) + body in one lock acquisition */
+/* Binary head, plus a RAW item head when 'raw' is set */
+static void build_record(struct record_head *h, char *raw, uint64_t now,
+			 enum silly_log_level level, size_t len)
+{
+	uint32_t n = (uint32_t)len;
+	h->magic = SILLY_LOG_MAGIC;
+	h->version = SILLY_LOG_VERSION;
+	h->level = (uint8_t)level;
+	h->pad = 0;
+	h->size = sizeof(*h) + n;
+	h->time = now;
+	h->traceid = trace_current();
+	if (raw != NULL) {
+		raw[0] = SILLY_LOG_RAW;
+		memcpy(&raw[1], &n, sizeof(n));
+		h->size += RAW_HEAD_LEN;
+	}
+}
+
+static void lines_write(struct iovec *iov, int cnt)
+{
+	if (unlikely(ring_write(iov, cnt) == 0))
+		block_writev(STDERR_FILENO, iov, cnt);
+}
+
+/* Write head (from head_cache) + body to the calling thread's ring */
 void log_write_(enum silly_log_level level, const char *body, size_t body_len)
 {
-	build_head(timer_now(), level);
-	pthread_mutex_lock(&LB->lock);
-	if (unlikely(ring_write(body, body_len) == 0)) {
-		size_t head_len = HEAD_LEN(head_cache);
-		fwrite(head_cache.buf, 1, head_len, stderr);
+	struct iovec iov[3];
+	if (unlikely(LB == NULL)) { //before log_init, no clock either
 		fwrite(body, 1, body_len, stderr);
+		return;
 	}
-	pthread_mutex_unlock(&LB->lock);
+	if (is_binary) {
+		struct record_head h;
+		char raw[RAW_HEAD_LEN];
+		build_record(&h, raw, timer_now(), level, body_len);
+		iov[0].iov_base = &h;
+		iov[0].iov_len = sizeof(h);
+		iov[1].iov_base = raw;
+		iov[1].iov_len = sizeof(raw);
+		iov[2].iov_base = (void *)body;
+		iov[2].iov_len = body_len;
+		lines_write(iov, 3);
+		return;
+	}
+	build_head(timer_now(), level);
+	iov[0].iov_base = head_cache.buf;
+	iov[0].iov_len = HEAD_LEN(head_cache);
+	iov[1].iov_base = (void *)body;
+	iov[1].iov_len = body_len;
+	lines_write(iov, 2);
+}
+
+/* Write already encoded items as one record, binary format only */
+void log_writeb_(enum silly_log_level level, const char *items, size_t len)
+{
+	struct record_head h;
+	struct iovec iov[2];
+	if (unlikely(LB == NULL || !is_binary))
+		return;
+	build_record(&h, NULL, timer_now(), level, len);
+	iov[0].iov_base = &h;
+	iov[0].iov_len = sizeof(h);
+	iov[1].iov_base = (void *)items;
+	iov[1].iov_len = len;
+	lines_write(iov, 2);
 }
 
 void log_writef_(enum silly_log_level level, const char *fmt, ...)
@@ -293,14 +551,20 @@ void log_writef_(enum silly_log_level level, const char *fmt, ...)
 
 void log_open_file(const char *path)
 {
-	int fd;
 	if (!is_daemon)
 		return;
-	fd = open(path, O_CREAT | O_WRONLY | O_APPEND, 00666);
-	if (fd >= 0) {
-		dup2(fd, STDOUT_FILENO);
-		close(fd);
+	if (LB == NULL) {
+		logrotate_open(path);
+		return;
 	}
+	/* reopened by the writer, after the lines already queued */
+	pthread_mutex_lock(&LB->lock);
+	snprintf(LB->reopen, sizeof(LB->reopen), "%s", path);
+	atomic_store_explicit(&LB->reopening, 1, memory_order_release);
+	pthread_cond_signal(&LB->cond);
+	pthread_mutex_unlock(&LB->lock);
+	if (!LB->running)
+		log_flush();
 }
 
 /*
@@ -312,33 +576,74 @@ void log_open_file(const char *path)
  * may have crashed while holding the lock.
  *
  * Therefore, we are in a logically unsafe state. We deliberately skip
- * the mutex to avoid deadlock hazards. By making read_pos and write_pos
- * atomic, we ensure memory-safe concurrent access without C-level data
- * race UB. We use memory_order_relaxed instead of acquire/release semantics
- * because normal thread synchronization is handled by the mutex. During a
- * crash, enforcing memory barriers to prevent CPU reordering is unnecessary
- * overhead for the hot path; we accept that we may read logically
- * inconsistent positions mid-write (yielding garbled output), but recovering
- * *some* log data is the priority here. writev() is used as it is
- * async-signal-safe.
+ * both mutexes to avoid deadlock hazards, and walk the ring list without
+ * reaping it. By making read_pos and write_pos atomic, we ensure
+ * memory-safe concurrent access without C-level data race UB. We accept
+ * that we may race with the writer thread or read a ring mid-write
+ * (yielding duplicated or garbled output), but recovering *some* log data
+ * is the priority here. writev() is used as it is async-signal-safe.
  */
 static void eh_clean(void)
 {
+	struct log_ring *r;
+	struct iovec iov[2];
 	if (LB == NULL)
 		return;
-	ring_flush();
+	for (r = LB->rings; r != NULL; r = r->next) {
+		int cnt = 1;
+		uint32_t start = atomic_load_explicit(&r->read_pos,
+						      memory_order_relaxed);
+		uint32_t end = atomic_load_explicit(&r->write_pos,
+						    memory_order_relaxed);
+		if (start == end)
+			continue;
+		iov[0].iov_base = r->buf + start;
+		if (end > start) {
+			iov[0].iov_len = end - start;
+		} else {
+			iov[0].iov_len = r->size - start;
+			iov[1].iov_base = r->buf;
+			iov[1].iov_len = end;
+			cnt = 2;
+		}
+		block_writev(STDOUT_FILENO, iov, cnt);
+		atomic_store_explicit(&r->read_pos, end, memory_order_relaxed);
+	}
 }
 
 void log_init(const struct boot_args *config)
 {
-	LB = (struct log_buf *)mem_alloc(sizeof(*LB));
-	LB->buf = (char *)mem_alloc(LOG_BUF_SIZE);
-	LB->size = LOG_BUF_SIZE;
-	atomic_init(&LB->read_pos, 0);
-	atomic_init(&LB->write_pos, 0);
+	int err;
+	struct log_buf *lb;
+	lb = (struct log_buf *)mem_alloc(sizeof(*lb));
+	memset(lb, 0, sizeof(*lb));
+	lb->drop = config->logdrop;
+	is_binary = config->logbinary;
+	lb->running = 1;
+	atomic_init(&lb->sleeping, 0);
+	atomic_init(&lb->reopening, 0);
+	atomic_init(&lb->written_bytes, 0);
+	atomic_init(&lb->dropped_bytes, 0);
+	atomic_init(&lb->dropped_lines, 0);
+	atomic_init(&lb->blocked, 0);
+	atomic_init(&lb->flushes, 0);
+	atomic_init(&lb->flush_ns, 0);
+	atomic_init(&lb->flush_ns_max, 0);
+	pthread_mutex_init(&lb->lock, NULL);
+	pthread_mutex_init(&lb->wlock, NULL);
+	pthread_cond_init(&lb->cond, NULL);
+	pthread_cond_init(&lb->space, NULL);
+	pthread_key_create(&lb->key, ring_release);
 	is_daemon = config->daemon;
-	pthread_mutex_init(&LB->lock, NULL);
+	logrotate_init(config);
 	log_open_file(config->logpath);
+	LB = lb;
+	err = pthread_create(&lb->tid, NULL, log_writer, NULL);
+	if (unlikely(err != 0)) {
+		/* producers drain their own ring when there is no writer */
+		fprintf(stderr, "[log] writer thread create fail:%d\n", err);
+		lb->running = 0;
+	}
 	set_eh(eh_clean);
 	atexit(eh_clean);
 }
@@ -357,29 +662,88 @@ enum silly_log_level log_get_level()
 	return log_level;
 }
 
+int log_binary()
+{
+	return is_binary;
+}
+
 void log_flush()
 {
-	pthread_mutex_lock(&LB->lock);
-	ring_flush();
-	pthread_mutex_unlock(&LB->lock);
+	pthread_mutex_lock(&LB->wlock);
+	rings_drain();
+	pthread_mutex_unlock(&LB->wlock);
+}
+
+void log_stat(struct silly_logstat *stat)
+{
+	stat->written_bytes = atomic_load(&LB->written_bytes);
+	stat->dropped_bytes = atomic_load(&LB->dropped_bytes);
+	stat->dropped_lines = atomic_load(&LB->dropped_lines);
+	stat->blocked = atomic_load(&LB->blocked);
+	stat->flushes = atomic_load(&LB->flushes);
+	stat->flush_ns = atomic_load(&LB->flush_ns);
+	stat->flush_ns_max = atomic_exchange(&LB->flush_ns_max, 0);
 }
 
 void log_exit()
 {
+	struct log_ring *r;
+	struct log_buf *lb = LB;
+	pthread_mutex_lock(&lb->lock);
+	if (lb->running) {
+		lb->running = 0;
+		pthread_cond_signal(&lb->cond);
+		pthread_mutex_unlock(&lb->lock);
+		pthread_join(lb->tid, NULL);
+	} else {
+		pthread_mutex_unlock(&lb->lock);
+	}
 	log_flush();
-	mem_free(LB->buf);
-	pthread_mutex_destroy(&LB->lock);
-	mem_free(LB);
+	logrotate_exit();
 	LB = NULL;
+	ring = NULL;
+	while ((r = lb->rings) != NULL) {
+		lb->rings = r->next;
+		ring_free(r);
+	}
+	pthread_key_delete(lb->key);
+	pthread_cond_destroy(&lb->space);
+	pthread_cond_destroy(&lb->cond);
+	pthread_mutex_destroy(&lb->wlock);
+	pthread_mutex_destroy(&lb->lock);
+	mem_free(lb);
 }
 
 void log_directf_(uint64_t now, enum silly_log_level level, const char *fmt, ...)
 {
 	va_list ap;
-	build_head(now, level);
-	fflush(stdout);
 	if (LB != NULL)
-		ring_flush();
+		log_flush();
+	fflush(stdout);
+	if (is_binary) {
+		int n;
+		char body[1024];
+		struct record_head h;
+		char raw[RAW_HEAD_LEN];
+		struct iovec iov[3];
+		va_start(ap, fmt);
+		n = vsnprintf(body, sizeof(body), fmt, ap);
+		va_end(ap);
+		if (n < 0)
+			return;
+		if ((size_t)n >= sizeof(body)) //direct lines are short notes
+			n = sizeof(body) - 1;
+		build_record(&h, raw, now, level, n);
+		iov[0].iov_base = &h;
+		iov[0].iov_len = sizeof(h);
+		iov[1].iov_base = raw;
+		iov[1].iov_len = sizeof(raw);
+		iov[2].iov_base = body;
+		iov[2].iov_len = n;
+		block_writev(STDOUT_FILENO, iov, 3);
+		return;
+	}
+	build_head(now, level);
 	fwrite(head_cache.buf, 1, HEAD_LEN(head_cache), stdout);
 	va_start(ap, fmt);
 	vfprintf(stdout, fmt, ap);
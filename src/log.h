@@ -9,10 +9,13 @@ void log_init(const struct boot_args *config);
 void log_open_file(const char *path);
 void log_set_level(enum silly_log_level level);
 enum silly_log_level log_get_level(void);
+int log_binary(void);
 void log_flush(void);
+void log_stat(struct silly_logstat *stat);
 void log_exit(void);
 
 void log_write_(enum silly_log_level level, const char *msg, size_t len);
+void log_writeb_(enum silly_log_level level, const char *items, size_t len);
 void log_writef_(enum silly_log_level level, const char *fmt, ...);
 void log_directf_(uint64_t now, enum silly_log_level level, const char *fmt, ...);
 
@@ -25,6 +28,13 @@ void log_directf_(uint64_t now, enum silly_log_level level, const char *fmt, ...
 		log_write_(level, msg, len); \
 	} while (0)
 
+#define log_writeb(level, items, len) \
+	do { \
+		if (!log_visible(level)) \
+			break; \
+		log_writeb_(level, items, len); \
+	} while (0)
+
 #define log_writef(level, fmt, ...) \
 	do { \
 		if (!log_visible(level)) \
@@ -0,0 +1,486 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <lz4.h>
+
+#include "silly.h"
+#include "compiler.h"
+#include "mem.h"
+#include "logrotate.h"
+
+/*
+** The log file is rotated by the drainers of log.c (wlock held), right
+** after a batch is written: the file is renamed to '<path>.<tag>' and
+** reopened, producers keep filling their rings meanwhile. The tag is a
+** sequence number or a timestamp ('-n' added on a clash); compared as
+** '-' separated numbers, the newest segment is the greatest. A
+** background thread compresses the rotated segments and deletes the
+** oldest beyond 'keep'.
+*/
+
+#define IO_BUF_SIZE (64 * 1024)
+#define LZ4_LEGACY_MAGIC (0x184C2102)
+#define LZ4_LEGACY_BLOCK (8 * 1024 * 1024)
+
+struct job {
+	struct job *next;
+	char base[PATH_MAX]; // log path the segment was rotated from
+	char path[PATH_MAX]; // the rotated segment
+};
+
+struct logrotate {
+	char path[PATH_MAX];
+	size_t size;  // rotate past this many bytes, 0: off
+	int interval; // rotate every 'interval' seconds, 0: off
+	int keep;     // rotated segments kept, 0: all
+	int timename;
+	int compress;
+	int opened;
+	size_t written;
+	time_t since;
+	unsigned long long seq;
+	/* background compression and retention */
+	int running;
+	pthread_t tid;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct job *head;
+	struct job **tail;
+};
+
+static struct logrotate R;
+
+static const char *suffixes[] = {
+	"",
+	".gz",
+	".lz4",
+};
+
+/* ---- segment names ---- */
+
+static void path_split(const char *path, char *dir, size_t size,
+		       const char **base)
+{
+	const char *slash = strrchr(path, '/');
+	if (slash == NULL) {
+		snprintf(dir, size, ".");
+		*base = path;
+	} else {
+		size_t n = slash - path;
+		if (n == 0)
+			n = 1;
+		if (n >= size)
+			n = size - 1;
+		memcpy(dir, path, n);
+		dir[n] = '\0';
+		*base = slash + 1;
+	}
+}
+
+/* The tag of a segment of 'base', NULL if 'name' is not one */
+static const char *segment_tag(const char *name, const char *base,
+			       size_t *len)
+{
+	size_t i, n;
+	const char *tag;
+	size_t blen = strlen(base);
+	if (strncmp(name, base, blen) != 0 || name[blen] != '.')
+		return NULL;
+	tag = name + blen + 1;
+	n = strlen(tag);
+	for (i = 1; i < ARRAY_SIZE(suffixes); i++) {
+		size_t slen = strlen(suffixes[i]);
+		if (n > slen && strcmp(tag + n - slen, suffixes[i]) == 0) {
+			n -= slen;
+			break;
+		}
+	}
+	if (n == 0)
+		return NULL;
+	for (i = 0; i < n; i++) {
+		if ((tag[i] < '0' || tag[i] > '9') && tag[i] != '-')
+			return NULL;
+	}
+	*len = n;
+	return tag;
+}
+
+static int name_taken(const char *name)
+{
+	size_t i;
+	char buf[PATH_MAX];
+	for (i = 0; i < ARRAY_SIZE(suffixes); i++) {
+		snprintf(buf, sizeof(buf), "%s%s", name, suffixes[i]);
+		if (access(buf, F_OK) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+static int segment_name(char *buf, size_t size)
+{
+	int i, n;
+	char stamp[32];
+	struct tm tm;
+	time_t now;
+	if (!R.timename) {
+		do {
+			n = snprintf(buf, size, "%s.%llu", R.path, ++R.seq);
+		} while (n > 0 && (size_t)n < size && name_taken(buf));
+		return (n > 0 && (size_t)n < size) ? 0 : -1;
+	}
+	now = time(NULL);
+	localtime_r(&now, &tm);
+	strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+	n = snprintf(buf, size, "%s.%s", R.path, stamp);
+	for (i = 1; n > 0 && (size_t)n < size && name_taken(buf); i++)
+		n = snprintf(buf, size, "%s.%s-%d", R.path, stamp, i);
+	return (n > 0 && (size_t)n < size) ? 0 : -1;
+}
+
+/* Continue the numbering of the segments left by a previous run */
+static void seq_scan(const char *path)
+{
+	DIR *d;
+	struct dirent *e;
+	const char *base;
+	char dir[PATH_MAX];
+	path_split(path, dir, sizeof(dir), &base);
+	d = opendir(dir);
+	if (d == NULL)
+		return;
+	while ((e = readdir(d)) != NULL) {
+		size_t len;
+		const char *tag = segment_tag(e->d_name, base, &len);
+		if (tag != NULL && memchr(tag, '-', len) == NULL) {
+			unsigned long long n = strtoull(tag, NULL, 10);
+			if (n > R.seq)
+				R.seq = n;
+		}
+	}
+	closedir(d);
+}
+
+/* ---- background compression ---- */
+
+static size_t read_full(FILE *fp, char *buf, size_t size)
+{
+	size_t n = 0;
+	while (n < size) {
+		size_t r = fread(buf + n, 1, size - n, fp);
+		if (r == 0)
+			break;
+		n += r;
+	}
+	return n;
+}
+
+static int gzip_file(FILE *in, const char *dst)
+{
+	size_t n;
+	int ok = 1;
+	char *buf;
+	gzFile out = gzopen(dst, "wb");
+	if (out == NULL)
+		return -1;
+	buf = (char *)mem_alloc(IO_BUF_SIZE);
+	while ((n = fread(buf, 1, IO_BUF_SIZE, in)) > 0) {
+		if (gzwrite(out, buf, (unsigned)n) != (int)n) {
+			ok = 0;
+			break;
+		}
+	}
+	mem_free(buf);
+	if (gzclose(out) != Z_OK)
+		ok = 0;
+	return ok ? 0 : -1;
+}
+
+static void put_le32(unsigned char *p, uint32_t n)
+{
+	p[0] = n & 0xff;
+	p[1] = (n >> 8) & 0xff;
+	p[2] = (n >> 16) & 0xff;
+	p[3] = (n >> 24) & 0xff;
+}
+
+/* lz4 legacy frame: magic, then (u32 size, block) per 8MB of input */
+static int lz4_file(FILE *in, const char *dst)
+{
+	size_t n;
+	int ok = 1;
+	char *src, *buf;
+	unsigned char le[4];
+	int bound = LZ4_compressBound(LZ4_LEGACY_BLOCK);
+	FILE *out = fopen(dst, "wb");
+	if (out == NULL)
+		return -1;
+	src = (char *)mem_alloc(LZ4_LEGACY_BLOCK);
+	buf = (char *)mem_alloc(bound);
+	put_le32(le, LZ4_LEGACY_MAGIC);
+	ok = fwrite(le, 1, 4, out) == 4;
+	while (ok && (n = read_full(in, src, LZ4_LEGACY_BLOCK)) > 0) {
+		int c = LZ4_compress_default(src, buf, (int)n, bound);
+		put_le32(le, (uint32_t)c);
+		ok = c > 0 && fwrite(le, 1, 4, out) == 4 &&
+		     fwrite(buf, 1, c, out) == (size_t)c;
+	}
+	mem_free(buf);
+	mem_free(src);
+	if (fclose(out) != 0)
+		ok = 0;
+	return ok ? 0 : -1;
+}
+
+static void compress_segment(const char *path)
+{
+	int err;
+	FILE *in;
+	char dst[PATH_MAX];
+	char tmp[PATH_MAX];
+	const char *suffix = suffixes[R.compress];
+	int n = snprintf(dst, sizeof(dst), "%s%s", path, suffix);
+	if (n < 0 || (size_t)n >= sizeof(dst))
+		return;
+	n = snprintf(tmp, sizeof(tmp), "%s.tmp", dst);
+	if (n < 0 || (size_t)n >= sizeof(tmp))
+		return;
+	in = fopen(path, "rb");
+	if (in == NULL)
+		return;
+	if (R.compress == LOGROTATE_GZIP)
+		err = gzip_file(in, tmp);
+	else
+		err = lz4_file(in, tmp);
+	fclose(in);
+	if (err == 0 && rename(tmp, dst) == 0) {
+		unlink(path);
+	} else {
+		fprintf(stderr, "[log] compress %s fail\n", path);
+		unlink(tmp);
+	}
+}
+
+struct segment {
+	size_t tag; /* offset of the tag in 'name' */
+	size_t len;
+	char name[PATH_MAX];
+};
+
+static int segment_cmp(const void *a, const void *b)
+{
+	const struct segment *x = (const struct segment *)a;
+	const struct segment *y = (const struct segment *)b;
+	const char *p = x->name + x->tag, *pe = p + x->len;
+	const char *q = y->name + y->tag, *qe = q + y->len;
+	while (p < pe || q < qe) {
+		unsigned long long m = 0, n = 0;
+		if (p >= pe)
+			return -1;
+		if (q >= qe)
+			return 1;
+		while (p < pe && *p != '-')
+			m = m * 10 + (*p++ - '0');
+		while (q < qe && *q != '-')
+			n = n * 10 + (*q++ - '0');
+		if (m != n)
+			return m < n ? -1 : 1;
+		p += p < pe;
+		q += q < qe;
+	}
+	return strcmp(x->name, y->name);
+}
+
+/* Delete the oldest segments of 'path' beyond R.keep */
+static void retention_sweep(const char *path)
+{
+	DIR *d;
+	int i, n = 0, cap = 0;
+	struct dirent *e;
+	const char *base;
+	struct segment *segs = NULL;
+	char dir[PATH_MAX];
+	path_split(path, dir, sizeof(dir), &base);
+	d = opendir(dir);
+	if (d == NULL)
+		return;
+	while ((e = readdir(d)) != NULL) {
+		size_t len;
+		const char *tag = segment_tag(e->d_name, base, &len);
+		if (tag == NULL)
+			continue;
+		if (n == cap) {
+			cap = cap == 0 ? 16 : cap * 2;
+			segs = (struct segment *)mem_realloc(segs,
+							     cap * sizeof(*segs));
+		}
+		snprintf(segs[n].name, sizeof(segs[n].name), "%s", e->d_name);
+		segs[n].tag = tag - e->d_name;
+		segs[n].len = len;
+		n++;
+	}
+	closedir(d);
+	if (n > R.keep) {
+		qsort(segs, n, sizeof(*segs), segment_cmp);
+		for (i = 0; i < n - R.keep; i++) {
+			char buf[PATH_MAX * 2];
+			snprintf(buf, sizeof(buf), "%s/%s", dir, segs[i].name);
+			unlink(buf);
+		}
+	}
+	mem_free(segs);
+}
+
+static void *compressor(void *arg)
+{
+	(void)arg;
+	pthread_mutex_lock(&R.lock);
+	for (;;) {
+		struct job *j = R.head;
+		if (j == NULL) {
+			if (!R.running)
+				break;
+			pthread_cond_wait(&R.cond, &R.lock);
+			continue;
+		}
+		R.head = j->next;
+		if (R.head == NULL)
+			R.tail = &R.head;
+		pthread_mutex_unlock(&R.lock);
+		if (R.compress != LOGROTATE_NONE)
+			compress_segment(j->path);
+		if (R.keep > 0)
+			retention_sweep(j->base);
+		mem_free(j);
+		pthread_mutex_lock(&R.lock);
+	}
+	pthread_mutex_unlock(&R.lock);
+	return NULL;
+}
+
+static void job_push(const char *path)
+{
+	struct job *j;
+	if (!R.running)
+		return;
+	j = (struct job *)mem_alloc(sizeof(*j));
+	j->next = NULL;
+	snprintf(j->base, sizeof(j->base), "%s", R.path);
+	snprintf(j->path, sizeof(j->path), "%s", path);
+	pthread_mutex_lock(&R.lock);
+	*R.tail = j;
+	R.tail = &j->next;
+	pthread_cond_signal(&R.cond);
+	pthread_mutex_unlock(&R.lock);
+}
+
+/* ---- rotation, called with wlock held ---- */
+
+int logrotate_open(const char *path)
+{
+	int fd;
+	struct stat st;
+	fd = open(path, O_CREAT | O_WRONLY | O_APPEND, 00666);
+	if (fd < 0)
+		return -1;
+	dup2(fd, STDOUT_FILENO);
+	R.written = fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+	close(fd);
+	if (path != R.path)
+		snprintf(R.path, sizeof(R.path), "%s", path);
+	R.since = time(NULL);
+	R.opened = 1;
+	return 0;
+}
+
+void logrotate_written(size_t n)
+{
+	R.written += n;
+}
+
+static void rotate(void)
+{
+	char name[PATH_MAX];
+	if (segment_name(name, sizeof(name)) != 0 ||
+	    rename(R.path, name) != 0) {
+		fprintf(stderr, "[log] rotate %s fail:%s\n", R.path,
+			strerror(errno));
+		R.written = 0; /* retry after another period */
+		R.since = time(NULL);
+		return;
+	}
+	if (logrotate_open(R.path) != 0) {
+		fprintf(stderr, "[log] reopen %s fail:%s\n", R.path,
+			strerror(errno));
+	}
+	job_push(name);
+}
+
+void logrotate_check(void)
+{
+	time_t now;
+	if (!R.opened || (R.size == 0 && R.interval == 0))
+		return;
+	if (R.size > 0 && R.written >= R.size) {
+		rotate();
+		return;
+	}
+	if (R.interval > 0) {
+		now = time(NULL);
+		if (now - R.since < R.interval)
+			return;
+		if (R.written > 0)
+			rotate();
+		else
+			R.since = now;
+	}
+}
+
+void logrotate_init(const struct boot_args *config)
+{
+	int err;
+	memset(&R, 0, sizeof(R));
+	R.size = config->logrotate_size;
+	R.interval = config->logrotate_interval;
+	R.keep = config->logrotate_keep;
+	R.timename = config->logrotate_time;
+	R.compress = config->logrotate_compress;
+	R.tail = &R.head;
+	if (R.size == 0 && R.interval == 0)
+		return;
+	if (!R.timename && config->logpath[0] != '\0')
+		seq_scan(config->logpath);
+	if (R.compress == LOGROTATE_NONE && R.keep == 0)
+		return;
+	pthread_mutex_init(&R.lock, NULL);
+	pthread_cond_init(&R.cond, NULL);
+	R.running = 1;
+	err = pthread_create(&R.tid, NULL, compressor, NULL);
+	if (unlikely(err != 0)) {
+		fprintf(stderr, "[log] compressor thread create fail:%d\n",
+			err);
+		R.running = 0;
+	}
+}
+
+void logrotate_exit(void)
+{
+	if (!R.running)
+		return;
+	pthread_mutex_lock(&R.lock);
+	R.running = 0;
+	pthread_cond_signal(&R.cond);
+	pthread_mutex_unlock(&R.lock);
+	/* rotated segments still queued are compressed before exit */
+	pthread_join(R.tid, NULL);
+	pthread_cond_destroy(&R.cond);
+	pthread_mutex_destroy(&R.lock);
+}
@@ -0,0 +1,21 @@
+#ifndef _LOGROTATE_H
+#define _LOGROTATE_H
+
+#include <stddef.h>
+#include "args.h"
+
+enum logrotate_compress {
+	LOGROTATE_NONE = 0,
+	LOGROTATE_GZIP = 1,
+	LOGROTATE_LZ4 = 2,
+};
+
+void logrotate_init(const struct boot_args *config);
+void logrotate_exit(void);
+
+/* the functions below are called by the log drainers with wlock held */
+int logrotate_open(const char *path);
+void logrotate_written(size_t n);
+void logrotate_check(void);
+
+#endif
@@ -13,6 +13,8 @@
 #include "daemon.h"
 #include "trace.h"
 #include "log.h"
+#include "logrotate.h"
+#include "metrics.h"
 #include "timer.h"
 #include "engine.h"
 #include "platform.h"
@@ -26,6 +28,13 @@ static void print_help(const char *selfname)
 		"-d, --daemon              Run as a daemon",
 		"-l, --log-level LEVEL     Set logging level (debug, info, warn, error)",
 		"    --log-path PATH       Path for the log file (effective with --daemon)",
+		"    --log-overflow POLICY What to do when a log buffer is full (block, drop)",
+		"    --log-format FORMAT   Format of the log lines (text, binary)",
+		"    --log-rotate-size SIZE        Rotate the log file past SIZE bytes (K, M, G suffix)",
+		"    --log-rotate-interval SEC     Rotate the log file every SEC seconds",
+		"    --log-rotate-keep N           Rotated log files to keep (default: all)",
+		"    --log-rotate-name NAME        Rotated file suffix (number, time)",
+		"    --log-rotate-compress METHOD  Compress rotated log files (none, gzip, lz4)",
 		"    --pid-file FILE       Path for the PID file (effective with --daemon)",
 		"-L, --lualib-path PATH    Path for Lua libraries (package.path)",
 		"-C, --lualib-cpath PATH   Path for C Lua libraries (package.cpath)",
@@ -64,6 +73,28 @@ static int opt_int(const char *arg, const char *name)
 	return (int)n;
 }
 
+static size_t opt_size(const char *arg, const char *name)
+{
+	char *end;
+	unsigned long long n = strtoull(arg, &end, 10);
+	switch (*end) {
+	case 'G': case 'g':
+		n *= 1024;
+		//fallthrough
+	case 'M': case 'm':
+		n *= 1024;
+		//fallthrough
+	case 'K': case 'k':
+		n *= 1024;
+		end++;
+		break;
+	}
+	if (*end != '\0') {
+		log_error("[option] %s is invalid:%s\n", name, arg);
+	}
+	return (size_t)n;
+}
+
 static void parse_args(struct boot_args *args, int argc, char *argv[])
 {
 	int c;
@@ -71,18 +102,25 @@ static void parse_args(struct boot_args *args, int argc, char *argv[])
 	optind = 2;
 	opterr = 0;
 	struct option long_options[] = {
-		{ "help",            no_argument,       0, 'h' },
-		{ "version",         no_argument,       0, 'v' },
-		{ "daemon",          no_argument,       0, 'd' },
-		{ "log-level",       required_argument, 0, 'l' },
-		{ "log-path",        required_argument, 0, 0   },
-		{ "pid-file",        required_argument, 0, 1   },
-		{ "lualib-path",     required_argument, 0, 'L' },
-		{ "lualib-cpath",    required_argument, 0, 'C' },
-		{ "socket-affinity", required_argument, 0, 'S' },
-		{ "worker-affinity", required_argument, 0, 'W' },
-		{ "timer-affinity",  required_argument, 0, 'T' },
-		{ NULL,              0,                 0, 0   }
+		{ "help",                no_argument,       0, 'h' },
+		{ "version",             no_argument,       0, 'v' },
+		{ "daemon",              no_argument,       0, 'd' },
+		{ "log-level",           required_argument, 0, 'l' },
+		{ "log-path",            required_argument, 0, 0   },
+		{ "pid-file",            required_argument, 0, 1   },
+		{ "log-overflow",        required_argument, 0, 2   },
+		{ "log-format",          required_argument, 0, 3   },
+		{ "log-rotate-size",     required_argument, 0, 4   },
+		{ "log-rotate-interval", required_argument, 0, 5   },
+		{ "log-rotate-keep",     required_argument, 0, 6   },
+		{ "log-rotate-name",     required_argument, 0, 7   },
+		{ "log-rotate-compress", required_argument, 0, 8   },
+		{ "lualib-path",         required_argument, 0, 'L' },
+		{ "lualib-cpath",        required_argument, 0, 'C' },
+		{ "socket-affinity",     required_argument, 0, 'S' },
+		{ "worker-affinity",     required_argument, 0, 'W' },
+		{ "timer-affinity",      required_argument, 0, 'T' },
+		{ NULL,                  0,                 0, 0   }
 	};
 	struct {
 		const char *name;
@@ -121,6 +159,58 @@ static void parse_args(struct boot_args *args, int argc, char *argv[])
 			opt_path(args->pidfile, ARRAY_SIZE(args->pidfile), optarg,
 				 "pid-file");
 			break;
+		case 2:
+			if (strcmp(optarg, "block") == 0) {
+				args->logdrop = 0;
+			} else if (strcmp(optarg, "drop") == 0) {
+				args->logdrop = 1;
+			} else {
+				log_error("[option] unknown log-overflow:%s\n",
+					  optarg);
+			}
+			break;
+		case 3:
+			if (strcmp(optarg, "text") == 0) {
+				args->logbinary = 0;
+			} else if (strcmp(optarg, "binary") == 0) {
+				args->logbinary = 1;
+			} else {
+				log_error("[option] unknown log-format:%s\n",
+					  optarg);
+			}
+			break;
+		case 4:
+			args->logrotate_size = opt_size(optarg, "log-rotate-size");
+			break;
+		case 5:
+			args->logrotate_interval =
+				opt_int(optarg, "log-rotate-interval");
+			break;
+		case 6:
+			args->logrotate_keep = opt_int(optarg, "log-rotate-keep");
+			break;
+		case 7:
+			if (strcmp(optarg, "number") == 0) {
+				args->logrotate_time = 0;
+			} else if (strcmp(optarg, "time") == 0) {
+				args->logrotate_time = 1;
+			} else {
+				log_error("[option] unknown log-rotate-name:%s\n",
+					  optarg);
+			}
+			break;
+		case 8:
+			if (strcmp(optarg, "none") == 0) {
+				args->logrotate_compress = LOGROTATE_NONE;
+			} else if (strcmp(optarg, "gzip") == 0) {
+				args->logrotate_compress = LOGROTATE_GZIP;
+			} else if (strcmp(optarg, "lz4") == 0) {
+				args->logrotate_compress = LOGROTATE_LZ4;
+			} else {
+				log_error("[option] unknown log-rotate-compress:%s\n",
+					  optarg);
+			}
+			break;
 		case 'l':
 			for (i = 0; i < ARRAY_SIZE(loglevels); i++) {
 				if (strcmp(loglevels[i].name, optarg) == 0) {
@@ -195,6 +285,7 @@ int main(int argc, char *argv[])
 	daemon_stop(&args);
 	now = timer_now();
 	timer_exit();
+	metrics_exit();
 	log_exit();
 	log_directf(now, SILLY_LOG_INFO,
 		"%s exit, leak memory size:%zu\n",
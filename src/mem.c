@@ -13,6 +13,7 @@
 #endif
 
 static atomic_ptrdiff_t allocsize = 0;
+static THREAD_LOCAL const struct mem_tracer *tracer = NULL;
 
 #ifndef DISABLE_JEMALLOC
 
@@ -37,7 +38,7 @@ static inline size_t xalloc_usable_size(void *ptr)
 #endif
 }
 
-void *mem_alloc(size_t sz)
+void *mem_alloc_from(size_t sz, const void *caller)
 {
 	void *ptr = MALLOC(sz);
 #ifdef SILLY_TEST
@@ -45,26 +46,49 @@ void *mem_alloc(size_t sz)
 #endif
 	int real = xalloc_usable_size(ptr);
 	atomic_fetch_add_explicit(&allocsize, real, memory_order_relaxed);
+	if (unlikely(tracer != NULL))
+		tracer->alloc(ptr, sz, caller);
 	return ptr;
 }
 
-void *mem_realloc(void *ptr, size_t sz)
+void *mem_realloc_from(void *ptr, size_t sz, const void *caller)
 {
+	if (unlikely(tracer != NULL) && ptr != NULL)
+		tracer->free(ptr);
 	ssize_t realo = xalloc_usable_size(ptr);
 	ptr = REALLOC(ptr, sz);
 	ssize_t realn = xalloc_usable_size(ptr);
 	atomic_fetch_add_explicit(&allocsize, realn - realo,
 				  memory_order_relaxed);
+	if (unlikely(tracer != NULL))
+		tracer->alloc(ptr, sz, caller);
 	return ptr;
 }
 
+void *mem_alloc(size_t sz)
+{
+	return mem_alloc_from(sz, __builtin_return_address(0));
+}
+
+void *mem_realloc(void *ptr, size_t sz)
+{
+	return mem_realloc_from(ptr, sz, __builtin_return_address(0));
+}
+
 void mem_free(void *ptr)
 {
 	size_t real = xalloc_usable_size(ptr);
+	if (unlikely(tracer != NULL) && ptr != NULL)
+		tracer->free(ptr);
 	atomic_fetch_sub_explicit(&allocsize, real, memory_order_relaxed);
 	FREE(ptr);
 }
 
+void mem_trace(const struct mem_tracer *t)
+{
+	tracer = t;
+}
+
 #define BUILD(name, MAJOR, MINOR) (name "-" STR(MAJOR) "." STR(MINOR))
 
 const char *mem_allocator()
@@ -3,9 +3,18 @@
 
 #include <stdlib.h>
 
+struct mem_tracer {
+	void (*alloc)(void *ptr, size_t sz, const void *caller);
+	void (*free)(void *ptr);
+};
+
 void *mem_alloc(size_t sz);
 void *mem_realloc(void *ptr, size_t sz);
+void *mem_alloc_from(size_t sz, const void *caller);
+void *mem_realloc_from(void *ptr, size_t sz, const void *caller);
 void mem_free(void *ptr);
+//trace the allocations of the calling thread, NULL to stop
+void mem_trace(const struct mem_tracer *tracer);
 int mem_mallctl(const char *name, void *oldp, size_t *oldlenp, void *newp,
 		size_t newlen);
 
@@ -13,6 +13,7 @@ enum message_type {
 	MESSAGE_TCP_DATA,
 	MESSAGE_UDP_DATA,
 	MESSAGE_SOCKET_CLOSE,
+	MESSAGE_TCP_DRAIN,
 	MESSAGE_CUSTOM,
 };
 
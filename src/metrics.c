@@ -0,0 +1,734 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "silly.h"
+#include "compiler.h"
+#include "mem.h"
+#include "timer.h"
+#include "metrics.h"
+
+/*
+** Families and series are append only lists, published with a release
+** store so a scrape walks them without a lock; 'lock' only serializes
+** the writers. A thread records into its own shard (threads beyond
+** METRICS_SHARDS share them round-robin), each shard starts on its own
+** cache line, so the hot path is one uncontended atomic per cell.
+**
+** A loghist finds its bucket from the exponent and the top mantissa
+** bits of the value, so 'observe' costs the same for any range and
+** precision. Its summary window is a ring of snapshots of the summed
+** buckets, taken when the quantiles are read: the quantiles are those
+** of the difference between now and the newest snapshot at least a
+** window old.
+*/
+
+#define HIST_COUNT (0)
+#define HIST_SUM (1)
+#define HIST_BUCKET (2)
+
+#define LOGHIST_MIN (1e-6)
+#define LOGHIST_MAX (1e3)
+#define LOGHIST_PRECISION (3)
+#define LOGHIST_PRECISION_MAX (8)
+#define LOGHIST_OCTAVES_MAX (128)
+#define LOGHIST_WINDOW (60.0)
+#define QUANTILE_MAX (32)
+#define WINDOW_RING (METRICS_WINDOW_SLOTS + 1)
+
+/* snapshots are [count][buckets...] */
+struct window {
+	uint64_t stamp[WINDOW_RING]; // timer_monotonic() of each snapshot
+	int head;                    // the next snapshot to overwrite
+	int n;                       // snapshots taken, up to WINDOW_RING
+	uint64_t *cur;
+	uint64_t *diff;
+	uint64_t *ring;
+};
+
+struct silly_metric_series {
+	_Atomic(struct silly_metric_series *) next;
+	struct silly_metric_series *hnext; // hash chain of the family
+	struct silly_metric *family;
+	uint32_t hash;
+	char **values;
+	char *labels; // 'name="value",...' ready for the exposition
+	void *mem;
+	atomic_uint_least64_t *cells; // shards * stride, cache line aligned
+	struct window *window;        // loghist with quantiles
+};
+
+struct silly_metric {
+	_Atomic(struct silly_metric *) next;
+	struct silly_metric_desc desc;
+	int shards;
+	int stride; // cells per shard, padded to a cache line
+	int emin;   // loghist: exponent of 'lo'
+	double lo;  // loghist: bound of the underflow bucket
+	double hi;  // loghist: last bound, above is only counted
+	pthread_mutex_t lock;
+	_Atomic(struct silly_metric_series *) head;
+	struct silly_metric_series *tail;
+	struct silly_metric_series **slots;
+	int slotcount;
+	int count;
+};
+
+struct metrics {
+	pthread_mutex_t lock;
+	_Atomic(struct silly_metric *) head;
+	struct silly_metric *tail;
+	atomic_int shard_next;
+};
+
+static struct metrics R = {
+	PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0,
+};
+
+static THREAD_LOCAL int shard = -1;
+
+static const double default_buckets[] = {
+	0.005, 0.01, 0.025, 0.05, 0.075, 0.1, 0.25,
+	0.5, 0.75, 1.0, 2.5, 5.0, 7.5, 10.0,
+};
+
+static inline int shard_of_thread(void)
+{
+	if (unlikely(shard < 0)) {
+		int n = atomic_fetch_add_explicit(&R.shard_next, 1,
+						  memory_order_relaxed);
+		shard = n % METRICS_SHARDS;
+	}
+	return shard;
+}
+
+static inline double cell_tof(uint64_t bits)
+{
+	double d;
+	memcpy(&d, &bits, sizeof(d));
+	return d;
+}
+
+static inline uint64_t cell_bits(double d)
+{
+	uint64_t bits;
+	memcpy(&bits, &d, sizeof(bits));
+	return bits;
+}
+
+static inline void cell_addf(atomic_uint_least64_t *c, double v)
+{
+	uint64_t old = atomic_load_explicit(c, memory_order_relaxed);
+	while (!atomic_compare_exchange_weak_explicit(
+		c, &old, cell_bits(cell_tof(old) + v), memory_order_relaxed,
+		memory_order_relaxed))
+		;
+}
+
+static char *dupstr(const char *s)
+{
+	size_t n = strlen(s) + 1;
+	char *p = (char *)mem_alloc(n);
+	memcpy(p, s, n);
+	return p;
+}
+
+static char **dupstrs(const char *const *strs, int n)
+{
+	char **p;
+	if (n == 0)
+		return NULL;
+	p = (char **)mem_alloc(n * sizeof(*p));
+	for (int i = 0; i < n; i++)
+		p[i] = dupstr(strs[i]);
+	return p;
+}
+
+static void freestrs(char **strs, int n)
+{
+	if (strs == NULL)
+		return;
+	for (int i = 0; i < n; i++)
+		mem_free(strs[i]);
+	mem_free(strs);
+}
+
+/* "%.15g" when it reads back exactly, integral bounds keep a ".0" */
+static char *bound_name(double v)
+{
+	char buf[40];
+	int n = snprintf(buf, sizeof(buf), "%.15g", v);
+	if (strtod(buf, NULL) != v)
+		n = snprintf(buf, sizeof(buf), "%.17g", v);
+	if (strspn(buf, "-0123456789") == (size_t)n)
+		memcpy(buf + n, ".0", 3);
+	return dupstr(buf);
+}
+
+static int double_cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static inline int bucketed(enum silly_metric_kind kind)
+{
+	return kind == SILLY_METRIC_HISTOGRAM || kind == SILLY_METRIC_LOGHIST;
+}
+
+/* 'lo', then 2^precision bounds per power of two up to 'hi' */
+static double *loghist_buckets(struct silly_metric_desc *d, int *emin,
+			       int *count)
+{
+	int e0, e1, sub, n;
+	double *b;
+	if (d->min == 0 && d->max == 0) {
+		d->min = LOGHIST_MIN;
+		d->max = LOGHIST_MAX;
+	}
+	if (d->precision <= 0)
+		d->precision = LOGHIST_PRECISION;
+	if (d->precision > LOGHIST_PRECISION_MAX)
+		return NULL;
+	if (!(d->min > 0) || !(d->max > d->min) || isinf(d->max))
+		return NULL;
+	frexp(d->min, &e0); // min is in [2^(e0-1), 2^e0)
+	frexp(d->max, &e1);
+	e0 -= 1;
+	e1 -= 1;
+	if (e1 - e0 + 1 > LOGHIST_OCTAVES_MAX || e0 < -1000 || e1 > 1000)
+		return NULL;
+	sub = 1 << d->precision;
+	n = 1 + (e1 - e0 + 1) * sub;
+	b = (double *)mem_alloc(n * sizeof(double));
+	b[0] = ldexp(1.0, e0);
+	for (int i = 1; i < n; i++) {
+		int j = i - 1;
+		b[i] = ldexp(1.0 + (double)((j & (sub - 1)) + 1) / sub,
+			     e0 + j / sub);
+	}
+	*emin = e0;
+	*count = n;
+	return b;
+}
+
+static int quantiles_check(struct silly_metric_desc *d)
+{
+	if (d->quantilecount < 0 || d->quantilecount > QUANTILE_MAX)
+		return 0;
+	for (int i = 0; i < d->quantilecount; i++) {
+		double q = d->quantiles[i];
+		if (!(q >= 0 && q <= 1))
+			return 0;
+	}
+	if (d->window == 0)
+		d->window = LOGHIST_WINDOW;
+	return d->window > 0;
+}
+
+static uint32_t values_hash(const char *const *values, int n)
+{
+	uint32_t h = 2166136261u;
+	for (int i = 0; i < n; i++) {
+		const unsigned char *p = (const unsigned char *)values[i];
+		for (; *p; p++)
+			h = (h ^ *p) * 16777619u;
+		h = (h ^ 0xff) * 16777619u;
+	}
+	return h;
+}
+
+static int values_equal(char **a, const char *const *b, int n)
+{
+	for (int i = 0; i < n; i++) {
+		if (strcmp(a[i], b[i]) != 0)
+			return 0;
+	}
+	return 1;
+}
+
+/* label values are escaped as the text exposition wants them */
+static char *labels_compose(const struct silly_metric_desc *desc,
+			    const char *const *values)
+{
+	size_t n = 1;
+	char *buf, *p;
+	for (int i = 0; i < desc->labelcount; i++)
+		n += strlen(desc->labelnames[i]) + 2 * strlen(values[i]) + 4;
+	p = buf = (char *)mem_alloc(n);
+	for (int i = 0; i < desc->labelcount; i++) {
+		const char *v = values[i];
+		if (i > 0)
+			*p++ = ',';
+		n = strlen(desc->labelnames[i]);
+		memcpy(p, desc->labelnames[i], n);
+		p += n;
+		*p++ = '=';
+		*p++ = '"';
+		for (; *v; v++) {
+			switch (*v) {
+			case '\\':
+			case '"':
+				*p++ = '\\';
+				*p++ = *v;
+				break;
+			case '\n':
+				*p++ = '\\';
+				*p++ = 'n';
+				break;
+			default:
+				*p++ = *v;
+				break;
+			}
+		}
+		*p++ = '"';
+	}
+	*p = '\0';
+	return buf;
+}
+
+static int same_layout(const struct silly_metric *m,
+		       const struct silly_metric_desc *desc,
+		       const double *buckets, int bucketcount)
+{
+	const struct silly_metric_desc *d = &m->desc;
+	if (d->kind != desc->kind || d->labelcount != desc->labelcount)
+		return 0;
+	for (int i = 0; i < d->labelcount; i++) {
+		if (strcmp(d->labelnames[i], desc->labelnames[i]) != 0)
+			return 0;
+	}
+	if (!bucketed(d->kind))
+		return 1;
+	if (d->bucketcount != bucketcount)
+		return 0;
+	if (memcmp(d->buckets, buckets, bucketcount * sizeof(double)) != 0)
+		return 0;
+	if (d->kind != SILLY_METRIC_LOGHIST)
+		return 1;
+	if (d->quantilecount != desc->quantilecount ||
+	    d->window != desc->window)
+		return 0;
+	return memcmp(d->quantiles, desc->quantiles,
+		      d->quantilecount * sizeof(double)) == 0;
+}
+
+static struct silly_metric *family_find(const char *name)
+{
+	struct silly_metric *m;
+	m = atomic_load_explicit(&R.head, memory_order_acquire);
+	for (; m != NULL; m = atomic_load_explicit(&m->next,
+						   memory_order_acquire)) {
+		if (strcmp(m->desc.name, name) == 0)
+			return m;
+	}
+	return NULL;
+}
+
+static void family_free(struct silly_metric *m)
+{
+	struct silly_metric_series *s, *next;
+	s = atomic_load_explicit(&m->head, memory_order_relaxed);
+	for (; s != NULL; s = next) {
+		next = atomic_load_explicit(&s->next, memory_order_relaxed);
+		freestrs(s->values, m->desc.labelcount);
+		mem_free(s->labels);
+		mem_free(s->mem);
+		mem_free(s->window);
+		mem_free(s);
+	}
+	pthread_mutex_destroy(&m->lock);
+	freestrs((char **)m->desc.labelnames, m->desc.labelcount);
+	freestrs((char **)m->desc.bucketnames, m->desc.bucketcount);
+	mem_free((void *)m->desc.buckets);
+	mem_free((void *)m->desc.quantiles);
+	mem_free((void *)m->desc.name);
+	mem_free((void *)m->desc.help);
+	mem_free(m->slots);
+	mem_free(m);
+}
+
+struct silly_metric *metrics_new(const struct silly_metric_desc *desc)
+{
+	int cells;
+	size_t line;
+	int emin = 0;
+	double *buckets = NULL;
+	int bucketcount = 0;
+	struct silly_metric *m;
+	struct silly_metric_desc lh = *desc; // loghist with its defaults
+	if (desc->kind == SILLY_METRIC_LOGHIST) {
+		desc = &lh;
+		buckets = loghist_buckets(&lh, &emin, &bucketcount);
+		if (buckets == NULL || !quantiles_check(&lh)) {
+			mem_free(buckets);
+			return NULL;
+		}
+	} else if (desc->kind == SILLY_METRIC_HISTOGRAM) {
+		const double *src = desc->buckets;
+		bucketcount = desc->bucketcount;
+		if (bucketcount <= 0) {
+			src = default_buckets;
+			bucketcount = ARRAY_SIZE(default_buckets);
+		}
+		buckets = (double *)mem_alloc(bucketcount * sizeof(double));
+		memcpy(buckets, src, bucketcount * sizeof(double));
+		qsort(buckets, bucketcount, sizeof(double), double_cmp);
+	}
+	pthread_mutex_lock(&R.lock);
+	m = family_find(desc->name);
+	if (m != NULL) {
+		if (!same_layout(m, desc, buckets, bucketcount))
+			m = NULL;
+		pthread_mutex_unlock(&R.lock);
+		mem_free(buckets);
+		return m;
+	}
+	m = (struct silly_metric *)mem_alloc(sizeof(*m));
+	memset(m, 0, sizeof(*m));
+	atomic_init(&m->next, NULL);
+	atomic_init(&m->head, NULL);
+	m->desc.kind = desc->kind;
+	m->desc.name = dupstr(desc->name);
+	m->desc.help = dupstr(desc->help ? desc->help : "");
+	m->desc.labelcount = desc->labelcount;
+	m->desc.labelnames = (const char *const *)dupstrs(desc->labelnames,
+							  desc->labelcount);
+	m->desc.bucketcount = bucketcount;
+	m->desc.buckets = buckets;
+	m->desc.bucketnames = NULL;
+	if (desc->kind == SILLY_METRIC_LOGHIST) {
+		size_t sz = desc->quantilecount * sizeof(double);
+		m->desc.min = desc->min;
+		m->desc.max = desc->max;
+		m->desc.precision = desc->precision;
+		m->desc.window = desc->window;
+		m->desc.quantilecount = desc->quantilecount;
+		if (sz > 0) {
+			double *q = (double *)mem_alloc(sz);
+			memcpy(q, desc->quantiles, sz);
+			m->desc.quantiles = q;
+		}
+		m->emin = emin;
+		m->lo = buckets[0];
+		m->hi = buckets[bucketcount - 1];
+	}
+	if (bucketcount > 0) {
+		char **names = (char **)mem_alloc(bucketcount * sizeof(char *));
+		for (int i = 0; i < bucketcount; i++)
+			names[i] = bound_name(buckets[i]);
+		m->desc.bucketnames = (const char *const *)names;
+	}
+	switch (desc->kind) {
+	case SILLY_METRIC_HISTOGRAM:
+	case SILLY_METRIC_LOGHIST:
+		cells = HIST_BUCKET + bucketcount;
+		m->shards = METRICS_SHARDS;
+		break;
+	case SILLY_METRIC_GAUGE:
+		cells = 1;
+		m->shards = 1;
+		break;
+	default:
+		cells = 1;
+		m->shards = METRICS_SHARDS;
+		break;
+	}
+	line = CACHE_LINE_SIZE / sizeof(atomic_uint_least64_t);
+	m->stride = (cells + line - 1) / line * line;
+	pthread_mutex_init(&m->lock, NULL);
+	if (R.tail == NULL)
+		atomic_store_explicit(&R.head, m, memory_order_release);
+	else
+		atomic_store_explicit(&R.tail->next, m, memory_order_release);
+	R.tail = m;
+	pthread_mutex_unlock(&R.lock);
+	return m;
+}
+
+struct silly_metric *metrics_next(struct silly_metric *m)
+{
+	if (m == NULL)
+		return atomic_load_explicit(&R.head, memory_order_acquire);
+	return atomic_load_explicit(&m->next, memory_order_acquire);
+}
+
+const struct silly_metric_desc *metrics_desc(const struct silly_metric *m)
+{
+	return &m->desc;
+}
+
+static void slots_grow(struct silly_metric *m)
+{
+	int n = m->slotcount ? m->slotcount * 2 : 16;
+	struct silly_metric_series **slots;
+	slots = (struct silly_metric_series **)mem_alloc(n * sizeof(*slots));
+	memset(slots, 0, n * sizeof(*slots));
+	for (int i = 0; i < m->slotcount; i++) {
+		struct silly_metric_series *s, *next;
+		for (s = m->slots[i]; s != NULL; s = next) {
+			next = s->hnext;
+			s->hnext = slots[s->hash & (n - 1)];
+			slots[s->hash & (n - 1)] = s;
+		}
+	}
+	mem_free(m->slots);
+	m->slots = slots;
+	m->slotcount = n;
+}
+
+static struct silly_metric_series *series_new(struct silly_metric *m,
+					      const char *const *values,
+					      uint32_t hash)
+{
+	size_t sz;
+	uintptr_t p;
+	struct silly_metric_series *s;
+	s = (struct silly_metric_series *)mem_alloc(sizeof(*s));
+	atomic_init(&s->next, NULL);
+	s->hnext = NULL;
+	s->family = m;
+	s->hash = hash;
+	s->values = dupstrs(values, m->desc.labelcount);
+	s->labels = labels_compose(&m->desc, values);
+	sz = (size_t)m->shards * m->stride * sizeof(atomic_uint_least64_t);
+	s->mem = mem_alloc(sz + CACHE_LINE_SIZE);
+	p = ((uintptr_t)s->mem + CACHE_LINE_SIZE - 1) &
+	    ~(uintptr_t)(CACHE_LINE_SIZE - 1);
+	s->cells = (atomic_uint_least64_t *)p;
+	memset(s->cells, 0, sz);
+	s->window = NULL;
+	if (m->desc.quantilecount > 0) {
+		struct window *w;
+		size_t n = m->desc.bucketcount + 1;
+		w = (struct window *)mem_alloc(sizeof(*w) +
+					       (WINDOW_RING + 2) * n *
+						       sizeof(uint64_t));
+		memset(w, 0, sizeof(*w));
+		w->cur = (uint64_t *)(w + 1);
+		w->diff = w->cur + n;
+		w->ring = w->diff + n;
+		s->window = w;
+	}
+	return s;
+}
+
+struct silly_metric_series *metrics_series(struct silly_metric *m,
+					   const char *const *values)
+{
+	uint32_t hash;
+	struct silly_metric_series *s;
+	int n = m->desc.labelcount;
+	hash = values_hash(values, n);
+	pthread_mutex_lock(&m->lock);
+	if (m->slotcount > 0) {
+		s = m->slots[hash & (m->slotcount - 1)];
+		for (; s != NULL; s = s->hnext) {
+			if (s->hash == hash && values_equal(s->values, values, n))
+				goto out;
+		}
+	}
+	if (m->count >= m->slotcount)
+		slots_grow(m);
+	s = series_new(m, values, hash);
+	s->hnext = m->slots[hash & (m->slotcount - 1)];
+	m->slots[hash & (m->slotcount - 1)] = s;
+	m->count++;
+	if (m->tail == NULL)
+		atomic_store_explicit(&m->head, s, memory_order_release);
+	else
+		atomic_store_explicit(&m->tail->next, s, memory_order_release);
+	m->tail = s;
+out:
+	pthread_mutex_unlock(&m->lock);
+	return s;
+}
+
+struct silly_metric_series *metrics_series_next(struct silly_metric *m,
+						struct silly_metric_series *s)
+{
+	if (s == NULL)
+		return atomic_load_explicit(&m->head, memory_order_acquire);
+	return atomic_load_explicit(&s->next, memory_order_acquire);
+}
+
+const char *metrics_series_labels(const struct silly_metric_series *s)
+{
+	return s->labels;
+}
+
+void metrics_add(struct silly_metric_series *s, double v)
+{
+	struct silly_metric *m = s->family;
+	int i = m->shards > 1 ? shard_of_thread() : 0;
+	cell_addf(&s->cells[i * m->stride], v);
+}
+
+void metrics_set(struct silly_metric_series *s, double v)
+{
+	assert(s->family->shards == 1);
+	atomic_store_explicit(&s->cells[0], cell_bits(v),
+			      memory_order_relaxed);
+}
+
+/*
+** The bits of the previous double are used, so a value on a bound lands
+** in the bucket it closes as 'le' wants.
+*/
+static inline int loghist_index(const struct silly_metric *m, double v)
+{
+	uint64_t bits;
+	int e, sub, p = m->desc.precision;
+	if (!(v > m->lo)) // NaN too
+		return 0;
+	if (v > m->hi)
+		return m->desc.bucketcount;
+	bits = cell_bits(v) - 1;
+	e = (int)((bits >> 52) & 0x7ff) - 1023;
+	sub = (int)(bits >> (52 - p)) & ((1 << p) - 1);
+	return 1 + ((e - m->emin) << p) + sub;
+}
+
+void metrics_observe(struct silly_metric_series *s, double v)
+{
+	struct silly_metric *m = s->family;
+	const double *b = m->desc.buckets;
+	atomic_uint_least64_t *c;
+	int lo = 0, hi = m->desc.bucketcount;
+	c = &s->cells[shard_of_thread() * m->stride];
+	if (m->desc.kind == SILLY_METRIC_LOGHIST)
+		lo = hi = loghist_index(m, v);
+	while (lo < hi) { // first bucket with v <= bound
+		int mid = (lo + hi) / 2;
+		if (v <= b[mid])
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	if (lo < m->desc.bucketcount)
+		atomic_fetch_add_explicit(&c[HIST_BUCKET + lo], 1,
+					  memory_order_relaxed);
+	atomic_fetch_add_explicit(&c[HIST_COUNT], 1, memory_order_relaxed);
+	cell_addf(&c[HIST_SUM], v);
+}
+
+void metrics_read(const struct silly_metric_series *s,
+		  struct silly_metric_sample *sample)
+{
+	const struct silly_metric *m = s->family;
+	int bucketcount = m->desc.bucketcount;
+	sample->value = 0;
+	sample->sum = 0;
+	sample->count = 0;
+	if (!bucketed(m->desc.kind)) {
+		for (int i = 0; i < m->shards; i++) {
+			sample->value += cell_tof(atomic_load_explicit(
+				&s->cells[i * m->stride],
+				memory_order_relaxed));
+		}
+		return;
+	}
+	if (sample->buckets != NULL)
+		memset(sample->buckets, 0, bucketcount * sizeof(uint64_t));
+	for (int i = 0; i < m->shards; i++) {
+		atomic_uint_least64_t *c = &s->cells[i * m->stride];
+		sample->count += atomic_load_explicit(&c[HIST_COUNT],
+						      memory_order_relaxed);
+		sample->sum += cell_tof(atomic_load_explicit(
+			&c[HIST_SUM], memory_order_relaxed));
+		if (sample->buckets == NULL)
+			continue;
+		for (int j = 0; j < bucketcount; j++) {
+			sample->buckets[j] += atomic_load_explicit(
+				&c[HIST_BUCKET + j], memory_order_relaxed);
+		}
+	}
+}
+
+/* linear within the bucket holding the rank, its lower bound is the
+** previous bound (0 for the first one) */
+double metrics_quantile(const struct silly_metric_desc *desc,
+			const struct silly_metric_sample *sample, double q)
+{
+	double rank, lower = 0;
+	uint64_t acc = 0;
+	if (sample->count == 0 || desc->bucketcount == 0)
+		return NAN;
+	q = q < 0 ? 0 : (q > 1 ? 1 : q);
+	rank = q * (double)sample->count;
+	for (int i = 0; i < desc->bucketcount; i++) {
+		uint64_t c = sample->buckets[i];
+		double upper = desc->buckets[i];
+		if (c > 0 && (double)(acc + c) >= rank) {
+			double r = rank - (double)acc;
+			return lower + (upper - lower) * (r > 0 ? r : 0) / c;
+		}
+		acc += c;
+		lower = upper;
+	}
+	return desc->buckets[desc->bucketcount - 1];
+}
+
+void metrics_quantiles(struct silly_metric_series *s, double *values)
+{
+	int k;
+	uint64_t now, span;
+	const uint64_t *base = NULL;
+	struct silly_metric *m = s->family;
+	struct window *w = s->window;
+	struct silly_metric_sample sample;
+	int n = m->desc.bucketcount + 1;
+	if (w == NULL) {
+		for (int i = 0; i < m->desc.quantilecount; i++)
+			values[i] = NAN;
+		return;
+	}
+	pthread_mutex_lock(&m->lock);
+	sample.buckets = w->cur + 1;
+	metrics_read(s, &sample);
+	w->cur[0] = sample.count;
+	now = timer_monotonic();
+	span = (uint64_t)(m->desc.window * 1000);
+	for (k = 1; k <= w->n; k++) { // newest first
+		int i = (w->head - k + WINDOW_RING) % WINDOW_RING;
+		if (now - w->stamp[i] >= span) {
+			base = &w->ring[i * n];
+			break;
+		}
+	}
+	if (base == NULL && w->n == WINDOW_RING) // read less often than 'span'
+		base = &w->ring[w->head * n];
+	for (int i = 0; i < n; i++)
+		w->diff[i] = w->cur[i] - (base != NULL ? base[i] : 0);
+	sample.count = w->diff[0];
+	sample.buckets = w->diff + 1;
+	for (int i = 0; i < m->desc.quantilecount; i++)
+		values[i] = metrics_quantile(&m->desc, &sample,
+					     m->desc.quantiles[i]);
+	k = (w->head - 1 + WINDOW_RING) % WINDOW_RING;
+	if (w->n == 0 || now - w->stamp[k] >= span / METRICS_WINDOW_SLOTS) {
+		memcpy(&w->ring[w->head * n], w->cur, n * sizeof(uint64_t));
+		w->stamp[w->head] = now;
+		w->head = (w->head + 1) % WINDOW_RING;
+		if (w->n < WINDOW_RING)
+			w->n++;
+	}
+	pthread_mutex_unlock(&m->lock);
+}
+
+void metrics_exit(void)
+{
+	struct silly_metric *m, *next;
+	pthread_mutex_lock(&R.lock);
+	m = atomic_load_explicit(&R.head, memory_order_relaxed);
+	atomic_store_explicit(&R.head, NULL, memory_order_relaxed);
+	R.tail = NULL;
+	pthread_mutex_unlock(&R.lock);
+	for (; m != NULL; m = next) {
+		next = atomic_load_explicit(&m->next, memory_order_relaxed);
+		family_free(m);
+	}
+}
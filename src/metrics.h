@@ -0,0 +1,24 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include "silly.h"
+
+struct silly_metric *metrics_new(const struct silly_metric_desc *desc);
+struct silly_metric *metrics_next(struct silly_metric *m);
+const struct silly_metric_desc *metrics_desc(const struct silly_metric *m);
+struct silly_metric_series *metrics_series(struct silly_metric *m,
+					   const char *const *values);
+struct silly_metric_series *metrics_series_next(struct silly_metric *m,
+						struct silly_metric_series *s);
+const char *metrics_series_labels(const struct silly_metric_series *s);
+void metrics_add(struct silly_metric_series *s, double v);
+void metrics_set(struct silly_metric_series *s, double v);
+void metrics_observe(struct silly_metric_series *s, double v);
+void metrics_read(const struct silly_metric_series *s,
+		  struct silly_metric_sample *sample);
+void metrics_quantiles(struct silly_metric_series *s, double *values);
+double metrics_quantile(const struct silly_metric_desc *desc,
+			const struct silly_metric_sample *sample, double q);
+void metrics_exit(void);
+
+#endif
@@ -39,6 +39,7 @@ struct silly_message_id {
 	int socket_listen;
 	int socket_connect;
 	int socket_close;
+	int tcp_drain;
 };
 
 enum silly_log_level {
@@ -55,6 +56,80 @@ struct silly_timerstat {
 	atomic_uint_least64_t canceled;
 };
 
+struct silly_profilestat {
+	uint64_t ticks;   // SIGPROF ticks received by the worker
+	uint64_t samples; // Lua stacks handed to the profiler hook
+	uint64_t native;  // ticks outside Lua (C dispatch loop)
+	uint64_t skipped; // ticks dropped, previous sample pending or hook busy
+};
+
+/*
+** Allocation tracer of the worker thread. 'alloc' and 'free' run inside
+** the allocator (Lua state and silly_malloc on the worker thread), 'caller'
+** is NULL for the Lua state. When 'alloc' returns non-zero, 'hook' is
+** called at the next point where the Lua stack can be walked, or right
+** away with L == NULL when there is no Lua code running.
+*/
+struct silly_memtrace {
+	int (*alloc)(void *ptr, size_t size, const void *caller);
+	void (*free)(void *ptr);
+	lua_Hook hook;
+};
+
+/*
+** GC scheduling of the worker. The Lua parameters are applied as is,
+** 'idle' bounds the GC steps run before the worker parks and 'busy' is
+** the backlog at which the inline collector is slowed down until the
+** queue drains.
+*/
+struct silly_gcconf {
+	int generational; // 1: generational mode, 0: incremental mode
+	int pause;        // LUA_GCPPAUSE, percent
+	int stepmul;      // LUA_GCPSTEPMUL, percent
+	int minormul;     // LUA_GCPMINORMUL, percent
+	int idle;         // microseconds of GC steps per idle period, 0: off
+	int busy;         // backlog that throttles the inline GC, 0: off
+};
+
+struct silly_gcstat {
+	uint64_t dispatch;    // dispatch cycles (batches of messages)
+	uint64_t idle_steps;  // GC steps run while idle
+	uint64_t idle_cycles; // GC cycles finished while idle
+	uint64_t idle_ns;     // time spent in idle GC steps
+	uint64_t throttled;   // times the inline GC was throttled
+};
+
+/*
+** --log-format=binary: every line is a record in host byte order, a
+** 24 byte head (u8 SILLY_LOG_MAGIC, u8 SILLY_LOG_VERSION, u8 level,
+** u8 0, u32 record size, u64 time in ms, u64 trace id) followed by
+** typed items. tools/logdecode.lua renders records back to text.
+*/
+#define SILLY_LOG_MAGIC (0xb1)
+#define SILLY_LOG_VERSION (1)
+
+enum silly_log_item {
+	SILLY_LOG_RAW = 1,   // u32 len, bytes: text written as is
+	SILLY_LOG_STR = 2,   // u32 len, bytes: an argument
+	SILLY_LOG_INT = 3,   // i64
+	SILLY_LOG_NUM = 4,   // double
+	SILLY_LOG_TRUE = 5,  // -
+	SILLY_LOG_FALSE = 6, // -
+	SILLY_LOG_NIL = 7,   // -
+	SILLY_LOG_SRC = 8,   // u32 line, u32 len, bytes: source of the call
+	SILLY_LOG_FMT = 9,   // u32 len, bytes: '%s' format of the next items
+};
+
+struct silly_logstat {
+	uint64_t written_bytes; // bytes written to the log fd
+	uint64_t dropped_bytes; // bytes dropped on a full buffer (drop policy)
+	uint64_t dropped_lines; // lines dropped on a full buffer (drop policy)
+	uint64_t blocked;       // times a producer waited for room (block policy)
+	uint64_t flushes;       // writev batches issued by the drainers
+	uint64_t flush_ns;      // total time spent in the batches
+	uint64_t flush_ns_max;  // slowest batch since the last silly_logstat
+};
+
 struct silly_netstat {
 	atomic_uint_least16_t tcp_connections;
 	atomic_uint_least64_t received_bytes;
@@ -74,6 +149,85 @@ struct silly_socketstat {
 	char remoteaddr[SILLY_SOCKET_NAMELEN];
 };
 
+/*
+** TCP traffic aggregated by listener (accepted connections) and by
+** remote peer (outgoing connections). Groups are created on listen and
+** connect and live until exit; past SOCKET_PEERSTAT_MAX groups the
+** rest share one group whose addr is "*".
+*/
+enum silly_peer_close {
+	SILLY_PEER_CLOSE_LOCAL = 0,   // closed by this side
+	SILLY_PEER_CLOSE_EOF = 1,     // closed by the other side
+	SILLY_PEER_CLOSE_RESET = 2,   // ECONNRESET
+	SILLY_PEER_CLOSE_TIMEOUT = 3, // ETIMEDOUT
+	SILLY_PEER_CLOSE_REFUSED = 4, // ECONNREFUSED, connect only
+	SILLY_PEER_CLOSE_ERROR = 5,   // any other error
+	SILLY_PEER_CLOSE_COUNT = 6,
+};
+
+struct silly_peerstat {
+	const char *kind; // "listener" or "peer"
+	char addr[SILLY_SOCKET_NAMELEN];
+	uint64_t opens;          // accepted or attempted connections
+	uint64_t closes[SILLY_PEER_CLOSE_COUNT];
+	uint64_t sent_bytes;
+	uint64_t received_bytes;
+	uint64_t eagain;         // writes the kernel would not take in full
+	uint64_t drains;         // backlogs written out after an eagain
+	uint64_t drain_ns;       // total time from the eagain to empty wlist
+	uint64_t wlist_max;      // largest wlist since the last read
+	// TCP_INFO, sampled only when silly_socket_tcpinfo is on (Linux)
+	uint64_t retransmits;    // retransmitted segments of closed sockets
+	uint32_t rtt_us;         // smoothed RTT of the last sample
+	uint32_t cwnd;           // congestion window of the last sample
+};
+
+/*
+** Metrics kept in C, writable from any thread. Counters and histograms
+** have one cache line aligned shard per thread group, summed only when
+** read; a gauge is a single cell so 'set' stays coherent. Families and
+** series live until exit, their pointers can be cached by the callers.
+*/
+enum silly_metric_kind {
+	SILLY_METRIC_COUNTER = 0,
+	SILLY_METRIC_GAUGE = 1,
+	SILLY_METRIC_HISTOGRAM = 2,
+	SILLY_METRIC_LOGHIST = 3, // log-linear buckets, see 'precision'
+};
+
+struct silly_metric;        // a family: name, help and label names
+struct silly_metric_series; // one set of label values of a family
+
+struct silly_metric_desc {
+	enum silly_metric_kind kind;
+	const char *name;
+	const char *help;
+	int labelcount;
+	const char *const *labelnames;
+	int bucketcount;        // histogram, 0 for the default buckets
+	const double *buckets;  // upper bounds, +Inf is implied
+	const char *const *bucketnames; // the bounds as exported in 'le'
+	/*
+	** loghist: each power of two in [min, max] is split in 2^precision
+	** buckets, values below and above land in one bucket each. The
+	** buckets and their names above are computed by silly_metric_new.
+	** With quantiles it is exported as a summary over 'window' seconds.
+	*/
+	double min;
+	double max;
+	int precision;
+	int quantilecount;
+	const double *quantiles;
+	double window;
+};
+
+struct silly_metric_sample {
+	double value;      // counter, gauge
+	double sum;        // histogram, loghist
+	uint64_t count;    // histogram, loghist
+	uint64_t *buckets; // histogram, loghist, per bucket (not cumulative)
+};
+
 typedef uint16_t silly_tracenode_t;
 typedef uint64_t silly_traceid_t;
 
@@ -92,6 +246,9 @@ SILLY_API void silly_log_open_file(const char *path);
 SILLY_API void silly_log_set_level(enum silly_log_level level);
 SILLY_API enum silly_log_level silly_log_get_level();
 SILLY_API void silly_log_write(enum silly_log_level level, const char *buf, size_t len);
+SILLY_API int silly_log_binary();
+SILLY_API void silly_log_writeb(enum silly_log_level level, const char *items, size_t len);
+SILLY_API void silly_logstat(struct silly_logstat *stat);
 #define silly_log_visible(level) (level >= silly_log_get_level())
 #define silly_log_(level, ...)                                                \
 	do {                                                                  \
@@ -117,6 +274,13 @@ SILLY_API void silly_log_write(enum silly_log_level level, const char *buf, size
 #define silly_log_error(...) silly_log_(SILLY_LOG_ERROR, __VA_ARGS__)
 
 SILLY_API int silly_signal_watch(int signum);
+SILLY_API int silly_profile_start(int hz, lua_Hook hook);
+SILLY_API void silly_profile_stop();
+SILLY_API void silly_profilestat(struct silly_profilestat *stat);
+SILLY_API void silly_memtrace(const struct silly_memtrace *mt);
+SILLY_API void silly_gctune(const struct silly_gcconf *conf,
+			    struct silly_gcconf *old);
+SILLY_API void silly_gcstat(struct silly_gcstat *stat);
 SILLY_API silly_socket_id_t silly_tcp_listen(const char *ip, const char *port,
 					     int backlog);
 SILLY_API silly_socket_id_t silly_udp_bind(const char *ip, const char *port);
@@ -129,16 +293,23 @@ SILLY_API silly_socket_id_t silly_udp_connect(const char *ip, const char *port,
 SILLY_API int silly_ntop(const void *data, char name[SILLY_SOCKET_NAMELEN]);
 SILLY_API int silly_tcp_send(silly_socket_id_t sid, uint8_t *buff, size_t sz,
 			     void (*freex)(void *));
+SILLY_API int silly_tcp_multicast(const silly_socket_id_t *sids, int n,
+				  uint8_t *buff, size_t sz,
+				  void (*freex)(void *));
 SILLY_API int silly_udp_send(silly_socket_id_t sid, uint8_t *buff, size_t sz,
 			     const uint8_t *addr, size_t addrlen,
 			     void (*freex)(void *));
 SILLY_API void silly_socket_readenable(silly_socket_id_t sid, int enable);
 SILLY_API int silly_socket_sendsize(silly_socket_id_t sid);
+SILLY_API int silly_tcp_watermark(silly_socket_id_t sid, uint32_t high,
+				  uint32_t low);
 SILLY_API int silly_socket_close(silly_socket_id_t sid);
 SILLY_API const char *silly_socket_multiplexer();
 SILLY_API void silly_netstat(struct silly_netstat *stat);
 SILLY_API void silly_socketstat(silly_socket_id_t sid,
 			      struct silly_socketstat *info);
+SILLY_API int silly_peerstat(int i, struct silly_peerstat *stat);
+SILLY_API int silly_socket_tcpinfo(int enable);
 
 SILLY_API uint64_t silly_now();
 SILLY_API uint64_t silly_monotonic();
@@ -151,6 +322,25 @@ SILLY_API silly_traceid_t silly_trace_exchange(silly_traceid_t id);
 SILLY_API silly_traceid_t silly_trace_current();
 SILLY_API silly_traceid_t silly_trace_new();
 
+SILLY_API struct silly_metric *silly_metric_new(const struct silly_metric_desc *desc);
+SILLY_API struct silly_metric *silly_metric_next(struct silly_metric *m);
+SILLY_API const struct silly_metric_desc *silly_metric_desc(const struct silly_metric *m);
+SILLY_API struct silly_metric_series *silly_metric_series(struct silly_metric *m,
+							  const char *const *values);
+SILLY_API struct silly_metric_series *silly_metric_series_next(struct silly_metric *m,
+							       struct silly_metric_series *s);
+SILLY_API const char *silly_metric_series_labels(const struct silly_metric_series *s);
+SILLY_API void silly_metric_add(struct silly_metric_series *s, double v);
+SILLY_API void silly_metric_set(struct silly_metric_series *s, double v);
+SILLY_API void silly_metric_observe(struct silly_metric_series *s, double v);
+SILLY_API void silly_metric_read(const struct silly_metric_series *s,
+				 struct silly_metric_sample *sample);
+SILLY_API void silly_metric_quantiles(struct silly_metric_series *s,
+				      double *values);
+SILLY_API double silly_metric_quantile(const struct silly_metric_desc *desc,
+				       const struct silly_metric_sample *sample,
+				       double q);
+
 SILLY_API void silly_push(struct silly_message *msg);
 SILLY_API uint32_t silly_genid();
 SILLY_API size_t silly_worker_backlog();
@@ -28,6 +28,7 @@
 #ifdef __linux__
 
 #define USE_ACCEPT4
+#define USE_TCP_INFO
 #define _GNU_SOURCE
 
 #define USE_SPINLOCK
@@ -44,6 +45,14 @@
 #define SOCKET_WLIST_CACHE_SIZE 128
 #endif
 
+#ifndef SOCKET_PEERSTAT_MAX
+#define SOCKET_PEERSTAT_MAX (64) //listener and peer groups, the rest share one
+#endif
+
+#ifndef SOCKET_TCPINFO_INTERVAL
+#define SOCKET_TCPINFO_INTERVAL (1000) //ms between TCP_INFO samples of a group
+#endif
+
 
 
 #ifndef TCP_READ_BUF_SIZE
@@ -66,6 +75,30 @@
 #define LOG_BUF_SIZE (1024 * 1024) //1MB
 #endif
 
+#ifndef LOG_FLUSH_INTERVAL
+#define LOG_FLUSH_INTERVAL (100) //ms
+#endif
+
+#ifndef LOG_IOV_MAX
+#define LOG_IOV_MAX (64)
+#endif
+
+#ifndef LOG_LIMIT_SITES
+#define LOG_LIMIT_SITES (4096) //call sites and keys tracked by the limiter
+#endif
+
+#ifndef METRICS_SHARDS
+#define METRICS_SHARDS (16) //counter/histogram shards, threads share them round-robin
+#endif
+
+#ifndef METRICS_WINDOW_SLOTS
+#define METRICS_WINDOW_SLOTS (5) //snapshots a loghist summary window slides by
+#endif
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE (64)
+#endif
+
 #ifndef LOG_DISABLE_FILE_LINE
 #define LOG_ENABLE_FILE_LINE
 #endif
@@ -7,6 +7,7 @@
 #include <string.h>
 #include <stdatomic.h>
 #include <stdint.h>
+#include <time.h>
 
 #include "silly.h"
 #include "platform.h"
@@ -175,20 +176,54 @@ struct wlist {
 	union sockaddr_full *udpaddress;
 };
 
+#define PEER_LISTENER 0
+#define PEER_REMOTE 1
+#define PEER_OTHER 2
+
+static const char *peer_kind_name[] = {
+	"listener",
+	"peer",
+	"other",
+};
+
+// written by the socket thread only, read by socket_peerstat
+struct peerstat {
+	uint8_t kind;
+	char addr[SILLY_SOCKET_NAMELEN];
+	uint64_t sampled_at; // ms of the last TCP_INFO sample
+	atomic_uint_least64_t opens;
+	atomic_uint_least64_t closes[SILLY_PEER_CLOSE_COUNT];
+	atomic_uint_least64_t sent_bytes;
+	atomic_uint_least64_t received_bytes;
+	atomic_uint_least64_t eagain;
+	atomic_uint_least64_t drains;
+	atomic_uint_least64_t drain_ns;
+	atomic_uint_least64_t wlist_max;
+	atomic_uint_least64_t retransmits;
+	atomic_uint_least32_t rtt_us;
+	atomic_uint_least32_t cwnd;
+};
+
 struct socket {
 	_Atomic(silly_socket_id_t) sid; //socket descriptor
 	fd_t fd;
 	uint32_t version;
 	uint8_t type;
 	uint8_t dirty;
+	uint8_t tallied; //the close has been counted in peer
 	atomic_uint_least8_t state;
+	atomic_uint_least8_t wlpaused; //wlbytes reached wlhigh, waiting for wllow
 	atomic_uint_least32_t wlbytes;
+	atomic_uint_least32_t wlhigh; //0: no watermarks
+	atomic_uint_least32_t wllow;
 	uint32_t wloffset;
 	struct wlist *wlhead;
 	struct wlist **wltail;
 	struct socket *next;
 	atomic_uint_least64_t sent_bytes;
 	atomic_uint_least64_t received_bytes;
+	struct peerstat *peer; //tcp only, socket thread only
+	uint64_t blocked_at;   //ns of the first eagain of the wlist
 };
 
 struct socket_pool {
@@ -258,6 +293,10 @@ struct socket_manager {
 	silly_socket_id_t reserveid;
 	//netstat
 	struct silly_netstat netstat;
+	//per listener and per remote peer stats
+	atomic_int peercount;
+	atomic_int tcpinfo;
+	struct peerstat peers[SOCKET_PEERSTAT_MAX];
 	//wlist node cache
 	struct wlist_cache wcache;
 	//dirty socket tracking for batched writev
@@ -289,8 +328,10 @@ enum op_type {
 	OP_TCP_CONNECT,
 	OP_UDP_CONNECT,
 	OP_TCP_SEND,
+	OP_TCP_MULTICAST,
 	OP_UDP_SEND,
 	OP_READ_ENABLE,
+	OP_WATERMARK,
 	OP_CLOSE,
 	OP_EXIT,
 };
@@ -334,6 +375,23 @@ struct op_readenable {
 	int ctrl;
 };
 
+struct op_watermark {
+	struct op_hdr hdr;
+};
+
+struct op_tcpmulticast {
+	struct op_hdr hdr;
+	uint8_t *data;
+	size_t size;
+	void (*free)(void *);
+	int count;
+	//silly_socket_id_t sids[count] follows
+};
+
+#define MULTICAST_SIDS                                  \
+	((UINT16_MAX - sizeof(struct op_tcpmulticast)) / \
+	 sizeof(silly_socket_id_t))
+
 struct op_exit {
 	struct op_hdr hdr;
 };
@@ -347,6 +405,7 @@ struct op_pkt {
 		struct op_tcpsend tcpsend;
 		struct op_udpsend udpsend;
 		struct op_readenable readenable;
+		struct op_watermark watermark;
 		struct op_exit exit;
 	};
 };
@@ -391,6 +450,11 @@ struct message_close {
 	int err;
 };
 
+struct message_drain {
+	struct silly_message hdr;
+	silly_socket_id_t sid;
+};
+
 static struct socket_manager *SM;
 
 static inline void wlist_append(struct socket_manager *ss, struct socket *s,
@@ -460,12 +524,18 @@ static void socket_default(struct socket *s)
 	s->fd = -1;
 	s->type = SOCKET_RESERVE;
 	s->dirty = 0;
+	s->tallied = 0;
+	s->peer = NULL;
+	s->blocked_at = 0;
 	s->wloffset = 0;
 	atomic_store_relaxed(&s->state, 0);
 	s->wlhead = NULL;
 	s->wltail = &s->wlhead;
 	s->next = NULL;
 	atomic_store_relaxed(&s->wlbytes, 0);
+	atomic_store_relaxed(&s->wlhigh, 0);
+	atomic_store_relaxed(&s->wllow, 0);
+	atomic_store_relaxed(&s->wlpaused, 0);
 	atomic_store_relaxed(&s->sid, -1);
 	atomic_store_relaxed(&s->sent_bytes, 0);
 	atomic_store_relaxed(&s->received_bytes, 0);
@@ -482,6 +552,9 @@ static void pool_init(struct socket_pool *p)
 		atomic_init(&s->sid, -1);
 		atomic_init(&s->state, 0);
 		atomic_init(&s->wlbytes, 0);
+		atomic_init(&s->wlhigh, 0);
+		atomic_init(&s->wllow, 0);
+		atomic_init(&s->wlpaused, 0);
 		socket_default(s);
 #ifdef SILLY_TEST
 		s->version = UINT16_MAX;
@@ -564,6 +637,117 @@ static int ntop(const union sockaddr_full *addr,
 	return namelen;
 }
 
+static inline uint64_t clock_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static struct peerstat *peer_get(struct socket_manager *ss, int kind,
+				 const union sockaddr_full *addr)
+{
+	int i, n;
+	struct peerstat *p;
+	char namebuf[SILLY_SOCKET_NAMELEN];
+	int namelen = ntop(addr, namebuf);
+	namebuf[namelen] = '\0';
+	n = atomic_load_relaxed(&ss->peercount);
+	for (i = 0; i < n; i++) {
+		p = &ss->peers[i];
+		if (p->kind == kind && strcmp(p->addr, namebuf) == 0)
+			return p;
+	}
+	if (n == SOCKET_PEERSTAT_MAX)
+		return &ss->peers[n - 1];
+	p = &ss->peers[n];
+	if (n == SOCKET_PEERSTAT_MAX - 1) {
+		p->kind = PEER_OTHER;
+		p->addr[0] = '*';
+	} else {
+		p->kind = kind;
+		memcpy(p->addr, namebuf, namelen + 1);
+	}
+	atomic_store_explicit(&ss->peercount, n + 1, memory_order_release);
+	return p;
+}
+
+static void peer_tcpinfo(struct socket_manager *ss, struct socket *s,
+			 int closing)
+{
+#ifdef USE_TCP_INFO
+	uint64_t now;
+	struct tcp_info ti;
+	socklen_t len = sizeof(ti);
+	struct peerstat *p = s->peer;
+	if (!atomic_load_relaxed(&ss->tcpinfo) || s->fd < 0)
+		return;
+	now = clock_ns() / 1000000;
+	if (!closing && now - p->sampled_at < SOCKET_TCPINFO_INTERVAL)
+		return;
+	if (getsockopt(s->fd, IPPROTO_TCP, TCP_INFO, &ti, &len) < 0)
+		return;
+	p->sampled_at = now;
+	atomic_store_relaxed(&p->rtt_us, ti.tcpi_rtt);
+	atomic_store_relaxed(&p->cwnd, ti.tcpi_snd_cwnd);
+	if (closing)
+		atomic_add_relaxed(&p->retransmits, ti.tcpi_total_retrans);
+#else
+	(void)ss;
+	(void)s;
+	(void)closing;
+#endif
+}
+
+static void peer_close(struct socket_manager *ss, struct socket *s, int err)
+{
+	int reason;
+	if (s->peer == NULL || s->tallied)
+		return;
+	s->tallied = 1;
+	switch (err) {
+	case 0:
+		reason = SILLY_PEER_CLOSE_LOCAL;
+		break;
+	case EXEOF:
+		reason = SILLY_PEER_CLOSE_EOF;
+		break;
+	case ECONNRESET:
+		reason = SILLY_PEER_CLOSE_RESET;
+		break;
+	case ETIMEDOUT:
+		reason = SILLY_PEER_CLOSE_TIMEOUT;
+		break;
+	case ECONNREFUSED:
+		reason = SILLY_PEER_CLOSE_REFUSED;
+		break;
+	default:
+		reason = SILLY_PEER_CLOSE_ERROR;
+		break;
+	}
+	peer_tcpinfo(ss, s, 1);
+	atomic_add_relaxed(&s->peer->closes[reason], 1);
+}
+
+static void peer_blocked(struct socket_manager *ss, struct socket *s)
+{
+	if (s->peer == NULL)
+		return;
+	atomic_add_relaxed(&s->peer->eagain, 1);
+	if (s->blocked_at == 0)
+		s->blocked_at = clock_ns();
+	peer_tcpinfo(ss, s, 0);
+}
+
+static void peer_drained(struct socket *s)
+{
+	if (s->blocked_at == 0)
+		return;
+	atomic_add_relaxed(&s->peer->drains, 1);
+	atomic_add_relaxed(&s->peer->drain_ns, clock_ns() - s->blocked_at);
+	s->blocked_at = 0;
+}
+
 static int accept_unpack(lua_State *L, struct silly_message *m)
 {
 	struct message_accept *ma = container_of(m, struct message_accept, hdr);
@@ -600,6 +784,13 @@ static int close_unpack(lua_State *L, struct silly_message *m)
 	return 2;
 }
 
+static int drain_unpack(lua_State *L, struct silly_message *m)
+{
+	struct message_drain *md = container_of(m, struct message_drain, hdr);
+	lua_pushinteger(L, md->sid);
+	return 1;
+}
+
 static int tcpdata_unpack(lua_State *L, struct silly_message *m)
 {
 	struct message_tcpdata *md =
@@ -684,6 +875,7 @@ static void report_close(struct socket_manager *ss, struct socket *s, int err)
 		return;
 	set_closing(s); // Ensure the close event is emitted only once
 	assert(socket_type(s) == SOCKET_CONNECTION);
+	peer_close(ss, s, err);
 	mc = mem_alloc(sizeof(*mc));
 	mc->hdr.type = MESSAGE_SOCKET_CLOSE;
 	mc->hdr.unpack = close_unpack;
@@ -694,6 +886,37 @@ static void report_close(struct socket_manager *ss, struct socket *s, int err)
 	return;
 }
 
+/*
+ * The worker pauses a socket when its send pushes wlbytes to wlhigh,
+ * the socket thread resumes it once wlbytes falls to wllow. Both sides
+ * write their variable before reading the other one's, the fences make
+ * sure at least one of them sees the resume condition, and the CAS on
+ * wlpaused lets only one of them clear it: either the send returns not
+ * paused, or exactly one drain message is emitted.
+ */
+static void check_drained(struct socket_manager *ss, struct socket *s)
+{
+	uint8_t paused = 1;
+	uint32_t high, low;
+	struct message_drain *md;
+	atomic_thread_fence(memory_order_seq_cst);
+	if (!atomic_load_relaxed(&s->wlpaused))
+		return;
+	high = atomic_load_relaxed(&s->wlhigh);
+	low = atomic_load_relaxed(&s->wllow);
+	if (high != 0 && atomic_load_relaxed(&s->wlbytes) > low)
+		return;
+	if (!atomic_compare_exchange_strong(&s->wlpaused, &paused, 0))
+		return;
+	(void)ss;
+	md = mem_alloc(sizeof(*md));
+	md->hdr.type = MESSAGE_TCP_DRAIN;
+	md->hdr.unpack = drain_unpack;
+	md->hdr.free = mem_free;
+	md->sid = s->sid;
+	worker_push(&md->hdr);
+}
+
 static void report_tcpdata(struct socket_manager *ss, struct socket *s,
 			   uint8_t *data, size_t sz)
 {
@@ -731,8 +954,10 @@ static void report_udpdata(struct socket_manager *ss, struct socket *s,
 
 static void report_connect(struct socket_manager *ss, struct socket *s, int err)
 {
-	(void)ss;
-	struct message_connect *mc = mem_alloc(sizeof(*mc));
+	struct message_connect *mc;
+	if (err != 0)
+		peer_close(ss, s, err);
+	mc = mem_alloc(sizeof(*mc));
 	mc->hdr.type = MESSAGE_SOCKET_CONNECT;
 	mc->hdr.unpack = connect_unpack;
 	mc->hdr.free = mem_free;
@@ -843,6 +1068,9 @@ static void exec_accept(struct socket_manager *ss, struct socket *listen)
 		free_socket(ss, s);
 		return;
 	}
+	s->peer = listen->peer;
+	if (s->peer != NULL)
+		atomic_add_relaxed(&s->peer->opens, 1);
 	report_accept(ss, listen, s, &addr);
 	atomic_add_relaxed(&ss->netstat.tcp_connections, 1);
 	return;
@@ -1020,6 +1248,10 @@ static enum read_result forward_msg_tcp(struct socket_manager *ss,
 		report_tcpdata(ss, s, buf, len);
 		atomic_add_relaxed(&ss->netstat.received_bytes, len);
 		atomic_add_relaxed(&s->received_bytes, len);
+		if (s->peer != NULL) {
+			atomic_add_relaxed(&s->peer->received_bytes, len);
+			peer_tcpinfo(ss, s, 0);
+		}
 		return len >= (ssize_t)sizeof(ss->readbuf) ? READ_SOME :
 							     READ_ALL;
 	}
@@ -1120,6 +1352,7 @@ static int drain_wlist_tcp(struct socket_manager *ss, struct socket *s)
 	int iovcnt;
 	uint32_t wloffset;
 	ssize_t total;
+	size_t want = 0;
 	struct iovec iov[64];
 	struct wlist *w = s->wlhead;
 	if (w == NULL)
@@ -1135,15 +1368,20 @@ static int drain_wlist_tcp(struct socket_manager *ss, struct socket *s)
 		iov[iovcnt].iov_len = len;
 		iovcnt++;
 		wloffset = 0;
+		want += len;
 	}
 	total = sendv(s->fd, iov, iovcnt);
 	if (unlikely(total < 0))
 		return -1;
 	if (total == 0) { //EAGAIN
+		peer_blocked(ss, s);
 		write_enable(ss, s, 1);
 		return 0;
 	}
+	if ((size_t)total < want) //the kernel buffer is full
+		peer_blocked(ss, s);
 	atomic_sub_relaxed(&s->wlbytes, total);
+	check_drained(ss, s);
 	//consume sent bytes from wlist
 	w = s->wlhead;
 	while (w && total > 0) {
@@ -1166,6 +1404,7 @@ static int drain_wlist_tcp(struct socket_manager *ss, struct socket *s)
 	}
 	//all data sent
 	s->wltail = &s->wlhead;
+	peer_drained(s);
 	write_enable(ss, s, 0);
 	if (is_closewait(s)) {
 		atomic_sub_relaxed(&ss->netstat.tcp_connections, 1);
@@ -1339,6 +1578,8 @@ static int op_tcp_listen(struct socket_manager *ss, struct op_listen *op,
 			 struct socket *s)
 {
 	int err;
+	socklen_t len;
+	union sockaddr_full addr;
 	(void)op;
 	assert(is_listening(s) && s->type == SOCKET_TCP_LISTEN);
 	err = add_to_sp(ss, s);
@@ -1349,6 +1590,9 @@ static int op_tcp_listen(struct socket_manager *ss, struct op_listen *op,
 		return err;
 	}
 	clr_listening(s);
+	len = sizeof(addr);
+	if (getsockname(s->fd, &addr.sa, &len) == 0)
+		s->peer = peer_get(ss, PEER_LISTENER, &addr);
 	report_listen(ss, s, 0);
 	return err;
 }
@@ -1466,6 +1710,8 @@ static void op_tcp_connect(struct socket_manager *ss, struct op_connect *op,
 	keepalive(fd);
 	nodelay(fd);
 	addr = &op->addr;
+	s->peer = peer_get(ss, PEER_REMOTE, addr);
+	atomic_add_relaxed(&s->peer->opens, 1);
 	cret = connect(fd, &addr->sa, sockaddr_len(addr));
 	if (unlikely(cret == -1 && socketerrno != CONNECT_IN_PROGRESS)) { //error
 		char namebuf[SILLY_SOCKET_NAMELEN];
@@ -1598,6 +1844,7 @@ static int op_close(struct socket_manager *ss, struct op_close *op,
 		log_error("[socket] op_close unsupport type %d\n", type);
 		return -1;
 	}
+	peer_close(ss, s, 0);
 	if (wlist_empty(s)) { //already send all the data, directly close it
 		if (s->type == SOCKET_TCP_CONNECTION && unlikely(!is_connecting(s))) {
 			atomic_sub_relaxed(&SM->netstat.tcp_connections, 1);
@@ -1611,9 +1858,12 @@ static int op_close(struct socket_manager *ss, struct op_close *op,
 	}
 }
 
+// returns 1 when the send pauses the socket, see check_drained
 int socket_tcp_send(silly_socket_id_t sid, uint8_t *buf, size_t sz,
 		    void (*freex)(void *))
 {
+	uint8_t paused = 1;
+	uint32_t high, wlbytes;
 	struct op_tcpsend op = { 0 };
 	struct socket *s = pool_get(&SM->pool, sid);
 	if (freex == NULL)
@@ -1634,17 +1884,90 @@ int socket_tcp_send(silly_socket_id_t sid, uint8_t *buf, size_t sz,
 	op.data = buf;
 	op.size = sz;
 	op.free = freex;
-	atomic_add_relaxed(&s->wlbytes, sz);
+	high = atomic_load_relaxed(&s->wlhigh);
+	wlbytes = atomic_add_relaxed(&s->wlbytes, sz) + sz;
 	op_push(SM, &op.hdr);
+	if (high == 0 || wlbytes < high)
+		return 0;
+	atomic_store_relaxed(&s->wlpaused, 1);
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_relaxed(&s->wlbytes) > atomic_load_relaxed(&s->wllow))
+		return 1;
+	if (!atomic_compare_exchange_strong(&s->wlpaused, &paused, 0))
+		return 1; //the drain message is on the way
 	return 0;
 }
 
-static void op_tcp_send(struct socket_manager *ss, struct op_tcpsend *op,
-			struct socket *s)
+int socket_tcp_multicast(const silly_socket_id_t *sids, int n, uint8_t *buf,
+			 size_t sz, void (*freex)(void *))
+{
+	int i, count = 0;
+	silly_socket_id_t *dst;
+	struct op_tcpmulticast *op;
+	size_t cap = n < (int)MULTICAST_SIDS ? (size_t)n : MULTICAST_SIDS;
+	if (unlikely(n <= 0))
+		return 0;
+	op = mem_alloc(sizeof(*op) + cap * sizeof(*dst));
+	op->hdr.op = OP_TCP_MULTICAST;
+	op->hdr.sid = 0;
+	op->data = buf;
+	op->size = sz;
+	op->free = freex;
+	op->count = 0;
+	dst = (silly_socket_id_t *)(op + 1);
+	for (i = 0; i < n; i++) {
+		struct socket *s = pool_get(&SM->pool, sids[i]);
+		if (unlikely(sz == 0 || s == NULL || is_zombine(s))) {
+			freex(buf);
+			continue;
+		}
+		atomic_add_relaxed(&s->wlbytes, sz);
+		dst[op->count++] = sids[i];
+		if ((size_t)op->count == cap) {
+			op->hdr.size = sizeof(*op) + op->count * sizeof(*dst);
+			op_push(SM, &op->hdr);
+			count += op->count;
+			op->count = 0;
+		}
+	}
+	if (op->count > 0) {
+		op->hdr.size = sizeof(*op) + op->count * sizeof(*dst);
+		op_push(SM, &op->hdr);
+		count += op->count;
+	}
+	mem_free(op);
+	return count;
+}
+
+int socket_tcp_watermark(silly_socket_id_t sid, uint32_t high, uint32_t low)
+{
+	struct op_watermark op = { 0 };
+	struct socket *s = pool_get(&SM->pool, sid);
+	if (unlikely(s == NULL || is_zombine(s)))
+		return -EXCLOSED;
+	//stored here so the very next send already sees them, the op only
+	//lets the socket thread re-check a connection that is paused now
+	atomic_store_relaxed(&s->wllow, low);
+	atomic_store_relaxed(&s->wlhigh, high);
+	op.hdr.op = OP_WATERMARK;
+	op.hdr.sid = sid;
+	op.hdr.size = sizeof(op);
+	op_push(SM, &op.hdr);
+	return 0;
+}
+
+static void op_watermark(struct socket_manager *ss, struct op_watermark *op,
+			 struct socket *s)
+{
+	(void)op;
+	if (unlikely(s->type != SOCKET_TCP_CONNECTION))
+		return;
+	check_drained(ss, s);
+}
+
+static void tcp_append(struct socket_manager *ss, struct socket *s,
+		       uint8_t *data, size_t sz, void (*freex)(void *))
 {
-	uint8_t *data = op->data;
-	size_t sz = op->size;
-	void (*freex)(void *) = op->free;
 	if (unlikely(s->type != SOCKET_TCP_CONNECTION)) {
 		freex(data);
 		atomic_sub_relaxed(&s->wlbytes, sz);
@@ -1655,11 +1978,39 @@ static void op_tcp_send(struct socket_manager *ss, struct op_tcpsend *op,
 	}
 	atomic_add_relaxed(&ss->netstat.sent_bytes, sz);
 	atomic_add_relaxed(&s->sent_bytes, sz);
+	if (s->peer != NULL) {
+		struct peerstat *p = s->peer;
+		uint64_t wl = atomic_load_relaxed(&s->wlbytes);
+		atomic_add_relaxed(&p->sent_bytes, sz);
+		if (wl > atomic_load_relaxed(&p->wlist_max))
+			atomic_store_relaxed(&p->wlist_max, wl);
+	}
 	wlist_append(ss, s, data, sz, freex);
 	if (!is_connecting(s))
 		mark_dirty(ss, s);
 }
 
+static void op_tcp_send(struct socket_manager *ss, struct op_tcpsend *op,
+			struct socket *s)
+{
+	tcp_append(ss, s, op->data, op->size, op->free);
+}
+
+static void op_tcp_multicast(struct socket_manager *ss,
+			     struct op_tcpmulticast *op)
+{
+	int i;
+	silly_socket_id_t *sids = (silly_socket_id_t *)(op + 1);
+	for (i = 0; i < op->count; i++) {
+		struct socket *s = pool_get(&ss->pool, sids[i]);
+		if (unlikely(s == NULL || is_zombine(s))) {
+			op->free(op->data);
+			continue;
+		}
+		tcp_append(ss, s, op->data, op->size, op->free);
+	}
+}
+
 int socket_udp_send(silly_socket_id_t sid, uint8_t *buf, size_t sz,
 		    const uint8_t *addr, size_t addrlen, void (*freex)(void *))
 {
@@ -1754,6 +2105,10 @@ static int op_process(struct socket_manager *ss)
 			return -1;
 		assert(op->hdr.size > 0);
 		ptr += op->hdr.size;
+		if (op->hdr.op == OP_TCP_MULTICAST) {
+			op_tcp_multicast(ss, (struct op_tcpmulticast *)op);
+			continue;
+		}
 		s = pool_get(&ss->pool, op->hdr.sid);
 		if (s == NULL || (op->hdr.op != OP_CLOSE && is_zombine(s))) {
 			if (op->hdr.op == OP_TCP_SEND) {
@@ -1792,6 +2147,9 @@ static int op_process(struct socket_manager *ss)
 		case OP_READ_ENABLE:
 			op_read_enable(ss, &op->readenable, s);
 			break;
+		case OP_WATERMARK:
+			op_watermark(ss, &op->watermark, s);
+			break;
 		default:
 			log_error("[socket] op_process:"
 				  "unkonw operation:%d\n",
@@ -1954,6 +2312,8 @@ int socket_init()
 	atomic_init(&ss->netstat.sent_bytes, 0);
 	atomic_init(&ss->netstat.operate_request, 0);
 	atomic_init(&ss->netstat.operate_processed, 0);
+	atomic_init(&ss->peercount, 0);
+	atomic_init(&ss->tcpinfo, 0);
 	ss->eventindex = 0;
 	ss->eventcount = 0;
 	resize_eventbuf(ss, EVENT_SIZE);
@@ -2064,6 +2424,43 @@ void socket_stat(silly_socket_id_t sid, struct silly_socketstat *info)
 	return;
 }
 
+int socket_peerstat(int i, struct silly_peerstat *stat)
+{
+	int j;
+	struct peerstat *p;
+	int n = atomic_load_explicit(&SM->peercount, memory_order_acquire);
+	if (i < 0 || i >= n)
+		return 0;
+	p = &SM->peers[i];
+	stat->kind = peer_kind_name[p->kind];
+	memcpy(stat->addr, p->addr, sizeof(stat->addr));
+	stat->opens = atomic_load_relaxed(&p->opens);
+	for (j = 0; j < SILLY_PEER_CLOSE_COUNT; j++)
+		stat->closes[j] = atomic_load_relaxed(&p->closes[j]);
+	stat->sent_bytes = atomic_load_relaxed(&p->sent_bytes);
+	stat->received_bytes = atomic_load_relaxed(&p->received_bytes);
+	stat->eagain = atomic_load_relaxed(&p->eagain);
+	stat->drains = atomic_load_relaxed(&p->drains);
+	stat->drain_ns = atomic_load_relaxed(&p->drain_ns);
+	stat->wlist_max = atomic_exchange_explicit(&p->wlist_max, 0,
+						   memory_order_relaxed);
+	stat->retransmits = atomic_load_relaxed(&p->retransmits);
+	stat->rtt_us = atomic_load_relaxed(&p->rtt_us);
+	stat->cwnd = atomic_load_relaxed(&p->cwnd);
+	return 1;
+}
+
+int socket_tcpinfo(int enable)
+{
+#ifdef USE_TCP_INFO
+	atomic_store_relaxed(&SM->tcpinfo, enable != 0);
+	return 0;
+#else
+	(void)enable;
+	return -1;
+#endif
+}
+
 #ifdef SILLY_TEST
 void socket_debug_ctrl(const char *cmd, const char *key, int val)
 {
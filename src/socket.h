@@ -25,8 +25,11 @@ int socket_send_size(silly_socket_id_t sid);
 
 int socket_tcp_send(silly_socket_id_t sid, uint8_t *buff, size_t sz,
 		    void (*free)(void *));
+int socket_tcp_multicast(const silly_socket_id_t *sids, int n, uint8_t *buf,
+			 size_t sz, void (*free)(void *));
 int socket_udp_send(silly_socket_id_t sid, uint8_t *buff, size_t sz,
 		    const uint8_t *addr, size_t addrlen, void (*free)(void *));
+int socket_tcp_watermark(silly_socket_id_t sid, uint32_t high, uint32_t low);
 int socket_close(silly_socket_id_t sid);
 
 int socket_poll();
@@ -35,6 +38,8 @@ const char *socket_multiplexer();
 
 void socket_netstat(struct silly_netstat *stat);
 void socket_stat(silly_socket_id_t sid, struct silly_socketstat *info);
+int socket_peerstat(int i, struct silly_peerstat *stat);
+int socket_tcpinfo(int enable);
 
 #ifdef SILLY_TEST
 void socket_debug_ctrl(const char *cmd, const char *key, int val);
@@ -4,6 +4,11 @@
 #include <fcntl.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
 
 #include <lua.h>
 #include <lauxlib.h>
@@ -98,6 +103,88 @@ void signal_kill_usr2(pthread_t tid)
 	pthread_kill(tid, SIGUSR2);
 }
 
+void signal_block_prof(void)
+{
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGPROF);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+#if defined(__linux__)
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+static timer_t prof_timer;
+static int prof_timer_created = 0;
+#endif
+
+/*
+** Deliver SIGPROF to the calling thread 'hz' times per second of the CPU
+** time it consumes. On Linux this is a per-thread CPU clock timer, other
+** systems fall back to ITIMER_PROF, which counts the CPU time of the whole
+** process; SIGPROF is blocked in every other thread, so the signal still
+** lands on the caller.
+*/
+int signal_prof_start(void (*handler)(int), int hz)
+{
+	sigset_t set;
+	struct sigaction sa;
+	long interval = 1000000000L / hz;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGPROF, &sa, NULL) != 0)
+		return errno;
+	sigemptyset(&set);
+	sigaddset(&set, SIGPROF);
+	pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+#if defined(__linux__)
+	struct sigevent sev;
+	struct itimerspec its;
+	clockid_t clock;
+	if (pthread_getcpuclockid(pthread_self(), &clock) != 0)
+		clock = CLOCK_THREAD_CPUTIME_ID;
+	if (!prof_timer_created) {
+		memset(&sev, 0, sizeof(sev));
+		sev.sigev_notify = SIGEV_THREAD_ID;
+		sev.sigev_signo = SIGPROF;
+		sev.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+		if (timer_create(clock, &sev, &prof_timer) != 0)
+			return errno;
+		prof_timer_created = 1;
+	}
+	its.it_interval.tv_sec = interval / 1000000000L;
+	its.it_interval.tv_nsec = interval % 1000000000L;
+	its.it_value = its.it_interval;
+	if (timer_settime(prof_timer, 0, &its, NULL) != 0)
+		return errno;
+#else
+	struct itimerval itv;
+	itv.it_interval.tv_sec = interval / 1000000000L;
+	itv.it_interval.tv_usec = (interval % 1000000000L) / 1000;
+	itv.it_value = itv.it_interval;
+	if (setitimer(ITIMER_PROF, &itv, NULL) != 0)
+		return errno;
+#endif
+	return 0;
+}
+
+void signal_prof_stop(void)
+{
+#if defined(__linux__)
+	if (prof_timer_created) {
+		timer_delete(prof_timer);
+		prof_timer_created = 0;
+	}
+#else
+	struct itimerval itv;
+	memset(&itv, 0, sizeof(itv));
+	setitimer(ITIMER_PROF, &itv, NULL);
+#endif
+}
+
 static void (*eh_fn)(void) = NULL;
 
 static void eh_handler(int sig)
@@ -39,6 +39,9 @@ void signal_ignore_pipe(void);
 void signal_block_usr2(void);
 void signal_register_usr2(void (*handler)(int));
 void signal_kill_usr2(pthread_t tid);
+void signal_block_prof(void);
+int signal_prof_start(void (*handler)(int), int hz);
+void signal_prof_stop(void);
 void set_eh(void (*handler)(void));
 
 static inline int cpu_count(void)
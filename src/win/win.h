@@ -6,6 +6,7 @@
 #include <iphlpapi.h>
 #include <ws2def.h>
 #include <io.h>
+#include <errno.h>
 #include <limits.h>
 #include "log.h"
 
@@ -96,6 +97,9 @@ static inline void signal_ignore_pipe(void) {}
 static inline void signal_block_usr2(void) {}
 static inline void signal_register_usr2(void (*handler)(int)) { (void)handler; }
 static inline void signal_kill_usr2(void *tid) { (void)tid; }
+static inline void signal_block_prof(void) {}
+static inline int signal_prof_start(void (*handler)(int), int hz) { (void)handler; (void)hz; return ENOTSUP; }
+static inline void signal_prof_stop(void) {}
 void set_eh(void (*handler)(void));
 
 /* DNS system configuration defaults (synthesized at runtime) */
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 #include <pthread.h>
 #include <lua.h>
 #include <lualib.h>
@@ -25,6 +26,10 @@
 
 #define WARNING_THRESHOLD (64)
 
+#define GC_IDLE_US (1000)
+#define GC_BUSY (128)
+#define GC_THROTTLE (4)
+
 #define STK_TRACEBACK (1)
 #define STK_ERROR_TABLE (2)
 #define STK_CALLBACK_TABLE (3)
@@ -50,6 +55,17 @@ struct worker {
 	lua_Hook oldhook;
 	int oldmask;
 	int oldcount;
+	volatile sig_atomic_t inlua;
+	lua_State *volatile prof_armed;
+	volatile sig_atomic_t prof_pending;
+	lua_Hook prof_hook;
+	const struct silly_memtrace *memtrace;
+	struct silly_profilestat prof_stat;
+	struct silly_gcconf gc;
+	struct silly_gcstat gc_stat;
+	int gc_throttled;
+	int gc_incycle;
+	size_t gc_alloc;
 	uint32_t maxmsg;
 	struct queue *queue;
 	void (*callback)(lua_State *L, struct silly_message *msg);
@@ -61,6 +77,7 @@ struct worker {
 struct worker *W;
 
 static void warn_hook(lua_State *L, lua_Debug *ar);
+static inline void gc_pressure(size_t backlog);
 
 static inline void callback(struct silly_message *sm)
 {
@@ -75,16 +92,20 @@ static inline void callback(struct silly_message *sm)
 		return;
 	}
 	args = sm->unpack(L, sm);
+	W->inlua = 1;
 	/*the first stack slot of main thread is always trace function */
 	err = lua_pcall(L, args, 0, STK_TRACEBACK);
+	W->inlua = 0;
 	if (unlikely(err != LUA_OK)) {
 		log_error("[worker] message:%d callback fail:%d:%s\n", sm->type,
 			  err, lua_tostring(L, -1));
 		lua_pop(L, 1);
 	}
 	sm->free(sm);
+	W->inlua = 1;
 	lua_pushvalue(W->L, STK_DISPATCH_WAKEUP);
 	lua_call(W->L, 0, 0);
+	W->inlua = 0;
 }
 
 void worker_push(struct silly_message *msg)
@@ -173,12 +194,14 @@ void worker_dispatch()
 {
 	struct silly_message *msg;
 	struct silly_message *tmp;
+	gc_pressure(queue_size(W->queue));
 	msg = queue_pop(W->queue);
 	atomic_fetch_add_explicit(&W->process_id, 1, memory_order_relaxed);
 	if (msg == NULL) {
 		process_pending_signals();
 		return;
 	}
+	W->gc_stat.dispatch++;
 	do {
 		do {
 			atomic_fetch_add_explicit(&W->process_id, 1,
@@ -188,6 +211,7 @@ void worker_dispatch()
 			msg = tmp;
 		} while (msg);
 		process_pending_signals();
+		gc_pressure(queue_size(W->queue));
 		msg = queue_pop(W->queue);
 	} while (msg);
 	W->maxmsg = WARNING_THRESHOLD;
@@ -321,12 +345,16 @@ static void lua_warnf(void *ud, const char *msg, int tocont)
 static void *lua_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
 {
 	(void)ud;
-	(void)osize;
 	if (nsize == 0) {
 		mem_free(ptr);
 		return NULL;
 	} else {
-		return mem_realloc(ptr, nsize);
+		//osize is the object type when ptr is NULL
+		if (ptr == NULL)
+			W->gc_alloc += nsize;
+		else if (nsize > osize)
+			W->gc_alloc += nsize - osize;
+		return mem_realloc_from(ptr, nsize, NULL);
 	}
 }
 
@@ -395,6 +423,12 @@ void worker_start(const struct boot_args *config)
 	W->L = L;
 	W->running = L;
 	lua_gc(L, LUA_GCGEN);
+	W->gc.generational = 1;
+	W->gc.pause = lua_gc(L, LUA_GCPARAM, LUA_GCPPAUSE, -1);
+	W->gc.stepmul = lua_gc(L, LUA_GCPARAM, LUA_GCPSTEPMUL, -1);
+	W->gc.minormul = lua_gc(L, LUA_GCPARAM, LUA_GCPMINORMUL, -1);
+	W->gc.idle = GC_IDLE_US;
+	W->gc.busy = GC_BUSY;
 	//set load path
 	lib_len = max(sizeof("lualib/?.lua"), sizeof("luaclib/?" LUA_LIB_SUFFIX));
 	dir_len = config->selfname - config->selfpath;
@@ -432,6 +466,7 @@ void worker_start(const struct boot_args *config)
 	} else {
 		luaL_loadstring(L, REPL);
 	}
+	W->inlua = 1;
 	if (unlikely(lua_pcall(L, 1, 0, 1))) {
 		log_error("[worker] call %s %s\n", config->bootstrap,
 			  lua_tostring(L, -1));
@@ -440,6 +475,7 @@ void worker_start(const struct boot_args *config)
 	}
 	lua_pushvalue(L, STK_DISPATCH_WAKEUP);
 	lua_call(L, 0, 0);
+	W->inlua = 0;
 	return;
 }
 
@@ -514,6 +550,245 @@ int worker_signal_watch(int signum)
 	return 0;
 }
 
+/*
+** Sampling profilers, using the same hook-from-signal pattern as the
+** endless loop detection above.
+**
+** SIGPROF is only delivered to the worker thread and the allocation tracer
+** only runs on it, so the arming and the hook always run on the thread
+** that owns the Lua state and need no locking. Neither can walk the Lua
+** stack where it fires (a signal, or the middle of a stack reallocation);
+** both arm a one-shot hook on 'W->running' and the hook, which runs at the
+** next instruction, call or return of that coroutine, takes the samples
+** pending in 'prof_pending'. Ticks that arrive while the worker is outside
+** Lua (queue handling, message unpacking) are only counted. A hook
+** installed by someone else (debugger, endless loop detection) is never
+** replaced; that sample is skipped.
+*/
+#define PROF_CPU (1)
+#define PROF_ALLOC (2)
+
+static void profile_hook(lua_State *L, lua_Debug *ar)
+{
+	int pending;
+	lua_sethook(L, NULL, 0, 0);
+	if (L != W->prof_armed) /* armed before the coroutine was switched */
+		return;
+	pending = W->prof_pending;
+	W->prof_pending = 0;
+	if ((pending & PROF_CPU) != 0 && W->prof_hook != NULL) {
+		W->prof_stat.samples++;
+		W->prof_hook(L, ar);
+	}
+	if ((pending & PROF_ALLOC) != 0 && W->memtrace != NULL)
+		W->memtrace->hook(L, ar);
+	W->prof_armed = NULL;
+}
+
+//1: armed, 0: already pending, -1: the hook is owned by someone else
+static int profile_arm(int bit)
+{
+	lua_State *L = W->running;
+	lua_Hook hook = lua_gethook(L);
+	if (L == W->prof_armed) {
+		if ((W->prof_pending & bit) != 0)
+			return 0;
+		W->prof_pending |= bit;
+		return 1;
+	}
+	if (hook != NULL && hook != profile_hook)
+		return -1;
+	W->prof_pending |= bit;
+	W->prof_armed = L;
+	lua_sethook(L, profile_hook,
+		    LUA_MASKCALL | LUA_MASKRET | LUA_MASKCOUNT, 1);
+	return 1;
+}
+
+static void profile_disarm(int bit)
+{
+	lua_State *L;
+	W->prof_pending &= ~bit;
+	if (W->prof_pending != 0)
+		return;
+	L = W->prof_armed;
+	W->prof_armed = NULL;
+	if (L != NULL && lua_gethook(L) == profile_hook)
+		lua_sethook(L, NULL, 0, 0);
+}
+
+static void profile_handler(int sig)
+{
+	(void)sig;
+	if (W->prof_hook == NULL)
+		return;
+	W->prof_stat.ticks++;
+	if (W->inlua == 0)
+		W->prof_stat.native++;
+	else if (profile_arm(PROF_CPU) != 1)
+		W->prof_stat.skipped++;
+}
+
+int worker_profile_start(int hz, lua_Hook hook)
+{
+	int err;
+	if (hz <= 0 || hz > 1000 || hook == NULL)
+		return EINVAL;
+	if (W->prof_hook != NULL)
+		return EALREADY;
+	W->prof_hook = hook;
+	err = signal_prof_start(profile_handler, hz);
+	if (err != 0) {
+		W->prof_hook = NULL;
+		signal_prof_stop();
+	}
+	return err;
+}
+
+void worker_profile_stop()
+{
+	if (W->prof_hook == NULL)
+		return;
+	signal_prof_stop();
+	W->prof_hook = NULL;
+	profile_disarm(PROF_CPU);
+}
+
+void worker_profilestat(struct silly_profilestat *stat)
+{
+	*stat = W->prof_stat;
+}
+
+static void memtrace_alloc(void *ptr, size_t sz, const void *caller)
+{
+	const struct silly_memtrace *mt = W->memtrace;
+	if (mt->alloc(ptr, sz, caller) == 0)
+		return;
+	/* outside Lua there is no stack worth waiting for */
+	if (W->inlua == 0 || profile_arm(PROF_ALLOC) < 0)
+		mt->hook(NULL, NULL);
+}
+
+static void memtrace_free(void *ptr)
+{
+	W->memtrace->free(ptr);
+}
+
+void worker_memtrace(const struct silly_memtrace *mt)
+{
+	static const struct mem_tracer tracer = {
+		.alloc = memtrace_alloc,
+		.free = memtrace_free,
+	};
+	if (mt == NULL) { //may come from lua_close on the main thread
+		mem_trace(NULL);
+		W->memtrace = NULL;
+		profile_disarm(PROF_ALLOC);
+	} else {
+		assert(pthread_equal(pthread_self(), W->tid));
+		W->memtrace = mt;
+		mem_trace(&tracer);
+	}
+}
+
+/*
+** GC scheduling: the collector still runs inline (driven by allocation
+** debt), but before the worker parks 'worker_idle' pays part of that
+** debt in bounded steps, and while the backlog is long the inline
+** collector is slowed down (lower stepmul, rarer minor collections)
+** so the work lands in the next idle period instead of on requests.
+*/
+static void gc_apply(lua_State *L, const struct silly_gcconf *c, int throttled)
+{
+	int stepmul = c->stepmul;
+	int minormul = c->minormul;
+	if (throttled) {
+		stepmul = max(stepmul / GC_THROTTLE, 1);
+		minormul = minormul * GC_THROTTLE;
+	}
+	lua_gc(L, LUA_GCPARAM, LUA_GCPPAUSE, c->pause);
+	lua_gc(L, LUA_GCPARAM, LUA_GCPSTEPMUL, stepmul);
+	lua_gc(L, LUA_GCPARAM, LUA_GCPMINORMUL, minormul);
+}
+
+static inline void gc_pressure(size_t backlog)
+{
+	int throttle = W->gc.busy > 0 && backlog >= (size_t)W->gc.busy;
+	if (likely(throttle == W->gc_throttled))
+		return;
+	W->gc_throttled = throttle;
+	W->gc_stat.throttled += throttle;
+	gc_apply(W->L, &W->gc, throttle);
+}
+
+static inline uint64_t gc_clock()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+** Bytes to allocate before an idle collection is worth it: half of
+** what would start the collector inline (a minor collection in
+** generational mode, a new cycle in incremental mode).
+*/
+static size_t gc_threshold(lua_State *L)
+{
+	size_t heap = (size_t)lua_gc(L, LUA_GCCOUNT) * 1024;
+	if (W->gc.generational)
+		return heap / 100 * W->gc.minormul / 2;
+	return heap / 100 * max(W->gc.pause - 100, 10) / 2;
+}
+
+void worker_idle()
+{
+	uint64_t start, now, deadline;
+	lua_State *L = W->L;
+	if (W->gc.idle <= 0)
+		return;
+	if (!W->gc_incycle && W->gc_alloc < gc_threshold(L))
+		return;
+	start = gc_clock();
+	deadline = start + (uint64_t)W->gc.idle * 1000;
+	W->gc_incycle = 1;
+	W->inlua = 1; //finalizers may run
+	do {
+		int done = lua_gc(L, LUA_GCSTEP, 0);
+		W->gc_stat.idle_steps++;
+		now = gc_clock();
+		//a generational step is a whole minor collection
+		if (done || W->gc.generational) {
+			W->gc_stat.idle_cycles += done;
+			W->gc_incycle = 0;
+			W->gc_alloc = 0;
+			break;
+		}
+	} while (now < deadline && worker_backlog() == 0);
+	W->inlua = 0;
+	W->gc_stat.idle_ns += now - start;
+}
+
+void worker_gctune(const struct silly_gcconf *conf, struct silly_gcconf *old)
+{
+	lua_State *L = W->L;
+	if (old != NULL)
+		*old = W->gc;
+	if (conf == NULL)
+		return;
+	if (conf->generational != W->gc.generational) {
+		lua_gc(L, conf->generational ? LUA_GCGEN : LUA_GCINC);
+		W->gc_incycle = 0;
+	}
+	W->gc = *conf;
+	gc_apply(L, &W->gc, W->gc_throttled);
+}
+
+void worker_gcstat(struct silly_gcstat *stat)
+{
+	*stat = W->gc_stat;
+}
+
 void worker_exit()
 {
 	lua_close(W->L); // lua close may call worker_push during gc
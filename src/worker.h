@@ -11,6 +11,7 @@ void worker_start(const struct boot_args *config);
 
 void worker_push(struct silly_message *msg);
 void worker_dispatch();
+void worker_idle();
 
 uint32_t worker_alloc_id();
 size_t worker_backlog();
@@ -19,6 +20,12 @@ uint32_t worker_process_id();
 void worker_resume(lua_State *L);
 void worker_mark_endless();
 int worker_signal_watch(int signum);
+int worker_profile_start(int hz, lua_Hook hook);
+void worker_profile_stop();
+void worker_profilestat(struct silly_profilestat *stat);
+void worker_memtrace(const struct silly_memtrace *mt);
+void worker_gctune(const struct silly_gcconf *conf, struct silly_gcconf *old);
+void worker_gcstat(struct silly_gcstat *stat);
 
 char **worker_args(int *argc);
 
@@ -0,0 +1,59 @@
+local blob = require "silly.adt.blob"
+local hash = require "silly.crypto.hash"
+local gzip = require "silly.compress.gzip"
+local testaux = require "test.testaux"
+
+-- Test 1: Read operations
+do
+	local data = string.pack("<I4I2", 0x12345678, 0xabcd) .. "hello world"
+	local b = blob.new(data)
+	testaux.asserteq(#b, #data, "Case 1.1: length")
+	testaux.asserteq(b:len(), #data, "Case 1.2: len method")
+	testaux.asserteq(b:sub(7), "hello world", "Case 1.3: sub to end")
+	testaux.asserteq(b:sub(7, 11), "hello", "Case 1.4: sub range")
+	testaux.asserteq(b:sub(-5), "world", "Case 1.5: negative sub")
+	testaux.asserteq(b:byte(7), string.byte("h"), "Case 1.6: byte")
+	local x, y, z = b:byte(7, 9)
+	testaux.asserteq(x + y + z, string.byte("h") + string.byte("e") + string.byte("l"),
+		"Case 1.7: byte range")
+	local u32, u16, pos = b:unpack("<I4I2")
+	testaux.asserteq(u32, 0x12345678, "Case 1.8: unpack u32")
+	testaux.asserteq(u16, 0xabcd, "Case 1.9: unpack u16")
+	testaux.asserteq(pos, 7, "Case 1.10: unpack position")
+	testaux.asserteq(b:view(), data, "Case 1.11: view equals source")
+end
+
+-- Test 2: Empty blob
+do
+	local b = blob.new("")
+	testaux.asserteq(#b, 0, "Case 2.1: empty length")
+	testaux.asserteq(b:view(), "", "Case 2.2: empty view")
+	testaux.asserteq(b:sub(1), "", "Case 2.3: empty sub")
+end
+
+-- Test 3: Views outlive the blob
+do
+	local data = string.rep("0123456789", 1000)
+	local b = blob.new(data)
+	local v = b:view()
+	b = nil
+	collectgarbage()
+	collectgarbage()
+	testaux.asserteq(v, data, "Case 3.1: view still valid after blob is collected")
+end
+
+-- Test 4: Feed to compress and crypto
+do
+	local data = string.rep("silly blob ", 4096)
+	local b = blob.new(data)
+	testaux.asserteq(hash.hash("sha256", b:view()), hash.hash("sha256", data),
+		"Case 4.1: hash of view")
+	testaux.asserteq(gzip.decompress(gzip.compress(b:view())), data,
+		"Case 4.2: gzip round trip of view")
+end
+
+-- Test 5: Invalid argument
+do
+	testaux.assert_error(function() blob.new({}) end, "Case 5.1: new requires string")
+	testaux.assert_error(function() blob.len("abc") end, "Case 5.2: method requires blob")
+end
@@ -43,7 +43,7 @@ local function buildpacket()
 	local len = math.random(1, 30)
 	local raw = testaux.randomdata(len)
 	testaux.asserteq(#raw, len, "random packet length")
-	local hdr = string.pack("<I4I4I8", 0, 0, 0) --session, cmd, traceid
+	local hdr = string.pack("<I4I4I8I4I4", 0, 0, 0, 0, 0) --session, cmd, traceid, timeout, reserved
 	local body = hdr .. raw
 	local pk = string.pack("<I4", #body) .. body
 	return raw, pk
@@ -85,7 +85,7 @@ math.randomseed(1721030230,139887399596712)
 
 testaux.case("Test 1: Netpacket hash conflict part1", function()
 	BUFF = np.create()
-	local dat = string.pack("<I4", 16) .. "1234567812345678"
+	local dat = string.pack("<I4I4I4I8I4I4", 24, 1, 2, 3, 0, 0)
 	local part1 = dat:sub(1, 10)
 	justpush(0, part1)
 	justpush(2048, part1)
@@ -156,7 +156,7 @@ testaux.case("Test 5: Netpacket queue expand", function()
 end)
 
 testaux.case("Test 6: Netpacket hash conflict part2", function()
-	local dat = string.pack("<I4", 16) .. "1234567812345678"
+	local dat = string.pack("<I4I4I4I8I4I4", 24, 1, 2, 3, 0, 0)
 	local part2 = dat:sub(11, -1)
 	justpush(2048, part2)
 	justpush(4096, part2)
@@ -189,7 +189,7 @@ testaux.case("Test 9: Hardlimit push (error)", function()
 	local limit = 64
 	local buf = np.create(limit, limit)
 	local body = string.rep("x", limit + 1)
-	local hdr = string.pack("<I4I4I8", 0, 0, 0) --session, cmd, traceid
+	local hdr = string.pack("<I4I4I8I4I4", 0, 0, 0, 0, 0) --session, cmd, traceid, timeout, reserved
 	body = hdr .. body
 	local pk = string.pack("<I4", #body) .. body
 	local ptr, size = testaux.new(pk)
@@ -202,7 +202,7 @@ testaux.case("Test 10: Hardlimit push (ok)", function()
 	local limit = 256
 	local buf = np.create(limit, limit)
 	local raw = "hello"
-	local hdr = string.pack("<I4I4I8", 0, 0, 0) --session, cmd, traceid
+	local hdr = string.pack("<I4I4I8I4I4", 0, 0, 0, 0, 0) --session, cmd, traceid, timeout, reserved
 	local body = hdr .. raw
 	local pk = string.pack("<I4", #body) .. body
 	local ptr, size = testaux.new(pk)
@@ -218,7 +218,7 @@ testaux.case("Test 11: Hardlimit request (error)", function()
 	local limit = 32
 	local buf = np.create(limit, limit)
 	local data = string.rep("x", limit)
-	local session, err = np.request(buf, 1, 0, data)
+	local session, err = np.request(buf, 1, 1, 0, 0, data)
 	testaux.asserteq(session, false, "hardlimit request should fail")
 	testaux.assertneq(err, nil, "hardlimit request should return error string")
 end)
@@ -227,7 +227,7 @@ testaux.case("Test 12: Hardlimit response (error)", function()
 	local limit = 32
 	local buf = np.create(limit, limit)
 	local data = string.rep("x", limit)
-	local body, err = np.response(buf, 1, data)
+	local body, err = np.response(buf, 1, 1, data)
 	testaux.asserteq(body, false, "hardlimit response should fail")
 	testaux.assertneq(err, nil, "hardlimit response should return error string")
 end)
@@ -313,6 +313,7 @@ cluster.serve {
 	timeout = CLUSTER_TIMEOUT,
 	hardlimit = CLUSTER_HARDLIMIT,
 	softlimit = CLUSTER_SOFTLIMIT,
+	compress = 256,
 	marshal = marshal,
 	unmarshal = unmarshal,
 	accept = function(peer)
@@ -602,3 +603,225 @@ testaux.case("Test 25: Cluster DNS failure returns host-specific string", functi
 			"Test 25.4: Error should propagate underlying DNS reason")
 	end)
 end)
+
+testaux.case("Test 26: Netpacket response batch", function()
+	local buf = np.create(256, 256)
+	testaux.asserteq(np.flush(buf), 0, "Test 26.1: empty flush")
+	testaux.asserteq(np.response(buf, 1, 1, "a"), true, "Test 26.2: append fd 1")
+	testaux.asserteq(np.response(buf, 1, 2, "b"), true, "Test 26.3: append fd 1 again")
+	testaux.asserteq(np.response(buf, 2, 3, "c"), true, "Test 26.4: append fd 2")
+	np.clear(buf, 1)
+	np.clear(buf, 2)
+	testaux.asserteq(np.flush(buf), 0, "Test 26.5: clear drops pending batches")
+	local session, ptr, size = np.request(buf, 1, 1, 0, 0, "hello")
+	testaux.asserteq(type(session), "number", "Test 26.6: request session")
+	testaux.asserteq(type(ptr), "userdata", "Test 26.7: request returns owned buffer")
+	testaux.asserteq(size, 4 + 24 + 5, "Test 26.8: request frame size")
+	np.push(buf, 9, ptr, size)
+	local fd, data, s, cmd = np.pop(buf)
+	testaux.asserteq(fd, 9, "Test 26.9: request frame fd")
+	testaux.asserteq(data, "hello", "Test 26.10: request frame payload")
+	testaux.asserteq(s, session, "Test 26.11: request frame session")
+	testaux.asserteq(cmd, 1, "Test 26.12: request frame cmd")
+end)
+
+testaux.case("Test 27: RPC burst responses are batched per peer", function()
+	case = case_one
+	local l = cluster.listen("127.0.0.1:8990")
+	testaux.assertneq(l, nil, "Test 27.1: listener should start")
+	local p = cluster.connect("127.0.0.1:8990")
+	local wg = waitgroup.new()
+	for i = 1, 64 do
+		wg:fork(request(p, i, 4, i % 2 == 0 and "foo" or "bar"))
+	end
+	wg:wait()
+	cluster.close(p)
+	cluster.close(l)
+end)
+
+testaux.case("Test 28: Netpacket inflight and pick", function()
+	local buf = np.create(256, 256)
+	testaux.asserteq(np.pick(buf, {false, false}), nil, "Test 28.1: no live fd")
+	testaux.asserteq(np.acquire(buf, 11), 1, "Test 28.2: acquire fd 11")
+	testaux.asserteq(np.acquire(buf, 11), 2, "Test 28.3: acquire fd 11 again")
+	testaux.asserteq(np.acquire(buf, 12), 1, "Test 28.4: acquire fd 12")
+	testaux.asserteq(np.inflight(buf, 11), 2, "Test 28.5: inflight fd 11")
+	local fd, n = np.pick(buf, {11, false, 12})
+	testaux.asserteq(fd, 12, "Test 28.6: pick least outstanding")
+	testaux.asserteq(n, 1, "Test 28.7: pick returns inflight")
+	testaux.asserteq(np.pick(buf, {11, 13, 12}), 13, "Test 28.8: idle fd wins")
+	testaux.asserteq(np.release(buf, 11), 1, "Test 28.9: release fd 11")
+	np.clear(buf, 12)
+	testaux.asserteq(np.inflight(buf, 12), 0, "Test 28.10: clear drops inflight")
+	testaux.asserteq(np.release(buf, 12), 0, "Test 28.11: release after clear")
+end)
+
+testaux.case("Test 29: Multiple connections per peer", function()
+	case = case_two
+	accept_peer = nil
+	local l = cluster.listen("127.0.0.1:8991")
+	testaux.assertneq(l, nil, "Test 29.1: listener should start")
+	local p = cluster.connect("127.0.0.1:8991", 4)
+	local wg = waitgroup.new()
+	for i = 1, 16 do
+		wg:fork(request(p, i, 3, "foo"))
+	end
+	wg:wait()
+	testaux.asserteq(p.alive, 4, "Test 29.2: all connections established")
+	local seen = {}
+	for i = 1, 4 do
+		local fd = p.fds[i]
+		testaux.assertneq(fd, false, "Test 29.3: slot connected")
+		testaux.asserteq(seen[fd], nil, "Test 29.4: slot fds are distinct")
+		seen[fd] = true
+	end
+	-- Kill one connection from the server side, the peer keeps working
+	case = case_one
+	cluster.close(accept_peer)
+	wait_done(function()
+		return p.alive == 3
+	end, 2000, "one connection closed")
+	testaux.assertneq(p.fd, nil, "Test 29.5: peer still has a live fd")
+	local body, err = cluster.call(p, "foo", {name = "x", age = 1, rand = "y"})
+	testaux.assertneq(body, nil, err)
+	wait_done(function()
+		return p.alive == 4
+	end, 2000, "dead connection reconnected")
+	cluster.close(p)
+	cluster.close(l)
+end)
+
+testaux.case("Test 30: Netpacket lz4 negotiation", function()
+	local a = np.create(4096, 4096, 16)
+	local b = np.create(4096, 4096, 16)
+	local raw = string.rep("abcdefgh", 64)
+	-- a doesn't know whether b decodes lz4 yet, the first frame is raw
+	local _, ptr, size = np.request(a, 1, 1, 0, 0, raw)
+	testaux.asserteq(size, 4 + 24 + #raw, "Test 30.1: first request is not compressed")
+	np.push(b, 2, ptr, size)
+	local _, data = np.pop(b)
+	testaux.asserteq(data, raw, "Test 30.2: raw request payload")
+	-- b has seen a's capability bit, large payloads go compressed
+	local session
+	session, ptr, size = np.request(b, 2, 7, 0, 0, raw)
+	testaux.assertlt(size, 4 + 24 + #raw, "Test 30.3: request is compressed")
+	np.push(a, 1, ptr, size)
+	local fd, s, cmd
+	fd, data, s, cmd = np.pop(a)
+	testaux.asserteq(fd, 1, "Test 30.4: compressed frame fd")
+	testaux.asserteq(data, raw, "Test 30.5: payload restored")
+	testaux.asserteq(s, session, "Test 30.6: session has no flag bits")
+	testaux.asserteq(cmd, 7, "Test 30.7: cmd kept")
+	-- small payloads stay raw
+	_, ptr, size = np.request(b, 2, 7, 0, 0, "tiny")
+	testaux.asserteq(size, 4 + 24 + 4, "Test 30.8: small payload not compressed")
+	np.push(a, 1, ptr, size)
+	testaux.asserteq(select(2, np.pop(a)), "tiny", "Test 30.9: small payload")
+	local sb = np.stats(b)
+	testaux.asserteq(sb.compress_count, 1, "Test 30.10: compress count")
+	testaux.asserteq(sb.compress_in, #raw, "Test 30.11: compress input bytes")
+	testaux.assertlt(sb.compress_out, sb.compress_in, "Test 30.12: compress ratio")
+	local sa = np.stats(a)
+	testaux.asserteq(sa.decompress_count, 1, "Test 30.13: decompress count")
+	testaux.asserteq(sa.decompress_out, #raw, "Test 30.14: decompress output bytes")
+	-- a node with compression disabled never advertises it
+	local c = np.create(4096, 4096)
+	_, ptr, size = np.request(c, 3, 1, 0, 0, raw)
+	np.push(b, 3, ptr, size)
+	np.pop(b)
+	_, ptr, size = np.request(b, 3, 1, 0, 0, raw)
+	testaux.asserteq(size, 4 + 24 + #raw, "Test 30.15: no lz4 towards a disabled peer")
+	np.push(c, 3, ptr, size)
+	testaux.asserteq(select(2, np.pop(c)), raw, "Test 30.16: disabled peer payload")
+end)
+
+testaux.case("Test 31: RPC with lz4 payloads", function()
+	case = case_one
+	local l = cluster.listen("127.0.0.1:8992")
+	testaux.assertneq(l, nil, "Test 31.1: listener should start")
+	local p = cluster.connect("127.0.0.1:8992")
+	local before = cluster.stats()
+	local rand = string.rep("0123456789", 300)
+	for i = 1, 3 do
+		local body, err = cluster.call(p, "foo", {name = "z", age = i, rand = rand})
+		testaux.assertneq(body, nil, err)
+		testaux.asserteq(body and body.rand, rand, "Test 31.2: large payload round trip")
+	end
+	local after = cluster.stats()
+	testaux.assertgt(after.compress_count, before.compress_count, "Test 31.3: payloads compressed")
+	testaux.assertgt(after.decompress_count, before.decompress_count, "Test 31.4: payloads decompressed")
+	testaux.assertgt(after.compress_ns, before.compress_ns, "Test 31.5: compress cpu time counted")
+	local collector = require "silly.metrics.collector.cluster"
+	local buf = {}
+	collector.new():collect(buf)
+	testaux.asserteq(#buf, 10, "Test 31.6: collector exports counters")
+	testaux.asserteq(buf[1].name, "cluster_compress_total", "Test 31.7: compress counter")
+	testaux.assertgt(buf[1].value, 0, "Test 31.8: compress counter value")
+	cluster.close(p)
+	cluster.close(l)
+end)
+
+testaux.case("Test 32: Netpacket deadline and cancel", function()
+	local buf = np.create(256, 256)
+	-- deadline is converted to the local clock when the frame arrives
+	local session, ptr, size = np.request(buf, 1, 1, 0, 500, "a")
+	np.push(buf, 5, ptr, size)
+	local fd, data, s, cmd, traceid, deadline = np.pop(buf)
+	testaux.asserteq(data, "a", "Test 32.1: payload")
+	testaux.assertgt(deadline, time.monotonic(), "Test 32.2: deadline in the future")
+	testaux.assertle(deadline, time.monotonic() + 500, "Test 32.3: deadline bounded by timeout")
+	_, ptr, size = np.request(buf, 1, 1, 0, 0, "b")
+	np.push(buf, 5, ptr, size)
+	fd, data, s, cmd, traceid, deadline = np.pop(buf)
+	testaux.asserteq(deadline, 0, "Test 32.4: no deadline")
+	-- expired requests are dropped before they are popped
+	_, ptr, size = np.request(buf, 1, 1, 0, 1, "c")
+	np.push(buf, 5, ptr, size)
+	time.sleep(20)
+	testaux.asserteq(np.pop(buf), nil, "Test 32.5: expired request dropped")
+	testaux.asserteq(np.stats(buf).expired, 1, "Test 32.6: expired counter")
+	-- a cancel frame removes the queued request
+	session, ptr, size = np.request(buf, 1, 1, 0, 0, "d")
+	np.push(buf, 5, ptr, size)
+	ptr, size = np.cancel(buf, session)
+	np.push(buf, 5, ptr, size)
+	testaux.asserteq(np.pop(buf), nil, "Test 32.7: cancelled request dropped")
+	testaux.asserteq(np.stats(buf).cancelled, 1, "Test 32.8: cancelled counter")
+	-- a cancel frame for a request already popped is handed to lua
+	ptr, size = np.cancel(buf, 77)
+	np.push(buf, 6, ptr, size)
+	fd, data, s, cmd = np.pop(buf)
+	testaux.asserteq(fd, 6, "Test 32.9: cancel frame fd")
+	testaux.asserteq(s, 77, "Test 32.10: cancel frame session")
+	testaux.asserteq(cmd, false, "Test 32.11: cancel frame cmd")
+end)
+
+testaux.case("Test 33: RPC deadline propagation and cancel", function()
+	local l = cluster.listen("127.0.0.1:8993")
+	testaux.assertneq(l, nil, "Test 33.1: listener should start")
+	local p = cluster.connect("127.0.0.1:8993")
+	local seen_before, seen_after, nested_err
+	case = function(peer, cmd, msg)
+		seen_before = cluster.deadline()
+		time.sleep(CLUSTER_TIMEOUT + 200)
+		seen_after = cluster.deadline()
+		local _, err = cluster.call(p, "foo", msg)
+		nested_err = err
+		return msg
+	end
+	local start = time.monotonic()
+	local body, err = cluster.call(p, "foo", {name = "d", age = 1, rand = "x"})
+	testaux.asserteq(body, nil, "Test 33.2: call times out")
+	testaux.asserteq(err, ETIMEDOUT, "Test 33.3: timeout error")
+	testaux.assertgt(seen_before, start, "Test 33.4: handler sees the deadline")
+	testaux.assertle(seen_before, start + CLUSTER_TIMEOUT + 50, "Test 33.5: deadline follows caller timeout")
+	wait_done(function()
+		return seen_after ~= nil
+	end, 2000, "handler finished")
+	testaux.asserteq(seen_after, 0, "Test 33.6: cancel frame reaches the handler")
+	testaux.asserteq(nested_err, ETIMEDOUT, "Test 33.7: nested call fails fast after cancel")
+	testaux.asserteq(cluster.deadline(), nil, "Test 33.8: no deadline outside handler")
+	case = case_one
+	cluster.close(p)
+	cluster.close(l)
+end)
@@ -0,0 +1,72 @@
+local silly = require "silly"
+local time = require "silly.time"
+local metrics = require "silly.metrics.c"
+local testaux = require "test.testaux"
+
+local function garbage(n)
+	local x
+	for i = 1, n do
+		x = {i, tostring(i)}
+	end
+	return x
+end
+
+local default = silly.gctune()
+
+testaux.case("Test 1: default settings", function()
+	testaux.asserteq(default.mode, "generational", "Test 1.1: generational by default")
+	testaux.assertgt(default.idle, 0, "Test 1.2: idle steps enabled")
+	testaux.assertgt(default.busy, 0, "Test 1.3: throttling enabled")
+	testaux.asserteq(default.pause, collectgarbage("param", "pause"),
+		"Test 1.4: pause mirrors the Lua parameter")
+end)
+
+testaux.case("Test 2: tune at runtime", function()
+	local conf = silly.gctune {mode = "incremental", pause = 150, stepmul = 200}
+	testaux.asserteq(conf.mode, "incremental", "Test 2.1: mode switched")
+	testaux.asserteq(conf.pause, 150, "Test 2.2: pause applied")
+	testaux.asserteq(conf.stepmul, 200, "Test 2.3: stepmul applied")
+	testaux.asserteq(conf.idle, default.idle, "Test 2.4: missing fields are kept")
+	testaux.asserteq(collectgarbage("param", "pause"), 150, "Test 2.5: Lua sees the pause")
+	testaux.asserteq(collectgarbage("param", "stepmul"), 200, "Test 2.6: Lua sees the stepmul")
+	testaux.asserteq(silly.gctune(), conf, "Test 2.7: read back")
+	local ok = pcall(silly.gctune, {mode = "fast"})
+	testaux.asserteq(ok, false, "Test 2.8: unknown mode is rejected")
+	ok = pcall(silly.gctune, {idle = -1})
+	testaux.asserteq(ok, false, "Test 2.9: negative value is rejected")
+	testaux.asserteq(silly.gctune(), conf, "Test 2.10: rejected tune changes nothing")
+end)
+
+testaux.case("Test 3: steps run while the worker is idle", function()
+	for _, mode in ipairs({"incremental", "generational"}) do
+		silly.gctune {mode = mode}
+		local _, steps, _, ns = metrics.gcstat()
+		garbage(200000)
+		time.sleep(50)
+		local _, steps2, _, ns2 = metrics.gcstat()
+		testaux.assertgt(steps2, steps, "Test 3.1: " .. mode .. " idle steps taken")
+		testaux.assertgt(ns2, ns, "Test 3.2: " .. mode .. " idle time accounted")
+	end
+	silly.gctune {idle = 0}
+	time.sleep(10)
+	local _, steps = metrics.gcstat()
+	garbage(200000)
+	time.sleep(50)
+	local _, steps2 = metrics.gcstat()
+	testaux.asserteq(steps2, steps, "Test 3.3: idle = 0 disables the steps")
+end)
+
+testaux.case("Test 4: dispatch cycles are counted", function()
+	local dispatch = metrics.gcstat()
+	for _ = 1, 5 do
+		time.sleep(1)
+	end
+	testaux.assertgt(metrics.gcstat() - dispatch, 4, "Test 4.1: each wakeup is a dispatch")
+	silly.gctune {
+		mode = default.mode,
+		pause = default.pause,
+		stepmul = default.stepmul,
+		idle = default.idle,
+	}
+	testaux.asserteq(silly.gctune(), default, "Test 4.2: restored")
+end)
@@ -109,3 +109,59 @@ do
 	local threads = hive.threads()
 	testaux.asserteq(threads, 2, "Case 6: threads scaled down")
 end
+
+-- Test 7: Shared queue and statistics
+do
+	local _, before = hive.threads()
+	local slow = hive.spawn([[
+		return function()
+			os.execute ('sleep 1')
+			return "slow"
+		end
+	]])
+	local wg = waitgroup.new()
+	wg:fork(function()
+		testaux.asserteq(hive.invoke(slow), "slow", "Case 7: slow task result")
+	end)
+	local start = time.monotonic()
+	for i = 1, 3 do
+		wg:fork(function()
+			local fast = hive.spawn([[
+				return function(n) return n * 2 end
+			]])
+			testaux.asserteq(hive.invoke(fast, i), i * 2, "Case 7: fast task result")
+			testaux.assertlt(time.monotonic() - start, 500,
+				"Case 7: fast task not blocked by slow task")
+		end)
+	end
+	wg:wait()
+	local _, after = hive.threads()
+	testaux.asserteq(after.tasks - before.tasks, 4, "Case 7: tasks counted")
+	testaux.asserteq(after.queue, 0, "Case 7: queue drained")
+	testaux.asserteq(after.busy, 0, "Case 7: no busy thread")
+	testaux.assertgt(after.run_ns - before.run_ns, 1000000000 - 1,
+		"Case 7: run time counted")
+	testaux.assertle(before.wait_ns, after.wait_ns, "Case 7: wait time counted")
+end
+
+-- Test 8: Shared blob arguments and results
+do
+	local blob = require "silly.adt.blob"
+	local worker = hive.spawn([[
+		local blob = require "silly.adt.blob"
+		local hash = require "silly.crypto.hash"
+		return function(b, conf)
+			local head = b:unpack("<I4")
+			return blob.new(hash.hash("sha256", b:view())), head, #b, conf.data:sub(1, 3)
+		end
+	]])
+	local payload = string.pack("<I4", 42) .. string.rep("x", 5 * 1024 * 1024)
+	local conf = {data = blob.new("abcdef")}
+	local digest, head, size, prefix = hive.invoke(worker, blob.new(payload), conf)
+	testaux.asserteq(head, 42, "Case 8: blob readable in hive")
+	testaux.asserteq(size, #payload, "Case 8: blob size in hive")
+	testaux.asserteq(prefix, "abc", "Case 8: blob nested in table")
+	testaux.asserteq(#digest, 32, "Case 8: blob result size")
+	local hash = require "silly.crypto.hash"
+	testaux.asserteq(digest:view(), hash.hash("sha256", payload), "Case 8: blob result")
+end
@@ -478,3 +478,234 @@ testaux.case("Test 16: Repeated encode stress (luaL_Buffer stack bug)", function
 	end
 	testaux.success("Test 16.3: encode/decode roundtrip x2000 no crash")
 end)
+
+testaux.case("Test 17: Shortest float round-trip", function()
+	local cases = {
+		{0.1, "0.1"}, {0.3, "0.3"}, {1.5, "1.5"}, {-2.25, "-2.25"},
+		{1/3, "0.3333333333333333"}, {1e-7, "1e-7"}, {0.000001, "0.000001"},
+		{1e300, "1e300"}, {5e-324, "5e-324"}, {2^63, "9.223372036854776e18"},
+		{1.7976931348623157e308, "1.7976931348623157e308"},
+	}
+	for i, c in ipairs(cases) do
+		testaux.asserteq(json.encode(c[1]), c[2], "Test 17.1: format " .. c[2])
+	end
+	local bad = 0
+	for i = 1, 10000 do
+		local x = (math.random() - 0.5) * 10 ^ math.random(-300, 300)
+		local y = json.decode(json.encode(x))
+		if y ~= x then
+			bad = bad + 1
+		end
+	end
+	testaux.asserteq(bad, 0, "Test 17.2: random floats round-trip exactly")
+	local big = json.decode("[9223372036854775808]")
+	testaux.asserteq(math.type(big[1]), "float", "Test 17.3: integer overflow decodes as float")
+end)
+
+testaux.case("Test 18: Long strings across SIMD blocks", function()
+	local specials = {'"', '\\', '\n', '\t', '\1', '\31', '/', '\127', '\200'}
+	for len = 0, 70 do
+		for _, ch in ipairs(specials) do
+			local s = string.rep("a", len) .. ch .. string.rep("b", 70 - len)
+			local enc = json.encode(s)
+			testaux.asserteq(json.decode(enc), s, "Test 18.1: round-trip special at " .. len)
+		end
+	end
+	local s = string.rep("x", 1000)
+	testaux.asserteq(json.encode(s), '"' .. s .. '"', "Test 18.2: plain long string")
+	local pretty = "[" .. string.rep(" ", 40) .. "1," .. string.rep("\n\t ", 20) .. "2" .. string.rep(" ", 17) .. "]"
+	local arr = json.decode(pretty)
+	testaux.asserteq(arr[1] + arr[2], 3, "Test 18.3: long whitespace runs")
+	testaux.asserteq(json.decode('"' .. string.rep("z", 40)), nil, "Test 18.4: unterminated long string")
+	testaux.asserteq(json.decode('"' .. string.rep("z", 40) .. '\1"'), nil, "Test 18.5: control char in long string")
+end)
+
+testaux.case("Test 19: Streaming decoder", function()
+	local buffer = require "silly.adt.buffer"
+	local docs = {
+		'{"a":[1,2.5,-3e2,"x\\"y\\u00e9\\ud83d\\ude00",true,false,null],"b":{"c":{}},"d":[]}',
+		'  [ {"k" : "v"} , [ [ ] ] , 12345678901234 , "' .. string.rep("s", 200) .. '" ]  ',
+		'"top level \\\\ string"',
+		'[[[[[[[[[[1]]]]]]]]]]',
+	}
+	for i, doc in ipairs(docs) do
+		local expect = json.decode(doc)
+		-- every split point, fed as two chunks
+		for cut = 0, #doc do
+			local dec = json.decoder()
+			dec:feed(doc:sub(1, cut))
+			local ok = dec:feed(doc:sub(cut + 1))
+			testaux.asserteq(ok, true, "Test 19.1: doc " .. i .. " complete after cut " .. cut)
+			testaux.asserteq(dec:finish(), expect, "Test 19.1: doc " .. i .. " cut " .. cut)
+		end
+		-- one byte at a time through silly.adt.buffer
+		local dec = json.decoder()
+		local buf = buffer.new()
+		for j = 1, #doc do
+			buf:append(doc:sub(j, j))
+			local ok, err = dec:feed(buf:readall())
+			testaux.assertneq(ok, nil, "Test 19.2: doc " .. i .. " byte " .. j .. " " .. tostring(err))
+		end
+		testaux.asserteq(dec:finish(), expect, "Test 19.2: doc " .. i .. " byte by byte")
+	end
+	-- a top level number is only complete at end of input
+	local dec = json.decoder()
+	testaux.asserteq(dec:feed("12"), false, "Test 19.3: top level number pending")
+	testaux.asserteq(dec:feed("34"), false, "Test 19.3: top level number pending")
+	testaux.asserteq(dec:finish(), 1234, "Test 19.3: top level number at finish")
+	dec = json.decoder()
+	dec:feed(" null ")
+	testaux.asserteq(dec:finish(), json.null, "Test 19.4: top level null")
+	dec = json.decoder()
+	dec:feed("false")
+	testaux.asserteq(dec:finish(), false, "Test 19.5: top level false")
+	-- errors
+	local bad = {'[1,]', '{"a" 1}', '{1:2}', '[1}', '{"a":1]', '[tru]', '["a\1"]', '[01]', '[1 2]', '}'}
+	for _, doc in ipairs(bad) do
+		dec = json.decoder()
+		local ok = dec:feed(doc)
+		testaux.asserteq(ok, nil, "Test 19.6: reject " .. doc)
+		local v, err = dec:finish()
+		testaux.asserteq(v, nil, "Test 19.6: finish after error " .. doc)
+		testaux.asserteq(err, "Invalid json", "Test 19.6: error message " .. doc)
+	end
+	dec = json.decoder()
+	dec:feed('{"a":[1')
+	local v, err = dec:finish()
+	testaux.asserteq(v, nil, "Test 19.7: truncated input")
+	testaux.asserteq(err, "Unexpected end of input", "Test 19.7: truncated input error")
+	dec = json.decoder()
+	testaux.asserteq(select(2, dec:finish()), "Empty input", "Test 19.8: empty input")
+	dec = json.decoder()
+	dec:feed("[1] ")
+	local ok, err = dec:feed("[2]")
+	testaux.asserteq(ok, nil, "Test 19.9: trailing data rejected")
+	testaux.asserteq(err, "Trailing data", "Test 19.9: trailing data error")
+	dec = json.decoder()
+	testaux.asserteq(dec:feed(string.rep("[", 129)), nil, "Test 19.10: nesting too deep")
+end)
+
+testaux.case("Test 20: Streaming encoder", function()
+	local obj = {
+		name = "silly",
+		list = {1, 2.5, "three", true, json.null, {}},
+		nested = {a = {b = {c = {"deep"}}}},
+		long = string.rep("0123456789", 1000) .. '"\n',
+	}
+	for _, chunk in ipairs({1, 7, 64, 4096, 1 << 20}) do
+		local parts = {}
+		for s in json.encoder(obj, chunk) do
+			parts[#parts + 1] = s
+		end
+		local out = table.concat(parts)
+		testaux.asserteq(json.decode(out), json.decode(json.encode(obj)), "Test 20.1: chunk " .. chunk .. " round-trip")
+		local max = 0
+		for i = 1, #parts - 1 do
+			max = math.max(max, #parts[i])
+		end
+		-- a chunk may overrun by one key or scalar, never by a long string
+		testaux.assertle(max, chunk + 64, "Test 20.2: chunk " .. chunk .. " bounded")
+	end
+	local parts = {}
+	for s in json.encoder("x") do
+		parts[#parts + 1] = s
+	end
+	testaux.asserteq(parts, {'"x"'}, "Test 20.3: scalar root")
+	testaux.asserteq(table.concat((function()
+		local t = {}
+		for s in json.encoder({}) do t[#t + 1] = s end
+		return t
+	end)()), "[]", "Test 20.4: empty table")
+	local ok, err = pcall(function()
+		for _ in json.encoder({1, 2, function() end}, 1) do end
+	end)
+	testaux.asserteq(ok, false, "Test 20.5: unsupported type raises")
+	testaux.assertcontains(tostring(err), "unsupported type", "Test 20.5: error message")
+	local deep = {}
+	local t = deep
+	for _ = 1, 200 do
+		t[1] = {}
+		t = t[1]
+	end
+	ok, err = pcall(function()
+		for _ in json.encoder(deep) do end
+	end)
+	testaux.asserteq(ok, false, "Test 20.6: nesting too deep raises")
+	testaux.assertcontains(tostring(err), "nesting too deep", "Test 20.6: error message")
+end)
+
+testaux.case("Test 21: JSON pointer get", function()
+	local doc = [==[ {"a": {"b": [10, {"c": "x"}, [true, null]], "s": "v"},
+		"a/b": 1, "m~n": 2, "esc\"key": 3, "": 4, "list": [], "big": ]==] ..
+		'"' .. string.rep("z", 100) .. '"' .. [[, "last": -1.5e3} ]]
+	testaux.asserteq(json.get(doc, "/a/b/0"), 10, "Test 21.1: array element")
+	testaux.asserteq(json.get(doc, "/a/b/1/c"), "x", "Test 21.2: nested member")
+	testaux.asserteq(json.get(doc, "/a/b/2/0"), true, "Test 21.3: nested array")
+	testaux.asserteq(json.get(doc, "/a/b/2/1"), json.null, "Test 21.4: null")
+	testaux.asserteq(json.get(doc, "/a/s"), "v", "Test 21.5: member after container")
+	testaux.asserteq(json.get(doc, "/a~1b"), 1, "Test 21.6: ~1 escape")
+	testaux.asserteq(json.get(doc, "/m~0n"), 2, "Test 21.7: ~0 escape")
+	testaux.asserteq(json.get(doc, '/esc"key'), 3, "Test 21.8: escaped key")
+	testaux.asserteq(json.get(doc, "/"), 4, "Test 21.9: empty key")
+	testaux.asserteq(json.get(doc, "/last"), -1500, "Test 21.10: last member")
+	testaux.asserteq(json.get(doc, "/a/b"), json.decode(doc).a.b, "Test 21.11: subtree")
+	testaux.asserteq(json.get(doc, ""), json.decode(doc), "Test 21.12: whole document")
+	testaux.asserteq(json.get(doc, "/missing"), nil, "Test 21.13: missing member")
+	testaux.asserteq(json.get(doc, "/a/b/3"), nil, "Test 21.14: index out of range")
+	testaux.asserteq(json.get(doc, "/a/b/01"), nil, "Test 21.15: leading zero")
+	testaux.asserteq(json.get(doc, "/a/b/-"), nil, "Test 21.16: past the end")
+	testaux.asserteq(json.get(doc, "/list/0"), nil, "Test 21.17: empty array")
+	testaux.asserteq(json.get(doc, "/a/s/x"), nil, "Test 21.18: step into scalar")
+	local v, err = json.get('{"a": [1, 2', "/a/1")
+	testaux.asserteq(v, 2, "Test 21.19: unread tail is not validated")
+	v, err = json.get('{"a": [1 2]}', "/a/1")
+	testaux.asserteq(err, "Invalid json", "Test 21.20: malformed path")
+	testaux.asserteq(select(2, json.get("  ", "/a")), "Empty input", "Test 21.21: empty input")
+	testaux.assert_error(function() json.get(doc, "a") end, "Test 21.22: pointer must start with /")
+	testaux.assert_error(function() json.get(doc, "/a~2") end, "Test 21.23: invalid ~ escape")
+end)
+
+testaux.case("Test 22: Lazy decoding", function()
+	local doc = [[{"id": 7, "user": {"name": "Alice", "tags": ["a", "b", "c"]},
+		"items": [{"k": 1}, {"k": 2}, {"k": 3}], "note": "brace } in \"string\" [",
+		"empty": {}, "none": null, "bad": {"x": 1}}]]
+	local p = assert(json.lazy(doc))
+	testaux.asserteq(type(p), "userdata", "Test 22.1: proxy for container")
+	testaux.asserteq(p.id, 7, "Test 22.2: scalar member")
+	testaux.asserteq(p.user.name, "Alice", "Test 22.3: nested member")
+	testaux.asserteq(#p.user.tags, 3, "Test 22.4: array length")
+	testaux.asserteq(p.user.tags[3], "c", "Test 22.5: array element is 1-based")
+	testaux.asserteq(p.items[2].k, 2, "Test 22.6: object in array")
+	testaux.asserteq(p.note, 'brace } in "string" [', "Test 22.7: brackets inside strings")
+	testaux.asserteq(p.none, json.null, "Test 22.8: null")
+	testaux.asserteq(p.missing, nil, "Test 22.9: missing key")
+	testaux.asserteq(p.user, p.user, "Test 22.10: child proxy is cached")
+	local keys = {}
+	for k, v in pairs(p.user) do
+		keys[#keys + 1] = k
+	end
+	table.sort(keys)
+	testaux.asserteq(keys, {"name", "tags"}, "Test 22.11: pairs over object")
+	local sum = 0
+	for i, it in pairs(p.items) do
+		sum = sum + i * it.k
+	end
+	testaux.asserteq(sum, 14, "Test 22.12: pairs over array")
+	testaux.asserteq(json.materialize(p), json.decode(doc), "Test 22.13: materialize whole")
+	testaux.asserteq(json.materialize(p.items), json.decode(doc).items, "Test 22.14: materialize subtree")
+	testaux.asserteq(json.materialize(5), 5, "Test 22.15: materialize plain value")
+	testaux.assert_error(function() p.id = 1 end, "Test 22.16: proxy is read-only")
+	testaux.asserteq(json.lazy("42"), 42, "Test 22.17: scalar root")
+	testaux.asserteq(select(2, json.lazy("[1, 2")), "Invalid json", "Test 22.18: unbalanced")
+	testaux.asserteq(select(2, json.lazy("[1}")), "Invalid json", "Test 22.19: mismatched close")
+	testaux.asserteq(select(2, json.lazy('["abc]')), "Invalid json", "Test 22.20: unterminated string")
+	testaux.asserteq(select(2, json.lazy(string.rep("[", 200) .. string.rep("]", 200))), "nesting too deep", "Test 22.21: nesting too deep")
+	-- values are only validated when read
+	local q = assert(json.lazy('{"ok": 1, "bad": [1 2]}'))
+	testaux.asserteq(q.ok, 1, "Test 22.22: untouched subtree is not parsed")
+	testaux.assert_error(function() return q.bad[1] end, "Test 22.23: malformed subtree raises on access")
+	-- the proxy keeps the source alive
+	local r = json.lazy(json.encode({list = {1, 2, 3}}))
+	collectgarbage()
+	testaux.asserteq(r.list[2], 2, "Test 22.24: source survives gc")
+end)
@@ -0,0 +1,201 @@
+local logger = require "silly.logger"
+local decode = require "silly.logger.decode"
+local json = require "silly.encoding.json"
+local time = require "silly.time"
+local metrics = require "silly.metrics.c"
+local testaux = require "test.testaux"
+
+testaux.case("Test 1: lines reach the fd through the writer thread", function()
+	local written, _, _, _, flushes = metrics.logstat()
+	for i = 1, 1000 do
+		logger.info("testlog line", i)
+	end
+	time.sleep(300)
+	local written2, dropped, _, _, flushes2, flush_ns = metrics.logstat()
+	testaux.assertgt(written2 - written, 1000 * #"testlog line 1000",
+		"Test 1.1: burst is written")
+	testaux.assertgt(flushes2, flushes, "Test 1.2: flushes are counted")
+	testaux.assertgt(flush_ns, 0, "Test 1.3: flush time is counted")
+	testaux.asserteq(dropped, 0, "Test 1.4: block policy drops nothing")
+end)
+
+testaux.case("Test 2: a burst larger than the ring", function()
+	local written = metrics.logstat()
+	local line = string.rep("x", 1000)
+	for _ = 1, 2000 do
+		logger.info(line)
+	end
+	time.sleep(300)
+	local written2, dropped = metrics.logstat()
+	testaux.assertgt(written2 - written, 2000 * 1000, "Test 2.1: every line is written")
+	testaux.asserteq(dropped, 0, "Test 2.2: nothing dropped")
+	local _, _, _, _, _, _, max = metrics.logstat()
+	testaux.asserteq(max, 0, "Test 2.3: max flush time resets on read")
+end)
+
+local script = [[
+local silly = require "silly"
+local logger = require "silly.logger"
+print("plain")
+logger.info("args", 1, -2, 2.5, true, false, nil, {a = 1}, "s")
+logger.infof("x=%s y=%s 100%%", 7, "s")
+logger.debug("hidden")
+logger.error(string.rep("z", 3000))
+silly.exit(0)
+]]
+
+local function run(path, format)
+	local f = io.popen("./silly " .. path .. " --log-format=" .. format .. " 2>/dev/null")
+	local out = f:read("a")
+	f:close()
+	return out
+end
+
+-- lines of the script, without the time and trace columns
+local function script_lines(text, path)
+	local lines = {}
+	for line in text:gmatch("[^\n]*\n") do
+		if line:find(path, 1, true) then
+			lines[#lines + 1] = line:sub(38)
+		end
+	end
+	return lines
+end
+
+testaux.case("Test 3: binary records render like the text format", function()
+	local tmp = os.tmpname()
+	local path = tmp .. ".lua"
+	local f = assert(io.open(path, "w"))
+	f:write(script)
+	f:close()
+	local text = run(path, "text")
+	local bin = run(path, "binary")
+	os.remove(path)
+	os.remove(tmp)
+	local buf = {}
+	local recs = {}
+	local pos, rec = 1, nil
+	while true do
+		rec, pos = decode.decode(bin, pos, true)
+		if not rec then
+			break
+		end
+		buf[#buf + 1] = decode.text(rec)
+		if rec.level then
+			recs[#recs + 1] = rec
+		end
+	end
+	testaux.assertgt(#recs, 3, "Test 3.1: records are decoded")
+	testaux.asserteq(pos, #bin + 1, "Test 3.2: every byte is decoded")
+	local rendered = table.concat(buf)
+	testaux.assertneq(rendered:find("\nplain\n", 1, true) or rendered:find("^plain\n"), nil,
+		"Test 3.3: print() passes through")
+	local want = script_lines(text, path)
+	testaux.asserteq(#want, 3, "Test 3.4: text mode lines")
+	testaux.asserteq(script_lines(rendered, path), want, "Test 3.5: same text as text mode")
+	testaux.assertneq(rendered:find("exit, leak memory size:", 1, true), nil,
+		"Test 3.6: C lines are records too")
+	local first = recs[1]
+	local obj = json.decode(decode.json(first))
+	testaux.asserteq(obj.level, "I", "Test 3.7: json level")
+	testaux.asserteq(obj.ts, first.time, "Test 3.8: json timestamp")
+end)
+
+testaux.case("Test 4: per call site rate limiting", function()
+	logger.ratelimit(0.01, 5)
+	local allowed = 0
+	for _ = 1, 20 do
+		if logger.allow("testlog.key") then
+			allowed = allowed + 1
+		end
+	end
+	testaux.asserteq(allowed, 5, "Test 4.1: a key passes its burst")
+	testaux.asserteq(logger.suppressed()["testlog.key"], 15, "Test 4.2: the rest is counted")
+	local line
+	local written = metrics.logstat()
+	for _ = 1, 20 do
+		line = debug.getinfo(1, "l").currentline + 1
+		logger.error("testlog limited")
+	end
+	local site = "test/testlog.lua:" .. line
+	testaux.asserteq(logger.suppressed()[site], 15, "Test 4.3: keyed by the call site")
+	local other = debug.getinfo(1, "l").currentline + 1
+	logger.warn("testlog other site")
+	testaux.asserteq(logger.suppressed()["test/testlog.lua:" .. other], nil,
+		"Test 4.4: other sites keep their own bucket")
+	require("silly.logger.c").report()
+	time.sleep(300)
+	local written2 = metrics.logstat()
+	testaux.assertgt(written2 - written, 6 * #"testlog limited" + #"suppressed 15 messages",
+		"Test 4.5: summary is written")
+	logger.ratelimit(0)
+	testaux.asserteq(logger.allow("testlog.key"), true, "Test 4.6: rate 0 turns limiting off")
+	testaux.asserteq(logger.suppressed()[site], 15, "Test 4.7: totals survive")
+end)
+
+local rotate_script = [[
+local silly = require "silly"
+local logger = require "silly.logger"
+local time = require "silly.time"
+local line = string.rep("r", 200)
+for round = 1, 4 do
+	for i = 1, 200 do
+		logger.info(line, round, i)
+	end
+	time.sleep(100)
+end
+silly.exit(0)
+]]
+
+testaux.case("Test 5: rotation by size keeps the newest compressed segments", function()
+	local dir = os.tmpname()
+	os.remove(dir)
+	assert(os.execute("mkdir -p " .. dir))
+	local script = dir .. "/app.lua"
+	local f = assert(io.open(script, "w"))
+	f:write(rotate_script)
+	f:close()
+	local log = dir .. "/app.log"
+	local pidfile = dir .. "/app.pid"
+	os.execute("./silly " .. script .. " --daemon --log-path=" .. log ..
+		" --pid-file=" .. pidfile .. " --log-rotate-size=20K" ..
+		" --log-rotate-keep=2 --log-rotate-compress=gzip")
+	local pid
+	for _ = 1, 50 do
+		local pf = io.open(pidfile)
+		pid = pf and pf:read("n")
+		if pf then
+			pf:close()
+		end
+		if pid then
+			break
+		end
+		time.sleep(100)
+	end
+	testaux.assertneq(pid, nil, "Test 5.1: daemon started")
+	for _ = 1, 100 do
+		if not os.execute("kill -0 " .. pid .. " 2>/dev/null") then
+			break
+		end
+		time.sleep(100)
+	end
+	local segs = {}
+	local ls = io.popen("ls " .. dir)
+	for name in ls:lines() do
+		if name:find("^app%.log%.") then
+			segs[#segs + 1] = name
+		end
+	end
+	ls:close()
+	table.sort(segs)
+	testaux.asserteq(#segs, 2, "Test 5.2: only 'keep' segments remain")
+	for _, name in ipairs(segs) do
+		testaux.assertneq(name:match("^app%.log%.%d+%.gz$"), nil,
+			"Test 5.3: segment is numbered and compressed")
+		local gz<close> = assert(io.open(dir .. "/" .. name, "rb"))
+		testaux.asserteq(gz:read(2), "\x1f\x8b", "Test 5.4: gzip magic")
+	end
+	local cur<close> = io.open(log)
+	testaux.assertneq(cur, nil, "Test 5.5: log file is reopened after rotating")
+	os.execute("rm -rf " .. dir)
+end)
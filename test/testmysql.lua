@@ -1470,3 +1470,82 @@ do
 	pool:query("DROP TABLE IF EXISTS test_autorollback")
 	pool:close()
 end
+
+-- Test 42: test pipelined execute on one connection
+do
+	local pool = mysql.open {
+		addr = "127.0.0.1:3306",
+		user = "root",
+		password = "root",
+		database = "test",
+		max_idle_conns = 1,
+		max_open_conns = 1,
+	}
+	local res, err = pool:pipeline {
+		{"SELECT ? AS v", 1},
+		{"SELECT * FROM non_existent_table"},
+		{"SELECT ? AS v", 3},
+		table.pack("SELECT ? AS v", nil),
+	}
+	testaux.assertneq(res, nil, "Test 42.1: Should pipeline requests")
+	assert(res)
+	testaux.asserteq(res[1][1].v, 1, "Test 42.2: First result")
+	testaux.asserteq(res[3], nil, "Test 42.3: Failed prepare has no result")
+	testaux.asserteq(res[4].message:find("doesn't exist") ~= nil, true, "Test 42.4: Failed prepare returns error")
+	testaux.asserteq(res[5][1].v, 3, "Test 42.5: Third result")
+	testaux.asserteq(res[7][1].v, nil, "Test 42.6: NULL parameter")
+	res, err = pool:query("SELECT ? AS v", 5)
+	testaux.asserteq(res and res[1].v, 5, "Test 42.7: Connection is usable after pipeline")
+	pool:close()
+end
+
+-- Test 43: test min_idle_conns warm up and statement replay
+do
+	local pool = mysql.open {
+		addr = "127.0.0.1:3306",
+		user = "root",
+		password = "root",
+		database = "test",
+		min_idle_conns = 2,
+		max_open_conns = 4,
+	}
+	time.sleep(500)
+	testaux.asserteq(#pool.conns_idle, 2, "Test 43.1: Should warm up min_idle_conns")
+	local res, err = pool:query("SELECT ? AS v", 1)
+	testaux.asserteq(res and res[1].v, 1, "Test 43.2: Query on warm connection")
+	-- drop one connection, the warm task should reopen it with the hot statement
+	local conn = table.remove(pool.conns_idle)
+	conn.is_broken = true
+	conn:close()
+	time.sleep(1500)
+	testaux.asserteq(#pool.conns_idle, 2, "Test 43.3: Should refill min_idle_conns")
+	local warm = pool.conns_idle[#pool.conns_idle]
+	testaux.assertneq(warm.stmt_cache["SELECT ? AS v"], nil, "Test 43.4: Hot statement prepared on new connection")
+	pool:close()
+end
+
+-- Test 44: test pool stats
+do
+	local pool = mysql.open {
+		addr = "127.0.0.1:3306",
+		user = "root",
+		password = "root",
+		max_idle_conns = 1,
+		max_open_conns = 1,
+	}
+	local wg = wg.new()
+	for i = 1, 3 do
+		wg:fork(function()
+			pool:query("SELECT SLEEP(0.1)")
+		end)
+	end
+	wg:wait()
+	local st = pool:stats()
+	testaux.asserteq(st.max_open_conns, 1, "Test 44.1: max_open_conns")
+	testaux.asserteq(st.open_conns, 1, "Test 44.2: open_conns")
+	testaux.asserteq(st.idle, 1, "Test 44.3: idle")
+	testaux.asserteq(st.in_use, 0, "Test 44.4: in_use")
+	testaux.asserteq(st.wait_count, 2, "Test 44.5: wait_count")
+	testaux.asserteq(st.wait_duration >= 100, true, "Test 44.6: wait_duration")
+	pool:close()
+end
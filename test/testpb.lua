@@ -0,0 +1,143 @@
+local pb = require "pb"
+local protoc = require "protoc"
+local testaux = require "test.testaux"
+
+local schema = [[
+syntax = "proto3";
+
+package testpb;
+
+enum Color {
+  RED = 0;
+  GREEN = 1;
+  BLUE = 2;
+}
+
+message Point {
+  int32 x = 1;
+  int32 y = 2;
+}
+
+message Node {
+  string name = 1;
+  repeated Node children = 2;
+}
+
+message Item {
+  int64 id = 1;
+  string name = 2;
+  double price = 3;
+  bool active = 4;
+  Color color = 5;
+  bytes blob = 6;
+  Point pos = 7;
+  repeated int32 counts = 8;
+  repeated string tags = 9;
+  repeated Point path = 10;
+  map<string, int32> attrs = 11;
+  map<string, Point> marks = 12;
+  oneof extra {
+    string note = 13;
+    int32 code = 14;
+  }
+  sint64 delta = 15;
+  fixed32 crc = 16;
+  Node tree = 100;
+  uint32 big = 5000;
+}
+]]
+
+local item = {
+	id = 1234567890123,
+	name = "widget",
+	price = 9.75,
+	active = true,
+	color = "BLUE",
+	blob = "\0\1\2\255",
+	pos = {x = 3, y = -4},
+	counts = {1, 2, 300, -5},
+	tags = {"a", "bb", "ccc"},
+	path = {{x = 1, y = 2}, {x = 0, y = 0}, {x = -7, y = 8}},
+	attrs = {hp = 100, mp = 0},
+	marks = {home = {x = 10, y = 20}, origin = {x = 0, y = 0}},
+	note = "hello",
+	delta = -42,
+	crc = 0xdeadbeef,
+	tree = {name = "root", children = {
+		{name = "a", children = {{name = "a1"}}},
+		{name = "b"},
+	}},
+	big = 7,
+}
+
+testaux.case("Test 1: compiled codec matches interpreter", function()
+	-- plain pb.load leaves the types uncompiled
+	local p = protoc.new()
+	assert(pb.load(p:compile(schema)))
+	local data = pb.encode("testpb.Item", item)
+	local want = pb.decode("testpb.Item", data)
+	testaux.asserteq(want.extra, "note", "Test 1.1: interpreter records oneof")
+
+	local n = pb.compile()
+	testaux.assertgt(n, 0, "Test 1.2: compile all message types")
+	local got = pb.decode("testpb.Item", data)
+	testaux.asserteq(got, want, "Test 1.3: compiled decode equals interpreter")
+	local data2 = pb.encode("testpb.Item", item)
+	testaux.asserteq(#data2, #data, "Test 1.4: compiled encode has same size")
+	testaux.asserteq(pb.decode("testpb.Item", data2), want,
+		"Test 1.5: compiled encode round trip")
+
+	local codec = pb.compile("testpb.Item")
+	testaux.asserteq(codec:type(), ".testpb.Item", "Test 1.6: codec type name")
+	testaux.asserteq(codec:decode(data), want, "Test 1.7: codec:decode")
+	testaux.asserteq(codec:decode(codec:encode(item)), want, "Test 1.8: codec:encode")
+	testaux.asserteq(pb.compile("testpb.Item"), codec, "Test 1.9: codec is cached")
+end)
+
+testaux.case("Test 2: proto3 zero values and unknown fields", function()
+	local codec = pb.compile("testpb.Item")
+	local data = codec:encode({id = 0, name = "", active = false, pos = {}, counts = {}})
+	testaux.asserteq(data, "\58\0", "Test 2.1: zero scalars skipped, empty message kept")
+	local obj = codec:decode("")
+	testaux.asserteq(obj.id, 0, "Test 2.2: proto3 default filled")
+	testaux.asserteq(obj.name, "", "Test 2.3: proto3 default string")
+	-- field 3 of Point is unknown and must be skipped
+	local pt = pb.compile("testpb.Point"):decode("\8\1\24\99\16\2")
+	testaux.asserteq(pt, {x = 1, y = 2}, "Test 2.4: unknown field skipped")
+	local ok = pcall(codec.decode, codec, "\10\5ab")
+	testaux.asserteq(ok, false, "Test 2.5: truncated input raises error")
+end)
+
+testaux.case("Test 3: index layout", function()
+	local codec = pb.compile("testpb.Point", "index")
+	testaux.asserteq(codec:decode(pb.encode("testpb.Point", {x = 5, y = 6})), {5, 6},
+		"Test 3.1: fields keyed by position")
+	testaux.asserteq(pb.decode("testpb.Point", codec:encode({7, 8})), {x = 7, y = 8},
+		"Test 3.2: encode from positional table")
+	local node = pb.compile("testpb.Node", "index")
+	local obj = node:decode(pb.encode("testpb.Node",
+		{name = "r", children = {{name = "c"}}}))
+	testaux.asserteq(obj, {"r", {{"c"}}}, "Test 3.3: nested messages use index layout")
+end)
+
+testaux.case("Test 4: schema changes invalidate codecs", function()
+	local codec = pb.compile("testpb.Point")
+	local p = protoc.new()
+	p:load([[
+syntax = "proto3";
+package testpb2;
+message Pair { int32 a = 1; }
+]])
+	testaux.assert_error(function()
+		codec:decode("")
+	end, "Test 4.1: outdated codec raises error")
+	local again = pb.compile("testpb.Point")
+	testaux.assertneq(again, codec, "Test 4.2: recompiled after load")
+	testaux.asserteq(pb.decode("testpb2.Pair", "\8\9").a, 9, "Test 4.3: protoc load compiles")
+	pb.option("enable_hooks")
+	pb.hook("testpb.Point", function(t) t.hooked = true return t end)
+	testaux.asserteq(pb.decode("testpb.Point", "\8\1").hooked, true,
+		"Test 4.4: hooks bypass the compiled codec")
+	pb.hook("testpb.Point", nil)
+	pb.option("disable_hooks")
+end)
@@ -0,0 +1,115 @@
+local perf = require "silly.perf"
+local task = require "silly.task"
+local time = require "silly.time"
+local testaux = require "test.testaux"
+
+local function burn_cpu(ms)
+	local x = 0
+	local stop = os.clock() + ms / 1000
+	while os.clock() < stop do
+		for i = 1, 1000 do
+			x = x + i % 7
+		end
+	end
+	return x
+end
+
+local function count(folded, pattern)
+	local n = 0
+	for line in folded:gmatch("[^\n]+") do
+		local stack, c = line:match("^(.*) (%d+)$")
+		testaux.assertneq(stack, nil, "folded line has a count")
+		if stack:find(pattern, 1, true) then
+			n = n + tonumber(c)
+		end
+	end
+	return n
+end
+
+testaux.case("Test 1: start arguments", function()
+	testaux.assertneq(perf.samplestart(0), nil, "Test 1.1: zero hz is rejected")
+	testaux.assertneq(perf.samplestart(100000), nil, "Test 1.2: too high hz is rejected")
+	testaux.asserteq(perf.samplestart(199), nil, "Test 1.3: start")
+	testaux.assertneq(perf.samplestart(199), nil, "Test 1.4: second start is rejected")
+	perf.samplestop()
+	perf.sampledump(true)
+end)
+
+testaux.case("Test 2: samples carry the Lua stack", function()
+	testaux.asserteq(perf.samplestart(499), nil, "Test 2.1: start")
+	burn_cpu(400)
+	perf.samplestop()
+	local st = perf.samplestat()
+	testaux.assertgt(st.samples, 0, "Test 2.2: samples taken")
+	testaux.asserteq(st.ticks, st.samples + st.native + st.skipped,
+		"Test 2.3: every tick is accounted")
+	local folded = perf.sampledump(true)
+	testaux.assertgt(count(folded, "worker_dispatch;"), 0, "Test 2.4: rooted at the dispatch loop")
+	testaux.assertgt(count(folded, "burn_cpu (test/testperf.lua:6)"), 0,
+		"Test 2.5: hot function appears in the stacks")
+	testaux.asserteq(perf.sampledump(), "", "Test 2.6: reset clears the stacks")
+	testaux.asserteq(perf.samplestat().samples, 0, "Test 2.7: reset clears the counters")
+end)
+
+testaux.case("Test 3: coroutine stacks", function()
+	testaux.asserteq(perf.samplestart(499), nil, "Test 3.1: start")
+	local done = false
+	task.fork(function()
+		burn_cpu(300)
+		done = true
+	end)
+	while not done do
+		time.sleep(10)
+	end
+	perf.samplestop()
+	local folded = perf.sampledump(true)
+	testaux.assertgt(count(folded, "burn_cpu"), 0, "Test 3.2: forked task is sampled")
+	burn_cpu(100)
+	testaux.asserteq(perf.sampledump(), "", "Test 3.3: no samples after stop")
+end)
+
+local keep = {}
+
+local function make_garbage(n)
+	local x
+	for i = 1, n do
+		x = {i, tostring(i)}
+	end
+	return x
+end
+
+local function make_live(n)
+	for i = 1, n do
+		keep[i] = {i, i * 2, i * 3}
+	end
+end
+
+testaux.case("Test 4: allocation profiler", function()
+	testaux.assertneq(perf.allocstart(0), nil, "Test 4.1: zero rate is rejected")
+	testaux.asserteq(perf.allocstart(16 * 1024), nil, "Test 4.2: start")
+	testaux.assertneq(perf.allocstart(), nil, "Test 4.3: second start is rejected")
+	make_garbage(50000)
+	make_live(20000)
+	local st = perf.allocstat()
+	testaux.assertgt(st.samples, 0, "Test 4.4: allocations sampled")
+	testaux.assertgt(st.live, 0, "Test 4.5: sampled objects still alive")
+	local bytes = perf.allocdump("bytes")
+	testaux.assertgt(count(bytes, "make_garbage (test/testperf.lua:"), 0,
+		"Test 4.6: garbage producer has allocated bytes")
+	local live = perf.allocdump("live")
+	testaux.assertgt(count(live, "make_live (test/testperf.lua:"), 0,
+		"Test 4.7: live objects are attributed")
+	keep = {}
+	collectgarbage("collect")
+	collectgarbage("collect")
+	testaux.asserteq(count(perf.allocdump("live"), "make_live"), 0,
+		"Test 4.8: freed objects leave the live view")
+	perf.allocdump("bytes", true)
+	testaux.asserteq(count(perf.allocdump("bytes"), "make_garbage"), 0,
+		"Test 4.9: reset clears the totals")
+	perf.allocstop()
+	st = perf.allocstat()
+	testaux.asserteq(st.live, 0, "Test 4.10: stop drops the live view")
+	make_garbage(10000)
+	testaux.asserteq(perf.allocstat().samples, st.samples, "Test 4.11: no samples after stop")
+end)
@@ -498,5 +498,347 @@ testaux.case("Test 20: Prometheus format_count trailing comma bug", function()
 	end
 end)
 
-silly.exit(0)
+-- Test 21: C metrics read back through the collector interface
+testaux.case("Test 21: Native metrics", function()
+	local native = require "silly.metrics.native"
+	local hits = native.counter("native_hits_total", "Native hits", {"method", "code"})
+	local get = hits:labels("GET", 200)
+	for _ = 1, 10 do
+		get:inc()
+	end
+	hits:labels("POST", 500):add(2.5)
+	testaux.asserteq(hits:labels("GET", "200") ~= nil, true, "Test 21.1: labels resolve again")
+	local conns = native.gauge("native_conns", "Native connections")
+	conns:set(7)
+	conns:dec()
+	conns:sub(2)
+	local lat = native.histogram("native_latency", "Native latency", nil, {1, 0.1, 0.5})
+	lat:observe(0.05)
+	lat:observe(0.5)
+	lat:observe(3)
+
+	local buf = {}
+	native:collect(buf)
+	local got = {}
+	for _, m in ipairs(buf) do
+		got[m.name] = m
+	end
+	local m = got.native_hits_total
+	testaux.asserteq(m.kind, "counter", "Test 21.2: counter kind")
+	testaux.asserteq(m.metrics['method="GET",code="200"'].value, 10, "Test 21.3: GET count")
+	testaux.asserteq(m.metrics['method="POST",code="500"'].value, 2.5, "Test 21.4: POST value")
+	testaux.asserteq(got.native_conns.value, 4, "Test 21.5: gauge value")
+	local h = got.native_latency
+	testaux.asserteq(h.buckets[1], 0.1, "Test 21.6: buckets are sorted")
+	testaux.asserteq(h.bucketcounts[1], 1, "Test 21.7: <=0.1")
+	testaux.asserteq(h.bucketcounts[2], 1, "Test 21.8: <=0.5 includes the bound")
+	testaux.asserteq(h.bucketcounts[3], 0, "Test 21.9: <=1")
+	testaux.asserteq(h.count, 3, "Test 21.10: count")
+	testaux.asserteq(h.sum, 3.55, "Test 21.11: sum")
+
+	local ok = pcall(hits.inc, hits)
+	testaux.asserteq(ok, false, "Test 21.12: labeled family needs labels()")
+	ok = pcall(hits.labels, hits, "GET")
+	testaux.asserteq(ok, false, "Test 21.13: label count is checked")
+	ok = pcall(get.add, get, -1)
+	testaux.asserteq(ok, false, "Test 21.14: counter can only increase")
+	ok = pcall(native.gauge, "native_hits_total", "again")
+	testaux.asserteq(ok, false, "Test 21.15: same name, other type")
+	local again = native.counter("native_hits_total", "again", {"method", "code"})
+	again:labels("GET", "200"):inc()
+	buf = {}
+	native:collect(buf)
+	for _, x in ipairs(buf) do
+		if x.name == "native_hits_total" then
+			m = x
+		end
+	end
+	testaux.asserteq(m.metrics['method="GET",code="200"'].value, 11,
+		"Test 21.16: same layout shares the family")
+end)
+
+-- Test 22: hive workers record into the same series
+testaux.case("Test 22: Native metrics from hive workers", function()
+	local hive = require "silly.hive"
+	local native = require "silly.metrics.native"
+	local prometheus = require "silly.metrics.prometheus"
+	local code = [[
+		local native = require "silly.metrics.native"
+		local jobs = native.counter("native_jobs_total", "Jobs", {"kind"}):labels("hive")
+		return function(n)
+			for _ = 1, n do
+				jobs:inc()
+			end
+			return n
+		end
+	]]
+	local jobs = native.counter("native_jobs_total", "Jobs", {"kind"}):labels("hive")
+	local w1 = hive.spawn(code)
+	local w2 = hive.spawn(code)
+	local done = 0
+	local wg = require("silly.sync.waitgroup").new()
+	for _, w in ipairs({w1, w2}) do
+		wg:fork(function()
+			local n = hive.invoke(w, 10000)
+			done = done + n
+		end)
+	end
+	for _ = 1, 10000 do
+		jobs:inc()
+	end
+	wg:wait()
+	testaux.asserteq(done, 20000, "Test 22.1: workers finished")
+	local text = prometheus.gather()
+	testaux.assertneq(text:find('native_jobs_total{kind="hive"} 30000\n', 1, true), nil,
+		"Test 22.2: every thread's increments are exported")
+end)
+
+-- Test 23: exposition written by the C writer
+testaux.case("Test 23: Exposition format", function()
+	local prometheus = require "silly.metrics.prometheus"
+	local native = require "silly.metrics.native"
+	local r = registry.new()
+	local c = counter("expo_requests_total", "Requests \\ \"all\"\nkinds", {"code"})
+	c:labels("200"):add(3)
+	local h = histogram("expo_latency", "Latency", nil, {0.1, 1, 5})
+	h:observe(0.0625)
+	h:observe(0.5)
+	h:observe(0.75)
+	h:observe(10)
+	local g = gauge("expo_ratio", "Ratio")
+	g:set(0.1)
+	local nh = native.histogram("expo_native_seconds", "Native", nil, {1, 2})
+	nh:observe(0.5)
+	nh:observe(1.5)
+	nh:observe(3)
+	r:register(c)
+	r:register(h)
+	r:register(g)
+	r:register(native)
+
+	local text = prometheus.gather(r)
+	local function has(s, msg)
+		testaux.assertneq(text:find(s, 1, true), nil, msg)
+	end
+	has('expo_requests_total{code="200"} 3\n', "Test 23.1: space before the value")
+	has('# HELP expo_requests_total Requests \\\\ "all"\\nkinds\n', "Test 23.2: HELP escaping")
+	has('expo_latency_bucket{le="0.1"} 1\n', "Test 23.3: first bucket")
+	has('expo_latency_bucket{le="1.0"} 3\n', "Test 23.4: buckets are cumulative")
+	has('expo_latency_bucket{le="5.0"} 3\n', "Test 23.5: buckets are cumulative")
+	has('expo_latency_bucket{le="+Inf"} 4\n', "Test 23.6: +Inf equals count")
+	has('expo_latency_count 4\n', "Test 23.7: count")
+	has('expo_latency_sum 11.3125\n', "Test 23.8: sum")
+	has('expo_ratio 0.1\n', "Test 23.9: shortest round-trip double")
+	has('expo_native_seconds_bucket{le="2.0"} 2\n', "Test 23.10: native buckets are cumulative")
+	has('expo_native_seconds_bucket{le="+Inf"} 3\n', "Test 23.11: native +Inf")
+	testaux.asserteq(text:find("# EOF", 1, true), nil, "Test 23.12: no EOF in text format")
+
+	local om = prometheus.gather(r, "openmetrics")
+	testaux.assertneq(om:find('# TYPE expo_requests counter\n', 1, true), nil,
+		"Test 23.13: OpenMetrics counter family drops _total")
+	testaux.assertneq(om:find('expo_requests_total{code="200"} 3\n', 1, true), nil,
+		"Test 23.14: OpenMetrics counter sample keeps _total")
+	testaux.assertneq(om:find('\\"all\\"', 1, true), nil,
+		"Test 23.15: OpenMetrics escapes quotes in HELP")
+	testaux.asserteq(om:sub(-6), "# EOF\n", "Test 23.16: OpenMetrics ends with EOF")
+end)
+
+-- Test 24: scrape over http, streamed in chunks and gzip encoded
+testaux.case("Test 24: Streaming respond", function()
+	local http = require "silly.net.http"
+	local prometheus = require "silly.metrics.prometheus"
+	local r = registry.new()
+	local c = counter("expo_stream_total", "Many series", {"id"})
+	for i = 1, 5000 do
+		c:labels(tostring(i)):add(i)
+	end
+	r:register(c)
+	local server = http.listen {
+		addr = "127.0.0.1:8093",
+		handler = function(stream)
+			prometheus.respond(stream, r)
+		end
+	}
+	local httpc = http.newclient()
+	local plain = httpc:get("http://127.0.0.1:8093/metrics", {
+		["accept-encoding"] = "identity",
+	})
+	testaux.assertneq(plain, nil, "Test 24.1: plain scrape")
+	testaux.asserteq(plain.header["content-type"], "text/plain; version=0.0.4; charset=utf-8",
+		"Test 24.2: text format content type")
+	testaux.asserteq(plain.body, prometheus.gather(r), "Test 24.3: streamed body equals gather")
+	testaux.assertgt(#plain.body, 128 * 1024, "Test 24.4: body spans several chunks")
+
+	local om = httpc:get("http://127.0.0.1:8093/metrics", {
+		["accept"] = "application/openmetrics-text;version=1.0.0,text/plain;q=0.5",
+		["accept-encoding"] = "gzip",
+	})
+	testaux.assertneq(om, nil, "Test 24.5: gzip scrape")
+	testaux.asserteq(om.header["content-encoding"], "gzip", "Test 24.6: gzip encoded")
+	testaux.asserteq(om.body, prometheus.gather(r, "openmetrics"),
+		"Test 24.7: gzip body inflates to the OpenMetrics text")
+	server:close()
+end)
+
+-- Test 25: log-linear histogram, quantiles and snapshots
+testaux.case("Test 25: Native loghistogram", function()
+	local native = require "silly.metrics.native"
+	local prometheus = require "silly.metrics.prometheus"
+	local h = native.loghistogram("loghist_test_seconds", "Loghist", nil, {
+		min = 0.001, max = 10, precision = 4,
+	})
+	for i = 1, 1000 do
+		h:observe(i / 1000)
+	end
+	local snap = h:snapshot()
+	testaux.asserteq(snap:count(), 1000, "Test 25.1: snapshot count")
+	testaux.asserteq(snap:sum(), 500.5, "Test 25.2: snapshot sum")
+	-- a bucket spans 1/2^precision of its power of two
+	local function near(v, want, msg, precision)
+		local err = 1 / 2 ^ (precision or 4)
+		testaux.assertlt(math.abs(v - want) / want, err, msg)
+	end
+	near(snap:quantile(0.5), 0.5, "Test 25.3: p50 within the bucket precision")
+	near(snap:quantile(0.99), 0.99, "Test 25.4: p99 within the bucket precision")
+	near(snap:quantile(0.999), 0.999, "Test 25.5: p999 within the bucket precision")
+
+	-- bounds are upper inclusive: 0.5 is the bound of its bucket
+	local text = prometheus.gather()
+	testaux.assertneq(text:find('loghist_test_seconds_bucket{le="0.5"} 500\n', 1, true), nil,
+		"Test 25.6: classic export is cumulative at the log-linear bounds")
+	testaux.assertneq(text:find('loghist_test_seconds_bucket{le="+Inf"} 1000\n', 1, true), nil,
+		"Test 25.7: +Inf equals count")
+	testaux.asserteq(text:find('loghist_test_seconds_bucket{le="20', 1, true), nil,
+		"Test 25.8: empty buckets are left out")
+
+	-- snapshots of series with the same layout merge
+	local v = native.loghistogram("loghist_test_merge", "Merge", {"op"})
+	local get, put = v:labels("get"), v:labels("put")
+	for _ = 1, 90 do
+		get:observe(0.001)
+	end
+	for _ = 1, 10 do
+		put:observe(1)
+	end
+	local merged = get:snapshot():merge(put:snapshot())
+	testaux.asserteq(merged:count(), 100, "Test 25.9: merged count")
+	near(merged:quantile(0.5), 0.001, "Test 25.10: merged p50 from the fast series", 3)
+	near(merged:quantile(0.95), 1, "Test 25.11: merged p95 from the slow series", 3)
+	local other = native.histogram("loghist_test_classic", "Classic", nil, {1, 2})
+	testaux.asserteq(pcall(merged.merge, merged, other:snapshot()), false,
+		"Test 25.12: different buckets don't merge")
+
+	testaux.asserteq(pcall(native.loghistogram, "loghist_test_bad", "", nil, {precision = 20}), false,
+		"Test 25.13: precision is bounded")
+	testaux.asserteq(pcall(native.loghistogram, "loghist_test_bad", "", nil, {quantiles = {2}}), false,
+		"Test 25.14: quantiles are in [0, 1]")
+	testaux.asserteq(pcall(native.loghistogram, "loghist_test_seconds", "", nil), false,
+		"Test 25.15: same name with another layout is refused")
+end)
+
+-- Test 26: summary quantiles over a sliding window
+testaux.case("Test 26: Native loghistogram summary window", function()
+	local time = require "silly.time"
+	local native = require "silly.metrics.native"
+	local prometheus = require "silly.metrics.prometheus"
+	local h = native.loghistogram("loghist_test_rpc_seconds", "RPC", {"method"}, {
+		quantiles = {0.5, 0.99}, window = 0.5,
+	})
+	local call = h:labels("call")
+	for _ = 1, 100 do
+		call:observe(1)
+	end
+	local function quantile(text, q)
+		local pat = 'loghist_test_rpc_seconds{method="call",quantile="' .. q .. '"} (%S+)\n'
+		return tonumber(text:match(pat))
+	end
+	local text = prometheus.gather()
+	testaux.assertneq(text:find("# TYPE loghist_test_rpc_seconds summary\n", 1, true), nil,
+		"Test 26.1: exported as a summary")
+	testaux.assertlt(math.abs(quantile(text, "0.5") - 1), 0.07, "Test 26.2: p50 of the first window")
+	time.sleep(700)
+	for _ = 1, 100 do
+		call:observe(0.01)
+	end
+	text = prometheus.gather()
+	testaux.assertlt(math.abs(quantile(text, "0.99") - 0.01), 0.001,
+		"Test 26.3: older observations left the window")
+	testaux.assertneq(text:find('loghist_test_rpc_seconds_count{method="call"} 200\n', 1, true), nil,
+		"Test 26.4: _count stays cumulative")
+	local om = prometheus.gather(nil, "openmetrics")
+	testaux.assertneq(om:find('loghist_test_rpc_seconds{method="call",quantile="0.5"} ', 1, true), nil,
+		"Test 26.5: OpenMetrics summary")
+end)
 
+-- Test 27: TCP stats by listener and by remote peer
+testaux.case("Test 27: Net collector", function()
+	local tcp = require "silly.net.tcp"
+	local c = require "silly.metrics.c"
+	local net = require "silly.metrics.collector.net"
+	local time = require "silly.time"
+	local prometheus = require "silly.metrics.prometheus"
+	local test = require "test.aux.c"
+	local addr = "127.0.0.1:8094"
+	local payload = string.rep("x", 8192)
+	local listener = tcp.listen {
+		addr = addr,
+		accept = function(conn)
+			conn:read(5)
+			test.debugctrl("socket.conf", { sendv_cap = 1024 })
+			conn:write(payload)
+			conn:close()
+		end
+	}
+	local function find(kind)
+		for _, st in ipairs(c.peerstat()) do
+			if st.kind == kind and st.addr == addr then
+				return st
+			end
+		end
+	end
+	local conn = tcp.connect(addr)
+	conn:write("hello")
+	testaux.asserteq(conn:read(8192), payload, "Test 27.1: payload received")
+	conn:read(1)
+	conn:close()
+	test.debugctrl("socket.reset")
+	time.sleep(100)
+	local ls = find("listener")
+	testaux.assertneq(ls, nil, "Test 27.2: listener group")
+	testaux.asserteq(ls.opens, 1, "Test 27.3: one accept")
+	testaux.asserteq(ls.received_bytes, 5, "Test 27.4: listener received bytes")
+	testaux.asserteq(ls.sent_bytes, 8192, "Test 27.5: listener sent bytes")
+	testaux.assertgt(ls.eagain, 0, "Test 27.6: partial writes counted")
+	testaux.asserteq(ls.drains, 1, "Test 27.7: backlog drained once")
+	testaux.asserteq(ls.wlist_max, 8192, "Test 27.8: write list high-water mark")
+	testaux.asserteq(ls.closes["local"], 1, "Test 27.9: closed by the server")
+	local ps = find("peer")
+	testaux.assertneq(ps, nil, "Test 27.10: peer group")
+	testaux.asserteq(ps.opens, 1, "Test 27.11: one connect")
+	testaux.asserteq(ps.sent_bytes, 5, "Test 27.12: peer sent bytes")
+	testaux.asserteq(ps.received_bytes, 8192, "Test 27.13: peer received bytes")
+	testaux.asserteq(ps.closes.eof, 1, "Test 27.14: closed by the other side")
+	testaux.asserteq(find("listener").wlist_max, 0, "Test 27.15: high-water mark resets on read")
+
+	local text = prometheus.gather()
+	testaux.assertneq(text:find('silly_net_connections_total{kind="listener",addr="' .. addr .. '"} 1\n', 1, true), nil,
+		"Test 27.16: connections by listener")
+	testaux.assertneq(text:find('silly_net_closes_total{kind="peer",addr="' .. addr .. '",reason="eof"} 1\n', 1, true), nil,
+		"Test 27.17: closes by reason")
+	if net.tcpinfo(true) then
+		conn = tcp.connect(addr)
+		conn:write("hello")
+		conn:read(8192)
+		conn:read(1)
+		conn:close()
+		time.sleep(100)
+		testaux.assertgt(find("peer").cwnd, 0, "Test 27.18: TCP_INFO sampled on close")
+		text = prometheus.gather()
+		testaux.assertneq(text:find('silly_net_cwnd_segments{kind="peer",addr="' .. addr .. '"} ', 1, true), nil,
+			"Test 27.19: TCP_INFO exported")
+		net.tcpinfo(false)
+	end
+	listener:close()
+end)
+
+silly.exit(0)
@@ -893,4 +893,132 @@ testaux.case("Test 30: Peer FIN propagates EEOF to non-blocking read", function(
 	testaux.success("Test 30 passed")
 end)
 
+-- Test 31: Write watermarks pause and resume writers
+testaux.case("Test 31: Write watermarks pause and resume writers", function()
+	local chunk_size = 1024
+	local num_chunks = 8
+	local total_size = chunk_size * num_chunks
+	local chunks = {}
+	for i = 1, num_chunks do
+		chunks[i] = make_data(chunk_size, i * 31)
+	end
+	local expected = table.concat(chunks)
+	local cfd
+	listen_cb = function(sfd)
+		sfd:watermark(4096, 1024)
+		test.debugctrl("socket.conf", { eagain_every = 1 })
+		local done = false
+		task.fork(function()
+			for i = 1, num_chunks do
+				local ok, err = sfd:write(chunks[i])
+				testaux.asserteq(ok, true, "Test 31.1: write " .. i .. " succeeds")
+			end
+			done = true
+		end)
+		time.sleep(200)
+		testaux.asserteq(done, false, "Test 31.2: writer paused at the high mark")
+		testaux.asserteq(sfd:unsentbytes(), 4096, "Test 31.3: nothing queued past the high mark")
+		test.debugctrl("socket.reset")
+		local r1 = testaux.recv(cfd, 4096)
+		time.sleep(200)
+		testaux.asserteq(done, true, "Test 31.4: drain resumed the writer")
+		local r2 = testaux.recv(cfd, total_size - 4096)
+		testaux.asserteq(r1 .. r2, expected, "Test 31.5: Client received correct data")
+		sfd:close()
+		testaux.close(cfd)
+	end
+	cfd = testaux.connect(ip, port)
+	testaux.assertneq(cfd, nil, "Test 31.6: Connect to server")
+	wait_done()
+	testaux.success("Test 31 passed")
+end)
+
+-- Test 32: Write watermarks without waiting
+testaux.case("Test 32: Write watermarks without waiting", function()
+	local data = make_data(1024, 32)
+	local cfd
+	listen_cb = function(sfd)
+		sfd:watermark(2048, 0, true)
+		test.debugctrl("socket.conf", { eagain_every = 1 })
+		testaux.asserteq(sfd:write(data), true, "Test 32.1: below the high mark")
+		testaux.asserteq(sfd:write(data), true, "Test 32.2: write reaching the high mark is queued")
+		local ok, err = sfd:write(data)
+		testaux.asserteq(ok, false, "Test 32.3: paused write fails")
+		testaux.asserteq(err, errno.AGAIN, "Test 32.4: with EAGAIN")
+		test.debugctrl("socket.reset")
+		local received = testaux.recv(cfd, 2048)
+		testaux.asserteq(received, data .. data, "Test 32.5: paused write was not queued")
+		testaux.asserteq(sfd:drain(), true, "Test 32.6: drain returns once the low mark is reached")
+		testaux.asserteq(sfd:write(data), true, "Test 32.7: write after drain")
+		testaux.asserteq(testaux.recv(cfd, 1024), data, "Test 32.8: Client received correct data")
+		sfd:close()
+		testaux.close(cfd)
+	end
+	cfd = testaux.connect(ip, port)
+	testaux.assertneq(cfd, nil, "Test 32.9: Connect to server")
+	wait_done()
+	testaux.success("Test 32 passed")
+end)
+
+-- Test 33: Closing a paused connection wakes its writers
+testaux.case("Test 33: Closing a paused connection wakes its writers", function()
+	local data = make_data(2048, 33)
+	local cfd
+	listen_cb = function(sfd)
+		sfd:watermark(1024)
+		test.debugctrl("socket.conf", { eagain_every = 1 })
+		local ok, err
+		task.fork(function()
+			ok, err = sfd:write(data)
+		end)
+		time.sleep(100)
+		testaux.asserteq(ok, nil, "Test 33.1: writer paused")
+		sfd:close()
+		time.sleep(100)
+		testaux.asserteq(ok, false, "Test 33.2: writer woken by close")
+		testaux.asserteq(err, ECLOSED, "Test 33.3: with ECLOSED")
+		test.debugctrl("socket.reset")
+		testaux.close(cfd)
+	end
+	cfd = testaux.connect(ip, port)
+	testaux.assertneq(cfd, nil, "Test 33.4: Connect to server")
+	wait_done()
+	testaux.success("Test 33 passed")
+end)
+
+-- Test 34: Multicast one payload to many connections
+testaux.case("Test 34: Multicast one payload to many connections", function()
+	local num_clients = 3
+	local conns = {}
+	local cfds = {}
+	for i = 1, num_clients do
+		listen_cb = function(sfd)
+			conns[i] = sfd
+		end
+		cfds[i] = testaux.connect(ip, port)
+		testaux.assertneq(cfds[i], nil, "Test 34.1: Connect client " .. i)
+		while not conns[i] do
+			time.sleep(10)
+		end
+	end
+	local data = make_data(4096, 34)
+	local n = tcp.multicast(conns, data)
+	testaux.asserteq(n, num_clients, "Test 34.2: Queued on every connection")
+	for i = 1, num_clients do
+		testaux.asserteq(testaux.recv(cfds[i], #data), data, "Test 34.3: Client " .. i .. " received the payload")
+	end
+	conns[num_clients]:close()
+	n = tcp.multicast(conns, "tail")
+	testaux.asserteq(n, num_clients - 1, "Test 34.4: Closed connections are skipped")
+	for i = 1, num_clients - 1 do
+		testaux.asserteq(testaux.recv(cfds[i], 4), "tail", "Test 34.5: Client " .. i .. " received the tail")
+	end
+	testaux.asserteq(tcp.multicast({}, "none"), 0, "Test 34.6: Empty list")
+	for i = 1, num_clients do
+		conns[i]:close()
+		testaux.close(cfds[i])
+	end
+	testaux.success("Test 34 passed")
+end)
+
 print("testtcp2 all tests passed!")
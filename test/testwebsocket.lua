@@ -262,5 +262,49 @@ testaux.case("Test 7: WebSocket DNS failure returns contextual string", function
 	end)
 end)
 
+testaux.case("Test 8: Broadcast to many sockets", function()
+	local num_clients = 3
+	local finished = false
+	local server_socks = {}
+	server_handler = function(sock)
+		server_socks[#server_socks + 1] = sock
+		while not finished do
+			time.sleep(50)
+		end
+		sock:close()
+	end
+	local clients = {}
+	for i = 1, num_clients do
+		local sock = websocket.connect("ws://" .. TEST_HOST .. ":" .. TEST_PORT)
+		testaux.asserteq(not not sock, true, "Test 8.1: Client " .. i .. " connected")
+		clients[i] = sock
+		while #server_socks < i do
+			time.sleep(10)
+		end
+	end
+	local n, err = websocket.broadcast(server_socks, "hello", "text")
+	testaux.asserteq(n, num_clients, "Test 8.2: Broadcast reached every socket")
+	testaux.asserteq(err, nil, "Test 8.3: No broadcast error")
+	local big = string.rep("x", 70000)
+	n = websocket.broadcast(server_socks, big)
+	testaux.asserteq(n, num_clients, "Test 8.4: Fragmented broadcast reached every socket")
+	for i = 1, num_clients do
+		local dat, typ = clients[i]:read()
+		testaux.asserteq(dat, "hello", "Test 8.5: Client " .. i .. " read text")
+		testaux.asserteq(typ, "text", "Test 8.6: Client " .. i .. " read text type")
+		dat, typ = clients[i]:read()
+		testaux.asserteq(dat, big, "Test 8.7: Client " .. i .. " read fragmented message")
+		testaux.asserteq(typ, "binary", "Test 8.8: Client " .. i .. " read binary type")
+	end
+	n, err = websocket.broadcast(server_socks, string.rep("x", 126), "ping")
+	testaux.asserteq(n, 0, "Test 8.9: Oversized control frame is rejected")
+	testaux.assertneq(err, nil, "Test 8.10: Oversized control frame error")
+	for i = 1, num_clients do
+		clients[i]:close()
+	end
+	finished = true
+	wait_done()
+end)
+
 server:close()
 tls_server:close()
@@ -0,0 +1,116 @@
+local zproto = require "zproto"
+local net = require "silly.net"
+local time = require "silly.time"
+local tcp = require "silly.net.tcp"
+local testaux = require "test.testaux"
+
+local proto = assert(zproto:parse [[
+info {
+	.name:string 1
+	.age:integer 2
+}
+packet 0xfe {
+	.id:integer 1
+	.info:info 2
+	.list:info[] 3
+	.luck:integer[] 4
+	.book:info[name] 5
+	.note:string 6
+}
+]])
+
+local msg = {
+	id = 7,
+	info = {name = "alice", age = 18},
+	list = {{name = "bob", age = 20}, {name = "carol", age = 0}},
+	luck = {1, 0, 0, 0, 9},
+	book = {dave = {name = "dave", age = 30}},
+	note = "hello",
+}
+
+testaux.case("Test 1: decode into a reused table", function()
+	local data = proto:encode("packet", msg)
+	local want = proto:decode("packet", data)
+	local into = {stale = true, note = "old"}
+	local got = proto:decode("packet", data, nil, into)
+	testaux.asserteq(got, into, "Test 1.1: result is the table passed in")
+	testaux.asserteq(got.stale, nil, "Test 1.2: stale fields are cleared")
+	testaux.asserteq(got, want, "Test 1.3: refilled table equals a fresh decode")
+	local small = proto:encode("packet", {id = 8})
+	got = proto:decode("packet", small, nil, into)
+	testaux.asserteq(got, {id = 8}, "Test 1.4: fields absent on the wire are gone")
+end)
+
+local function subtables(t, out)
+	for _, v in pairs(t) do
+		if type(v) == "table" then
+			out[#out + 1] = v
+			subtables(v, out)
+		end
+	end
+	return out
+end
+
+testaux.case("Test 2: sub-tables come from the pool", function()
+	local data = proto:encode("packet", msg)
+	local pool = {}
+	local into = proto:decode("packet", data)
+	local old = {}
+	for _, t in ipairs(subtables(into, {})) do
+		old[t] = true
+	end
+	proto:decode("packet", data, nil, into, pool)
+	testaux.asserteq(#pool, 0, "Test 2.1: every recycled table is reused")
+	local fresh = 0
+	for _, t in ipairs(subtables(into, {})) do
+		if not old[t] then
+			fresh = fresh + 1
+		end
+	end
+	testaux.asserteq(fresh, 0, "Test 2.2: no new sub-table is created")
+	testaux.asserteq(into, proto:decode("packet", data), "Test 2.3: pooled decode is correct")
+	proto:decode("packet", proto:encode("packet", {id = 1}), nil, into, pool)
+	testaux.assertgt(#pool, 0, "Test 2.4: unused sub-tables stay in the pool")
+	for _, t in ipairs(pool) do
+		testaux.asserteq(next(t), nil, "Test 2.5: pooled tables are empty")
+	end
+end)
+
+testaux.case("Test 3: encode into an owned buffer", function()
+	local data = proto:encode("packet", msg)
+	local ptr, sz = proto:encodebuf("packet", msg)
+	testaux.asserteq(type(ptr), "userdata", "Test 3.1: returns a lightuserdata")
+	testaux.asserteq(net.tostring(ptr, sz), data, "Test 3.2: same bytes as encode")
+	ptr, sz = proto:encodebuf("packet", msg, true)
+	local packed = proto:pack(data)
+	testaux.asserteq(net.tostring(ptr, sz), packed, "Test 3.3: packed in the same call")
+	ptr, sz = proto:encodebuf("packet", msg, true)
+	testaux.asserteq(proto:decode("packet", proto:unpack(ptr, sz)), proto:decode("packet", data),
+		"Test 3.4: packed buffer round trip")
+	net.free(ptr)
+end)
+
+testaux.case("Test 4: write the owned buffer to a connection", function()
+	local recv
+	local listenfd = tcp.listen {
+		addr = "127.0.0.1:10010",
+		accept = function(s)
+			recv = s
+		end
+	}
+	local c = assert(tcp.connect("127.0.0.1:10010"))
+	local ptr, sz = proto:encodebuf("packet", msg, true)
+	testaux.asserteq(c:write(ptr, sz), true, "Test 4.1: conn:write takes the buffer")
+	while not recv do
+		time.sleep(10)
+	end
+	local got = recv:read(sz)
+	testaux.asserteq(proto:decode("packet", proto:unpack(got)), proto:decode("packet",
+		proto:encode("packet", msg)), "Test 4.2: peer decodes the packet")
+	c:close()
+	ptr, sz = proto:encodebuf("packet", msg)
+	local ok = c:write(ptr, sz)
+	testaux.asserteq(ok, false, "Test 4.3: closed conn frees the buffer")
+	recv:close()
+	listenfd:close()
+end)
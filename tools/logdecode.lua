@@ -0,0 +1,52 @@
+#!./silly
+-- Render a log written with --log-format=binary back to text lines,
+-- or to one JSON object per line.
+--
+-- usage:
+--   ./silly tools/logdecode.lua --log-level=warn --input=silly.log
+--   ./silly tools/logdecode.lua --log-level=warn --input=silly.log --format=json
+--   ./silly app.lua --log-format=binary | ./silly tools/logdecode.lua --log-level=warn
+--
+-- --log-level=warn keeps the boot lines of the decoder itself out of stdout.
+
+local silly = require "silly"
+local env = require "silly.env"
+local decode = require "silly.logger.decode"
+
+local CHUNK<const> = 64 * 1024
+
+local input = env.get("input")
+local render = env.get("format") == "json" and decode.json or decode.text
+
+local f = io.stdin
+if input then
+	f = assert(io.open(input, "rb"))
+end
+
+local data = ""
+local out = io.stdout
+while true do
+	local chunk = f:read(CHUNK)
+	local final = chunk == nil
+	if chunk then
+		data = data .. chunk
+	end
+	local pos = 1
+	while true do
+		local rec
+		rec, pos = decode.decode(data, pos, final)
+		if not rec then
+			break
+		end
+		out:write(render(rec))
+	end
+	data = data:sub(pos)
+	if final then
+		break
+	end
+end
+if f ~= io.stdin then
+	f:close()
+end
+out:flush()
+silly.exit(0)